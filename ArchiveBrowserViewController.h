@@ -0,0 +1,7 @@
+#import <UIKit/UIKit.h>
+
+@class ZipArchiveMount;
+
+@interface ArchiveBrowserViewController : UIViewController
+- (instancetype)initWithMount:(ZipArchiveMount *)mount path:(NSString *)path;
+@end
@@ -0,0 +1,107 @@
+#import "ArchiveBrowserViewController.h"
+#import "ZipArchiveMount.h"
+#import "ThemeEngine.h"
+#import "TextEditorViewController.h"
+#import "ImageViewerViewController.h"
+#import "HexEditorViewController.h"
+
+// The hex view keeps the whole buffer in memory, so huge entries are only previewed.
+static const NSUInteger ArchivePreviewLimit = 16 * 1024 * 1024;
+
+@interface ArchiveBrowserViewController () <UITableViewDelegate, UITableViewDataSource>
+@property (nonatomic, strong) ZipArchiveMount *mount;
+@property (nonatomic, copy) NSString *path;
+@property (nonatomic, strong) NSArray<FileItem *> *items;
+@property (nonatomic, strong) UITableView *tableView;
+@end
+
+@implementation ArchiveBrowserViewController
+
+- (instancetype)initWithMount:(ZipArchiveMount *)mount path:(NSString *)path {
+    self = [super init];
+    if (self) {
+        _mount = mount;
+        _path = [path copy] ?: @"";
+    }
+    return self;
+}
+
+- (void)viewDidLoad {
+    [super viewDidLoad];
+    self.title = self.path.length ? [self.path lastPathComponent] : [self.mount.archivePath lastPathComponent];
+    self.view.backgroundColor = [ThemeEngine mainBackgroundColor];
+
+    self.tableView = [[UITableView alloc] initWithFrame:self.view.bounds style:UITableViewStylePlain];
+    self.tableView.autoresizingMask = UIViewAutoresizingFlexibleWidth | UIViewAutoresizingFlexibleHeight;
+    self.tableView.backgroundColor = [UIColor clearColor];
+    self.tableView.delegate = self;
+    self.tableView.dataSource = self;
+    [self.view addSubview:self.tableView];
+
+    self.items = [self.mount contentsOfDirectoryAtPath:self.path];
+}
+
+- (NSString *)entryPathForItem:(FileItem *)item {
+    return self.path.length ? [self.path stringByAppendingFormat:@"/%@", item.name] : item.name;
+}
+
+- (void)openItem:(FileItem *)item {
+    NSString *entryPath = [self entryPathForItem:item];
+    NSString *ext = item.name.pathExtension.lowercaseString;
+    BOOL isText = [@[@"txt", @"xml", @"json", @"h", @"m", @"c", @"cpp", @"sql", @"plist", @"csv", @"tsv", @"md", @"log"] containsObject:ext];
+    BOOL isImage = [@[@"png", @"jpg", @"jpeg", @"gif", @"bmp", @"heic"] containsObject:ext];
+    NSUInteger limit = isImage ? 0 : ArchivePreviewLimit;
+
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+        NSError *error;
+        NSData *data = [self.mount dataForItemAtPath:entryPath maxLength:limit error:&error];
+        dispatch_async(dispatch_get_main_queue(), ^{
+            if (!data) {
+                UIAlertController *alert = [UIAlertController alertControllerWithTitle:@"エラー" message:error.localizedDescription preferredStyle:UIAlertControllerStyleAlert];
+                [alert addAction:[UIAlertAction actionWithTitle:@"OK" style:UIAlertActionStyleDefault handler:nil]];
+                [self presentViewController:alert animated:YES completion:nil];
+                return;
+            }
+            UIViewController *vc = nil;
+            if (isText) vc = [[TextEditorViewController alloc] initWithData:data title:item.name];
+            else if (isImage) vc = [[ImageViewerViewController alloc] initWithData:data title:item.name];
+            else vc = [[HexEditorViewController alloc] initWithData:data title:item.name];
+            [self.navigationController pushViewController:vc animated:YES];
+        });
+    });
+}
+
+#pragma mark - TableView
+
+- (NSInteger)tableView:(UITableView *)tableView numberOfRowsInSection:(NSInteger)section { return self.items.count; }
+
+- (UITableViewCell *)tableView:(UITableView *)tableView cellForRowAtIndexPath:(NSIndexPath *)indexPath {
+    UITableViewCell *cell = [tableView dequeueReusableCellWithIdentifier:@"EntryCell"];
+    if (!cell) {
+        cell = [[UITableViewCell alloc] initWithStyle:UITableViewCellStyleSubtitle reuseIdentifier:@"EntryCell"];
+        cell.backgroundColor = [UIColor clearColor];
+        cell.textLabel.textColor = [UIColor whiteColor];
+        cell.detailTextLabel.textColor = [[UIColor whiteColor] colorWithAlphaComponent:0.6];
+    }
+    FileItem *item = self.items[indexPath.row];
+    cell.textLabel.text = item.name;
+    cell.imageView.image = [UIImage systemImageNamed:item.isDirectory ? @"folder.fill" : (item.isLocked ? @"lock.fill" : @"doc")];
+    cell.imageView.tintColor = item.isDirectory ? [ThemeEngine liquidColor] : [UIColor whiteColor];
+    cell.detailTextLabel.text = item.isDirectory ? nil : [NSByteCountFormatter stringFromByteCount:[item.attributes[NSFileSize] longLongValue] countStyle:NSByteCountFormatterCountStyleFile];
+    return cell;
+}
+
+- (CGFloat)tableView:(UITableView *)tableView heightForRowAtIndexPath:(NSIndexPath *)indexPath { return 60; }
+
+- (void)tableView:(UITableView *)tableView didSelectRowAtIndexPath:(NSIndexPath *)indexPath {
+    [tableView deselectRowAtIndexPath:indexPath animated:YES];
+    FileItem *item = self.items[indexPath.row];
+    if (item.isDirectory) {
+        ArchiveBrowserViewController *vc = [[ArchiveBrowserViewController alloc] initWithMount:self.mount path:[self entryPathForItem:item]];
+        [self.navigationController pushViewController:vc animated:YES];
+    } else {
+        [self openItem:item];
+    }
+}
+
+@end
@@ -1,6 +1,20 @@
 #import <Foundation/Foundation.h>
 #import <UIKit/UIKit.h>
 
+typedef NS_ENUM(NSInteger, DownloadChecksumState) {
+    DownloadChecksumNone,       // no checksum was given
+    DownloadChecksumVerifying,
+    DownloadChecksumVerified,
+    DownloadChecksumMismatch,   // the file is kept; actualChecksum says what arrived
+    DownloadChecksumFailed      // the file could not be read back
+};
+
+typedef NS_ENUM(NSInteger, DownloadPriority) {
+    DownloadPriorityLow = -1,
+    DownloadPriorityNormal = 0,
+    DownloadPriorityHigh = 1
+};
+
 @interface DownloadTask : NSObject
 @property (strong, nonatomic) NSURLSessionTask *task;
 @property (copy, nonatomic) NSString *filename;
@@ -10,18 +24,59 @@
 @property (assign, nonatomic) BOOL isDownloading;
 @property (copy, nonatomic) NSString *destinationPath;
 @property (copy, nonatomic) NSString *relativeDestinationPath;
-@property (strong, nonatomic) NSData *resumeData;
+@property (assign, nonatomic) BOOL isPaused;            // stopped with its bytes kept; see resumeTask:
+@property (assign, nonatomic) BOOL isQueued;            // waiting for a free slot
+@property (assign, nonatomic) DownloadPriority priority;   // change with setPriority:forTask:
 @property (assign, nonatomic) UIBackgroundTaskIdentifier backgroundTaskID;
-@property (strong, nonatomic) NSFileHandle *fileHandle;
 @property (copy, nonatomic) NSString *tempPath;
+@property (copy, nonatomic) NSString *expectedChecksum;   // as verifyItemAtPath:checksum: takes it
+@property (copy, nonatomic) NSString *actualChecksum;
+@property (assign, nonatomic) DownloadChecksumState checksumState;
+// HTTP connections fetching this download; more than one once the server
+// has agreed to byte ranges (see dl_ranges.h).
+@property (assign, nonatomic, readonly) NSUInteger connectionCount;
+// Smoothed over the last seconds; secondsRemaining is -1 while unknown.
+@property (assign, nonatomic) double bytesPerSecond;
+@property (assign, nonatomic) NSTimeInterval secondsRemaining;
 @end
 
 @interface DownloadManager : NSObject <NSURLSessionDataDelegate>
 @property (copy, nonatomic) void (^completionHandler)(void);
 + (instancetype)sharedManager;
+// Data is gathered per connection off the main thread and written by a
+// background queue; receivedBytes, progress and speed are refreshed, and
+// DownloadUpdated posted, at most ten times a second.
 @property (strong, nonatomic, readonly) NSMutableArray<DownloadTask *> *tasks;
+// New downloads are queued and start as slots free up: at most
+// maxConcurrentDownloads at a time and maxDownloadsPerHost per server, higher
+// priority first, otherwise in the order they were asked for. Running
+// downloads are not preempted. The queue and paused downloads are restored
+// at launch. The limits are kept in NSUserDefaults.
+@property (assign, nonatomic) NSInteger maxConcurrentDownloads;   // 3 unless set
+@property (assign, nonatomic) NSInteger maxDownloadsPerHost;       // 2 unless set
+// Bytes per second over all downloads, 0 for no limit. A connection over
+// budget is suspended until the token bucket refills, so the server is
+// slowed down by TCP instead of data piling up in memory.
+@property (assign, nonatomic) int64_t bandwidthLimit;
+- (void)setPriority:(DownloadPriority)priority forTask:(DownloadTask *)task;
 - (void)downloadFileAtURL:(NSURL *)url toPath:(NSString *)path;
+// The request goes out with "Range: bytes=0-". A server that answers 206 for
+// a file of 8 MB or more gets up to eight connections, each fetching a byte
+// range into its place in a preallocated temp file; anything else is
+// streamed over the one connection as before.
 - (void)downloadFileWithRequest:(NSURLRequest *)request toPath:(NSString *)path;
+// Checks the finished file against expectedChecksum (MD5, SHA-1, SHA-256,
+// CRC32 or xxHash64 hex) and posts DownloadUpdated with the outcome.
+- (void)downloadFileWithRequest:(NSURLRequest *)request toPath:(NSString *)path expectedChecksum:(NSString *)expectedChecksum;
+// Downloads that got byte ranges are journaled in Library/Caches/.download_tmp
+// as they go: URL, headers, validator and the ranges already on disk. Pausing,
+// losing the network for good or quitting the app leaves a paused task
+// (restored at the next launch). resumeTask: queues it again; once it runs
+// it sends If-Range requests for the missing bytes only. A file that changed on the server is
+// fetched again from the start. A server that sends neither a strong ETag nor
+// Last-Modified gives nothing to check that against, so such downloads are
+// not journaled and start over when resumed.
+- (void)pauseTask:(DownloadTask *)task;
 - (void)resumeTask:(DownloadTask *)task;
 - (void)cancelTask:(DownloadTask *)task;
 - (void)clearCompletedTasks;
@@ -2,13 +2,156 @@
 #import "FileManagerCore.h"
 #import "Logger.h"
 #import <AVFoundation/AVFoundation.h>
+#include "dl_ranges.h"
+#include "fs_hash.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const uint64_t DownloadSegmentThreshold = 8ULL << 20;   // smaller files stay on one connection
+static const uint64_t DownloadSegmentMinimum = 2ULL << 20;     // no steal leaves less than this on either side
+static const NSUInteger DownloadConnectionLimit = 8;            // matches HTTPMaximumConnectionsPerHost
+static const NSUInteger DownloadSegmentRetryLimit = 16;         // failed connections per download
+static const CFAbsoluteTime DownloadJournalInterval = 2.0;      // seconds between journal writes
+static const size_t DownloadBufferSize = 1 << 20;               // gathered per connection before a write
+static const size_t DownloadBufferAlignment = 16 << 10;         // the VM page size on Apple silicon
+static const CFAbsoluteTime DownloadBufferAge = 0.25;           // a slow connection still writes this often
+static const NSTimeInterval DownloadProgressInterval = 0.1;     // observers hear at most ten updates a second
+static NSString *const DownloadQueueFile = @"queue.json";       // in the temp directory, next to the journals
+
+@interface DownloadTask ()
+@property (strong, nonatomic) NSURLRequest *request;   // as handed in; every connection starts from it
+@property (copy, nonatomic) NSString *validator;       // ETag, else Last-Modified, sent as If-Range
+@property (assign, nonatomic) dlr_map *ranges;         // NULL while streaming over one connection
+@property (assign, nonatomic) int fd;
+@property (strong, nonatomic) NSMutableArray<NSURLSessionDataTask *> *connections;
+@property (assign, nonatomic) NSUInteger failures;
+@property (assign, nonatomic) CFAbsoluteTime journalSavedAt;
+@property (assign, nonatomic) CFAbsoluteTime speedSampledAt;
+@property (assign, nonatomic) int64_t speedSampledBytes;
+- (NSString *)journalPath;
+@end
 
 @implementation DownloadTask
+
+- (instancetype)init {
+    self = [super init];
+    if (self) {
+        _fd = -1;
+        _connections = [NSMutableArray array];
+        _secondsRemaining = -1;
+    }
+    return self;
+}
+
+- (NSUInteger)connectionCount {
+    return self.connections.count;
+}
+
+- (NSString *)journalPath {
+    return [[self.tempPath stringByDeletingPathExtension] stringByAppendingPathExtension:@"journal"];
+}
+
+- (void)dealloc {
+    if (_fd >= 0) close(_fd);
+    dlr_free(_ranges);
+}
+
 @end
 
-@interface DownloadManager () <NSURLSessionDataDelegate>
+// One connection's write-behind state. The network queue gathers what
+// arrives into buffer and hands each full one to the I/O queue, which writes
+// it at the segment's cursor (or appends it, without ranges). Everything but
+// written is guarded by @synchronized on the manager's sinks.
+@interface DownloadSink : NSObject
+@property (strong, nonatomic) DownloadTask *task;
+@property (assign, nonatomic) int segment;              // -1 while streaming without ranges
+@property (assign, nonatomic) dlr_map *ranges;
+@property (assign, nonatomic) int fd;
+@property (assign, nonatomic) uint8_t *buffer;
+@property (assign, nonatomic) size_t fill;
+@property (assign, nonatomic) CFAbsoluteTime filledSince;
+@property (assign) int64_t written;                     // without ranges; set on the I/O queue
+@end
+
+@implementation DownloadSink
+
+- (void)dealloc {
+    free(_buffer);
+}
+
+@end
+
+static int DownloadWriteAll(int fd, const uint8_t *data, size_t size) {
+    while (size > 0) {
+        ssize_t n = write(fd, data, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return errno;
+        data += n;
+        size -= (size_t)n;
+    }
+    return 0;
+}
+
+// Shared by every connection: each takes what it received, and one that
+// overdraws waits until the bucket is back at zero. It holds a quarter
+// second of the rate, so short bursts pass untouched.
+typedef struct DownloadBucket {
+    double rate;                    // bytes per second, 0 for no limit
+    double tokens;
+    CFAbsoluteTime refilledAt;
+} DownloadBucket;
+
+// Seconds the caller should pause before reading more; 0 within budget.
+static double DownloadBucketTake(DownloadBucket *bucket, size_t size, CFAbsoluteTime now) {
+    if (bucket->rate <= 0) return 0;
+    double burst = MAX(bucket->rate / 4, 64 * 1024);
+    bucket->tokens = MIN(burst, bucket->tokens + (now - bucket->refilledAt) * bucket->rate);
+    bucket->refilledAt = now;
+    bucket->tokens -= (double)size;
+    return bucket->tokens < 0 ? -bucket->tokens / bucket->rate : 0;
+}
+
+// Start, end and total of "bytes 0-99/1234"; the total is -1 when the server
+// sent "*".
+static BOOL DownloadParseContentRange(NSString *value, unsigned long long *start, unsigned long long *end, long long *total) {
+    unsigned long long first = 0, last = 0, length = 0;
+    const char *text = value.UTF8String;
+    if (!text) return NO;
+    if (sscanf(text, "bytes %llu-%llu/%llu", &first, &last, &length) == 3) {
+        *total = (long long)length;
+    } else if (sscanf(text, "bytes %llu-%llu/*", &first, &last) == 2) {
+        *total = -1;
+    } else {
+        return NO;
+    }
+    *start = first;
+    *end = last;
+    return YES;
+}
+
+// Names the temp file after the URL and destination, so asking for the same
+// download again finds what an earlier attempt left.
+static NSString *DownloadIdentifier(NSURL *url, NSString *destination) {
+    NSData *key = [[NSString stringWithFormat:@"%@\n%@", url.absoluteString, destination] dataUsingEncoding:NSUTF8StringEncoding];
+    fsh_state state;
+    uint8_t digest[16];
+    char hex[33];
+    fsh_init(&state, FSH_M128);
+    fsh_update(&state, key.bytes, key.length);
+    fsh_final(&state, digest);
+    fsh_hex(digest, sizeof(digest), hex);
+    return @(hex);
+}
+
+@interface DownloadManager () <NSURLSessionDataDelegate> {
+    DownloadBucket _bucket;             // guarded by @synchronized on sinks
+}
 @property (strong, nonatomic) NSURLSession *session;
 @property (strong, nonatomic) NSMutableDictionary<NSNumber *, DownloadTask *> *taskMap;
+@property (strong, nonatomic) NSMutableDictionary<NSNumber *, DownloadSink *> *sinks;   // task identifier -> sink, any thread
+@property (strong, nonatomic) dispatch_queue_t ioQueue;
+@property (strong, nonatomic) NSTimer *progressTimer;
 @property (strong, nonatomic) AVAudioPlayer *audioPlayer;
 @end
 
@@ -28,6 +171,15 @@
     if (self) {
         _tasks = [NSMutableArray array];
         _taskMap = [NSMutableDictionary dictionary];
+        _sinks = [NSMutableDictionary dictionary];
+        _ioQueue = dispatch_queue_create("DownloadManager.IO", dispatch_queue_attr_make_with_qos_class(DISPATCH_QUEUE_SERIAL, QOS_CLASS_UTILITY, 0));
+
+        // Callbacks arrive on a serial queue of their own: data never waits
+        // for the UI. Anything touching task state hops to the main queue.
+        NSOperationQueue *networkQueue = [[NSOperationQueue alloc] init];
+        networkQueue.name = @"DownloadManager.Network";
+        networkQueue.maxConcurrentOperationCount = 1;
+        networkQueue.qualityOfService = NSQualityOfServiceUtility;
 
         // Use defaultSessionConfiguration for pseudo-backgrounding
         NSURLSessionConfiguration *config = [NSURLSessionConfiguration defaultSessionConfiguration];
@@ -36,10 +188,16 @@
         config.HTTPMaximumConnectionsPerHost = 8;
         config.timeoutIntervalForRequest = 60;
         config.timeoutIntervalForResource = 24 * 60 * 60;
-        self.session = [NSURLSession sessionWithConfiguration:config delegate:self delegateQueue:[NSOperationQueue mainQueue]];
+        self.session = [NSURLSession sessionWithConfiguration:config delegate:self delegateQueue:networkQueue];
 
         [self setupAudioSession];
         [self clearInternalCache];
+        [self restoreQueue];
+        _bucket.rate = (double)self.bandwidthLimit;
+        // Restored downloads start once the app is up.
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [self scheduleTasks];
+        });
     }
     return self;
 }
@@ -96,50 +254,114 @@
 
 #pragma mark - Download Logic
 
+- (NSString *)temporaryDirectory {
+    NSString *home = [FileManagerCore effectiveHomeDirectory];
+    NSString *tmpDir = [home stringByAppendingPathComponent:@"Library/Caches/.download_tmp"];
+    // Cleanup old path
+    NSString *oldTmpDir = [home stringByAppendingPathComponent:@"Documents/.download_tmp"];
+    if ([[NSFileManager defaultManager] fileExistsAtPath:oldTmpDir]) [[NSFileManager defaultManager] removeItemAtPath:oldTmpDir error:nil];
+    [[NSFileManager defaultManager] createDirectoryAtPath:tmpDir withIntermediateDirectories:YES attributes:nil error:nil];
+    return tmpDir;
+}
+
+- (void)beginBackgroundTaskForTask:(DownloadTask *)dTask {
+    dTask.backgroundTaskID = [[UIApplication sharedApplication] beginBackgroundTaskWithExpirationHandler:^{
+        [[Logger sharedLogger] log:@"[DOWNLOAD] Background task expired!"];
+        // Keep what arrived; the task comes back paused at the next launch.
+        [self saveJournalForTask:dTask sync:YES];
+        [[UIApplication sharedApplication] endBackgroundTask:dTask.backgroundTaskID];
+        dTask.backgroundTaskID = UIBackgroundTaskInvalid;
+    }];
+}
+
+- (void)endBackgroundTaskForTask:(DownloadTask *)dTask {
+    if (dTask.backgroundTaskID != UIBackgroundTaskInvalid) {
+        [[UIApplication sharedApplication] endBackgroundTask:dTask.backgroundTaskID];
+        dTask.backgroundTaskID = UIBackgroundTaskInvalid;
+    }
+}
+
 - (void)downloadFileWithRequest:(NSURLRequest *)request toPath:(NSString *)path {
+    [self downloadFileWithRequest:request toPath:path expectedChecksum:nil];
+}
+
+- (void)downloadFileWithRequest:(NSURLRequest *)request toPath:(NSString *)path expectedChecksum:(NSString *)expectedChecksum {
     if (!request) return;
 
     NSFileManager *fm = [NSFileManager defaultManager];
     [fm createDirectoryAtPath:path withIntermediateDirectories:YES attributes:nil error:nil];
 
+    NSString *relativePath = [FileManagerCore relativeToHomePath:path];
+    NSString *tempPath = [[[self temporaryDirectory] stringByAppendingPathComponent:DownloadIdentifier(request.URL, relativePath)] stringByAppendingPathExtension:@"part"];
+    for (DownloadTask *existing in self.tasks) {
+        if (![existing.tempPath isEqualToString:tempPath]) continue;
+        if (existing.isPaused) [self resumeTask:existing];
+        if (existing.isQueued || existing.isDownloading) return;
+    }
+
     DownloadTask *dTask = [[DownloadTask alloc] init];
+    dTask.request = request;
     dTask.filename = [request.URL lastPathComponent] ?: @"downloaded_file";
     dTask.destinationPath = path;
-    dTask.relativeDestinationPath = [FileManagerCore relativeToHomePath:path];
-
-    // Start Background Task
-    dTask.backgroundTaskID = [[UIApplication sharedApplication] beginBackgroundTaskWithExpirationHandler:^{
-        [[Logger sharedLogger] log:@"[DOWNLOAD] Background task expired!"];
-        [[UIApplication sharedApplication] endBackgroundTask:dTask.backgroundTaskID];
-        dTask.backgroundTaskID = UIBackgroundTaskInvalid;
-    }];
+    dTask.relativeDestinationPath = relativePath;
+    dTask.expectedChecksum = expectedChecksum.length > 0 ? expectedChecksum : nil;
+    dTask.tempPath = tempPath;
+    dTask.isQueued = YES;
 
-    // Setup Temporary File for Streaming Write
-    NSString *home = [FileManagerCore effectiveHomeDirectory];
-    NSString *tmpDir = [home stringByAppendingPathComponent:@"Library/Caches/.download_tmp"];
-    // Cleanup old path
-    NSString *oldTmpDir = [home stringByAppendingPathComponent:@"Documents/.download_tmp"];
-    if ([[NSFileManager defaultManager] fileExistsAtPath:oldTmpDir]) [[NSFileManager defaultManager] removeItemAtPath:oldTmpDir error:nil];
-    [fm createDirectoryAtPath:tmpDir withIntermediateDirectories:YES attributes:nil error:nil];
-    dTask.tempPath = [tmpDir stringByAppendingPathComponent:[NSString stringWithFormat:@"stream_%ld", (long)[[NSDate date] timeIntervalSince1970]]];
-    [fm createFileAtPath:dTask.tempPath contents:nil attributes:nil];
-    dTask.fileHandle = [NSFileHandle fileHandleForWritingAtPath:dTask.tempPath];
+    [self.tasks addObject:dTask];
+    [self saveQueue];
+    [[NSNotificationCenter defaultCenter] postNotificationName:@"DownloadStarted" object:nil];
+    [self scheduleTasks];
+}
 
+// Fetches the file from its first byte, discarding anything kept so far.
+- (void)startTask:(DownloadTask *)dTask {
+    [[NSFileManager defaultManager] removeItemAtPath:dTask.journalPath error:nil];
     dTask.isDownloading = YES;
+    dTask.isPaused = NO;
+    dTask.isQueued = NO;
     dTask.progress = 0;
+    dTask.receivedBytes = 0;
+    dTask.failures = 0;
+    dTask.speedSampledAt = 0;
+    if (dTask.backgroundTaskID == UIBackgroundTaskInvalid) [self beginBackgroundTaskForTask:dTask];
+    int err = [self openTempFileForTask:dTask];
+    if (err) {
+        [self completeTask:dTask error:[NSError errorWithDomain:NSPOSIXErrorDomain code:err userInfo:@{NSLocalizedDescriptionKey: @(strerror(err))}]];
+        return;
+    }
 
-    NSURLSessionDataTask *task = [self.session dataTaskWithRequest:request];
+    // The first connection asks for the whole file as a range: a 206 answer
+    // tells us ranges work without a separate HEAD round trip.
+    NSURLRequest *request = dTask.request;
+    NSURLRequest *probe = request;
+    BOOL get = !request.HTTPMethod || [request.HTTPMethod isEqualToString:@"GET"];
+    if (get && ![request valueForHTTPHeaderField:@"Range"]) {
+        NSMutableURLRequest *ranged = [request mutableCopy];
+        [ranged setValue:@"bytes=0-" forHTTPHeaderField:@"Range"];
+        // Ranges of a compressed representation would not line up.
+        [ranged setValue:@"identity" forHTTPHeaderField:@"Accept-Encoding"];
+        probe = ranged;
+    }
+    NSURLSessionDataTask *task = [self.session dataTaskWithRequest:probe];
     dTask.task = task;
-
-    [self.tasks addObject:dTask];
-    self.taskMap[@(task.taskIdentifier)] = dTask;
+    [self registerConnection:task ofTask:dTask segment:-1];
 
     [[Logger sharedLogger] log:[NSString stringWithFormat:@"[DOWNLOAD] Pseudo-BG Start: %@", request.URL.absoluteString]];
 
     [self playSilentAudio];
+    [self startProgressTimer];
     [task resume];
+}
 
-    [[NSNotificationCenter defaultCenter] postNotificationName:@"DownloadStarted" object:nil];
+// Unlinks before creating, so writes still queued for an earlier
+// descriptor land in the old file rather than in this one.
+- (int)openTempFileForTask:(DownloadTask *)dTask {
+    unlink(dTask.tempPath.fileSystemRepresentation);
+    int fd = open(dTask.tempPath.fileSystemRepresentation, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return errno;
+    dTask.fd = fd;
+    return 0;
 }
 
 - (void)downloadFileAtURL:(NSURL *)url toPath:(NSString *)path {
@@ -147,101 +369,851 @@
     [self downloadFileWithRequest:[NSURLRequest requestWithURL:url] toPath:path];
 }
 
+#pragma mark - Journal
+
+// What it takes to ask for the download again; kept in its journal and in
+// the queue file.
+- (NSDictionary *)metadataForTask:(DownloadTask *)dTask {
+    NSMutableDictionary *meta = [NSMutableDictionary dictionary];
+    meta[@"url"] = dTask.request.URL.absoluteString ?: @"";
+    meta[@"method"] = dTask.request.HTTPMethod ?: @"GET";
+    meta[@"headers"] = dTask.request.allHTTPHeaderFields ?: @{};
+    meta[@"filename"] = dTask.filename ?: @"";
+    meta[@"destination"] = dTask.relativeDestinationPath ?: @"";
+    if (dTask.validator) meta[@"validator"] = dTask.validator;
+    if (dTask.expectedChecksum) meta[@"checksum"] = dTask.expectedChecksum;
+    return meta;
+}
+
+- (DownloadTask *)taskWithMetadata:(NSDictionary *)meta tempPath:(NSString *)tempPath {
+    NSString *link = [meta isKindOfClass:[NSDictionary class]] ? meta[@"url"] : nil;
+    NSURL *url = [link isKindOfClass:[NSString class]] ? [NSURL URLWithString:link] : nil;
+    if (!url) return nil;
+    NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:url];
+    if ([meta[@"method"] isKindOfClass:[NSString class]]) request.HTTPMethod = meta[@"method"];
+    if ([meta[@"headers"] isKindOfClass:[NSDictionary class]]) request.allHTTPHeaderFields = meta[@"headers"];
+
+    DownloadTask *dTask = [[DownloadTask alloc] init];
+    dTask.request = request;
+    dTask.filename = meta[@"filename"];
+    dTask.relativeDestinationPath = meta[@"destination"];
+    dTask.destinationPath = [FileManagerCore absoluteFromHomeRelativePath:dTask.relativeDestinationPath];
+    dTask.validator = meta[@"validator"];
+    dTask.expectedChecksum = meta[@"checksum"];
+    dTask.tempPath = tempPath;
+    return dTask;
+}
+
+// Written on the I/O queue, after the data queued so far. sync also flushes
+// the temp file first. Without it the journal still holds up when the app
+// is killed, since written bytes are in the kernel by then; it is left for
+// pauses so the data path does not wait on the disk.
+// Nothing is journaled without a validator: a resume could not send
+// If-Range, and a file changed on the server at the same size would be
+// spliced from two versions.
+- (void)saveJournalForTask:(DownloadTask *)dTask sync:(BOOL)sync {
+    if (!dTask.ranges || !dTask.validator) return;
+    NSData *meta = [NSJSONSerialization dataWithJSONObject:[self metadataForTask:dTask] options:0 error:nil];
+    NSString *journal = dTask.journalPath;
+    NSString *filename = dTask.filename;
+    dlr_map *ranges = dTask.ranges;
+    int fd = sync ? dTask.fd : -1;
+    dTask.journalSavedAt = CFAbsoluteTimeGetCurrent();
+    dispatch_async(self.ioQueue, ^{
+        int err = dlr_save(ranges, fd, journal.fileSystemRepresentation, meta.bytes, meta.length);
+        if (err) [[Logger sharedLogger] log:[NSString stringWithFormat:@"[DOWNLOAD] Cannot journal %@: %s", filename, strerror(err)]];
+    });
+}
+
+// The metadata of a journal whose temp file is intact, with the bytes it
+// covers; nil when either is missing or damaged.
+- (NSDictionary *)readJournal:(NSString *)journal total:(int64_t *)total done:(int64_t *)done {
+    NSString *part = [[journal stringByDeletingPathExtension] stringByAppendingPathExtension:@"part"];
+    dlr_map *ranges = NULL;
+    void *bytes = NULL;
+    size_t size = 0;
+    if (dlr_load(journal.fileSystemRepresentation, &ranges, &bytes, &size) != 0) return nil;
+    NSDictionary *meta = [NSJSONSerialization JSONObjectWithData:[NSData dataWithBytesNoCopy:bytes length:size freeWhenDone:YES] options:0 error:nil];
+    NSDictionary *attrs = [[NSFileManager defaultManager] attributesOfItemAtPath:part error:nil];
+    BOOL intact = [meta isKindOfClass:[NSDictionary class]] && [meta[@"validator"] isKindOfClass:[NSString class]]
+        && attrs && [attrs fileSize] == dlr_size(ranges);
+    *total = (int64_t)dlr_size(ranges);
+    *done = (int64_t)dlr_done(ranges);
+    dlr_free(ranges);
+    return intact ? meta : nil;
+}
+
+// Brings back what an earlier run left: the queue in its order, then
+// downloads that only have a journal, as paused tasks. Temp files nothing
+// refers to any more are dropped.
+- (void)restoreQueue {
+    NSString *tmpDir = [self temporaryDirectory];
+    NSFileManager *fm = [NSFileManager defaultManager];
+    NSArray<NSString *> *names = [fm contentsOfDirectoryAtPath:tmpDir error:nil];
+    NSMutableSet<NSString *> *kept = [NSMutableSet setWithObject:DownloadQueueFile];
+
+    NSData *data = [NSData dataWithContentsOfFile:[tmpDir stringByAppendingPathComponent:DownloadQueueFile]];
+    NSArray *entries = data ? [NSJSONSerialization JSONObjectWithData:data options:0 error:nil] : nil;
+    if (![entries isKindOfClass:[NSArray class]]) entries = @[];
+    for (NSDictionary *entry in entries) {
+        if (![entry isKindOfClass:[NSDictionary class]]) continue;
+        NSString *identifier = entry[@"id"];
+        if (![identifier isKindOfClass:[NSString class]] || identifier.length == 0 || [identifier containsString:@"/"]) continue;
+        NSString *journal = [[tmpDir stringByAppendingPathComponent:identifier] stringByAppendingPathExtension:@"journal"];
+        DownloadTask *dTask = [self taskWithMetadata:entry tempPath:[[journal stringByDeletingPathExtension] stringByAppendingPathExtension:@"part"]];
+        if (!dTask) continue;
+        dTask.priority = [entry[@"priority"] integerValue];
+        dTask.isPaused = [entry[@"paused"] boolValue];
+        dTask.isQueued = !dTask.isPaused;
+        int64_t total = 0, done = 0;
+        if ([self readJournal:journal total:&total done:&done]) {
+            dTask.totalBytes = total;
+            dTask.receivedBytes = done;
+            dTask.progress = total > 0 ? (float)done / (float)total : 0;
+            [kept addObject:journal.lastPathComponent];
+            [kept addObject:dTask.tempPath.lastPathComponent];
+        }
+        [self.tasks addObject:dTask];
+    }
+    NSUInteger queued = self.tasks.count;
+
+    for (NSString *name in names) {
+        if (![name.pathExtension isEqualToString:@"journal"] || [kept containsObject:name]) continue;
+        NSString *journal = [tmpDir stringByAppendingPathComponent:name];
+        int64_t total = 0, done = 0;
+        NSDictionary *meta = [self readJournal:journal total:&total done:&done];
+        DownloadTask *dTask = [self taskWithMetadata:meta tempPath:[[journal stringByDeletingPathExtension] stringByAppendingPathExtension:@"part"]];
+        if (!dTask) {
+            [[Logger sharedLogger] log:[NSString stringWithFormat:@"[DOWNLOAD] Discarding journal %@", name]];
+            continue;
+        }
+        dTask.totalBytes = total;
+        dTask.receivedBytes = done;
+        dTask.progress = total > 0 ? (float)done / (float)total : 0;
+        dTask.isPaused = YES;
+        [self.tasks addObject:dTask];
+        [kept addObject:name];
+        [kept addObject:dTask.tempPath.lastPathComponent];
+    }
+    for (NSString *name in names) {
+        if (![kept containsObject:name]) [fm removeItemAtPath:[tmpDir stringByAppendingPathComponent:name] error:nil];
+    }
+    if (self.tasks.count > 0) {
+        [[Logger sharedLogger] log:[NSString stringWithFormat:@"[DOWNLOAD] Restored %lu downloads from the queue and %lu from journals", (unsigned long)queued, (unsigned long)(self.tasks.count - queued)]];
+    }
+}
+
+// Written on the I/O queue; restoreQueue reads it back at launch.
+- (void)saveQueue {
+    NSMutableArray *entries = [NSMutableArray array];
+    for (DownloadTask *dTask in self.tasks) {
+        if (!dTask.isQueued && !dTask.isDownloading && !dTask.isPaused) continue;
+        NSMutableDictionary *entry = [[self metadataForTask:dTask] mutableCopy];
+        entry[@"id"] = dTask.tempPath.lastPathComponent.stringByDeletingPathExtension;
+        entry[@"priority"] = @(dTask.priority);
+        entry[@"paused"] = @(dTask.isPaused);
+        [entries addObject:entry];
+    }
+    NSData *data = [NSJSONSerialization dataWithJSONObject:entries options:0 error:nil];
+    NSString *path = [[self temporaryDirectory] stringByAppendingPathComponent:DownloadQueueFile];
+    dispatch_async(self.ioQueue, ^{
+        [data writeToFile:path atomically:YES];
+    });
+}
+
+#pragma mark - Scheduling
+
+- (NSInteger)maxConcurrentDownloads {
+    NSInteger limit = [[NSUserDefaults standardUserDefaults] integerForKey:@"DownloadConcurrency"];
+    return limit > 0 ? limit : 3;
+}
+
+- (void)setMaxConcurrentDownloads:(NSInteger)limit {
+    [[NSUserDefaults standardUserDefaults] setInteger:limit forKey:@"DownloadConcurrency"];
+    [self scheduleTasks];
+}
+
+- (NSInteger)maxDownloadsPerHost {
+    NSInteger limit = [[NSUserDefaults standardUserDefaults] integerForKey:@"DownloadsPerHost"];
+    return limit > 0 ? limit : 2;
+}
+
+- (void)setMaxDownloadsPerHost:(NSInteger)limit {
+    [[NSUserDefaults standardUserDefaults] setInteger:limit forKey:@"DownloadsPerHost"];
+    [self scheduleTasks];
+}
+
+- (int64_t)bandwidthLimit {
+    return MAX(0, [[[NSUserDefaults standardUserDefaults] objectForKey:@"DownloadBandwidthLimit"] longLongValue]);
+}
+
+- (void)setBandwidthLimit:(int64_t)limit {
+    [[NSUserDefaults standardUserDefaults] setObject:@(MAX(0, limit)) forKey:@"DownloadBandwidthLimit"];
+    @synchronized (self.sinks) {
+        _bucket.rate = (double)MAX(0, limit);
+        _bucket.tokens = 0;
+        _bucket.refilledAt = CFAbsoluteTimeGetCurrent();
+    }
+    [[Logger sharedLogger] log:[NSString stringWithFormat:@"[DOWNLOAD] Bandwidth limit: %lld bytes/s", MAX(0, limit)]];
+}
+
+static NSString *DownloadHost(DownloadTask *dTask) {
+    return dTask.request.URL.host.lowercaseString ?: @"";
+}
+
+// Starts queued downloads while there are free slots, highest priority
+// first; the sort is stable, so equal priorities keep their order.
+- (void)scheduleTasks {
+    NSInteger limit = self.maxConcurrentDownloads;
+    NSInteger perHost = self.maxDownloadsPerHost;
+    NSInteger running = 0;
+    NSMutableDictionary<NSString *, NSNumber *> *hosts = [NSMutableDictionary dictionary];
+    NSMutableArray<DownloadTask *> *queued = [NSMutableArray array];
+    for (DownloadTask *dTask in self.tasks) {
+        if (dTask.isQueued) [queued addObject:dTask];
+        if (!dTask.isDownloading) continue;
+        running++;
+        hosts[DownloadHost(dTask)] = @(hosts[DownloadHost(dTask)].integerValue + 1);
+    }
+    if (running >= limit || queued.count == 0) return;
+
+    [queued sortWithOptions:NSSortStable usingComparator:^NSComparisonResult(DownloadTask *a, DownloadTask *b) {
+        if (a.priority == b.priority) return NSOrderedSame;
+        return a.priority > b.priority ? NSOrderedAscending : NSOrderedDescending;
+    }];
+    BOOL started = NO;
+    for (DownloadTask *dTask in queued) {
+        if (running >= limit) break;
+        NSString *host = DownloadHost(dTask);
+        if (hosts[host].integerValue >= perHost) continue;
+        hosts[host] = @(hosts[host].integerValue + 1);
+        running++;
+        started = YES;
+        [self runTask:dTask];
+    }
+    if (started) [[NSNotificationCenter defaultCenter] postNotificationName:@"DownloadUpdated" object:nil];
+}
+
+- (void)setPriority:(DownloadPriority)priority forTask:(DownloadTask *)task {
+    if (task.priority == priority) return;
+    task.priority = priority;
+    [self saveQueue];
+    [self scheduleTasks];
+    [[NSNotificationCenter defaultCenter] postNotificationName:@"DownloadUpdated" object:nil];
+}
+
+#pragma mark - Write-behind
+
+// Makes a connection known to the network queue; its data goes to the
+// task's file from then on.
+- (void)registerConnection:(NSURLSessionDataTask *)task ofTask:(DownloadTask *)dTask segment:(int)segment {
+    DownloadSink *sink = [[DownloadSink alloc] init];
+    sink.task = dTask;
+    sink.segment = segment;
+    sink.ranges = dTask.ranges;
+    sink.fd = dTask.fd;
+    @synchronized (self.sinks) {
+        self.sinks[@(task.taskIdentifier)] = sink;
+    }
+    [dTask.connections addObject:task];
+    self.taskMap[@(task.taskIdentifier)] = dTask;
+}
+
+- (DownloadSink *)sinkForConnection:(NSURLSessionTask *)task {
+    if (!task) return nil;
+    @synchronized (self.sinks) {
+        return self.sinks[@(task.taskIdentifier)];
+    }
+}
+
+// Hands the sink's buffer to the I/O queue. Called with the sinks locked, so
+// nothing a connection wrote can be queued after it was retired.
+- (void)flushSink:(DownloadSink *)sink connection:(NSURLSessionTask *)task {
+    uint8_t *buffer = sink.buffer;
+    size_t size = sink.fill;
+    dlr_map *ranges = sink.ranges;
+    int fd = sink.fd;
+    int segment = sink.segment;
+    sink.buffer = NULL;
+    sink.fill = 0;
+    dispatch_async(self.ioQueue, ^{
+        int err = 0;
+        int finished = 0;
+        if (ranges) {
+            err = dlr_write(ranges, fd, segment, buffer, size, &finished);
+        } else {
+            err = DownloadWriteAll(fd, buffer, size);
+            if (!err) sink.written += (int64_t)size;
+        }
+        free(buffer);
+        if (err || finished) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                [self connection:task finishedWithError:err];
+            });
+        }
+    });
+}
+
+// Runs block on the main queue once everything queued for the I/O queue so
+// far is on disk.
+- (void)afterWrites:(dispatch_block_t)block {
+    dispatch_async(self.ioQueue, ^{
+        dispatch_async(dispatch_get_main_queue(), block);
+    });
+}
+
+// Closes the temp file and frees the range map once their queued writes are
+// done, then runs block on the main queue with the bytes the map counted.
+- (void)closeFilesOfTask:(DownloadTask *)dTask then:(void (^)(int64_t done))block {
+    int fd = dTask.fd;
+    dlr_map *ranges = dTask.ranges;
+    dTask.fd = -1;
+    dTask.ranges = NULL;
+    dispatch_async(self.ioQueue, ^{
+        int64_t done = ranges ? (int64_t)dlr_done(ranges) : -1;
+        if (fd >= 0) close(fd);
+        dlr_free(ranges);
+        if (block) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                block(done);
+            });
+        }
+    });
+}
+
+#pragma mark - Progress
+
+- (void)startProgressTimer {
+    if (self.progressTimer) return;
+    // Common modes keep it firing while the downloads list scrolls.
+    self.progressTimer = [NSTimer timerWithTimeInterval:DownloadProgressInterval target:self selector:@selector(progressTimerFired:) userInfo:nil repeats:YES];
+    [[NSRunLoop mainRunLoop] addTimer:self.progressTimer forMode:NSRunLoopCommonModes];
+}
+
+// The only place the data path reaches observers: one DownloadUpdated per
+// tick at most, however many packets arrived.
+- (void)progressTimerFired:(NSTimer *)timer {
+    CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+    BOOL active = NO;
+    BOOL changed = NO;
+    for (DownloadTask *dTask in self.tasks) {
+        if (!dTask.isDownloading) continue;
+        active = YES;
+        int64_t received = dTask.ranges ? (int64_t)dlr_done(dTask.ranges) : [self sinkForConnection:dTask.task].written;
+        if (received != dTask.receivedBytes) {
+            dTask.receivedBytes = received;
+            if (dTask.totalBytes > 0) dTask.progress = (float)received / (float)dTask.totalBytes;
+            changed = YES;
+        }
+        [self sampleSpeedOfTask:dTask at:now];
+        if (dTask.ranges && now - dTask.journalSavedAt >= DownloadJournalInterval) [self saveJournalForTask:dTask sync:NO];
+    }
+    if (!active) {
+        [timer invalidate];
+        self.progressTimer = nil;
+    }
+    if (changed) [[NSNotificationCenter defaultCenter] postNotificationName:@"DownloadUpdated" object:nil];
+}
+
+// Rate over half-second windows, smoothed so the ETA does not jump with
+// every burst.
+- (void)sampleSpeedOfTask:(DownloadTask *)dTask at:(CFAbsoluteTime)now {
+    if (dTask.speedSampledAt == 0 || dTask.receivedBytes < dTask.speedSampledBytes) {
+        dTask.speedSampledAt = now;
+        dTask.speedSampledBytes = dTask.receivedBytes;
+        dTask.bytesPerSecond = 0;
+        dTask.secondsRemaining = -1;
+        return;
+    }
+    CFAbsoluteTime elapsed = now - dTask.speedSampledAt;
+    if (elapsed < 0.5) return;
+    double rate = (double)(dTask.receivedBytes - dTask.speedSampledBytes) / elapsed;
+    dTask.bytesPerSecond = dTask.bytesPerSecond > 0 ? 0.7 * dTask.bytesPerSecond + 0.3 * rate : rate;
+    dTask.speedSampledAt = now;
+    dTask.speedSampledBytes = dTask.receivedBytes;
+    BOOL known = dTask.totalBytes > 0 && dTask.bytesPerSecond >= 1;
+    dTask.secondsRemaining = known ? (double)(dTask.totalBytes - dTask.receivedBytes) / dTask.bytesPerSecond : -1;
+}
+
+#pragma mark - Segments
+
+// Switches a download whose first connection got a 206 for the whole file
+// over to ranges: that connection keeps streaming as segment 0 and, for a
+// large file, the others steal from it.
+- (BOOL)startSegmentsForTask:(DownloadTask *)dTask size:(uint64_t)size response:(NSHTTPURLResponse *)response {
+    dlr_map *ranges = NULL;
+    int err = dlr_allocate(dTask.fd, size);
+    if (!err) err = dlr_create(size, DownloadSegmentMinimum, &ranges);
+    dlr_range range;
+    if (!err) err = dlr_claim(ranges, &range);
+    if (err) {
+        [[Logger sharedLogger] log:[NSString stringWithFormat:@"[DOWNLOAD] Cannot prepare %llu bytes for %@: %s", size, dTask.filename, strerror(err)]];
+        dlr_free(ranges);
+        return NO;
+    }
+    dTask.ranges = ranges;
+    // If-Range only takes a strong ETag.
+    NSString *etag = [response valueForHTTPHeaderField:@"ETag"];
+    dTask.validator = etag && ![etag hasPrefix:@"W/"] ? etag : [response valueForHTTPHeaderField:@"Last-Modified"];
+    // No data has arrived yet: the response is still waiting for its
+    // completion handler.
+    @synchronized (self.sinks) {
+        DownloadSink *sink = self.sinks[@(dTask.task.taskIdentifier)];
+        sink.ranges = ranges;
+        sink.segment = range.segment;
+    }
+    [self saveJournalForTask:dTask sync:NO];
+    while (dTask.connections.count < [self connectionLimitForTask:dTask] && [self addConnectionToTask:dTask]) {}
+    [[Logger sharedLogger] log:[NSString stringWithFormat:@"[DOWNLOAD] Ranges accepted, %llu bytes over %lu connections: %@", size, (unsigned long)dTask.connections.count, dTask.filename]];
+    return YES;
+}
+
+// Small files are not worth the extra connections, but still get the range
+// map so they can be resumed.
+- (NSUInteger)connectionLimitForTask:(DownloadTask *)dTask {
+    return dlr_size(dTask.ranges) >= DownloadSegmentThreshold ? DownloadConnectionLimit : 1;
+}
+
+// Opens one more connection on whatever dlr_claim hands out. NO when there
+// is nothing left worth splitting.
+- (BOOL)addConnectionToTask:(DownloadTask *)dTask {
+    dlr_range range;
+    if (dlr_claim(dTask.ranges, &range) != 0) return NO;
+    NSMutableURLRequest *request = [dTask.request mutableCopy];
+    [request setValue:[NSString stringWithFormat:@"bytes=%llu-%llu", range.start, range.end - 1] forHTTPHeaderField:@"Range"];
+    [request setValue:@"identity" forHTTPHeaderField:@"Accept-Encoding"];
+    // A file replaced on the server answers 200 instead of mixing versions.
+    if (dTask.validator) [request setValue:dTask.validator forHTTPHeaderField:@"If-Range"];
+    NSURLSessionDataTask *task = [self.session dataTaskWithRequest:request];
+    [self registerConnection:task ofTask:dTask segment:range.segment];
+    [task resume];
+    return YES;
+}
+
+// Forgets a connection so its late callbacks are ignored, and gives back
+// whatever it did not fetch. The release goes through the I/O queue behind
+// the connection's last write: a cursor that is still moving must not be
+// handed to another connection.
+- (void)retireConnection:(NSURLSessionTask *)task ofTask:(DownloadTask *)dTask {
+    @synchronized (self.sinks) {
+        DownloadSink *sink = self.sinks[@(task.taskIdentifier)];
+        dlr_map *ranges = sink.ranges;
+        int segment = sink.segment;
+        if (ranges && segment >= 0) {
+            dispatch_async(self.ioQueue, ^{
+                dlr_release(ranges, segment);
+            });
+        }
+        [self.sinks removeObjectForKey:@(task.taskIdentifier)];
+    }
+    [dTask.connections removeObject:(NSURLSessionDataTask *)task];
+    [self.taskMap removeObjectForKey:@(task.taskIdentifier)];
+}
+
+// Once released ranges are back in the map: finishes the download, or puts
+// them to work on new connections.
+- (void)refillTask:(DownloadTask *)dTask error:(NSError *)error {
+    dlr_map *ranges = dTask.ranges;
+    [self afterWrites:^{
+        if (!dTask.isDownloading || dTask.ranges != ranges) return;
+        if (dlr_complete(ranges)) {
+            [self completeTask:dTask error:nil];
+            return;
+        }
+        if (dTask.failures <= DownloadSegmentRetryLimit) {
+            while (dTask.connections.count < [self connectionLimitForTask:dTask] && [self addConnectionToTask:dTask]) {}
+        }
+        if (dTask.connections.count == 0) {
+            // Out of retries: keep every byte and let the user resume later.
+            [self suspendTask:dTask error:error ?: [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorNetworkConnectionLost userInfo:nil]];
+        }
+    }];
+}
+
+// The server stopped honouring ranges (or never could, for an empty file):
+// start over on one plain connection.
+- (void)restartSingleStream:(DownloadTask *)dTask reason:(NSString *)reason {
+    [[Logger sharedLogger] log:[NSString stringWithFormat:@"[DOWNLOAD] %@, restarting on one connection: %@", reason, dTask.filename]];
+    for (NSURLSessionDataTask *connection in [dTask.connections copy]) {
+        [self retireConnection:connection ofTask:dTask];
+        [connection cancel];
+    }
+    dTask.task = nil;
+    [self closeFilesOfTask:dTask then:^(int64_t done) {
+        if (!dTask.isDownloading) return;
+        // Behind any journal write still queued for the old ranges.
+        [[NSFileManager defaultManager] removeItemAtPath:dTask.journalPath error:nil];
+        dTask.receivedBytes = 0;
+        dTask.progress = 0;
+        int err = [self openTempFileForTask:dTask];
+        if (err) {
+            [self completeTask:dTask error:[NSError errorWithDomain:NSPOSIXErrorDomain code:err userInfo:@{NSLocalizedDescriptionKey: @(strerror(err))}]];
+            return;
+        }
+        NSURLSessionDataTask *task = [self.session dataTaskWithRequest:dTask.request];
+        dTask.task = task;
+        [self registerConnection:task ofTask:dTask segment:-1];
+        [task resume];
+    }];
+}
+
 #pragma mark - NSURLSessionDataDelegate
 
 - (void)URLSession:(NSURLSession *)session dataTask:(NSURLSessionDataTask *)dataTask didReceiveResponse:(NSURLResponse *)response completionHandler:(void (^)(NSURLSessionResponseDisposition))completionHandler {
+    dispatch_async(dispatch_get_main_queue(), ^{
+        [self connection:dataTask receivedResponse:response completionHandler:completionHandler];
+    });
+}
+
+// Runs on the network queue: only copies into the connection's buffer.
+- (void)URLSession:(NSURLSession *)session dataTask:(NSURLSessionDataTask *)dataTask didReceiveData:(NSData *)data {
+    @synchronized (self.sinks) {
+        DownloadSink *sink = self.sinks[@(dataTask.taskIdentifier)];
+        if (!sink) return;
+        __block BOOL failed = NO;
+        [data enumerateByteRangesUsingBlock:^(const void *bytes, NSRange byteRange, BOOL *stop) {
+            const uint8_t *p = bytes;
+            size_t left = byteRange.length;
+            while (left > 0) {
+                if (!sink.buffer) {
+                    void *buffer = NULL;
+                    if (posix_memalign(&buffer, DownloadBufferAlignment, DownloadBufferSize) != 0) {
+                        failed = YES;
+                        *stop = YES;
+                        return;
+                    }
+                    sink.buffer = buffer;
+                    sink.filledSince = CFAbsoluteTimeGetCurrent();
+                }
+                size_t n = MIN(left, DownloadBufferSize - sink.fill);
+                memcpy(sink.buffer + sink.fill, p, n);
+                sink.fill += n;
+                p += n;
+                left -= n;
+                if (sink.fill == DownloadBufferSize) [self flushSink:sink connection:dataTask];
+            }
+        }];
+        if (failed) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                [self connection:dataTask finishedWithError:ENOMEM];
+            });
+            return;
+        }
+        if (sink.fill > 0 && CFAbsoluteTimeGetCurrent() - sink.filledSince >= DownloadBufferAge) [self flushSink:sink connection:dataTask];
+
+        double wait = DownloadBucketTake(&_bucket, data.length, CFAbsoluteTimeGetCurrent());
+        if (wait > 0) {
+            // Not reading lets the socket buffer fill, and TCP slows the
+            // server down.
+            [dataTask suspend];
+            dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(wait * NSEC_PER_SEC)), dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+                @synchronized (self.sinks) {
+                    if (self.sinks[@(dataTask.taskIdentifier)] == sink) [dataTask resume];
+                }
+            });
+        }
+    }
+}
+
+- (void)URLSession:(NSURLSession *)session task:(NSURLSessionTask *)task didCompleteWithError:(NSError *)error {
+    @synchronized (self.sinks) {
+        DownloadSink *sink = self.sinks[@(task.taskIdentifier)];
+        if (!sink) return;
+        if (sink.fill > 0) [self flushSink:sink connection:task];
+    }
+    // Through the I/O queue, so the connection's last bytes are on disk first.
+    [self afterWrites:^{
+        [self connection:task completedWithError:error];
+    }];
+}
+
+- (void)connection:(NSURLSessionDataTask *)dataTask receivedResponse:(NSURLResponse *)response completionHandler:(void (^)(NSURLSessionResponseDisposition))completionHandler {
     DownloadTask *dTask = self.taskMap[@(dataTask.taskIdentifier)];
-    if (dTask) {
-        dTask.totalBytes = response.expectedContentLength;
+    if (!dTask) {
+        completionHandler(NSURLSessionResponseCancel);
+        return;
+    }
+    NSHTTPURLResponse *http = [response isKindOfClass:[NSHTTPURLResponse class]] ? (NSHTTPURLResponse *)response : nil;
+    unsigned long long start = 0, end = 0;
+    long long total = -1;
+    BOOL ranged = http.statusCode == 206 && DownloadParseContentRange([http valueForHTTPHeaderField:@"Content-Range"], &start, &end, &total);
+
+    DownloadSink *sink = [self sinkForConnection:dataTask];
+    if (sink && sink.segment >= 0) {
+        // A stolen range must come back as exactly the bytes asked for.
+        unsigned long long asked = 0;
+        sscanf([dataTask.originalRequest valueForHTTPHeaderField:@"Range"].UTF8String ?: "", "bytes=%llu-", &asked);
+        if (!ranged || start != asked || (total >= 0 && (uint64_t)total != dlr_size(dTask.ranges))) {
+            completionHandler(NSURLSessionResponseCancel);
+            [self restartSingleStream:dTask reason:[NSString stringWithFormat:@"Range answered with HTTP %ld", (long)http.statusCode]];
+            return;
+        }
+        completionHandler(NSURLSessionResponseAllow);
+        return;
     }
+
+    if (http.statusCode == 416 && [dataTask.originalRequest valueForHTTPHeaderField:@"Range"]) {
+        completionHandler(NSURLSessionResponseCancel);
+        [self restartSingleStream:dTask reason:@"Range not satisfiable"];
+        return;
+    }
+    dTask.totalBytes = ranged && total >= 0 ? total : response.expectedContentLength;
+    if (ranged && start == 0 && total > 0) [self startSegmentsForTask:dTask size:(uint64_t)total response:http];
     completionHandler(NSURLSessionResponseAllow);
 }
 
-- (void)URLSession:(NSURLSession *)session dataTask:(NSURLSessionDataTask *)dataTask didReceiveData:(NSData *)data {
+// A write failed, or the connection's segment is done: with the range
+// written, or a thief took the rest. Either way it goes on to steal in turn.
+- (void)connection:(NSURLSessionDataTask *)dataTask finishedWithError:(int)err {
     DownloadTask *dTask = self.taskMap[@(dataTask.taskIdentifier)];
-    if (dTask) {
-        [dTask.fileHandle writeData:data];
-        dTask.receivedBytes += data.length;
-        if (dTask.totalBytes > 0) dTask.progress = (float)dTask.receivedBytes / (float)dTask.totalBytes;
-
-        [[NSNotificationCenter defaultCenter] postNotificationName:@"DownloadUpdated" object:nil];
+    if (!dTask) return;
+    if (err) {
+        [self completeTask:dTask error:[NSError errorWithDomain:NSPOSIXErrorDomain code:err userInfo:@{NSLocalizedDescriptionKey: @(strerror(err))}]];
+        return;
     }
+    [self retireConnection:dataTask ofTask:dTask];
+    [dataTask cancel];
+    [self refillTask:dTask error:nil];
 }
 
-- (void)URLSession:(NSURLSession *)session task:(NSURLSessionTask *)task didCompleteWithError:(NSError *)error {
+- (void)connection:(NSURLSessionTask *)task completedWithError:(NSError *)error {
     DownloadTask *dTask = self.taskMap[@(task.taskIdentifier)];
     if (!dTask) return;
 
-    [dTask.fileHandle closeFile];
-    dTask.fileHandle = nil;
+    DownloadSink *sink = [self sinkForConnection:task];
+    BOOL segmented = sink && sink.segment >= 0 && dTask.ranges;
+    [self retireConnection:task ofTask:dTask];
+    if (!segmented) {
+        [self completeTask:dTask error:error];
+        return;
+    }
+    if (!dlr_complete(dTask.ranges)) {
+        // The connection dropped, or the server closed it short: its
+        // remainder goes to a fresh connection.
+        dTask.failures++;
+        [[Logger sharedLogger] log:[NSString stringWithFormat:@"[DOWNLOAD] Connection %lu lost for %@: %@", (unsigned long)dTask.failures, dTask.filename, error.localizedDescription ?: @"closed early"]];
+    }
+    [self refillTask:dTask error:error];
+}
+
+// Runs once per download, when the last byte is in or it has failed for good.
+- (void)completeTask:(DownloadTask *)dTask error:(NSError *)error {
+    if (!dTask.isDownloading) return;
+    for (NSURLSessionDataTask *connection in [dTask.connections copy]) {
+        [self retireConnection:connection ofTask:dTask];
+        [connection cancel];
+    }
     dTask.isDownloading = NO;
+    dTask.bytesPerSecond = 0;
+    dTask.secondsRemaining = -1;
+    [self saveQueue];
+    [self scheduleTasks];
 
-    if (error) {
-        [[Logger sharedLogger] log:[NSString stringWithFormat:@"[DOWNLOAD] Error: %@", error.localizedDescription]];
-        [[NSNotificationCenter defaultCenter] postNotificationName:@"DownloadError" object:error];
-    } else {
-        [[Logger sharedLogger] log:@"[DOWNLOAD] Stream complete, relocating..."];
+    [self closeFilesOfTask:dTask then:^(int64_t done) {
+        if (error) {
+            [[Logger sharedLogger] log:[NSString stringWithFormat:@"[DOWNLOAD] Error: %@", error.localizedDescription] level:LoggerLevelError];
+            [[NSNotificationCenter defaultCenter] postNotificationName:@"DownloadError" object:error];
+        } else {
+            [[Logger sharedLogger] log:@"[DOWNLOAD] Stream complete, relocating..."];
 
-        NSString *destPath = [FileManagerCore absoluteFromHomeRelativePath:dTask.relativeDestinationPath];
-        NSError *moveError = nil;
-        NSString *finalName = [[FileManagerCore sharedManager] moveItemAtURL:[NSURL fileURLWithPath:dTask.tempPath] toDirectory:destPath uniqueName:dTask.filename error:&moveError];
+            NSString *destPath = [FileManagerCore absoluteFromHomeRelativePath:dTask.relativeDestinationPath];
+            NSError *moveError = nil;
+            NSString *finalName = [[FileManagerCore sharedManager] moveItemAtURL:[NSURL fileURLWithPath:dTask.tempPath] toDirectory:destPath uniqueName:dTask.filename error:&moveError];
 
-        if (finalName) {
-            dTask.filename = finalName;
-            dTask.progress = 1.0;
-            [[Logger sharedLogger] log:[NSString stringWithFormat:@"[DOWNLOAD] SUCCESS: %@", finalName]];
-            [[NSNotificationCenter defaultCenter] postNotificationName:@"DownloadFinished" object:nil];
-        } else {
-            [[Logger sharedLogger] log:[NSString stringWithFormat:@"[DOWNLOAD] Final Move Error: %@", moveError.localizedDescription]];
-            [[NSNotificationCenter defaultCenter] postNotificationName:@"DownloadError" object:moveError];
+            if (finalName) {
+                dTask.filename = finalName;
+                if (dTask.totalBytes > 0) dTask.receivedBytes = dTask.totalBytes;
+                dTask.progress = 1.0;
+                [[Logger sharedLogger] log:[NSString stringWithFormat:@"[DOWNLOAD] SUCCESS: %@", finalName]];
+                [[NSNotificationCenter defaultCenter] postNotificationName:@"DownloadFinished" object:nil];
+                if (dTask.expectedChecksum) [self verifyTask:dTask atPath:[destPath stringByAppendingPathComponent:finalName]];
+            } else {
+                [[Logger sharedLogger] log:[NSString stringWithFormat:@"[DOWNLOAD] Final Move Error: %@", moveError.localizedDescription] level:LoggerLevelError];
+                [[NSNotificationCenter defaultCenter] postNotificationName:@"DownloadError" object:moveError];
+            }
         }
-    }
 
-    // Clean up temp file
-    [[NSFileManager defaultManager] removeItemAtPath:dTask.tempPath error:nil];
+        // Clean up temp file
+        [[NSFileManager defaultManager] removeItemAtPath:dTask.tempPath error:nil];
+        [[NSFileManager defaultManager] removeItemAtPath:dTask.journalPath error:nil];
 
-    // End Background Task
-    if (dTask.backgroundTaskID != UIBackgroundTaskInvalid) {
-        [[UIApplication sharedApplication] endBackgroundTask:dTask.backgroundTaskID];
-        dTask.backgroundTaskID = UIBackgroundTaskInvalid;
-    }
+        [self endBackgroundTaskForTask:dTask];
+        [self stopSilentAudio];
+    }];
+}
 
+// Stops the connections but keeps the temp file and journal for resumeTask:.
+- (void)suspendTask:(DownloadTask *)dTask error:(NSError *)error {
+    for (NSURLSessionDataTask *connection in [dTask.connections copy]) {
+        [self retireConnection:connection ofTask:dTask];
+        [connection cancel];
+    }
+    [self saveJournalForTask:dTask sync:YES];
+    dTask.isDownloading = NO;
+    dTask.isPaused = YES;
+    dTask.bytesPerSecond = 0;
+    dTask.secondsRemaining = -1;
+    [self closeFilesOfTask:dTask then:^(int64_t done) {
+        if (done >= 0) {
+            dTask.receivedBytes = done;
+            if (dTask.totalBytes > 0) dTask.progress = (float)done / (float)dTask.totalBytes;
+        }
+        if (error) {
+            [[Logger sharedLogger] log:[NSString stringWithFormat:@"[DOWNLOAD] Paused after error: %@", error.localizedDescription]];
+            [[NSNotificationCenter defaultCenter] postNotificationName:@"DownloadError" object:error];
+        } else {
+            [[Logger sharedLogger] log:[NSString stringWithFormat:@"[DOWNLOAD] Paused %@ at %lld of %lld bytes", dTask.filename, dTask.receivedBytes, dTask.totalBytes]];
+        }
+        [[NSNotificationCenter defaultCenter] postNotificationName:@"DownloadUpdated" object:nil];
+    }];
+    [self saveQueue];
+    [self endBackgroundTaskForTask:dTask];
     [self stopSilentAudio];
-    [self.taskMap removeObjectForKey:@(task.taskIdentifier)];
+    [[NSNotificationCenter defaultCenter] postNotificationName:@"DownloadUpdated" object:nil];
+    [self scheduleTasks];
+}
+
+// Reads the file back off the main thread; the digest is cached, so opening
+// its info page afterwards costs nothing.
+- (void)verifyTask:(DownloadTask *)dTask atPath:(NSString *)path {
+    dTask.checksumState = DownloadChecksumVerifying;
+    [[NSNotificationCenter defaultCenter] postNotificationName:@"DownloadUpdated" object:nil];
+    [[FileManagerCore sharedManager] verifyItemAtPath:path checksum:dTask.expectedChecksum completion:^(BOOL matches, NSString *actual, NSError *error) {
+        dTask.actualChecksum = actual;
+        dTask.checksumState = error ? DownloadChecksumFailed : matches ? DownloadChecksumVerified : DownloadChecksumMismatch;
+        if (error) [[Logger sharedLogger] log:[NSString stringWithFormat:@"[DOWNLOAD] Checksum not verified for %@: %@", dTask.filename, error.localizedDescription]];
+        else if (!matches) [[Logger sharedLogger] log:[NSString stringWithFormat:@"[DOWNLOAD] Checksum MISMATCH for %@: expected %@, got %@", dTask.filename, dTask.expectedChecksum, actual]];
+        else [[Logger sharedLogger] log:[NSString stringWithFormat:@"[DOWNLOAD] Checksum verified: %@", dTask.filename]];
+        [[NSNotificationCenter defaultCenter] postNotificationName:@"DownloadUpdated" object:nil];
+    }];
 }
 
 #pragma mark - Controls
 
+- (void)pauseTask:(DownloadTask *)task {
+    if (task.isQueued) {
+        task.isQueued = NO;
+        task.isPaused = YES;
+        [self saveQueue];
+        [[NSNotificationCenter defaultCenter] postNotificationName:@"DownloadUpdated" object:nil];
+        return;
+    }
+    if (!task.isDownloading) return;
+    // Without ranges there is nothing to continue from; the bytes stay until
+    // resumeTask: starts over.
+    if (!task.ranges) [[Logger sharedLogger] log:[NSString stringWithFormat:@"[DOWNLOAD] %@ cannot be resumed; the server does not serve ranges", task.filename]];
+    [self suspendTask:task error:nil];
+}
+
+// Back in the queue; scheduleTasks decides when it runs.
 - (void)resumeTask:(DownloadTask *)task {
-    // In pseudo-bg, we focus on keeping the process alive.
+    if (!task.isPaused) return;
+    task.isPaused = NO;
+    task.isQueued = YES;
+    [self saveQueue];
+    [[NSNotificationCenter defaultCenter] postNotificationName:@"DownloadUpdated" object:nil];
+    [self scheduleTasks];
+}
+
+// Continues from the journal when there is one, else from the start.
+- (void)runTask:(DownloadTask *)task {
+    task.isQueued = NO;
+    task.isDownloading = YES;
+    task.failures = 0;
+    task.speedSampledAt = 0;
+    [self beginBackgroundTaskForTask:task];
+    [self playSilentAudio];
+    [self startProgressTimer];
+    [[NSNotificationCenter defaultCenter] postNotificationName:@"DownloadUpdated" object:nil];
+
+    // On the I/O queue, behind the journal a pause may still be writing.
+    NSString *journal = task.journalPath;
+    NSString *part = task.tempPath;
+    dispatch_async(self.ioQueue, ^{
+        dlr_map *ranges = NULL;
+        void *meta = NULL;
+        size_t size = 0;
+        int loaded = dlr_load(journal.fileSystemRepresentation, &ranges, &meta, &size);
+        NSDictionary *info = loaded ? nil : [NSJSONSerialization JSONObjectWithData:[NSData dataWithBytesNoCopy:meta length:size freeWhenDone:NO] options:0 error:nil];
+        free(meta);
+        // Bytes fetched without a validator cannot be checked against the
+        // file on the server now; older journals may lack one.
+        if (!loaded && !([info isKindOfClass:[NSDictionary class]] && [info[@"validator"] isKindOfClass:[NSString class]])) {
+            dlr_free(ranges);
+            ranges = NULL;
+            loaded = ESTALE;
+        }
+        int fd = loaded ? -1 : open(part.fileSystemRepresentation, O_RDWR | O_CLOEXEC);
+        struct stat st;
+        if (fd >= 0 && (fstat(fd, &st) != 0 || (uint64_t)st.st_size != dlr_size(ranges))) {
+            close(fd);
+            fd = -1;
+        }
+        dispatch_async(dispatch_get_main_queue(), ^{
+            if (!task.isDownloading || task.connections.count > 0) {
+                // Paused or cancelled again meanwhile.
+                if (fd >= 0) close(fd);
+                dlr_free(ranges);
+                return;
+            }
+            if (fd < 0) {
+                dlr_free(ranges);
+                if (loaded == ESTALE) [[Logger sharedLogger] log:[NSString stringWithFormat:@"[DOWNLOAD] No validator to resume %@ against, starting over", task.filename]];
+                else if (loaded != ENOENT) [[Logger sharedLogger] log:[NSString stringWithFormat:@"[DOWNLOAD] Nothing to resume for %@, starting over", task.filename]];
+                [self startTask:task];
+                return;
+            }
+            task.fd = fd;
+            task.ranges = ranges;
+            task.totalBytes = (int64_t)dlr_size(ranges);
+            task.receivedBytes = (int64_t)dlr_done(ranges);
+            [[Logger sharedLogger] log:[NSString stringWithFormat:@"[DOWNLOAD] Resuming %@ at %lld of %lld bytes", task.filename, task.receivedBytes, task.totalBytes]];
+            if (dlr_complete(ranges)) {
+                [self completeTask:task error:nil];
+                return;
+            }
+            // Every connection asks for a missing range with If-Range, so a
+            // file that changed on the server answers 200 and starts over.
+            while (task.connections.count < [self connectionLimitForTask:task] && [self addConnectionToTask:task]) {}
+        });
+    });
 }
 
 - (void)cancelTask:(DownloadTask *)task {
-    [task.task cancel];
-    [task.fileHandle closeFile];
-    [[NSFileManager defaultManager] removeItemAtPath:task.tempPath error:nil];
-    [self.tasks removeObject:task];
-    if (task.backgroundTaskID != UIBackgroundTaskInvalid) {
-        [[UIApplication sharedApplication] endBackgroundTask:task.backgroundTaskID];
-        task.backgroundTaskID = UIBackgroundTaskInvalid;
+    for (NSURLSessionDataTask *connection in [task.connections copy]) {
+        [self retireConnection:connection ofTask:task];
+        [connection cancel];
     }
+    task.isDownloading = NO;
+    task.isPaused = NO;
+    task.isQueued = NO;
+    [self closeFilesOfTask:task then:^(int64_t done) {
+        [[NSFileManager defaultManager] removeItemAtPath:task.tempPath error:nil];
+        [[NSFileManager defaultManager] removeItemAtPath:task.journalPath error:nil];
+    }];
+    [self.tasks removeObject:task];
+    [self saveQueue];
+    [self endBackgroundTaskForTask:task];
     [self stopSilentAudio];
     [[NSNotificationCenter defaultCenter] postNotificationName:@"DownloadUpdated" object:nil];
+    [self scheduleTasks];
 }
 
 - (void)clearCompletedTasks {
-    NSPredicate *pred = [NSPredicate predicateWithFormat:@"isDownloading == YES"];
+    NSPredicate *pred = [NSPredicate predicateWithFormat:@"isDownloading == YES OR isPaused == YES OR isQueued == YES"];
     [self.tasks filterUsingPredicate:pred];
     [[NSNotificationCenter defaultCenter] postNotificationName:@"DownloadUpdated" object:nil];
 }
 
-
 - (void)clearInternalCache {
     NSString *cacheDir = [[FileManagerCore effectiveHomeDirectory] stringByAppendingPathComponent:@"Library/Caches"];
     NSFileManager *fm = [NSFileManager defaultManager];
     NSArray *files = [fm contentsOfDirectoryAtPath:cacheDir error:nil];
     for (NSString *file in files) {
-        if ([file isEqualToString:@".silent.wav"] || [file isEqualToString:@".download_tmp"]) continue;
+        // Dot names are the app's own state: partial downloads, the silent
+        // track, indexes and caches. Wiping them every launch would throw away
+        // what they are kept for.
+        if ([file hasPrefix:@"."]) continue;
         [fm removeItemAtPath:[cacheDir stringByAppendingPathComponent:file] error:nil];
     }
     [[Logger sharedLogger] log:@"[SYSTEM] Cleared internal Library/Caches"];
@@ -22,6 +22,7 @@
     [self.view addSubview:self.tableView];
 
     self.navigationItem.rightBarButtonItem = [[UIBarButtonItem alloc] initWithTitle:@"すべて消去" style:UIBarButtonItemStylePlain target:self action:@selector(clearAll)];
+    self.navigationItem.leftBarButtonItem = [[UIBarButtonItem alloc] initWithTitle:@"制限" style:UIBarButtonItemStylePlain target:self action:@selector(showLimits)];
 
     [[NSNotificationCenter defaultCenter] addObserver:self.tableView selector:@selector(reloadData) name:@"DownloadUpdated" object:nil];
     [[NSNotificationCenter defaultCenter] addObserver:self.tableView selector:@selector(reloadData) name:@"DownloadStarted" object:nil];
@@ -33,6 +34,51 @@
     [self.tableView reloadData];
 }
 
+#pragma mark - Limits
+
+- (void)showLimits {
+    DownloadManager *manager = [DownloadManager sharedManager];
+    NSString *bandwidth = manager.bandwidthLimit > 0 ? [NSString stringWithFormat:@"%@/s", [NSByteCountFormatter stringFromByteCount:manager.bandwidthLimit countStyle:NSByteCountFormatterCountStyleFile]] : @"無制限";
+    NSString *message = [NSString stringWithFormat:@"同時 %ld 件 · 1サーバー %ld 件 · 速度 %@", (long)manager.maxConcurrentDownloads, (long)manager.maxDownloadsPerHost, bandwidth];
+    UIAlertController *alert = [UIAlertController alertControllerWithTitle:@"ダウンロードの制限" message:message preferredStyle:UIAlertControllerStyleActionSheet];
+    [alert addAction:[UIAlertAction actionWithTitle:@"同時ダウンロード数" style:UIAlertActionStyleDefault handler:^(UIAlertAction *action) {
+        [self chooseFrom:@[@1, @2, @3, @5, @8] title:@"同時ダウンロード数" label:^NSString *(NSNumber *value) {
+            return [NSString stringWithFormat:@"%@ 件", value];
+        } apply:^(NSNumber *value) {
+            manager.maxConcurrentDownloads = value.integerValue;
+        }];
+    }]];
+    [alert addAction:[UIAlertAction actionWithTitle:@"1サーバーあたり" style:UIAlertActionStyleDefault handler:^(UIAlertAction *action) {
+        [self chooseFrom:@[@1, @2, @4] title:@"1サーバーあたりの同時ダウンロード数" label:^NSString *(NSNumber *value) {
+            return [NSString stringWithFormat:@"%@ 件", value];
+        } apply:^(NSNumber *value) {
+            manager.maxDownloadsPerHost = value.integerValue;
+        }];
+    }]];
+    [alert addAction:[UIAlertAction actionWithTitle:@"速度制限" style:UIAlertActionStyleDefault handler:^(UIAlertAction *action) {
+        [self chooseFrom:@[@0, @(512 << 10), @(1 << 20), @(5 << 20), @(10 << 20)] title:@"速度制限" label:^NSString *(NSNumber *value) {
+            if (value.longLongValue == 0) return @"無制限";
+            return [NSString stringWithFormat:@"%@/s", [NSByteCountFormatter stringFromByteCount:value.longLongValue countStyle:NSByteCountFormatterCountStyleFile]];
+        } apply:^(NSNumber *value) {
+            manager.bandwidthLimit = value.longLongValue;
+        }];
+    }]];
+    [alert addAction:[UIAlertAction actionWithTitle:@"キャンセル" style:UIAlertActionStyleCancel handler:nil]];
+    [self presentViewController:alert animated:YES completion:nil];
+}
+
+- (void)chooseFrom:(NSArray<NSNumber *> *)values title:(NSString *)title label:(NSString *(^)(NSNumber *value))label apply:(void (^)(NSNumber *value))apply {
+    UIAlertController *alert = [UIAlertController alertControllerWithTitle:title message:nil preferredStyle:UIAlertControllerStyleActionSheet];
+    for (NSNumber *value in values) {
+        [alert addAction:[UIAlertAction actionWithTitle:label(value) style:UIAlertActionStyleDefault handler:^(UIAlertAction *action) {
+            apply(value);
+            [self.tableView reloadData];
+        }]];
+    }
+    [alert addAction:[UIAlertAction actionWithTitle:@"キャンセル" style:UIAlertActionStyleCancel handler:nil]];
+    [self presentViewController:alert animated:YES completion:nil];
+}
+
 #pragma mark - TableView
 
 - (NSInteger)tableView:(UITableView *)tableView numberOfRowsInSection:(NSInteger)section {
@@ -65,12 +111,20 @@
     DownloadTask *task = [DownloadManager sharedManager].tasks[indexPath.row];
     cell.textLabel.text = task.filename;
 
-    if (!task.isDownloading && task.resumeData) {
+    if (task.isPaused) {
         UIButton *resumeBtn = [UIButton buttonWithType:UIButtonTypeSystem];
         [resumeBtn setTitle:@"再開" forState:UIControlStateNormal];
+        [resumeBtn sizeToFit];
         resumeBtn.tag = indexPath.row;
         [resumeBtn addTarget:self action:@selector(resumeTapped:) forControlEvents:UIControlEventTouchUpInside];
         cell.accessoryView = resumeBtn;
+    } else if (task.isDownloading || task.isQueued) {
+        UIButton *pauseBtn = [UIButton buttonWithType:UIButtonTypeSystem];
+        [pauseBtn setTitle:@"一時停止" forState:UIControlStateNormal];
+        [pauseBtn sizeToFit];
+        pauseBtn.tag = indexPath.row;
+        [pauseBtn addTarget:self action:@selector(pauseTapped:) forControlEvents:UIControlEventTouchUpInside];
+        cell.accessoryView = pauseBtn;
     } else {
         cell.accessoryView = nil;
     }
@@ -78,14 +132,38 @@
     if (task.isDownloading) {
         NSString *received = [NSByteCountFormatter stringFromByteCount:task.receivedBytes countStyle:NSByteCountFormatterCountStyleFile];
         NSString *total = [NSByteCountFormatter stringFromByteCount:task.totalBytes countStyle:NSByteCountFormatterCountStyleFile];
-        cell.detailTextLabel.text = [NSString stringWithFormat:@"%@ / %@ (%.0f%%)", received, total, task.progress * 100];
+        NSString *connections = task.connectionCount > 1 ? [NSString stringWithFormat:@" · %lu 接続", (unsigned long)task.connectionCount] : @"";
+        NSString *speed = @"";
+        if (task.bytesPerSecond > 0) {
+            speed = [NSString stringWithFormat:@" · %@/s", [NSByteCountFormatter stringFromByteCount:(int64_t)task.bytesPerSecond countStyle:NSByteCountFormatterCountStyleFile]];
+        }
+        if (task.secondsRemaining >= 0) {
+            long seconds = lround(task.secondsRemaining);
+            NSString *eta = seconds >= 3600 ? [NSString stringWithFormat:@"%ld:%02ld:%02ld", seconds / 3600, seconds / 60 % 60, seconds % 60]
+                                            : [NSString stringWithFormat:@"%ld:%02ld", seconds / 60, seconds % 60];
+            speed = [speed stringByAppendingFormat:@" · 残り %@", eta];
+        }
+        cell.detailTextLabel.text = [NSString stringWithFormat:@"%@ / %@ (%.0f%%)%@%@", received, total, task.progress * 100, speed, connections];
+    } else if (task.isQueued) {
+        NSString *priority = task.priority > DownloadPriorityNormal ? @" · 優先" : task.priority < DownloadPriorityNormal ? @" · 後回し" : @"";
+        cell.detailTextLabel.text = [NSString stringWithFormat:@"待機中%@", priority];
+    } else if (task.isPaused) {
+        NSString *received = [NSByteCountFormatter stringFromByteCount:task.receivedBytes countStyle:NSByteCountFormatterCountStyleFile];
+        NSString *total = [NSByteCountFormatter stringFromByteCount:task.totalBytes countStyle:NSByteCountFormatterCountStyleFile];
+        cell.detailTextLabel.text = [NSString stringWithFormat:@"一時停止 · %@ / %@ (%.0f%%)", received, total, task.progress * 100];
     } else {
-        cell.detailTextLabel.text = @"完了";
+        switch (task.checksumState) {
+            case DownloadChecksumVerifying: cell.detailTextLabel.text = @"完了 · 検証中…"; break;
+            case DownloadChecksumVerified: cell.detailTextLabel.text = @"完了 · 検証済み"; break;
+            case DownloadChecksumMismatch: cell.detailTextLabel.text = @"完了 · チェックサム不一致"; break;
+            case DownloadChecksumFailed: cell.detailTextLabel.text = @"完了 · 検証できません"; break;
+            default: cell.detailTextLabel.text = @"完了"; break;
+        }
     }
 
     UIProgressView *pv = (UIProgressView *)[cell.contentView viewWithTag:100];
     pv.progress = task.progress;
-    pv.hidden = !task.isDownloading;
+    pv.hidden = !task.isDownloading && !task.isPaused;
 
     return cell;
 }
@@ -99,8 +177,36 @@
     }
 }
 
+- (void)pauseTapped:(UIButton *)sender {
+    NSInteger row = sender.tag;
+    if (row < [DownloadManager sharedManager].tasks.count) {
+        DownloadTask *task = [DownloadManager sharedManager].tasks[row];
+        [[DownloadManager sharedManager] pauseTask:task];
+        [self.tableView reloadData];
+    }
+}
+
 - (void)tableView:(UITableView *)tableView didSelectRowAtIndexPath:(NSIndexPath *)indexPath {
     [tableView deselectRowAtIndexPath:indexPath animated:YES];
+    DownloadManager *manager = [DownloadManager sharedManager];
+    if (indexPath.row >= manager.tasks.count) return;
+    DownloadTask *task = manager.tasks[indexPath.row];
+    if (!task.isQueued && !task.isDownloading && !task.isPaused) return;
+
+    UIAlertController *alert = [UIAlertController alertControllerWithTitle:task.filename message:nil preferredStyle:UIAlertControllerStyleActionSheet];
+    NSArray *priorities = @[@[@"優先して開始", @(DownloadPriorityHigh)], @[@"通常の順番", @(DownloadPriorityNormal)], @[@"後回しにする", @(DownloadPriorityLow)]];
+    for (NSArray *choice in priorities) {
+        DownloadPriority priority = [choice[1] integerValue];
+        if (priority == task.priority) continue;
+        [alert addAction:[UIAlertAction actionWithTitle:choice[0] style:UIAlertActionStyleDefault handler:^(UIAlertAction *action) {
+            [manager setPriority:priority forTask:task];
+        }]];
+    }
+    [alert addAction:[UIAlertAction actionWithTitle:@"ダウンロードを中止" style:UIAlertActionStyleDestructive handler:^(UIAlertAction *action) {
+        [manager cancelTask:task];
+    }]];
+    [alert addAction:[UIAlertAction actionWithTitle:@"キャンセル" style:UIAlertActionStyleCancel handler:nil]];
+    [self presentViewController:alert animated:YES completion:nil];
 }
 
 @end
@@ -20,6 +20,8 @@
 #import "HexEditorViewController.h"
 #import "FileInfoViewController.h"
 #import "LogViewerViewController.h"
+#import "ArchiveBrowserViewController.h"
+#import "ZipArchiveMount.h"
 #import <UniformTypeIdentifiers/UniformTypeIdentifiers.h>
 
 @interface FileBrowserViewController () <UITableViewDelegate, UITableViewDataSource, UISearchBarDelegate, UIDocumentPickerDelegate, UIGestureRecognizerDelegate>
@@ -29,9 +31,19 @@
 @property (strong, nonatomic) BottomMenuView *bottomMenu;
 @property (strong, nonatomic) UISearchBar *searchBar;
 @property (strong, nonatomic) NSTimer *searchTimer;
+@property (strong, nonatomic) FileListingRequest *listingRequest;
+@property (strong, nonatomic) FileListingRequest *searchRequest;
+@property (strong, nonatomic) NSMutableArray<FileItem *> *searchResults;
+@property (strong, nonatomic) NSMutableArray<FileContentMatch *> *contentMatches;  // parallel to searchResults in content scope
 @property (strong, nonatomic) UISegmentedControl *searchScope;
+@property (strong, nonatomic) FileOperationJob *operationJob;
+@property (strong, nonatomic) UIView *operationBar;
+@property (strong, nonatomic) UIProgressView *operationProgress;
+@property (strong, nonatomic) UILabel *operationLabel;
 @property (strong, nonatomic) NSLayoutConstraint *searchBarTopConstraint;
 @property (assign, nonatomic) BOOL isSearchRevealed;
+@property (assign, nonatomic) BOOL needsReload;
+@property (assign, nonatomic) BOOL isSearching;
 - (void)createNewPDF;
 - (void)createNewSpreadsheet;
 @end
@@ -51,6 +63,7 @@
     self.navigationController.navigationBar.translucent = YES;
     [self setupUI];
     [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(reloadData) name:@"SettingsChanged" object:nil];
+    [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(directoryDidChange:) name:@"DirectoryChanged" object:nil];
     [self reloadData];
 }
 
@@ -93,8 +106,29 @@
     self.searchScope.translatesAutoresizingMaskIntoConstraints = NO;
     self.searchScope.hidden = YES;
     self.searchScope.backgroundColor = [[UIColor whiteColor] colorWithAlphaComponent:0.1];
+    [self.searchScope addTarget:self action:@selector(searchScopeChanged:) forControlEvents:UIControlEventValueChanged];
     [self.view addSubview:self.searchScope];
 
+    self.operationBar = [[UIView alloc] init];
+    self.operationBar.translatesAutoresizingMaskIntoConstraints = NO;
+    self.operationBar.backgroundColor = [[UIColor blackColor] colorWithAlphaComponent:0.6];
+    self.operationBar.hidden = YES;
+    [self.view addSubview:self.operationBar];
+    self.operationLabel = [[UILabel alloc] init];
+    self.operationLabel.translatesAutoresizingMaskIntoConstraints = NO;
+    self.operationLabel.font = [UIFont monospacedDigitSystemFontOfSize:12 weight:UIFontWeightRegular];
+    self.operationLabel.textColor = [UIColor whiteColor];
+    [self.operationBar addSubview:self.operationLabel];
+    self.operationProgress = [[UIProgressView alloc] initWithProgressViewStyle:UIProgressViewStyleDefault];
+    self.operationProgress.translatesAutoresizingMaskIntoConstraints = NO;
+    [self.operationBar addSubview:self.operationProgress];
+    UIButton *cancelOperation = [UIButton buttonWithType:UIButtonTypeSystem];
+    cancelOperation.translatesAutoresizingMaskIntoConstraints = NO;
+    [cancelOperation setImage:[UIImage systemImageNamed:@"xmark.circle.fill"] forState:UIControlStateNormal];
+    cancelOperation.tintColor = [UIColor lightGrayColor];
+    [cancelOperation addTarget:self action:@selector(cancelOperation) forControlEvents:UIControlEventTouchUpInside];
+    [self.operationBar addSubview:cancelOperation];
+
     UILayoutGuide *safe = self.view.safeAreaLayoutGuide;
     self.searchBarTopConstraint = [self.searchBar.topAnchor constraintEqualToAnchor:safe.topAnchor constant:-100];
 
@@ -121,7 +155,21 @@
         [self.bottomMenu.bottomAnchor constraintEqualToAnchor:self.view.bottomAnchor],
         [self.bottomMenu.leadingAnchor constraintEqualToAnchor:self.view.leadingAnchor],
         [self.bottomMenu.trailingAnchor constraintEqualToAnchor:self.view.trailingAnchor],
-        [self.bottomMenu.heightAnchor constraintEqualToConstant:90]
+        [self.bottomMenu.heightAnchor constraintEqualToConstant:90],
+
+        [self.operationBar.bottomAnchor constraintEqualToAnchor:self.bottomMenu.topAnchor],
+        [self.operationBar.leadingAnchor constraintEqualToAnchor:self.view.leadingAnchor],
+        [self.operationBar.trailingAnchor constraintEqualToAnchor:self.view.trailingAnchor],
+        [self.operationBar.heightAnchor constraintEqualToConstant:44],
+        [self.operationLabel.topAnchor constraintEqualToAnchor:self.operationBar.topAnchor constant:6],
+        [self.operationLabel.leadingAnchor constraintEqualToAnchor:self.operationBar.leadingAnchor constant:15],
+        [self.operationLabel.trailingAnchor constraintEqualToAnchor:cancelOperation.leadingAnchor constant:-10],
+        [self.operationProgress.topAnchor constraintEqualToAnchor:self.operationLabel.bottomAnchor constant:6],
+        [self.operationProgress.leadingAnchor constraintEqualToAnchor:self.operationLabel.leadingAnchor],
+        [self.operationProgress.trailingAnchor constraintEqualToAnchor:self.operationLabel.trailingAnchor],
+        [cancelOperation.centerYAnchor constraintEqualToAnchor:self.operationBar.centerYAnchor],
+        [cancelOperation.trailingAnchor constraintEqualToAnchor:self.operationBar.trailingAnchor constant:-10],
+        [cancelOperation.widthAnchor constraintEqualToConstant:32]
     ]];
 
     UIBarButtonItem *moreBtn = [[UIBarButtonItem alloc] initWithImage:[UIImage systemImageNamed:@"ellipsis.circle"] style:UIBarButtonItemStylePlain target:self action:@selector(showMoreMenu)];
@@ -153,6 +201,8 @@
             self.searchBar.hidden = YES;
             self.searchScope.hidden = YES;
             [self.searchBar resignFirstResponder];
+            self.searchBar.text = @"";
+            [self endSearch];
             [self reloadData];
         } else {
             [self.searchBar becomeFirstResponder];
@@ -161,22 +211,136 @@
 }
 
 
+- (void)viewWillAppear:(BOOL)animated {
+    [super viewWillAppear:animated];
+    if (self.needsReload) [self reloadData];
+}
+
 - (void)handleRefresh:(UIRefreshControl *)refresh {
+    // The watcher misses some changes (file contents on kqueue), so a pull always re-reads.
+    [[FileManagerCore sharedManager] invalidateDirectoryAtPath:self.currentPath];
     [self reloadData];
     [refresh endRefreshing];
 }
 
+- (void)directoryDidChange:(NSNotification *)note {
+    if (self.isSearching || ![note.userInfo[@"path"] isEqualToString:self.currentPath]) return;
+    if (!self.view.window) { self.needsReload = YES; return; }
+    // Bursts of events (a paste, an unzip) collapse into one reload.
+    [NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(reloadData) object:nil];
+    [self performSelector:@selector(reloadData) withObject:nil afterDelay:0.2];
+}
+
 - (void)reloadData {
-    self.items = [[FileManagerCore sharedManager] contentsOfDirectoryAtPath:self.currentPath];
+    if (self.isSearching) { [self performSearch]; return; }
+    self.needsReload = NO;
+    [self.listingRequest cancel];
     [self.pathBar updatePath:self.currentPath];
-    [self.tableView reloadData];
+    __weak typeof(self) weakSelf = self;
+    self.listingRequest = [[FileManagerCore sharedManager] listDirectoryAtPath:self.currentPath since:self.items handler:^(NSArray<FileItem *> *items, FileListingChanges *changes, BOOL finished) {
+        [weakSelf applyListing:items changes:changes];
+    }];
+}
+
+- (NSArray<NSIndexPath *> *)indexPathsForRows:(NSIndexSet *)rows {
+    NSMutableArray<NSIndexPath *> *paths = [NSMutableArray arrayWithCapacity:rows.count];
+    [rows enumerateIndexesUsingBlock:^(NSUInteger idx, BOOL *stop) { [paths addObject:[NSIndexPath indexPathForRow:idx inSection:0]]; }];
+    return paths;
+}
+
+- (void)applyListing:(NSArray<FileItem *> *)items changes:(FileListingChanges *)changes {
+    if (!changes || self.tableView.isEditing) { self.items = items; [self.tableView reloadData]; return; }
+    if (!changes.deleted.count && !changes.inserted.count && !changes.reloaded.count) { self.items = items; return; }
+    NSArray *deleted = [self indexPathsForRows:changes.deleted], *inserted = [self indexPathsForRows:changes.inserted], *reloaded = [self indexPathsForRows:changes.reloaded];
+    [UIView performWithoutAnimation:^{
+        [self.tableView performBatchUpdates:^{ self.items = items; [self.tableView deleteRowsAtIndexPaths:deleted withRowAnimation:UITableViewRowAnimationNone]; [self.tableView insertRowsAtIndexPaths:inserted withRowAnimation:UITableViewRowAnimationNone]; } completion:^(BOOL finished) {
+            // Reloads are given in the new rows, so they can only run once the batch has landed.
+            if (reloaded.count) [self.tableView reloadRowsAtIndexPaths:reloaded withRowAnimation:UITableViewRowAnimationNone];
+        }];
+    }];
 }
 
 - (void)navigateToPath:(NSString *)path {
     self.currentPath = path;
+    [self endSearch];
     [self reloadData];
 }
 
+#pragma mark - Search
+
+- (void)searchBar:(UISearchBar *)searchBar textDidChange:(NSString *)searchText {
+    // Typing restarts the timer; only the query that sits for a moment is searched.
+    [self.searchTimer invalidate];
+    self.searchTimer = [NSTimer scheduledTimerWithTimeInterval:0.3 target:self selector:@selector(searchTimerFired:) userInfo:nil repeats:NO];
+}
+
+- (void)searchBarSearchButtonClicked:(UISearchBar *)searchBar {
+    [self.searchTimer invalidate];
+    [searchBar resignFirstResponder];
+    [self performSearch];
+}
+
+- (void)searchTimerFired:(NSTimer *)timer {
+    [self performSearch];
+}
+
+- (void)searchScopeChanged:(UISegmentedControl *)sender {
+    if (self.searchBar.text.length) [self performSearch];
+}
+
+- (void)performSearch {
+    [self.searchRequest cancel];
+    NSString *query = [self.searchBar.text stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+    if (query.length == 0) { [self endSearch]; [self reloadData]; return; }
+
+    [self.listingRequest cancel];
+    self.isSearching = YES;
+    self.searchResults = [NSMutableArray array];
+    self.contentMatches = nil;
+    self.items = self.searchResults;
+    [self.tableView reloadData];
+    __weak typeof(self) weakSelf = self;
+    if (self.searchScope.selectedSegmentIndex == 1) {
+        self.contentMatches = [NSMutableArray array];
+        self.searchRequest = [[FileManagerCore sharedManager] searchContentsForText:query inPath:self.currentPath handler:^(NSArray<FileContentMatch *> *matches, BOOL finished) {
+            [weakSelf appendContentMatches:matches];
+        }];
+        return;
+    }
+    self.searchRequest = [[FileManagerCore sharedManager] searchFilesWithQuery:query inPath:self.currentPath handler:^(NSArray<FileItem *> *matches, BOOL finished) {
+        [weakSelf appendSearchResults:matches];
+    }];
+}
+
+- (void)appendSearchResults:(NSArray<FileItem *> *)matches {
+    if (!matches.count || self.items != self.searchResults) return;
+    NSMutableArray<NSIndexPath *> *paths = [NSMutableArray arrayWithCapacity:matches.count];
+    for (NSUInteger i = 0; i < matches.count; i++) [paths addObject:[NSIndexPath indexPathForRow:self.searchResults.count + i inSection:0]];
+    [UIView performWithoutAnimation:^{ [self.tableView performBatchUpdates:^{ [self.searchResults addObjectsFromArray:matches]; [self.tableView insertRowsAtIndexPaths:paths withRowAnimation:UITableViewRowAnimationNone]; } completion:nil]; }];
+}
+
+- (void)appendContentMatches:(NSArray<FileContentMatch *> *)matches {
+    if (!matches.count || !self.contentMatches) return;
+    NSMutableArray<FileItem *> *items = [NSMutableArray arrayWithCapacity:matches.count];
+    for (FileContentMatch *match in matches) {
+        FileItem *item = [[FileItem alloc] init];
+        item.name = match.path.lastPathComponent;
+        item.fullPath = match.path;
+        [items addObject:item];
+    }
+    [self.contentMatches addObjectsFromArray:matches];
+    [self appendSearchResults:items];
+}
+
+- (void)endSearch {
+    [self.searchTimer invalidate];
+    [self.searchRequest cancel];
+    self.searchRequest = nil;
+    self.isSearching = NO;
+    self.searchResults = nil;
+    self.contentMatches = nil;
+}
+
 #pragma mark - TableView
 
 - (NSInteger)tableView:(UITableView *)tableView numberOfRowsInSection:(NSInteger)section { return self.items.count; }
@@ -208,6 +372,15 @@
         cell.imageView.tintColor = [self iconColorForExtension:ext];
     }
     cell.detailTextLabel.text = item.isSymbolicLink ? [NSString stringWithFormat:@" Alias ➜ %@", item.linkTarget] : nil;
+    if (self.isSearching && !item.isSymbolicLink) {
+        NSString *parent = [item.fullPath stringByDeletingLastPathComponent];
+        cell.detailTextLabel.text = [parent hasPrefix:self.currentPath] ? [@"." stringByAppendingString:[parent substringFromIndex:self.currentPath.length]] : parent;
+        if (indexPath.row < (NSInteger)self.contentMatches.count) {
+            FileContentMatch *match = self.contentMatches[indexPath.row];
+            cell.detailTextLabel.text = match.line ? [NSString stringWithFormat:@"L%lu: %@", (unsigned long)match.line, match.snippet]
+                                                   : [NSString stringWithFormat:@"%@ · %lu 件一致", cell.detailTextLabel.text, (unsigned long)match.occurrences];
+        }
+    }
     return cell;
 }
 
@@ -348,12 +521,12 @@
         BOOL shouldConfirm = [[NSUserDefaults standardUserDefaults] objectForKey:@"ConfirmDeletion"] ? [[NSUserDefaults standardUserDefaults] boolForKey:@"ConfirmDeletion"] : YES;
         if (shouldConfirm) {
             UIAlertController *alert = [UIAlertController alertControllerWithTitle:@"削除の確認" message:[NSString stringWithFormat:@"%lu 個のアイテムを削除しますか？", (unsigned long)selectedPaths.count] preferredStyle:UIAlertControllerStyleAlert];
-            [alert addAction:[UIAlertAction actionWithTitle:@"削除" style:UIAlertActionStyleDestructive handler:^(UIAlertAction *action) { for (NSString *path in selectedPaths) { [[FileManagerCore sharedManager] removeItemAtPath:path error:nil]; } [self toggleSelectionMode]; [self reloadData]; }]];
+            [alert addAction:[UIAlertAction actionWithTitle:@"削除" style:UIAlertActionStyleDestructive handler:^(UIAlertAction *action) { [self runOperation:FileOperationDelete onPaths:selectedPaths]; [self toggleSelectionMode]; }]];
             [alert addAction:[UIAlertAction actionWithTitle:@"キャンセル" style:UIAlertActionStyleCancel handler:nil]];
             [self presentViewController:alert animated:YES completion:nil];
             return;
-        } else { for (NSString *path in selectedPaths) { [[FileManagerCore sharedManager] removeItemAtPath:path error:nil]; } }
-    } else if (actionType == 1) { NSString *zipName = [NSString stringWithFormat:@"archive_%ld.zip", (long)[[NSDate date] timeIntervalSince1970]]; NSString *dest = [self.currentPath stringByAppendingPathComponent:zipName]; [ZipManager compressFiles:selectedPaths toPath:dest format:ArchiveFormatZip password:nil error:nil]; }
+        } else { [self runOperation:FileOperationDelete onPaths:selectedPaths]; }
+    } else if (actionType == 1) { NSString *zipName = [NSString stringWithFormat:@"archive_%ld.zip", (long)[[NSDate date] timeIntervalSince1970]]; NSString *dest = [self.currentPath stringByAppendingPathComponent:zipName]; [self compressPaths:selectedPaths toPath:dest]; }
     else if (actionType == 2) { NSMutableArray *urls = [NSMutableArray array]; for (NSString *path in selectedPaths) [urls addObject:[NSURL fileURLWithPath:path]]; UIActivityViewController *avc = [[UIActivityViewController alloc] initWithActivityItems:urls applicationActivities:nil]; [self presentViewController:avc animated:YES completion:nil]; }
     else if (actionType == 3) { [FileManagerCore sharedManager].clipboardPaths = selectedPaths; [FileManagerCore sharedManager].isMoveOperation = NO; }
     else if (actionType == 4) { [FileManagerCore sharedManager].clipboardPaths = selectedPaths; [FileManagerCore sharedManager].isMoveOperation = YES; }
@@ -369,8 +542,54 @@
 }
 
 - (void)performPaste {
-    FileManagerCore *fmc = [FileManagerCore sharedManager]; for (NSString *src in fmc.clipboardPaths) { NSString *dest = [self.currentPath stringByAppendingPathComponent:[src lastPathComponent]]; if (fmc.isMoveOperation) { [fmc moveItemAtPath:src toPath:dest error:nil]; } else { [fmc copyItemAtPath:src toPath:dest error:nil]; } }
-    if (fmc.isMoveOperation) fmc.clipboardPaths = nil; [self reloadData];
+    FileManagerCore *fmc = [FileManagerCore sharedManager];
+    [self runOperation:fmc.isMoveOperation ? FileOperationMove : FileOperationCopy onPaths:fmc.clipboardPaths];
+    if (fmc.isMoveOperation) fmc.clipboardPaths = nil;
+}
+
+#pragma mark - File Operations
+
+// Pastes and bulk deletes run as one background job; the bar above the bottom
+// menu follows the latest one and the listing updates through the watcher.
+- (void)runOperation:(FileOperationKind)kind onPaths:(NSArray<NSString *> *)paths {
+    if (paths.count == 0) return;
+    __weak typeof(self) weakSelf = self;
+    self.operationJob = [[FileManagerCore sharedManager] performOperation:kind onPaths:paths toDirectory:kind == FileOperationDelete ? nil : self.currentPath handler:^(FileOperationJob *job) { [weakSelf operationJobDidUpdate:job]; }];
+    self.operationLabel.text = @"準備中...";
+    self.operationProgress.progress = 0;
+    self.operationBar.hidden = NO;
+}
+
+- (void)cancelOperation {
+    [self.operationJob cancel];
+}
+
+- (void)operationJobDidUpdate:(FileOperationJob *)job {
+    if (job != self.operationJob) return;
+    if (job.finished) {
+        self.operationJob = nil;
+        self.operationBar.hidden = YES;
+        [self reloadData];
+        if (job.failures.count > 0) {
+            NSMutableArray<NSString *> *lines = [NSMutableArray array];
+            for (FileOperationFailure *failure in [job.failures subarrayWithRange:NSMakeRange(0, MIN(job.failures.count, 5))]) {
+                [lines addObject:[NSString stringWithFormat:@"%@: %@", [failure.path lastPathComponent], failure.error.localizedDescription]];
+            }
+            if (job.failures.count > 5) [lines addObject:[NSString stringWithFormat:@"他 %lu 件", (unsigned long)(job.failures.count - 5)]];
+            UIAlertController *alert = [UIAlertController alertControllerWithTitle:[NSString stringWithFormat:@"%lu 個のアイテムを処理できませんでした", (unsigned long)job.failures.count] message:[lines componentsJoinedByString:@"\n"] preferredStyle:UIAlertControllerStyleAlert];
+            [alert addAction:[UIAlertAction actionWithTitle:@"OK" style:UIAlertActionStyleDefault handler:nil]];
+            [self presentViewController:alert animated:YES completion:nil];
+        }
+        return;
+    }
+    if (!job.planned) return;
+    NSString *verb = job.kind == FileOperationCopy ? @"コピー中" : job.kind == FileOperationMove ? @"移動中" : @"削除中";
+    NSMutableString *text = [NSMutableString stringWithFormat:@"%@ %llu / %llu", verb, job.filesDone, job.filesTotal];
+    if (job.bytesTotal > 0) [text appendFormat:@" · %@/s", [NSByteCountFormatter stringFromByteCount:(long long)job.rate countStyle:NSByteCountFormatterCountStyleFile]];
+    if (job.remainingTime >= 0) [text appendFormat:@" · 残り %.0f 秒", ceil(job.remainingTime)];
+    self.operationLabel.text = text;
+    double fraction = job.bytesTotal > 0 ? (double)job.bytesDone / job.bytesTotal : job.filesTotal > 0 ? (double)job.filesDone / job.filesTotal : 0;
+    [self.operationProgress setProgress:(float)fraction animated:NO];
 }
 
 - (void)promptForNewItem:(BOOL)isDir {
@@ -419,17 +638,36 @@
 
 - (void)showCompressionOptionsForItem:(FileItem *)item {
     UIAlertController *alert = [UIAlertController alertControllerWithTitle:@"Compress As..." message:nil preferredStyle:UIAlertControllerStyleActionSheet];
-    [alert addAction:[UIAlertAction actionWithTitle:@"ZIP" style:UIAlertActionStyleDefault handler:^(UIAlertAction *action) { [ZipManager compressFiles:@[item.fullPath] toPath:[item.fullPath stringByAppendingPathExtension:@"zip"] format:ArchiveFormatZip password:nil error:nil]; [self reloadData]; }]];
+    [alert addAction:[UIAlertAction actionWithTitle:@"ZIP" style:UIAlertActionStyleDefault handler:^(UIAlertAction *action) { [self compressPaths:@[item.fullPath] toPath:[item.fullPath stringByAppendingPathExtension:@"zip"]]; }]];
     [alert addAction:[UIAlertAction actionWithTitle:@"キャンセル" style:UIAlertActionStyleCancel handler:nil]];
     [self presentViewController:alert animated:YES completion:nil];
 }
 
+- (void)compressPaths:(NSArray<NSString *> *)paths toPath:(NSString *)dest {
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+        NSError *error = nil;
+        [ZipManager compressFiles:paths toPath:dest format:ArchiveFormatZip password:nil error:&error];
+        dispatch_async(dispatch_get_main_queue(), ^{
+            if (error) { UIAlertController *alert = [UIAlertController alertControllerWithTitle:@"エラー" message:error.localizedDescription preferredStyle:UIAlertControllerStyleAlert]; [alert addAction:[UIAlertAction actionWithTitle:@"OK" style:UIAlertActionStyleDefault handler:nil]]; [self presentViewController:alert animated:YES completion:nil]; }
+            [self reloadData];
+        });
+    });
+}
+
 - (void)showArchiveOptionsForItem:(FileItem *)item {
     CustomMenuView *menu = [CustomMenuView menuWithTitle:item.name];
+    [menu addAction:[CustomMenuAction actionWithTitle:@"中身を見る" systemImage:@"eye" style:CustomMenuActionStyleDefault handler:^{ [self browseArchiveAtPath:item.fullPath]; }]];
     [menu addAction:[CustomMenuAction actionWithTitle:@"展開" systemImage:@"arrow.up.bin" style:CustomMenuActionStyleDefault handler:^{ [self promptForArchivePasswordForPath:item.fullPath isExtracting:YES]; }]];
     [menu showInView:self.view];
 }
 
+- (void)browseArchiveAtPath:(NSString *)path {
+    NSError *error;
+    ZipArchiveMount *mount = [ZipArchiveMount mountArchiveAtPath:path error:&error];
+    if (!mount) { UIAlertController *alert = [UIAlertController alertControllerWithTitle:@"エラー" message:error.localizedDescription preferredStyle:UIAlertControllerStyleAlert]; [alert addAction:[UIAlertAction actionWithTitle:@"OK" style:UIAlertActionStyleDefault handler:nil]]; [self presentViewController:alert animated:YES completion:nil]; return; }
+    [self.navigationController pushViewController:[[ArchiveBrowserViewController alloc] initWithMount:mount path:@""] animated:YES];
+}
+
 - (void)promptForArchivePasswordForPath:(NSString *)path isExtracting:(BOOL)extracting {
     if (NO) {
         UIAlertController *alert = [UIAlertController alertControllerWithTitle:@"パスワード入力" message:@"このアーカイブは暗号化されています" preferredStyle:UIAlertControllerStyleAlert];
@@ -1,5 +1,6 @@
 #import "FileInfoViewController.h"
 #import "ThemeEngine.h"
+#import <errno.h>
 #import <sys/stat.h>
 #import <string.h>
 
@@ -7,6 +8,10 @@
 @property (nonatomic, strong) FileItem *item;
 @property (nonatomic, strong) UITableView *tableView;
 @property (nonatomic, strong) NSArray *sections;
+@property (nonatomic, strong) FileDiskUsage *usage;
+@property (nonatomic, strong) FileListingRequest *usageRequest;
+@property (nonatomic, strong) FileChecksumJob *checksumJob;
+@property (nonatomic, strong) FileChecksum *checksum;
 @end
 
 @implementation FileInfoViewController
@@ -32,9 +37,76 @@
     self.tableView.separatorColor = [[UIColor whiteColor] colorWithAlphaComponent:0.1];
     [self.view addSubview:self.tableView];
 
+    if (self.item.isDirectory && !self.item.isSymbolicLink) [self measureFolder];
     [self prepareData];
 }
 
+- (void)dealloc {
+    [_usageRequest cancel];
+    [_checksumJob cancel];
+}
+
+- (void)measureFolder {
+    __weak typeof(self) weakSelf = self;
+    self.usageRequest = [[FileManagerCore sharedManager] diskUsageAtPath:self.item.fullPath handler:^(FileDiskUsage *usage, NSError *error) {
+        __strong typeof(weakSelf) self = weakSelf;
+        if (!self) return;
+        if (error) {
+            self.usageRequest = nil;
+            return;
+        }
+        self.usage = usage;
+        if (usage.finished) self.usageRequest = nil;
+        [self prepareData];
+        [self.tableView reloadData];
+    }];
+}
+
+- (void)computeChecksums {
+    __weak typeof(self) weakSelf = self;
+    FileChecksumAlgorithm algorithms = FileChecksumMD5 | FileChecksumSHA1 | FileChecksumSHA256 | FileChecksumCRC32;
+    self.checksumJob = [[FileManagerCore sharedManager] computeChecksumsAtPath:self.item.fullPath algorithms:algorithms handler:^(FileChecksumJob *job) {
+        __strong typeof(weakSelf) self = weakSelf;
+        if (!self) return;
+        if (job.finished) {
+            self.checksum = job.error ? nil : job.checksums.firstObject;
+            self.checksumJob = job.error ? nil : self.checksumJob;
+        }
+        [self prepareData];
+        [self.tableView reloadData];
+    }];
+    [self prepareData];
+    [self.tableView reloadData];
+}
+
+- (void)verifyChecksum {
+    UIAlertController *alert = [UIAlertController alertControllerWithTitle:@"チェックサムを照合" message:@"MD5・SHA-1・SHA-256・CRC32・xxHash64 の値を貼り付けてください" preferredStyle:UIAlertControllerStyleAlert];
+    [alert addTextFieldWithConfigurationHandler:^(UITextField *tf) {
+        tf.placeholder = @"例: sha256:9f86d0…";
+        tf.text = [UIPasteboard generalPasteboard].string;
+        tf.autocorrectionType = UITextAutocorrectionTypeNo;
+        tf.autocapitalizationType = UITextAutocapitalizationTypeNone;
+    }];
+    __weak typeof(self) weakSelf = self;
+    [alert addAction:[UIAlertAction actionWithTitle:@"照合" style:UIAlertActionStyleDefault handler:^(UIAlertAction *action) {
+        [[FileManagerCore sharedManager] verifyItemAtPath:weakSelf.item.fullPath checksum:alert.textFields[0].text completion:^(BOOL matches, NSString *actual, NSError *error) {
+            __strong typeof(weakSelf) self = weakSelf;
+            if (!self) return;
+            NSString *title = error ? @"照合できません" : matches ? @"一致しました" : @"一致しません";
+            NSString *message = error ? (error.code == EINVAL ? @"チェックサムの形式を認識できません" : error.localizedDescription) : actual;
+            UIAlertController *result = [UIAlertController alertControllerWithTitle:title message:message preferredStyle:UIAlertControllerStyleAlert];
+            [result addAction:[UIAlertAction actionWithTitle:@"OK" style:UIAlertActionStyleCancel handler:nil]];
+            [self presentViewController:result animated:YES completion:nil];
+        }];
+    }]];
+    [alert addAction:[UIAlertAction actionWithTitle:@"キャンセル" style:UIAlertActionStyleCancel handler:nil]];
+    [self presentViewController:alert animated:YES completion:nil];
+}
+
+- (NSString *)byteString:(unsigned long long)bytes {
+    return [NSByteCountFormatter stringFromByteCount:(long long)bytes countStyle:NSByteCountFormatterCountStyleFile];
+}
+
 - (NSString *)permissionStringFromMode:(short)mode {
     char s[11];
     strcpy(s, "----------");
@@ -64,9 +136,45 @@
     [basicInfo addObject:@{@"label": @"拡張子", @"value": [self.item.fullPath pathExtension] ?: @"なし"}];
 
     NSMutableArray *sizeInfo = [NSMutableArray array];
-    unsigned long long size = [attrs[NSFileSize] unsignedLongLongValue];
-    [sizeInfo addObject:@{@"label": @"サイズ", @"value": [NSByteCountFormatter stringFromByteCount:size countStyle:NSByteCountFormatterCountStyleFile]}];
-    [sizeInfo addObject:@{@"label": @"バイト数", @"value": [NSString stringWithFormat:@"%llu バイト", size]}];
+    NSMutableArray *largestInfo = [NSMutableArray array];
+    if (self.item.isDirectory && !self.item.isSymbolicLink) {
+        FileDiskUsage *usage = self.usage;
+        NSString *pending = usage || self.usageRequest ? @"計算中…" : @"-";
+        NSString *suffix = usage.finished ? @"" : @" (計算中)";
+        [sizeInfo addObject:@{@"label": @"サイズ", @"value": usage.finished ? [self byteString:usage.size] : pending}];
+        [sizeInfo addObject:@{@"label": @"ディスク上のサイズ", @"value": usage ? [[self byteString:usage.allocatedSize] stringByAppendingString:suffix] : pending}];
+        [sizeInfo addObject:@{@"label": @"バイト数", @"value": usage.finished ? [NSString stringWithFormat:@"%llu バイト", usage.size] : pending}];
+        [sizeInfo addObject:@{@"label": @"ファイル数", @"value": usage ? [NSString stringWithFormat:@"%llu%@", usage.fileCount, suffix] : pending}];
+        [sizeInfo addObject:@{@"label": @"フォルダ数", @"value": usage ? [NSString stringWithFormat:@"%llu%@", usage.folderCount > 0 ? usage.folderCount - 1 : 0, suffix] : pending}];
+        for (FileDiskUsage *entry in [usage.largestItems subarrayWithRange:NSMakeRange(0, MIN(usage.largestItems.count, (NSUInteger)10))]) {
+            NSString *share = usage.allocatedSize ? [NSString stringWithFormat:@" (%.1f%%)", 100.0 * entry.allocatedSize / usage.allocatedSize] : @"";
+            NSString *name = entry.isDirectory ? [entry.path.lastPathComponent stringByAppendingString:@"/"] : entry.path.lastPathComponent;
+            [largestInfo addObject:@{@"label": name, @"value": [[self byteString:entry.allocatedSize] stringByAppendingString:share]}];
+        }
+    } else {
+        unsigned long long size = [attrs[NSFileSize] unsignedLongLongValue];
+        [sizeInfo addObject:@{@"label": @"サイズ", @"value": [NSByteCountFormatter stringFromByteCount:size countStyle:NSByteCountFormatterCountStyleFile]}];
+        [sizeInfo addObject:@{@"label": @"バイト数", @"value": [NSString stringWithFormat:@"%llu バイト", size]}];
+    }
+
+    NSMutableArray *checksumInfo = [NSMutableArray array];
+    if (!self.item.isDirectory && !self.item.isSymbolicLink) {
+        FileChecksum *checksum = self.checksum;
+        FileChecksumJob *job = self.checksumJob;
+        if (checksum) {
+            NSArray *names = @[@[@"MD5", @"md5"], @[@"SHA-1", @"sha1"], @[@"SHA-256", @"sha256"], @[@"CRC32", @"crc32"]];
+            for (NSArray *name in names) {
+                NSString *digest = checksum.digests[name[1]];
+                if (digest) [checksumInfo addObject:@{@"label": name[0], @"value": digest, @"copy": digest}];
+            }
+        } else if (job) {
+            NSString *progress = job.bytesTotal ? [NSString stringWithFormat:@"計算中… %.0f%%", 100.0 * job.bytesDone / job.bytesTotal] : @"計算中…";
+            [checksumInfo addObject:@{@"label": @"チェックサム", @"value": progress}];
+        } else {
+            [checksumInfo addObject:@{@"label": @"計算する", @"value": @"MD5・SHA-1・SHA-256・CRC32", @"action": @"compute"}];
+        }
+        [checksumInfo addObject:@{@"label": @"照合…", @"value": @"", @"action": @"verify"}];
+    }
 
     NSMutableArray *dateInfo = [NSMutableArray array];
     NSDateFormatter *df = [[NSDateFormatter alloc] init];
@@ -91,14 +199,16 @@
     [systemInfo addObject:@{@"label": @"ハードリンク数", @"value": [attrs[NSFileReferenceCount] stringValue] ?: @"-"}];
     [systemInfo addObject:@{@"label": @"拡張属性", @"value": [attrs objectForKey:@"NSFileExtendedAttributes"] ? @"あり" : @"なし"}];
 
-    self.sections = @[
-        @{@"title": @"一般情報", @"rows": basicInfo},
-        @{@"title": @"サイズ情報", @"rows": sizeInfo},
-        @{@"title": @"時間情報", @"rows": dateInfo},
-        @{@"title": @"権限とアクセス", @"rows": permissionInfo},
-        @{@"title": @"システム詳細", @"rows": systemInfo},
-        @{@"title": @"場所", @"rows": @[@{@"label": @"フルパス", @"value": self.item.fullPath ?: @""}]}
-    ];
+    NSMutableArray *sections = [NSMutableArray array];
+    [sections addObject:@{@"title": @"一般情報", @"rows": basicInfo}];
+    [sections addObject:@{@"title": @"サイズ情報", @"rows": sizeInfo}];
+    if (largestInfo.count > 0) [sections addObject:@{@"title": @"容量の大きい項目", @"rows": largestInfo}];
+    if (checksumInfo.count > 0) [sections addObject:@{@"title": @"チェックサム", @"rows": checksumInfo}];
+    [sections addObject:@{@"title": @"時間情報", @"rows": dateInfo}];
+    [sections addObject:@{@"title": @"権限とアクセス", @"rows": permissionInfo}];
+    [sections addObject:@{@"title": @"システム詳細", @"rows": systemInfo}];
+    [sections addObject:@{@"title": @"場所", @"rows": @[@{@"label": @"フルパス", @"value": self.item.fullPath ?: @""}]}];
+    self.sections = sections;
 }
 
 - (NSString *)localizedFileType:(NSString *)type {
@@ -134,16 +244,25 @@
         cell.textLabel.textColor = [[UIColor whiteColor] colorWithAlphaComponent:0.7];
         cell.detailTextLabel.textColor = [UIColor whiteColor];
         cell.detailTextLabel.numberOfLines = 0;
-        cell.selectionStyle = UITableViewCellSelectionStyleNone;
     }
 
     NSDictionary *row = self.sections[indexPath.section][@"rows"][indexPath.row];
     cell.textLabel.text = row[@"label"];
     cell.detailTextLabel.text = row[@"value"];
+    cell.textLabel.textColor = row[@"action"] ? [UIColor systemBlueColor] : [[UIColor whiteColor] colorWithAlphaComponent:0.7];
+    cell.selectionStyle = row[@"action"] || row[@"copy"] ? UITableViewCellSelectionStyleDefault : UITableViewCellSelectionStyleNone;
 
     return cell;
 }
 
+- (void)tableView:(UITableView *)tableView didSelectRowAtIndexPath:(NSIndexPath *)indexPath {
+    [tableView deselectRowAtIndexPath:indexPath animated:YES];
+    NSDictionary *row = self.sections[indexPath.section][@"rows"][indexPath.row];
+    if ([row[@"action"] isEqualToString:@"compute"]) [self computeChecksums];
+    else if ([row[@"action"] isEqualToString:@"verify"]) [self verifyChecksum];
+    else if (row[@"copy"]) [[UIPasteboard generalPasteboard] setString:row[@"copy"]];
+}
+
 - (void)tableView:(UITableView *)tableView willDisplayHeaderView:(UIView *)view forSection:(NSInteger)section {
     if ([view isKindOfClass:[UITableViewHeaderFooterView class]]) {
         UITableViewHeaderFooterView *header = (UITableViewHeaderFooterView *)view;
@@ -12,18 +12,240 @@
 @property (nonatomic, strong) NSDictionary *attributes;
 @end
 
+// Row changes between the items a handler received last and the ones it gets now.
+@interface FileListingChanges : NSObject
+@property (nonatomic, strong, readonly) NSIndexSet *deleted;   // rows of the previous items
+@property (nonatomic, strong, readonly) NSIndexSet *inserted;  // rows of the new items
+@property (nonatomic, strong, readonly) NSIndexSet *reloaded;  // rows of the new items whose entry changed
+@end
+
+// Called on the main queue. changes is nil when items replace whatever was
+// shown before (first page, or a reorder too large to express as row edits).
+typedef void (^FileListingHandler)(NSArray<FileItem *> *items, FileListingChanges *changes, BOOL finished);
+
+@interface FileListingRequest : NSObject
+@property (nonatomic, assign, readonly, getter=isCancelled) BOOL cancelled;
+- (void)cancel;
+@end
+
+// Called on the main queue with the matches found since the previous call, in
+// no particular order; the last call has finished set and no matches.
+typedef void (^FileSearchHandler)(NSArray<FileItem *> *matches, BOOL finished);
+
+// One line of a file that contains the searched text. Hits from the full-text
+// index name a whole file instead: line is 0 and occurrences is set.
+@interface FileContentMatch : NSObject
+@property (nonatomic, copy) NSString *path;
+@property (nonatomic, assign) unsigned long long offset;   // byte offset of the match in the file
+@property (nonatomic, assign) NSUInteger line;             // 1-based
+@property (nonatomic, copy) NSString *snippet;             // the line, trimmed around the match
+@property (nonatomic, assign) NSUInteger occurrences;
+@end
+
+typedef void (^FileContentSearchHandler)(NSArray<FileContentMatch *> *matches, BOOL finished);
+
+// Snapshot of a running copy; rates are bytes per second actually written.
+@interface FileCopyProgress : NSObject
+@property (nonatomic, copy) NSString *currentPath;
+@property (nonatomic, assign) unsigned long long fileBytesDone;
+@property (nonatomic, assign) unsigned long long fileBytesTotal;
+@property (nonatomic, assign) unsigned long long bytesDone;
+@property (nonatomic, assign) unsigned long long bytesTotal;
+@property (nonatomic, assign) NSUInteger filesDone;
+@property (nonatomic, assign) NSUInteger filesTotal;
+@property (nonatomic, assign) double fileRate;
+@property (nonatomic, assign) double rate;
+@end
+
+typedef void (^FileCopyProgressHandler)(FileCopyProgress *progress);
+typedef void (^FileCopyCompletion)(NSError *error);
+
+typedef NS_ENUM(NSInteger, FileOperationKind) {
+    FileOperationCopy,
+    FileOperationMove,
+    FileOperationDelete
+};
+
+@interface FileOperationFailure : NSObject
+@property (nonatomic, copy) NSString *path;        // the item as it was handed in
+@property (nonatomic, strong) NSError *error;      // NSPOSIXErrorDomain; NSFilePathErrorKey names the file that failed
+@end
+
+// One batch of copies, moves or deletes, planned before it starts (see
+// fs_batch.h). Every property changes on the main queue only, so it can be
+// observed with KVO as well as through the handler.
+@interface FileOperationJob : FileListingRequest
+@property (nonatomic, assign, readonly) FileOperationKind kind;
+@property (nonatomic, assign, readonly) BOOL planned;
+@property (nonatomic, assign, readonly) BOOL finished;
+@property (nonatomic, assign, readonly) NSUInteger itemCount;
+@property (nonatomic, assign, readonly) NSUInteger conflicts;          // taken names; these items got "name (1)"
+@property (nonatomic, assign, readonly) unsigned long long filesDone;
+@property (nonatomic, assign, readonly) unsigned long long filesTotal;
+@property (nonatomic, assign, readonly) unsigned long long bytesDone;
+@property (nonatomic, assign, readonly) unsigned long long bytesTotal;
+@property (nonatomic, assign, readonly) double rate;                   // bytes per second
+@property (nonatomic, assign, readonly) NSTimeInterval remainingTime;  // -1 while unknown
+@property (nonatomic, strong, readonly) NSArray<FileOperationFailure *> *failures;
+@property (nonatomic, strong, readonly) NSError *error;                 // the batch as a whole: cancelled, or could not be planned
+@end
+
+typedef void (^FileOperationHandler)(FileOperationJob *job);
+
+// Recursive size of a folder (see fs_usage.h), or of one file in it. Hard
+// links are counted once.
+@interface FileDiskUsage : NSObject
+@property (nonatomic, copy) NSString *path;
+@property (nonatomic, assign) BOOL isDirectory;
+@property (nonatomic, assign) unsigned long long size;            // apparent, as du --apparent-size
+@property (nonatomic, assign) unsigned long long allocatedSize;   // on disk
+@property (nonatomic, assign) unsigned long long fileCount;
+@property (nonatomic, assign) unsigned long long folderCount;     // the folder itself included
+@property (nonatomic, assign) BOOL finished;
+// Only on the finished root: its entries by allocated size, largest first,
+// for a treemap.
+@property (nonatomic, strong) NSArray<FileDiskUsage *> *largestItems;
+@end
+
+typedef void (^FileDiskUsageHandler)(FileDiskUsage *usage, NSError *error);
+
+// Files with identical contents (see fs_dupes.h).
+@interface FileDuplicateGroup : NSObject
+@property (nonatomic, assign) unsigned long long size;             // of each file
+@property (nonatomic, assign) unsigned long long reclaimableSize;  // freed by keeping one of them
+@property (nonatomic, copy) NSArray<NSString *> *paths;            // sorted
+@end
+
+typedef NS_ENUM(NSInteger, FileDuplicatePhase) {
+    FileDuplicatePhaseScanning,
+    FileDuplicatePhaseComparingEdges,   // first and last 4 KB of files that share a size
+    FileDuplicatePhaseHashing           // whole contents of what is left
+};
+
+// Same main-queue-only contract as FileOperationJob.
+@interface FileDuplicateSearch : FileListingRequest
+@property (nonatomic, assign, readonly) FileDuplicatePhase phase;
+@property (nonatomic, assign, readonly) BOOL finished;
+@property (nonatomic, assign, readonly) unsigned long long filesFound;
+@property (nonatomic, assign, readonly) unsigned long long filesDone;    // in the current phase
+@property (nonatomic, assign, readonly) unsigned long long filesTotal;
+@property (nonatomic, assign, readonly) unsigned long long bytesDone;    // while hashing
+@property (nonatomic, assign, readonly) unsigned long long bytesTotal;
+@property (nonatomic, strong, readonly) NSArray<FileDuplicateGroup *> *groups;   // most reclaimable first
+@property (nonatomic, assign, readonly) unsigned long long reclaimableSize;
+@property (nonatomic, strong, readonly) NSError *error;
+@end
+
+typedef void (^FileDuplicateHandler)(FileDuplicateSearch *search);
+
+typedef NS_OPTIONS(NSUInteger, FileChecksumAlgorithm) {
+    FileChecksumMD5 = 1 << 0,
+    FileChecksumSHA1 = 1 << 1,
+    FileChecksumSHA256 = 1 << 2,
+    FileChecksumCRC32 = 1 << 3,
+    FileChecksumXXH64 = 1 << 4      // xxHash64, fast but not cryptographic
+};
+
+// Checksums of one file (see fs_hash.h) as lower-case hex, keyed by
+// "md5", "sha1", "sha256", "crc32" and "xxh64"; empty when error is set.
+@interface FileChecksum : NSObject
+@property (nonatomic, copy) NSString *path;
+@property (nonatomic, assign) unsigned long long size;
+@property (nonatomic, copy) NSDictionary<NSString *, NSString *> *digests;
+@property (nonatomic, strong) NSError *error;
+@end
+
+// Same main-queue-only contract as FileOperationJob.
+@interface FileChecksumJob : FileListingRequest
+@property (nonatomic, assign, readonly) BOOL finished;
+@property (nonatomic, assign, readonly) unsigned long long filesDone;
+@property (nonatomic, assign, readonly) unsigned long long filesTotal;
+@property (nonatomic, assign, readonly) unsigned long long bytesDone;
+@property (nonatomic, assign, readonly) unsigned long long bytesTotal;
+@property (nonatomic, strong, readonly) NSArray<FileChecksum *> *checksums;   // sorted by path
+@property (nonatomic, strong, readonly) NSError *error;
+@end
+
+typedef void (^FileChecksumHandler)(FileChecksumJob *job);
+typedef void (^FileChecksumVerification)(BOOL matches, NSString *actual, NSError *error);
+
 @interface FileManagerCore : NSObject
 @property (nonatomic, strong) NSArray<NSString *> *clipboardPaths;
 @property (nonatomic, assign) BOOL isMoveOperation;
+// Entry count, size and build time of the name index; nil until one is open.
+@property (atomic, copy, readonly) NSString *searchIndexSummary;
+// Full-text index of the text files in the home directory, kept up to date in
+// the background. While enabled, content searches are answered from it with
+// ranked files; see fs_text.h for the query syntax.
+@property (nonatomic, assign) BOOL textIndexEnabled;
+@property (atomic, copy, readonly) NSString *textIndexSummary;
 + (instancetype)sharedManager;
 - (NSArray<FileItem *> *)contentsOfDirectoryAtPath:(NSString *)path;
+- (FileListingRequest *)listDirectoryAtPath:(NSString *)path handler:(FileListingHandler)handler;
+// Listings are cached per directory and watched for changes. Passing the items
+// currently on screen lets an unchanged folder answer with no I/O and a changed
+// one with just the rows that differ. Call on the main queue; the
+// "DirectoryChanged" notification (userInfo "path") reports watched folders
+// that changed on disk.
+- (FileListingRequest *)listDirectoryAtPath:(NSString *)path since:(NSArray<FileItem *> *)shown handler:(FileListingHandler)handler;
+- (void)invalidateDirectoryAtPath:(NSString *)path;
 - (BOOL)removeItemAtPath:(NSString *)path error:(NSError **)error;
 - (BOOL)copyItemAtPath:(NSString *)src toPath:(NSString *)dest error:(NSError **)error;
 - (BOOL)moveItemAtPath:(NSString *)src toPath:(NSString *)dest error:(NSError **)error;
+// Copies (or moves: a rename on the same volume, else copy then delete) in the
+// background with the fs_copy engine. Progress arrives on the main queue about
+// ten times a second; completion always runs there, with ECANCELED in
+// NSPOSIXErrorDomain after cancel. resume continues an interrupted copy to the
+// same destination instead of failing because it exists.
+- (FileListingRequest *)copyItemAtPath:(NSString *)src toPath:(NSString *)dest move:(BOOL)move resume:(BOOL)resume progress:(FileCopyProgressHandler)progress completion:(FileCopyCompletion)completion;
+// Copies or moves paths into directory, or deletes them, off the main thread.
+// Taken names get a " (n)" suffix. handler runs on the main queue once the
+// plan is known, about ten times a second while running, and a last time
+// with job.finished set.
+- (FileOperationJob *)performOperation:(FileOperationKind)kind onPaths:(NSArray<NSString *> *)paths toDirectory:(NSString *)directory handler:(FileOperationHandler)handler;
+// Measures the folder at path on a walker pool in the background. Folders
+// unchanged since an earlier measurement of path, or of a folder around it,
+// are not read again. handler runs on the main queue with running totals
+// about ten times a second, then once with usage.finished set, or with an
+// error (ECANCELED after cancel).
+- (FileListingRequest *)diskUsageAtPath:(NSString *)path handler:(FileDiskUsageHandler)handler;
+// Looks for duplicate files below paths in the background, hashing on every
+// core. Digests are kept in a cache by inode, size and mtime, so searching
+// again only reads files that changed. sha256 confirms matches with SHA-256
+// instead of a 128-bit non-cryptographic hash. handler runs on the main
+// queue about ten times a second and a last time with search.finished set.
+- (FileDuplicateSearch *)findDuplicatesInPaths:(NSArray<NSString *> *)paths sha256:(BOOL)sha256 handler:(FileDuplicateHandler)handler;
+// Checksums the file at path, or every file below the folder at path, in the
+// background. Each file is read once for all of algorithms; a folder's files
+// are spread over every core, a single file's algorithms likewise. Digests
+// share the duplicate search's cache, so unchanged files are not read again.
+// handler runs on the main queue about ten times a second and a last time
+// with job.finished set.
+- (FileChecksumJob *)computeChecksumsAtPath:(NSString *)path algorithms:(FileChecksumAlgorithm)algorithms handler:(FileChecksumHandler)handler;
+// Compares the file at path with a published checksum: hex digits in either
+// case, optionally written "sha256:…". Without a prefix the algorithm follows
+// from the length (see checksumAlgorithmForString:). completion runs on the
+// main queue with the digest found; an unrecognised checksum is EINVAL.
+- (FileListingRequest *)verifyItemAtPath:(NSString *)path checksum:(NSString *)expected completion:(FileChecksumVerification)completion;
+// 8 hex digits are CRC-32, 16 xxHash64, 32 MD5, 40 SHA-1 and 64 SHA-256; 0
+// when checksum is none of these.
++ (FileChecksumAlgorithm)checksumAlgorithmForString:(NSString *)checksum;
 - (BOOL)createSymbolicLinkAtPath:(NSString *)path withDestinationPath:(NSString *)dest error:(NSError **)error;
 - (NSArray<FileItem *> *)searchFilesWithQuery:(NSString *)query inPath:(NSString *)path recursive:(BOOL)recursive;
+// Searches names below path, from the persistent name index when path lies in
+// the home directory and otherwise on one walker thread per core. The query is a
+// substring, a glob when it contains * ? or [, or a regular expression written
+// /like this/. Letters match case-insensitively. Filter tokens narrow it:
+// size:>10M size:<1G date:>2024-01-31 date:<7d (modified within 7 days).
+- (FileListingRequest *)searchFilesWithQuery:(NSString *)query inPath:(NSString *)path handler:(FileSearchHandler)handler;
+// Searches the contents of every file below path for text, one scanner thread
+// per core. Binary files are skipped, letters match case-insensitively and at
+// most 100 lines are reported per file. Same handler contract as name search.
+- (FileListingRequest *)searchContentsForText:(NSString *)text inPath:(NSString *)path handler:(FileContentSearchHandler)handler;
 - (NSString *)copyItemAtPath:(NSString *)srcPath toDirectory:(NSString *)destDir uniqueName:(NSString *)preferredName error:(NSError **)error;
 - (NSString *)moveItemAtURL:(NSURL *)srcURL toDirectory:(NSString *)destDir uniqueName:(NSString *)preferredName error:(NSError **)error;
+// Rewrites the name index in the background and swaps it in when done.
+- (void)rebuildSearchIndex;
 + (NSString *)effectiveHomeDirectory;
 + (NSString *)relativeToHomePath:(NSString *)absolutePath;
 + (NSString *)absoluteFromHomeRelativePath:(NSString *)relativePath;
@@ -1,10 +1,356 @@
 #import "FileManagerCore.h"
 #import "Logger.h"
+#include "fs.h"
+#include "fs_batch.h"
+#include "fs_copy.h"
+#include "fs_dupes.h"
+#include "fs_grep.h"
+#include "fs_hash.h"
+#include "fs_index.h"
+#include "fs_names.h"
+#include "fs_search.h"
+#include "fs_text.h"
+#include "fs_usage.h"
+#include "fs_watch.h"
+#include <limits.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 @implementation FileItem
+
+// Listings only carry what the table needs; the full attribute set is fetched on first use.
+- (NSDictionary *)attributes {
+    if (!_attributes && _fullPath) _attributes = [[NSFileManager defaultManager] attributesOfItemAtPath:_fullPath error:nil];
+    return _attributes;
+}
+
+@end
+
+@implementation FileContentMatch
+@end
+
+@implementation FileCopyProgress
+@end
+
+@implementation FileOperationFailure
+@end
+
+@implementation FileDiskUsage
+@end
+
+@implementation FileDuplicateGroup
+@end
+
+@implementation FileChecksum
+@end
+
+// Array view over an fs_listing that creates each FileItem the first time a row asks for it.
+@interface FileListing : NSArray<FileItem *>
+- (instancetype)initWithDirectory:(NSString *)directory listing:(fs_listing *)listing order:(uint32_t *)order;
+- (instancetype)initWithDirectory:(NSString *)directory listing:(fs_listing *)listing order:(uint32_t *)order previous:(FileListing *)previous;
+- (const fs_listing *)records;
+- (const uint32_t *)order;
+@end
+
+@implementation FileListing {
+    NSString *_directory;
+    fs_listing _listing;
+    uint32_t *_order;
+    NSPointerArray *_items;
+}
+
+- (instancetype)initWithDirectory:(NSString *)directory listing:(fs_listing *)listing order:(uint32_t *)order {
+    return [self initWithDirectory:directory listing:listing order:order previous:nil];
+}
+
+// Records keep their index as a listing grows, so items already built for an
+// earlier page are carried over instead of being recreated.
+- (instancetype)initWithDirectory:(NSString *)directory listing:(fs_listing *)listing order:(uint32_t *)order previous:(FileListing *)previous {
+    self = [super init];
+    if (self) {
+        _directory = [directory copy];
+        _listing = *listing;
+        _order = order;
+        if (previous) {
+            @synchronized (previous) { _items = [previous->_items copy]; }
+        } else {
+            _items = [NSPointerArray strongObjectsPointerArray];
+        }
+        _items.count = listing->count;
+    }
+    return self;
+}
+
+- (void)dealloc {
+    fs_listing_free(&_listing);
+    free(_order);
+}
+
+- (NSUInteger)count {
+    return _listing.count;
+}
+
+- (const fs_listing *)records {
+    return &_listing;
+}
+
+- (const uint32_t *)order {
+    return _order;
+}
+
+- (id)objectAtIndex:(NSUInteger)index {
+    if (index >= _listing.count) [NSException raise:NSRangeException format:@"index %lu beyond bounds [0 .. %lu]", (unsigned long)index, (unsigned long)_listing.count];
+    uint32_t record = _order[index];
+    @synchronized (self) {
+        FileItem *item = (__bridge FileItem *)[_items pointerAtIndex:record];
+        if (!item) {
+            item = [self itemForRecord:record];
+            [_items replacePointerAtIndex:record withPointer:(__bridge void *)item];
+        }
+        return item;
+    }
+}
+
+- (FileItem *)itemForRecord:(uint32_t)i {
+    NSString *name = [[NSFileManager defaultManager] stringWithFileSystemRepresentation:fs_listing_name(&_listing, i) length:_listing.name_length[i]];
+    FileItem *item = [[FileItem alloc] init];
+    item.name = name;
+    item.fullPath = [_directory stringByAppendingPathComponent:name];
+    item.isDirectory = (_listing.flags[i] & FS_ENTRY_DIR) != 0;
+    item.isSymbolicLink = (_listing.flags[i] & FS_ENTRY_LINK) != 0;
+    if (item.isSymbolicLink) item.linkTarget = [[NSFileManager defaultManager] destinationOfSymbolicLinkAtPath:item.fullPath error:nil];
+    if (item.isDirectory) item.isLocked = access([item.fullPath fileSystemRepresentation], R_OK) != 0;
+    return item;
+}
+
+@end
+
+static NSIndexSet *FileListingIndexSet(const uint32_t *rows, size_t count) {
+    NSMutableIndexSet *set = [NSMutableIndexSet indexSet];
+    for (size_t i = 0; i < count; i++) [set addIndex:rows[i]];
+    return set;
+}
+
+@interface FileListingChanges ()
+- (instancetype)initWithDeleted:(NSIndexSet *)deleted inserted:(NSIndexSet *)inserted reloaded:(NSIndexSet *)reloaded;
 @end
 
-@implementation FileManagerCore
+@implementation FileListingChanges
+
+- (instancetype)initWithDeleted:(NSIndexSet *)deleted inserted:(NSIndexSet *)inserted reloaded:(NSIndexSet *)reloaded {
+    self = [super init];
+    if (self) {
+        _deleted = deleted ?: [NSIndexSet indexSet];
+        _inserted = inserted ?: [NSIndexSet indexSet];
+        _reloaded = reloaded ?: [NSIndexSet indexSet];
+    }
+    return self;
+}
+
++ (instancetype)changesWithDiff:(const fs_diff *)diff {
+    return [[self alloc] initWithDeleted:FileListingIndexSet(diff->removed, diff->removed_count)
+                                inserted:FileListingIndexSet(diff->inserted, diff->inserted_count)
+                                reloaded:FileListingIndexSet(diff->changed, diff->changed_count)];
+}
+
+@end
+
+static const size_t FileListingFirstPage = 200;
+static const size_t FileListingMaxPage = 16384;
+static const NSUInteger FileListingCacheLimit = 16;
+static const CFAbsoluteTime FileSearchIndexRefreshInterval = 5;
+static const size_t FileSearchIndexStaleLimit = 256;   // stale directories before a rebuild
+static const int64_t FileTextIndexUpdateDelay = 10;     // seconds after the last change
+static const size_t FileTextIndexMaxHits = 500;
+static const NSUInteger FileUsageScanLimit = 4;
+static const size_t FileUsageLargestLimit = 50;
+
+// What the browser shows as text or table documents; xlsx is a zip archive.
+static const char *const FileTextIndexExtensions[] = {
+    "plist", "xml", "json", "html", "js", "css", "csv", "tsv", "c", "cpp", "h", "m", "mm", "py", "sh", NULL
+};
+
+@interface FileListingRequest ()
+- (const volatile int *)cancelFlag;
+@end
+
+@implementation FileListingRequest {
+    volatile int _cancelled;
+}
+
+- (BOOL)isCancelled {
+    return _cancelled != 0;
+}
+
+- (void)cancel {
+    _cancelled = 1;
+}
+
+// Polled by C walkers that cannot message the request.
+- (const volatile int *)cancelFlag {
+    return &_cancelled;
+}
+
+@end
+
+static int64_t FileListingMTime(const struct stat *st) {
+    return (int64_t)st->st_mtimespec.tv_sec * 1000000000 + st->st_mtimespec.tv_nsec;
+}
+
+// Last listing of one directory together with what it was read with. Only
+// touched on the main queue.
+@interface FileListingCacheEntry : NSObject
+@property (nonatomic, copy) NSString *path;
+@property (nonatomic, strong) FileListing *listing;
+@property (nonatomic, assign) int flags;
+@property (nonatomic, assign) int sortMethod;
+@property (nonatomic, assign) int foldersFirst;
+@property (nonatomic, assign) dev_t device;
+@property (nonatomic, assign) ino_t inode;
+@property (nonatomic, assign) int64_t mtime;
+@property (nonatomic, assign) BOOL watched;
+@property (nonatomic, assign) BOOL dirty;
+@property (nonatomic, assign) NSUInteger generation;   // bumped by every change event
+@end
+
+@implementation FileListingCacheEntry
+@end
+
+// Mapped name index; the mapping stays valid until the last search holding
+// this object finishes, even after a rebuild has replaced it.
+@interface FileSearchIndex : NSObject
+@property (nonatomic, readonly) fsi_index *index;
+@property (atomic, assign) CFAbsoluteTime refreshedAt;
+- (instancetype)initWithIndex:(fsi_index *)index;
+@end
+
+@implementation FileSearchIndex
+
+- (instancetype)initWithIndex:(fsi_index *)index {
+    self = [super init];
+    if (self) _index = index;
+    return self;
+}
+
+- (void)dealloc {
+    fsi_close(_index);
+}
+
+@end
+
+// Mapped full-text index, kept alive by searches the same way.
+@interface FileTextIndex : NSObject
+@property (nonatomic, readonly) fst_index *index;
+- (instancetype)initWithIndex:(fst_index *)index;
+@end
+
+@implementation FileTextIndex
+
+- (instancetype)initWithIndex:(fst_index *)index {
+    self = [super init];
+    if (self) _index = index;
+    return self;
+}
+
+- (void)dealloc {
+    fst_close(_index);
+}
+
+@end
+
+@interface FileNameAllocator : NSObject
+@property (nonatomic, readonly) fsn_dir *dir;
+- (instancetype)initWithDir:(fsn_dir *)dir;
+@end
+
+@implementation FileNameAllocator
+
+- (instancetype)initWithDir:(fsn_dir *)dir {
+    self = [super init];
+    if (self) _dir = dir;
+    return self;
+}
+
+- (void)dealloc {
+    fsn_close(_dir);
+}
+
+@end
+
+@interface FileHashCache : NSObject
+@property (nonatomic, readonly) fsh_cache *cache;
+- (instancetype)initWithCache:(fsh_cache *)cache;
+@end
+
+@implementation FileHashCache
+
+- (instancetype)initWithCache:(fsh_cache *)cache {
+    self = [super init];
+    if (self) _cache = cache;
+    return self;
+}
+
+- (void)dealloc {
+    fsh_cache_close(_cache);
+}
+
+@end
+
+@interface FileUsageScan : NSObject
+@property (nonatomic, readonly) fsu_usage *usage;
+@property (nonatomic, readonly) NSString *root;
+- (instancetype)initWithUsage:(fsu_usage *)usage;
+@end
+
+@implementation FileUsageScan
+
+- (instancetype)initWithUsage:(fsu_usage *)usage {
+    self = [super init];
+    if (self) {
+        _usage = usage;
+        const char *root = fsu_root(usage);
+        _root = [[NSFileManager defaultManager] stringWithFileSystemRepresentation:root length:strlen(root)];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    fsu_free(_usage);
+}
+
+@end
+
+@interface FileManagerCore ()
+@property (atomic, strong) FileSearchIndex *searchIndex;
+@property (atomic, strong) FileTextIndex *textIndex;
+@property (atomic, copy, readwrite) NSString *textIndexSummary;
+@property (atomic, assign) BOOL textIndexUpdating;
+@property (atomic, assign) BOOL textIndexUpdateScheduled;
+@property (atomic, copy, readwrite) NSString *searchIndexSummary;
+@property (atomic, assign) BOOL indexRebuilding;
+@property (nonatomic, copy) NSString *indexRoot;
+@property (nonatomic, strong) dispatch_queue_t indexQueue;
+@property (atomic, assign) BOOL showHiddenFiles;
+@property (atomic, assign) BOOL foldersFirst;
+@property (atomic, assign) NSInteger sortMethod;
+@property (nonatomic, strong) NSMutableDictionary<NSString *, FileListingCacheEntry *> *listingCache;
+@property (nonatomic, strong) NSMutableArray<NSString *> *listingCacheOrder;   // least recently used first
+@property (nonatomic, strong) NSMutableDictionary<NSString *, FileNameAllocator *> *nameAllocators;   // guarded by itself
+@property (nonatomic, strong) NSMutableArray<FileUsageScan *> *usageScans;   // least recently used first; guarded by itself
+@property (nonatomic, strong) FileHashCache *hashCache;   // opened on first use; guarded by self
+- (void)directoryDidChange:(NSString *)key;
+@end
+
+// Runs on the watcher thread.
+static void FileListingWatchCallback(void *ctx, const char *path) {
+    FileManagerCore *core = (__bridge FileManagerCore *)ctx;
+    NSString *key = [[NSFileManager defaultManager] stringWithFileSystemRepresentation:path length:strlen(path)];
+    dispatch_async(dispatch_get_main_queue(), ^{ [core directoryDidChange:key]; });
+}
+
+@implementation FileManagerCore {
+    fs_watcher *_watcher;
+}
 
 + (instancetype)sharedManager {
     static FileManagerCore *shared = nil;
@@ -15,74 +361,814 @@
     return shared;
 }
 
+- (instancetype)init {
+    self = [super init];
+    if (self) {
+        [self loadListingSettings];
+        _listingCache = [NSMutableDictionary dictionary];
+        _listingCacheOrder = [NSMutableArray array];
+        _nameAllocators = [NSMutableDictionary dictionary];
+        _usageScans = [NSMutableArray array];
+        // NULL where the platform has no backend; entries are then validated by stat.
+        _watcher = fs_watch_create(FileListingWatchCallback, (__bridge void *)self);
+        _indexRoot = [FileManagerCore effectiveHomeDirectory];
+        _indexQueue = dispatch_queue_create("FileManagerCore.SearchIndex", dispatch_queue_attr_make_with_qos_class(DISPATCH_QUEUE_SERIAL, QOS_CLASS_UTILITY, 0));
+        [self openSearchIndex];
+        if (self.textIndexEnabled) [self openTextIndex];
+        [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(loadListingSettings) name:NSUserDefaultsDidChangeNotification object:nil];
+    }
+    return self;
+}
+
+// Cached so listing does not hit NSUserDefaults on every reload.
+- (void)loadListingSettings {
+    NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+    self.showHiddenFiles = [defaults boolForKey:@"ShowHiddenFiles"];
+    self.foldersFirst = [defaults objectForKey:@"FoldersFirst"] ? [defaults boolForKey:@"FoldersFirst"] : YES;
+    self.sortMethod = [defaults integerForKey:@"SortMethod"];
+}
+
 - (NSArray<FileItem *> *)contentsOfDirectoryAtPath:(NSString *)path {
-    NSFileManager *fm = [NSFileManager defaultManager];
-    NSError *error;
-    NSArray *contents = [fm contentsOfDirectoryAtPath:path error:&error];
+    int flags = self.showHiddenFiles ? FS_LIST_HIDDEN : 0;
+    NSInteger sortMethod = self.sortMethod;
+    // Name order only needs d_type; date and size orders need one fstatat per entry.
+    if (sortMethod == FS_SORT_DATE || sortMethod == FS_SORT_SIZE) flags |= FS_LIST_STAT;
 
-    if (error) return @[];
+    fs_listing listing;
+    if (fs_list_dir([path fileSystemRepresentation], flags, &listing) != 0) return @[];
 
-    BOOL showHidden = [[NSUserDefaults standardUserDefaults] boolForKey:@"ShowHiddenFiles"];
-    BOOL foldersFirst = [[NSUserDefaults standardUserDefaults] objectForKey:@"FoldersFirst"] ? [[NSUserDefaults standardUserDefaults] boolForKey:@"FoldersFirst"] : YES;
-    NSInteger sortMethod = [[NSUserDefaults standardUserDefaults] integerForKey:@"SortMethod"];
+    uint32_t *order = malloc((listing.count ? listing.count : 1) * sizeof(uint32_t));
+    if (!order) { fs_listing_free(&listing); return @[]; }
+    fs_listing_sort(&listing, (int)sortMethod, self.foldersFirst, order);
+    return [[FileListing alloc] initWithDirectory:path listing:&listing order:order];
+}
 
-    NSMutableArray *items = [NSMutableArray array];
-    for (NSString *name in contents) {
-        if (!showHidden && [name hasPrefix:@"."]) continue;
+#pragma mark - Listing Cache
 
-        NSString *fullPath = [path stringByAppendingPathComponent:name];
-        FileItem *item = [[FileItem alloc] init];
-        item.name = name;
-        item.fullPath = fullPath;
+- (NSString *)cacheKeyForPath:(NSString *)path {
+    const char *fsPath = [path fileSystemRepresentation];
+    return [[NSFileManager defaultManager] stringWithFileSystemRepresentation:fsPath length:strlen(fsPath)];
+}
 
-        NSDictionary *attrs = [fm attributesOfItemAtPath:fullPath error:nil];
-        item.attributes = attrs;
-        NSString *fileType = [attrs fileType];
-        item.isDirectory = [fileType isEqualToString:NSFileTypeDirectory];
-        item.isSymbolicLink = [fileType isEqualToString:NSFileTypeSymbolicLink];
+- (void)touchCacheKey:(NSString *)key {
+    [self.listingCacheOrder removeObject:key];
+    [self.listingCacheOrder addObject:key];
+}
 
-        if (item.isSymbolicLink) {
-            item.linkTarget = [fm destinationOfSymbolicLinkAtPath:fullPath error:nil];
-        }
+// Starts watching before the first read so changes made while it runs are not lost.
+- (FileListingCacheEntry *)insertCacheEntryForPath:(NSString *)path key:(NSString *)key flags:(int)flags sortMethod:(int)sortMethod foldersFirst:(int)foldersFirst {
+    FileListingCacheEntry *entry = [[FileListingCacheEntry alloc] init];
+    entry.path = path;
+    entry.flags = flags;
+    entry.sortMethod = sortMethod;
+    entry.foldersFirst = foldersFirst;
+    entry.watched = _watcher && fs_watch_add(_watcher, [path fileSystemRepresentation]) == 0;
+    self.listingCache[key] = entry;
+    [self touchCacheKey:key];
 
-        if (item.isDirectory) {
-            item.isLocked = ![fm isReadableFileAtPath:fullPath];
+    while (self.listingCacheOrder.count > FileListingCacheLimit) {
+        [self removeCacheEntry:self.listingCache[self.listingCacheOrder.firstObject]];
+    }
+    return entry;
+}
+
+// generation is the entry's generation when the read started; a change event
+// since then leaves the new snapshot marked stale.
+- (void)storeListing:(FileListing *)listing inEntry:(FileListingCacheEntry *)entry stat:(struct stat)st statted:(BOOL)statted generation:(NSUInteger)generation {
+    if (self.listingCache[[self cacheKeyForPath:entry.path]] != entry) return;
+    entry.listing = listing;
+    entry.device = statted ? st.st_dev : 0;
+    entry.inode = statted ? st.st_ino : 0;
+    entry.mtime = statted ? FileListingMTime(&st) : -1;
+    entry.dirty = entry.generation != generation;
+}
+
+- (void)removeCacheEntry:(FileListingCacheEntry *)entry {
+    NSString *key = [self cacheKeyForPath:entry.path];
+    if (self.listingCache[key] != entry) return;
+    if (entry.watched) fs_watch_remove(_watcher, [entry.path fileSystemRepresentation]);
+    [self.listingCache removeObjectForKey:key];
+    [self.listingCacheOrder removeObject:key];
+}
+
+- (void)directoryDidChange:(NSString *)key {
+    FileSearchIndex *searchIndex = self.searchIndex;
+    if (searchIndex) fsi_invalidate(searchIndex.index, [key fileSystemRepresentation]);
+    [self scheduleTextIndexUpdate];
+    FileListingCacheEntry *entry = self.listingCache[key];
+    if (!entry) return;
+    entry.generation++;
+    entry.dirty = YES;
+    [[NSNotificationCenter defaultCenter] postNotificationName:@"DirectoryChanged" object:self userInfo:@{@"path": entry.path}];
+}
+
+- (void)invalidateDirectoryAtPath:(NSString *)path {
+    FileSearchIndex *searchIndex = self.searchIndex;
+    if (searchIndex) fsi_invalidate(searchIndex.index, [[self cacheKeyForPath:path] fileSystemRepresentation]);
+    [self scheduleTextIndexUpdate];
+    FileListingCacheEntry *entry = self.listingCache[[self cacheKeyForPath:path]];
+    entry.generation++;
+    entry.dirty = YES;
+}
+
+#pragma mark - Listing
+
+- (FileListingRequest *)listDirectoryAtPath:(NSString *)path handler:(FileListingHandler)handler {
+    return [self listDirectoryAtPath:path since:nil handler:handler];
+}
+
+- (FileListingRequest *)listDirectoryAtPath:(NSString *)path since:(NSArray<FileItem *> *)shown handler:(FileListingHandler)handler {
+    FileListingRequest *request = [[FileListingRequest alloc] init];
+    int flags = self.showHiddenFiles ? FS_LIST_HIDDEN : 0;
+    int sortMethod = (int)self.sortMethod;
+    int foldersFirst = self.foldersFirst;
+    if (sortMethod == FS_SORT_DATE || sortMethod == FS_SORT_SIZE) flags |= FS_LIST_STAT;
+
+    NSString *key = [self cacheKeyForPath:path];
+    FileListingCacheEntry *entry = self.listingCache[key];
+    if (entry.listing && entry.flags == flags && entry.sortMethod == sortMethod && entry.foldersFirst == foldersFirst) {
+        [self touchCacheKey:key];
+        FileListing *cached = entry.listing;
+        BOOL onScreen = shown == cached;
+        if (entry.watched && !entry.dirty) {
+            // The watcher has seen nothing since this snapshot was read.
+            FileListingChanges *none = onScreen ? [[FileListingChanges alloc] initWithDeleted:nil inserted:nil reloaded:nil] : nil;
+            dispatch_async(dispatch_get_main_queue(), ^{ if (!request.isCancelled) handler(cached, none, YES); });
+            return request;
         }
-        [items addObject:item];
+        if (!onScreen) dispatch_async(dispatch_get_main_queue(), ^{ if (!request.isCancelled) handler(cached, nil, NO); });
+        [self revalidateEntry:entry request:request handler:handler];
+        return request;
     }
 
-    return [items sortedArrayUsingComparator:^NSComparisonResult(FileItem *obj1, FileItem *obj2) {
-        if (foldersFirst && obj1.isDirectory != obj2.isDirectory) {
-            return obj1.isDirectory ? NSOrderedAscending : NSOrderedDescending;
+    entry = [self insertCacheEntryForPath:path key:key flags:flags sortMethod:sortMethod foldersFirst:foldersFirst];
+    [self listPagesForEntry:entry request:request handler:handler];
+    return request;
+}
+
+// Re-reads a cached directory in one go and reports only the rows that differ
+// from the cached snapshot, which the handler is showing by now.
+- (void)revalidateEntry:(FileListingCacheEntry *)entry request:(FileListingRequest *)request handler:(FileListingHandler)handler {
+    NSString *path = entry.path;
+    FileListing *cached = entry.listing;
+    NSUInteger generation = entry.generation;
+    BOOL watched = entry.watched;
+    struct stat known = {0};
+    known.st_dev = entry.device;
+    known.st_ino = entry.inode;
+    int64_t knownMTime = entry.mtime;
+    int flags = entry.flags, sortMethod = entry.sortMethod, foldersFirst = entry.foldersFirst;
+
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+        if (request.isCancelled) return;
+        struct stat st = {0};
+        BOOL statted = stat([path fileSystemRepresentation], &st) == 0;
+        // Without a watcher the directory's own mtime is the only signal; it moves on create, delete and rename.
+        if (!watched && statted && st.st_dev == known.st_dev && st.st_ino == known.st_ino && FileListingMTime(&st) == knownMTime) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                [self storeListing:cached inEntry:entry stat:st statted:YES generation:generation];
+                if (!request.isCancelled) handler(cached, [[FileListingChanges alloc] initWithDeleted:nil inserted:nil reloaded:nil], YES);
+            });
+            return;
         }
 
-        switch (sortMethod) {
-            case 1: { // Date
-                NSDate *d1 = obj1.attributes[NSFileModificationDate];
-                NSDate *d2 = obj2.attributes[NSFileModificationDate];
-                return [d2 compare:d1]; // Newest first
+        fs_listing listing;
+        uint32_t *order = NULL;
+        FileListing *fresh = nil;
+        FileListingChanges *changes = nil;
+        if (fs_list_dir([path fileSystemRepresentation], flags, &listing) == 0) {
+            order = malloc((listing.count ? listing.count : 1) * sizeof(uint32_t));
+            if (!order) fs_listing_free(&listing);
+        }
+        if (order) {
+            fs_listing_sort(&listing, sortMethod, foldersFirst, order);
+            fs_diff diff;
+            if (fs_listing_diff(cached.records, cached.order, &listing, order, &diff) == 0) {
+                if (diff.ordered) changes = [FileListingChanges changesWithDiff:&diff];
+                fs_diff_free(&diff);
             }
-            case 2: { // Size
-                NSNumber *s1 = obj1.attributes[NSFileSize];
-                NSNumber *s2 = obj2.attributes[NSFileSize];
-                return [s2 compare:s1]; // Largest first
+            fresh = [[FileListing alloc] initWithDirectory:path listing:&listing order:order];
+        }
+
+        dispatch_async(dispatch_get_main_queue(), ^{
+            if (fresh) [self storeListing:fresh inEntry:entry stat:st statted:statted generation:generation];
+            else [self removeCacheEntry:entry];
+            if (!request.isCancelled) handler(fresh ?: @[], changes, YES);
+        });
+    });
+}
+
+- (void)listPagesForEntry:(FileListingCacheEntry *)entry request:(FileListingRequest *)request handler:(FileListingHandler)handler {
+    NSString *path = entry.path;
+    NSUInteger generation = entry.generation;
+    int flags = entry.flags, sortMethod = entry.sortMethod, foldersFirst = entry.foldersFirst;
+
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+        struct stat st = {0};
+        BOOL statted = stat([path fileSystemRepresentation], &st) == 0;
+        // complete is set on the final page of a clean read, which is then cached.
+        void (^deliver)(NSArray<FileItem *> *, FileListingChanges *, BOOL, FileListing *) = ^(NSArray<FileItem *> *items, FileListingChanges *changes, BOOL finished, FileListing *complete) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                if (complete) [self storeListing:complete inEntry:entry stat:st statted:statted generation:generation];
+                else if (finished) [self removeCacheEntry:entry];
+                if (!request.isCancelled) handler(items, changes, finished);
+            });
+        };
+
+        fs_list_cursor cursor;
+        if (fs_list_open(&cursor, [path fileSystemRepresentation], flags) != 0) { deliver(@[], nil, YES, nil); return; }
+
+        fs_listing listing;
+        memset(&listing, 0, sizeof(listing));
+        uint32_t *order = NULL;
+        size_t ordered = 0;
+        size_t page = FileListingFirstPage;
+        FileListing *previous = nil;
+
+        // Pages grow geometrically: the first one is on screen almost at once and
+        // a huge folder still needs only a handful of snapshots.
+        while (!request.isCancelled) {
+            uint32_t first = (uint32_t)listing.count;
+            int err = fs_list_read(&cursor, &listing, page);
+            BOOL finished = cursor.done || err != 0;
+
+            size_t count = listing.count;
+            uint32_t *merged = malloc((count ? count : 1) * sizeof(uint32_t));
+            uint32_t *positions = malloc((count - first ? count - first : 1) * sizeof(uint32_t));
+            fs_listing snapshot;
+            if (!merged || !positions || fs_listing_merge(&listing, sortMethod, foldersFirst, order, ordered, first, merged, positions) != 0 || fs_listing_copy(&listing, &snapshot) != 0) {
+                free(merged);
+                free(positions);
+                break;
+            }
+
+            FileListingChanges *changes = nil;
+            if (previous) {
+                NSIndexSet *inserted = FileListingIndexSet(positions, count - first);
+                changes = [[FileListingChanges alloc] initWithDeleted:nil inserted:inserted reloaded:nil];
             }
-            default: // Name
-                return [obj1.name compare:obj2.name options:NSCaseInsensitiveSearch];
+            free(positions);
+
+            uint32_t *snapshotOrder = malloc((count ? count : 1) * sizeof(uint32_t));
+            if (!snapshotOrder) { fs_listing_free(&snapshot); free(merged); break; }
+            memcpy(snapshotOrder, merged, count * sizeof(uint32_t));
+            free(order);
+            order = merged;
+            ordered = count;
+
+            FileListing *items = [[FileListing alloc] initWithDirectory:path listing:&snapshot order:snapshotOrder previous:previous];
+            previous = items;
+            // A listing cut short by a read error is shown but not cached.
+            deliver(items, changes, finished, finished && err == 0 ? items : nil);
+            if (finished) break;
+            page = MIN(page * 4, FileListingMaxPage);
         }
-    }];
+
+        free(order);
+        fs_listing_free(&listing);
+        fs_list_close(&cursor);
+    });
 }
 
 - (BOOL)removeItemAtPath:(NSString *)path error:(NSError **)error {
     return [[NSFileManager defaultManager] removeItemAtPath:path error:error];
 }
 
+#pragma mark - Copy
+
+static NSError *FileCopyError(int err, NSString *path) {
+    return [NSError errorWithDomain:NSPOSIXErrorDomain code:err userInfo:@{NSLocalizedDescriptionKey: @(strerror(err)), NSFilePathErrorKey: path ?: @""}];
+}
+
+static void FileCopyProgressSink(void *ctx, const fsc_progress *p) {
+    void (^sink)(const fsc_progress *) = (__bridge void (^)(const fsc_progress *))ctx;
+    sink(p);
+}
+
+static FileCopyProgress *FileCopyProgressMake(const fsc_progress *p) {
+    FileCopyProgress *progress = [[FileCopyProgress alloc] init];
+    progress.currentPath = p->path ? [[NSFileManager defaultManager] stringWithFileSystemRepresentation:p->path length:strlen(p->path)] : nil;
+    progress.fileBytesDone = p->file_done;
+    progress.fileBytesTotal = p->file_size;
+    progress.bytesDone = p->done;
+    progress.bytesTotal = p->total;
+    progress.filesDone = (NSUInteger)p->files_done;
+    progress.filesTotal = (NSUInteger)p->files_total;
+    progress.fileRate = p->file_rate;
+    progress.rate = p->rate;
+    return progress;
+}
+
+// Runs on the calling thread. A move renames when it can; across volumes it
+// copies with every file synced, then deletes the source.
+- (int)transferItemAtPath:(NSString *)src toPath:(NSString *)dest move:(BOOL)move flags:(int)flags progress:(void (^)(const fsc_progress *))sink cancel:(const volatile int *)cancel {
+    const char *from = [src fileSystemRepresentation];
+    const char *to = [dest fileSystemRepresentation];
+    if (move && !(flags & FSC_RESUME)) {
+        int err = fsn_rename_exclusive(from, to);
+        if (err != EXDEV) return err;
+    }
+    fsc_options options;
+    fsc_options_init(&options);
+    options.flags = flags | (move ? FSC_SYNC : 0);
+    if (sink) {
+        options.progress = FileCopyProgressSink;
+        options.ctx = (__bridge void *)sink;
+    }
+    int err = fsc_copy(from, to, &options, cancel);
+    NSError *removeError = nil;
+    if (!err && move && ![[NSFileManager defaultManager] removeItemAtPath:src error:&removeError]) {
+        [[Logger sharedLogger] log:[NSString stringWithFormat:@"[COPY] Moved %@ but could not remove it: %@", src, removeError.localizedDescription]];
+    }
+    return err;
+}
+
 - (BOOL)copyItemAtPath:(NSString *)src toPath:(NSString *)dest error:(NSError **)error {
-    return [[NSFileManager defaultManager] copyItemAtPath:src toPath:dest error:error];
+    int err = [self transferItemAtPath:src toPath:dest move:NO flags:0 progress:nil cancel:NULL];
+    if (err && error) *error = FileCopyError(err, src);
+    return err == 0;
 }
 
 - (BOOL)moveItemAtPath:(NSString *)src toPath:(NSString *)dest error:(NSError **)error {
-    return [[NSFileManager defaultManager] moveItemAtPath:src toPath:dest error:error];
+    int err = [self transferItemAtPath:src toPath:dest move:YES flags:0 progress:nil cancel:NULL];
+    if (err && error) *error = FileCopyError(err, src);
+    return err == 0;
+}
+
+- (FileListingRequest *)copyItemAtPath:(NSString *)src toPath:(NSString *)dest move:(BOOL)move resume:(BOOL)resume progress:(FileCopyProgressHandler)progress completion:(FileCopyCompletion)completion {
+    FileListingRequest *request = [[FileListingRequest alloc] init];
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+        void (^sink)(const fsc_progress *) = nil;
+        if (progress) {
+            sink = ^(const fsc_progress *p) {
+                FileCopyProgress *snapshot = FileCopyProgressMake(p);
+                dispatch_async(dispatch_get_main_queue(), ^{ if (!request.isCancelled) progress(snapshot); });
+            };
+        }
+        int err = [self transferItemAtPath:src toPath:dest move:move flags:resume ? FSC_RESUME : 0 progress:sink cancel:[request cancelFlag]];
+        if (err && err != ECANCELED) [[Logger sharedLogger] log:[NSString stringWithFormat:@"[COPY] %@ -> %@ failed: %s", src, dest, strerror(err)]];
+        NSError *error = err ? FileCopyError(err, src) : nil;
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [self invalidateDirectoryAtPath:[dest stringByDeletingLastPathComponent]];
+            if (move) [self invalidateDirectoryAtPath:[src stringByDeletingLastPathComponent]];
+            if (completion) completion(error);
+        });
+    });
+    return request;
+}
+
+#pragma mark - Batches
+
+@interface FileOperationJob ()
+@property (nonatomic, assign, readwrite) FileOperationKind kind;
+@property (nonatomic, assign, readwrite) BOOL planned;
+@property (nonatomic, assign, readwrite) BOOL finished;
+@property (nonatomic, assign, readwrite) NSUInteger itemCount;
+@property (nonatomic, assign, readwrite) NSUInteger conflicts;
+@property (nonatomic, assign, readwrite) unsigned long long filesDone;
+@property (nonatomic, assign, readwrite) unsigned long long filesTotal;
+@property (nonatomic, assign, readwrite) unsigned long long bytesDone;
+@property (nonatomic, assign, readwrite) unsigned long long bytesTotal;
+@property (nonatomic, assign, readwrite) double rate;
+@property (nonatomic, assign, readwrite) NSTimeInterval remainingTime;
+@property (nonatomic, strong, readwrite) NSArray<FileOperationFailure *> *failures;
+@property (nonatomic, strong, readwrite) NSError *error;
+@end
+
+@implementation FileOperationJob
+@end
+
+static void FileOperationProgressSink(void *ctx, const fsb_progress *p) {
+    void (^sink)(const fsb_progress *) = (__bridge void (^)(const fsb_progress *))ctx;
+    sink(p);
+}
+
+static NSString *FileOperationPath(const char *path) {
+    return [[NSFileManager defaultManager] stringWithFileSystemRepresentation:path length:strlen(path)];
+}
+
+- (FileOperationJob *)performOperation:(FileOperationKind)kind onPaths:(NSArray<NSString *> *)paths toDirectory:(NSString *)directory handler:(FileOperationHandler)handler {
+    FileOperationJob *job = [[FileOperationJob alloc] init];
+    job.kind = kind;
+    job.itemCount = paths.count;
+    job.remainingTime = -1;
+    NSArray<NSString *> *sources = [paths copy];
+    int op = kind == FileOperationCopy ? FSB_COPY : kind == FileOperationMove ? FSB_MOVE : FSB_DELETE;
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+        CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+        const char **cpaths = calloc(sources.count ?: 1, sizeof(char *));
+        for (NSUInteger i = 0; i < sources.count; i++) cpaths[i] = [sources[i] fileSystemRepresentation];
+        fsb_batch *batch = NULL;
+        int err = cpaths ? fsb_plan(op, cpaths, sources.count, directory.fileSystemRepresentation, FSB_KEEP_BOTH, [job cancelFlag], &batch) : ENOMEM;
+        free(cpaths);
+
+        fsb_summary summary = {0};
+        if (!err) {
+            fsb_get_summary(batch, &summary);
+            dispatch_async(dispatch_get_main_queue(), ^{
+                job.conflicts = (NSUInteger)summary.conflicts;
+                job.filesTotal = summary.files;
+                job.bytesTotal = summary.bytes;
+                job.planned = YES;
+                if (handler) handler(job);
+            });
+            void (^sink)(const fsb_progress *) = ^(const fsb_progress *p) {
+                unsigned long long filesDone = p->files_done, bytesDone = p->bytes_done;
+                double rate = p->rate, eta = p->eta;
+                dispatch_async(dispatch_get_main_queue(), ^{
+                    if (job.finished) return;
+                    job.filesDone = filesDone;
+                    job.bytesDone = bytesDone;
+                    job.rate = rate;
+                    job.remainingTime = eta;
+                    if (handler) handler(job);
+                });
+            };
+            fsb_options options;
+            fsb_options_init(&options);
+            options.progress = FileOperationProgressSink;
+            options.ctx = (__bridge void *)sink;
+            err = fsb_run(batch, &options, [job cancelFlag]);
+        }
+
+        NSMutableArray<FileOperationFailure *> *failures = [NSMutableArray array];
+        NSMutableSet<NSString *> *touched = [NSMutableSet set];
+        if (directory) [touched addObject:directory];
+        for (size_t i = 0; batch && i < fsb_item_count(batch); i++) {
+            if (kind != FileOperationCopy) [touched addObject:[sources[i] stringByDeletingLastPathComponent]];
+            int itemErr = fsb_item_error(batch, i);
+            if (!itemErr) continue;
+            FileOperationFailure *failure = [[FileOperationFailure alloc] init];
+            failure.path = sources[i];
+            const char *where = fsb_item_error_path(batch, i);
+            failure.error = FileCopyError(itemErr, where ? FileOperationPath(where) : sources[i]);
+            [failures addObject:failure];
+        }
+        fsb_free(batch);
+
+        NSString *verb = kind == FileOperationCopy ? @"copy" : kind == FileOperationMove ? @"move" : @"delete";
+        if (err && err != ECANCELED) {
+            [[Logger sharedLogger] log:[NSString stringWithFormat:@"[COPY] Batch %@ of %lu items failed: %s", verb, (unsigned long)sources.count, strerror(err)]];
+        } else {
+            [[Logger sharedLogger] log:[NSString stringWithFormat:@"[COPY] Batch %@: %lu items, %llu entries, %llu bytes in %.2f s, %lu failed%@", verb, (unsigned long)sources.count, summary.files, summary.bytes, CFAbsoluteTimeGetCurrent() - start, (unsigned long)failures.count, err ? @" (cancelled)" : @""]];
+        }
+        dispatch_async(dispatch_get_main_queue(), ^{
+            for (NSString *path in touched) [self invalidateDirectoryAtPath:path];
+            job.failures = failures;
+            job.error = err ? FileCopyError(err, nil) : nil;
+            job.remainingTime = 0;
+            job.finished = YES;
+            if (handler) handler(job);
+        });
+    });
+    return job;
+}
+
+#pragma mark - Disk Usage
+
+static void FileUsageProgressSink(void *ctx, const fsu_progress *p) {
+    void (^sink)(const fsu_progress *) = (__bridge void (^)(const fsu_progress *))ctx;
+    sink(p);
+}
+
+static BOOL FileUsagePathIsWithin(NSString *path, NSString *root) {
+    return [path isEqualToString:root] || [path hasPrefix:[root hasSuffix:@"/"] ? root : [root stringByAppendingString:@"/"]];
+}
+
+static FileDiskUsage *FileDiskUsageMake(NSString *path, BOOL isDirectory, const fsu_totals *totals) {
+    FileDiskUsage *usage = [[FileDiskUsage alloc] init];
+    usage.path = path;
+    usage.isDirectory = isDirectory;
+    usage.size = totals->apparent;
+    usage.allocatedSize = totals->allocated;
+    usage.fileCount = totals->files;
+    usage.folderCount = totals->dirs;
+    return usage;
+}
+
+// The most recent scan that covers path, to hand to fsu_scan as the previous one.
+- (FileUsageScan *)usageScanCoveringPath:(NSString *)path {
+    @synchronized (self.usageScans) {
+        for (FileUsageScan *scan in self.usageScans.reverseObjectEnumerator) {
+            if (FileUsagePathIsWithin(path, scan.root)) return scan;
+        }
+    }
+    return nil;
+}
+
+// Keeps scan in place of the ones it makes redundant: those of the same folder or below it.
+- (void)storeUsageScan:(FileUsageScan *)scan {
+    @synchronized (self.usageScans) {
+        NSIndexSet *covered = [self.usageScans indexesOfObjectsPassingTest:^BOOL(FileUsageScan *old, NSUInteger idx, BOOL *stop) {
+            return FileUsagePathIsWithin(old.root, scan.root);
+        }];
+        [self.usageScans removeObjectsAtIndexes:covered];
+        [self.usageScans addObject:scan];
+        while (self.usageScans.count > FileUsageScanLimit) [self.usageScans removeObjectAtIndex:0];
+    }
+}
+
+- (FileListingRequest *)diskUsageAtPath:(NSString *)path handler:(FileDiskUsageHandler)handler {
+    FileListingRequest *request = [[FileListingRequest alloc] init];
+    NSString *root = [path stringByStandardizingPath];
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+        FileUsageScan *previous = [self usageScanCoveringPath:root];
+        void (^sink)(const fsu_progress *) = ^(const fsu_progress *p) {
+            FileDiskUsage *running = [[FileDiskUsage alloc] init];
+            running.path = root;
+            running.isDirectory = YES;
+            running.allocatedSize = p->allocated;
+            running.fileCount = p->files;
+            running.folderCount = p->dirs;
+            dispatch_async(dispatch_get_main_queue(), ^{ if (!request.isCancelled && handler) handler(running, nil); });
+        };
+        fsu_options options;
+        fsu_options_init(&options);
+        options.progress = FileUsageProgressSink;
+        options.ctx = (__bridge void *)sink;
+        fsu_usage *usage = NULL;
+        int err = fsu_scan(root.fileSystemRepresentation, previous.usage, &options, [request cancelFlag], &usage);
+
+        FileDiskUsage *result = nil;
+        if (!err) {
+            FileUsageScan *scan = [[FileUsageScan alloc] initWithUsage:usage];
+            fsu_totals totals;
+            fsu_totals_at(usage, fsu_root(usage), &totals);
+            result = FileDiskUsageMake(root, YES, &totals);
+            result.finished = YES;
+            fsu_entry *entries = NULL;
+            size_t count = 0;
+            if (fsu_largest(usage, fsu_root(usage), FileUsageLargestLimit, &entries, &count) == 0) {
+                NSMutableArray<FileDiskUsage *> *largest = [NSMutableArray arrayWithCapacity:count];
+                for (size_t i = 0; i < count; i++) {
+                    NSString *name = [[NSFileManager defaultManager] stringWithFileSystemRepresentation:entries[i].name length:strlen(entries[i].name)];
+                    [largest addObject:FileDiskUsageMake([root stringByAppendingPathComponent:name], entries[i].is_dir != 0, &entries[i].totals)];
+                }
+                free(entries);
+                result.largestItems = largest;
+            }
+            fsu_stats stats;
+            fsu_get_stats(usage, &stats);
+            [[Logger sharedLogger] log:[NSString stringWithFormat:@"[SYSTEM] Disk usage of %@: %llu bytes in %llu files, %llu folders read, %llu reused, %llu unreadable, %.2f s", root, totals.allocated, totals.files, stats.dirs_read, stats.dirs_reused, stats.errors, stats.scan_ns / 1e9]];
+            [self storeUsageScan:scan];
+        } else if (err != ECANCELED) {
+            [[Logger sharedLogger] log:[NSString stringWithFormat:@"[SYSTEM] Disk usage of %@ failed: %s", root, strerror(err)]];
+        }
+        NSError *error = err ? FileCopyError(err, root) : nil;
+        dispatch_async(dispatch_get_main_queue(), ^{
+            if (handler) handler(result, error);
+        });
+    });
+    return request;
+}
+
+#pragma mark - Duplicates
+
+@interface FileDuplicateSearch ()
+@property (nonatomic, assign, readwrite) FileDuplicatePhase phase;
+@property (nonatomic, assign, readwrite) BOOL finished;
+@property (nonatomic, assign, readwrite) unsigned long long filesFound;
+@property (nonatomic, assign, readwrite) unsigned long long filesDone;
+@property (nonatomic, assign, readwrite) unsigned long long filesTotal;
+@property (nonatomic, assign, readwrite) unsigned long long bytesDone;
+@property (nonatomic, assign, readwrite) unsigned long long bytesTotal;
+@property (nonatomic, strong, readwrite) NSArray<FileDuplicateGroup *> *groups;
+@property (nonatomic, assign, readwrite) unsigned long long reclaimableSize;
+@property (nonatomic, strong, readwrite) NSError *error;
+@end
+
+@implementation FileDuplicateSearch
+@end
+
+static void FileDuplicateProgressSink(void *ctx, const fsd_progress *p) {
+    void (^sink)(const fsd_progress *) = (__bridge void (^)(const fsd_progress *))ctx;
+    sink(p);
+}
+
+- (NSString *)hashCachePath {
+    return [self.indexRoot stringByAppendingPathComponent:@"Library/Caches/.hash_cache"];
+}
+
+// Shared by every search; digests reach the disk when one finishes.
+- (FileHashCache *)sharedHashCache {
+    @synchronized (self) {
+        if (!self.hashCache) {
+            fsh_cache *cache = NULL;
+            if (fsh_cache_open([[self hashCachePath] fileSystemRepresentation], &cache) == 0) self.hashCache = [[FileHashCache alloc] initWithCache:cache];
+        }
+        return self.hashCache;
+    }
+}
+
+- (FileDuplicateSearch *)findDuplicatesInPaths:(NSArray<NSString *> *)paths sha256:(BOOL)sha256 handler:(FileDuplicateHandler)handler {
+    FileDuplicateSearch *search = [[FileDuplicateSearch alloc] init];
+    NSArray<NSString *> *roots = [paths copy];
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+        FileHashCache *cache = [self sharedHashCache];
+        const char **croots = malloc(roots.count * sizeof(char *) + 1);
+        for (NSUInteger i = 0; croots && i < roots.count; i++) croots[i] = [roots[i] fileSystemRepresentation];
+        void (^sink)(const fsd_progress *) = ^(const fsd_progress *p) {
+            fsd_progress snapshot = *p;
+            dispatch_async(dispatch_get_main_queue(), ^{
+                if (search.finished) return;
+                search.phase = snapshot.phase == FSD_PHASE_CONTENTS ? FileDuplicatePhaseHashing : snapshot.phase == FSD_PHASE_EDGES ? FileDuplicatePhaseComparingEdges : FileDuplicatePhaseScanning;
+                search.filesFound = snapshot.files;
+                search.filesDone = snapshot.done;
+                search.filesTotal = snapshot.total;
+                search.bytesDone = snapshot.bytes_done;
+                search.bytesTotal = snapshot.bytes_total;
+                if (handler) handler(search);
+            });
+        };
+        fsd_options options;
+        fsd_options_init(&options);
+        options.flags = sha256 ? FSD_SHA256 : 0;
+        options.cache = cache.cache;
+        options.progress = FileDuplicateProgressSink;
+        options.ctx = (__bridge void *)sink;
+        fsd_result *result = NULL;
+        int err = croots ? fsd_find(croots, roots.count, &options, [search cancelFlag], &result) : ENOMEM;
+        free(croots);
+        if (cache) fsh_cache_flush(cache.cache);
+
+        NSMutableArray<FileDuplicateGroup *> *groups = [NSMutableArray array];
+        fsd_summary summary = {0};
+        if (!err) {
+            fsd_get_summary(result, &summary);
+            for (size_t g = 0; g < fsd_group_count(result); g++) {
+                fsd_group group;
+                fsd_get_group(result, g, &group);
+                NSMutableArray<NSString *> *members = [NSMutableArray arrayWithCapacity:group.count];
+                for (size_t i = 0; i < group.count; i++) {
+                    const char *path = fsd_path(result, g, i);
+                    [members addObject:[[NSFileManager defaultManager] stringWithFileSystemRepresentation:path length:strlen(path)]];
+                }
+                FileDuplicateGroup *duplicate = [[FileDuplicateGroup alloc] init];
+                duplicate.size = group.size;
+                duplicate.reclaimableSize = group.reclaimable;
+                duplicate.paths = members;
+                [groups addObject:duplicate];
+            }
+            fsd_free(result);
+            [[Logger sharedLogger] log:[NSString stringWithFormat:@"[SEARCH] Duplicates: %llu files, %llu groups, %llu bytes reclaimable, %llu bytes hashed, %llu cached digests, %.2f s", summary.files, summary.groups, summary.reclaimable, summary.bytes_hashed, summary.cached, summary.scan_ns / 1e9]];
+        } else if (err != ECANCELED) {
+            [[Logger sharedLogger] log:[NSString stringWithFormat:@"[SEARCH] Duplicate search failed: %s", strerror(err)]];
+        }
+        dispatch_async(dispatch_get_main_queue(), ^{
+            search.groups = groups;
+            search.reclaimableSize = summary.reclaimable;
+            search.error = err ? FileCopyError(err, nil) : nil;
+            search.finished = YES;
+            if (handler) handler(search);
+        });
+    });
+    return search;
+}
+
+#pragma mark - Checksums
+
+@interface FileChecksumJob ()
+@property (nonatomic, assign, readwrite) BOOL finished;
+@property (nonatomic, assign, readwrite) unsigned long long filesDone;
+@property (nonatomic, assign, readwrite) unsigned long long filesTotal;
+@property (nonatomic, assign, readwrite) unsigned long long bytesDone;
+@property (nonatomic, assign, readwrite) unsigned long long bytesTotal;
+@property (nonatomic, strong, readwrite) NSArray<FileChecksum *> *checksums;
+@property (nonatomic, strong, readwrite) NSError *error;
+@end
+
+@implementation FileChecksumJob
+@end
+
+static const struct {
+    FileChecksumAlgorithm option;
+    int algo;
+} FileChecksumAlgorithms[] = {
+    {FileChecksumMD5, FSH_MD5},
+    {FileChecksumSHA1, FSH_SHA1},
+    {FileChecksumSHA256, FSH_SHA256},
+    {FileChecksumCRC32, FSH_CRC32},
+    {FileChecksumXXH64, FSH_XXH64},
+};
+
+static void FileChecksumProgressSink(void *ctx, const fsh_progress *p) {
+    void (^sink)(const fsh_progress *) = (__bridge void (^)(const fsh_progress *))ctx;
+    sink(p);
+}
+
+// The fs_hash algorithm of a published checksum, or 0; hex gets its digits
+// in lower case.
+static int FileChecksumParse(NSString *checksum, NSString **hex) {
+    NSString *text = [[checksum stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]] lowercaseString];
+    NSString *name = nil;
+    NSRange colon = [text rangeOfString:@":"];
+    if (colon.location != NSNotFound) {
+        name = [text substringToIndex:colon.location];
+        text = [text substringFromIndex:NSMaxRange(colon)];
+    }
+    NSCharacterSet *nonHex = [[NSCharacterSet characterSetWithCharactersInString:@"0123456789abcdef"] invertedSet];
+    if (text.length == 0 || [text rangeOfCharacterFromSet:nonHex].location != NSNotFound) return 0;
+    for (size_t i = 0; i < sizeof(FileChecksumAlgorithms) / sizeof(FileChecksumAlgorithms[0]); i++) {
+        int algo = FileChecksumAlgorithms[i].algo;
+        if (name && ![name isEqualToString:@(fsh_name(algo))]) continue;
+        if (text.length != 2 * fsh_digest_size(algo)) continue;
+        if (hex) *hex = text;
+        return algo;
+    }
+    return 0;
+}
+
++ (FileChecksumAlgorithm)checksumAlgorithmForString:(NSString *)checksum {
+    int algo = FileChecksumParse(checksum, NULL);
+    for (size_t i = 0; i < sizeof(FileChecksumAlgorithms) / sizeof(FileChecksumAlgorithms[0]); i++)
+        if (FileChecksumAlgorithms[i].algo == algo) return FileChecksumAlgorithms[i].option;
+    return 0;
+}
+
+- (FileChecksumJob *)computeChecksumsAtPath:(NSString *)path algorithms:(FileChecksumAlgorithm)algorithms handler:(FileChecksumHandler)handler {
+    FileChecksumJob *job = [[FileChecksumJob alloc] init];
+    NSString *root = [path copy];
+    unsigned algos = 0;
+    for (size_t i = 0; i < sizeof(FileChecksumAlgorithms) / sizeof(FileChecksumAlgorithms[0]); i++)
+        if (algorithms & FileChecksumAlgorithms[i].option) algos |= FSH_BIT(FileChecksumAlgorithms[i].algo);
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+        FileHashCache *cache = [self sharedHashCache];
+        void (^sink)(const fsh_progress *) = ^(const fsh_progress *p) {
+            fsh_progress snapshot = *p;
+            dispatch_async(dispatch_get_main_queue(), ^{
+                if (job.finished) return;
+                job.filesDone = snapshot.files_done;
+                job.filesTotal = snapshot.files_total;
+                job.bytesDone = snapshot.bytes_done;
+                job.bytesTotal = snapshot.bytes_total;
+                if (handler) handler(job);
+            });
+        };
+        fsh_options options;
+        fsh_options_init(&options);
+        options.algos = algos;
+        options.cache = cache.cache;
+        options.progress = FileChecksumProgressSink;
+        options.ctx = (__bridge void *)sink;
+        CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+        fsh_files *files = NULL;
+        int err = fsh_hash_path([root fileSystemRepresentation], &options, [job cancelFlag], &files);
+        if (cache) fsh_cache_flush(cache.cache);
+
+        NSMutableArray<FileChecksum *> *checksums = [NSMutableArray array];
+        if (!err) {
+            for (size_t i = 0; i < fsh_files_count(files); i++) {
+                const char *cpath = fsh_files_path(files, i);
+                FileChecksum *checksum = [[FileChecksum alloc] init];
+                checksum.path = [[NSFileManager defaultManager] stringWithFileSystemRepresentation:cpath length:strlen(cpath)];
+                checksum.size = fsh_files_size(files, i);
+                NSMutableDictionary<NSString *, NSString *> *digests = [NSMutableDictionary dictionary];
+                for (int algo = 1; algo < FSH_ALGO_COUNT; algo++) {
+                    const uint8_t *digest = fsh_files_digest(files, i, algo);
+                    if (!digest) continue;
+                    char hex[2 * FSH_DIGEST_MAX + 1];
+                    fsh_hex(digest, fsh_digest_size(algo), hex);
+                    digests[@(fsh_name(algo))] = @(hex);
+                }
+                checksum.digests = digests;
+                if (fsh_files_error(files, i)) checksum.error = FileCopyError(fsh_files_error(files, i), checksum.path);
+                [checksums addObject:checksum];
+            }
+            fsh_files_free(files);
+            [[Logger sharedLogger] log:[NSString stringWithFormat:@"[SYSTEM] Checksums of %@: %lu files, %.2f s", root, (unsigned long)checksums.count, CFAbsoluteTimeGetCurrent() - start]];
+        } else if (err != ECANCELED) {
+            [[Logger sharedLogger] log:[NSString stringWithFormat:@"[SYSTEM] Checksums of %@ failed: %s", root, strerror(err)]];
+        }
+        dispatch_async(dispatch_get_main_queue(), ^{
+            job.checksums = checksums;
+            job.error = err ? FileCopyError(err, root) : nil;
+            job.finished = YES;
+            if (handler) handler(job);
+        });
+    });
+    return job;
+}
+
+- (FileListingRequest *)verifyItemAtPath:(NSString *)path checksum:(NSString *)expected completion:(FileChecksumVerification)completion {
+    NSString *hex = nil;
+    int algo = FileChecksumParse(expected, &hex);
+    if (!algo) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            if (completion) completion(NO, nil, FileCopyError(EINVAL, path));
+        });
+        return [[FileListingRequest alloc] init];
+    }
+    FileChecksumAlgorithm option = [FileManagerCore checksumAlgorithmForString:expected];
+    NSString *name = @(fsh_name(algo));
+    return [self computeChecksumsAtPath:path algorithms:option handler:^(FileChecksumJob *job) {
+        if (!job.finished) return;
+        NSError *error = job.error;
+        if (!error && job.checksums.count != 1) error = FileCopyError(EISDIR, path);
+        if (!error) error = job.checksums.firstObject.error;
+        NSString *actual = error ? nil : job.checksums.firstObject.digests[name];
+        if (!error) [[Logger sharedLogger] log:[NSString stringWithFormat:@"[SYSTEM] %@ %@ of %@", name, [actual isEqualToString:hex] ? @"matches" : @"does not match", path]];
+        if (completion) completion(actual && [actual isEqualToString:hex], actual, error);
+    }];
 }
 
 - (BOOL)createSymbolicLinkAtPath:(NSString *)path withDestinationPath:(NSString *)dest error:(NSError **)error {
@@ -92,44 +1178,358 @@
     return [[NSFileManager defaultManager] createSymbolicLinkAtPath:path withDestinationPath:dest error:error];
 }
 
+#pragma mark - Search Index
+
+- (NSString *)searchIndexPath {
+    return [self.indexRoot stringByAppendingPathComponent:@"Library/Caches/.search_index"];
+}
+
+// Maps the index left by the last run, or builds one if there is none yet or
+// too much of it has gone stale.
+- (void)openSearchIndex {
+    dispatch_async(self.indexQueue, ^{
+        fsi_index *index = NULL;
+        int err = fsi_open([[self searchIndexPath] fileSystemRepresentation], &index);
+        if (!err && strcmp(fsi_root(index), [self.indexRoot fileSystemRepresentation]) != 0) {
+            fsi_close(index);
+            err = ESTALE;
+        }
+        if (err) {
+            if (err != ENOENT) [[Logger sharedLogger] log:[NSString stringWithFormat:@"[INDEX] Discarding index: %s", strerror(err)]];
+            [self rebuildSearchIndex];
+            return;
+        }
+        if ([self installSearchIndex:index] > FileSearchIndexStaleLimit) [self rebuildSearchIndex];
+    });
+}
+
+- (void)rebuildSearchIndex {
+    @synchronized (self) {
+        if (self.indexRebuilding) return;
+        self.indexRebuilding = YES;
+    }
+    dispatch_async(self.indexQueue, ^{
+        const char *file = [[self searchIndexPath] fileSystemRepresentation];
+        fsi_index *index = NULL;
+        int err = fsi_build([self.indexRoot fileSystemRepresentation], file, NULL, NULL);
+        if (!err) err = fsi_open(file, &index);
+        if (err) [[Logger sharedLogger] log:[NSString stringWithFormat:@"[INDEX] Build failed: %s", strerror(err)]];
+        else [self installSearchIndex:index];
+        self.indexRebuilding = NO;
+    });
+}
+
+// Checks stamps against the disk once, then publishes the index. Returns the
+// number of stale directories.
+- (size_t)installSearchIndex:(fsi_index *)index {
+    size_t stale = fsi_refresh(index, fsi_root(index), NULL);
+    FileSearchIndex *searchIndex = [[FileSearchIndex alloc] initWithIndex:index];
+    searchIndex.refreshedAt = CFAbsoluteTimeGetCurrent();
+    self.searchIndex = searchIndex;
+
+    fsi_stats stats;
+    fsi_get_stats(index, &stats);
+    NSString *size = [NSByteCountFormatter stringFromByteCount:(long long)stats.file_size countStyle:NSByteCountFormatterCountStyleFile];
+    self.searchIndexSummary = [NSString stringWithFormat:@"%llu 件 / %@ / %.0f ms", stats.entries, size, stats.build_ns / 1e6];
+    [[Logger sharedLogger] log:[NSString stringWithFormat:@"[INDEX] %llu paths in %llu folders, %@ on disk, built in %.0f ms, %zu stale", stats.entries, stats.dirs, size, stats.build_ns / 1e6, stale]];
+    return stale;
+}
+
+#pragma mark - Text Index
+
+- (NSString *)textIndexPath {
+    return [self.indexRoot stringByAppendingPathComponent:@"Library/Caches/.text_index"];
+}
+
+- (BOOL)textIndexEnabled {
+    return [[NSUserDefaults standardUserDefaults] boolForKey:@"TextIndexEnabled"];
+}
+
+- (void)setTextIndexEnabled:(BOOL)enabled {
+    [[NSUserDefaults standardUserDefaults] setBool:enabled forKey:@"TextIndexEnabled"];
+    if (enabled) {
+        [self openTextIndex];
+        return;
+    }
+    dispatch_async(self.indexQueue, ^{
+        self.textIndex = nil;
+        self.textIndexSummary = nil;
+        unlink([[self textIndexPath] fileSystemRepresentation]);
+    });
+}
+
+// Publishes the index left by the last run right away, then brings it up to
+// date; only files changed since then are read again.
+- (void)openTextIndex {
+    dispatch_async(self.indexQueue, ^{
+        fst_index *index = NULL;
+        if (!self.textIndex && fst_open([[self textIndexPath] fileSystemRepresentation], &index) == 0) {
+            if (strcmp(fst_root(index), [self.indexRoot fileSystemRepresentation]) == 0) [self installTextIndex:index];
+            else fst_close(index);
+        }
+        [self updateTextIndex];
+    });
+}
+
+- (void)scheduleTextIndexUpdate {
+    if (!self.textIndexEnabled) return;
+    @synchronized (self) {
+        if (self.textIndexUpdateScheduled) return;
+        self.textIndexUpdateScheduled = YES;
+    }
+    // Coalesces a burst of changes into one update.
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, FileTextIndexUpdateDelay * NSEC_PER_SEC), self.indexQueue, ^{
+        self.textIndexUpdateScheduled = NO;
+        [self updateTextIndex];
+    });
+}
+
+- (void)updateTextIndex {
+    @synchronized (self) {
+        if (self.textIndexUpdating) return;
+        self.textIndexUpdating = YES;
+    }
+    dispatch_async(self.indexQueue, ^{
+        if (!self.textIndexEnabled) {
+            self.textIndexUpdating = NO;
+            return;
+        }
+        const char *file = [[self textIndexPath] fileSystemRepresentation];
+        fst_index *index = NULL;
+        fst_stats stats;
+        int err = fst_build([self.indexRoot fileSystemRepresentation], file, FileTextIndexExtensions, NULL, &stats);
+        if (!err) err = fst_open(file, &index);
+        if (err) [[Logger sharedLogger] log:[NSString stringWithFormat:@"[INDEX] Text index update failed: %s", strerror(err)]];
+        else {
+            [[Logger sharedLogger] log:[NSString stringWithFormat:@"[INDEX] Text index: %llu files, %llu read (%llu bytes) in %.0f ms", stats.docs, stats.docs_read, stats.bytes_read, stats.build_ns / 1e6]];
+            [self installTextIndex:index];
+        }
+        self.textIndexUpdating = NO;
+    });
+}
+
+- (void)installTextIndex:(fst_index *)index {
+    self.textIndex = [[FileTextIndex alloc] initWithIndex:index];
+    fst_stats stats;
+    fst_get_stats(index, &stats);
+    NSString *size = [NSByteCountFormatter stringFromByteCount:(long long)stats.file_size countStyle:NSByteCountFormatterCountStyleFile];
+    self.textIndexSummary = [NSString stringWithFormat:@"%llu 件 / %llu 語 / %@", stats.docs, stats.terms, size];
+}
+
+#pragma mark - Search
+
+// "10M" -> bytes; K, M and G are powers of 1024 and a trailing B is ignored.
+static BOOL FileSearchParseSize(NSString *text, int64_t *bytes) {
+    NSScanner *scanner = [NSScanner scannerWithString:text.uppercaseString];
+    double value;
+    if (![scanner scanDouble:&value] || value < 0) return NO;
+    NSString *unit = [text.uppercaseString substringFromIndex:scanner.scanLocation];
+    if ([unit hasSuffix:@"B"]) unit = [unit substringToIndex:unit.length - 1];
+    NSDictionary<NSString *, NSNumber *> *scale = @{@"": @1, @"K": @1024, @"M": @(1024 * 1024), @"G": @(1024.0 * 1024 * 1024)};
+    if (!scale[unit]) return NO;
+    *bytes = (int64_t)(value * scale[unit].doubleValue);
+    return YES;
+}
+
+// "2024-01-31" -> local midnight, or an age such as "7d" / "12h" -> now minus that.
+static BOOL FileSearchParseDate(NSString *text, int64_t *seconds, BOOL *relative) {
+    unichar last = text.length ? [text characterAtIndex:text.length - 1] : 0;
+    if (last == 'd' || last == 'h') {
+        NSInteger amount = [[text substringToIndex:text.length - 1] integerValue];
+        if (amount <= 0) return NO;
+        *seconds = (int64_t)[[NSDate date] timeIntervalSince1970] - amount * (last == 'd' ? 86400 : 3600);
+        *relative = YES;
+        return YES;
+    }
+    NSDateFormatter *formatter = [[NSDateFormatter alloc] init];
+    formatter.locale = [NSLocale localeWithLocaleIdentifier:@"en_US_POSIX"];
+    formatter.dateFormat = @"yyyy-MM-dd";
+    NSDate *date = [formatter dateFromString:text];
+    if (!date) return NO;
+    *seconds = (int64_t)date.timeIntervalSince1970;
+    *relative = NO;
+    return YES;
+}
+
+// Splits filter tokens off the query and picks the match mode from what is left.
+- (NSString *)searchQuery:(fss_query *)q fromString:(NSString *)query {
+    fss_query_init(q);
+    q->flags = self.showHiddenFiles ? FSS_HIDDEN : 0;
+    NSMutableArray<NSString *> *words = [NSMutableArray array];
+    for (NSString *token in [query componentsSeparatedByCharactersInSet:[NSCharacterSet whitespaceCharacterSet]]) {
+        if (token.length == 0) continue;
+        NSString *lower = token.lowercaseString;
+        BOOL isSize = [lower hasPrefix:@"size:"], isDate = [lower hasPrefix:@"date:"];
+        if ((isSize || isDate) && token.length > 6) {
+            unichar op = [token characterAtIndex:5];
+            NSString *value = [token substringFromIndex:6];
+            int64_t number;
+            BOOL relative = NO;
+            if ((op == '>' || op == '<') && isSize && FileSearchParseSize(value, &number)) {
+                if (op == '>') q->min_size = number + 1; else q->max_size = MAX(number - 1, 0);
+                continue;
+            }
+            if ((op == '>' || op == '<') && isDate && FileSearchParseDate(value, &number, &relative)) {
+                // For ages "<7d" means newer than seven days; for dates ">" means after.
+                BOOL newer = relative ? op == '<' : op == '>';
+                if (newer) q->newer_than = number; else q->older_than = number;
+                continue;
+            }
+        }
+        [words addObject:token];
+    }
+
+    NSString *pattern = [[words componentsJoinedByString:@" "] precomposedStringWithCanonicalMapping];
+    if (pattern.length > 2 && [pattern hasPrefix:@"/"] && [pattern hasSuffix:@"/"]) {
+        q->match = FSS_MATCH_REGEX;
+        pattern = [pattern substringWithRange:NSMakeRange(1, pattern.length - 2)];
+    } else if ([pattern rangeOfCharacterFromSet:[NSCharacterSet characterSetWithCharactersInString:@"*?["]].location != NSNotFound) {
+        q->match = FSS_MATCH_GLOB;
+    }
+    return pattern;
+}
+
+static FileItem *FileSearchItem(const fss_match *m) {
+    NSString *path = [[NSFileManager defaultManager] stringWithFileSystemRepresentation:m->path length:strlen(m->path)];
+    FileItem *item = [[FileItem alloc] init];
+    item.name = [path lastPathComponent];
+    item.fullPath = path;
+    item.isDirectory = (m->flags & FS_ENTRY_DIR) != 0;
+    item.isSymbolicLink = (m->flags & FS_ENTRY_LINK) != 0;
+    if (item.isSymbolicLink) item.linkTarget = [[NSFileManager defaultManager] destinationOfSymbolicLinkAtPath:path error:nil];
+    return item;
+}
+
+static int FileSearchBatch(void *ctx, const fss_match *matches, size_t count) {
+    BOOL (^sink)(const fss_match *, size_t) = (__bridge BOOL (^)(const fss_match *, size_t))ctx;
+    return sink(matches, count) ? 0 : 1;
+}
+
+// Answers from the name index when path lies inside it, checking directory
+// stamps at most every few seconds; anything else is walked live.
+- (int)runSearch:(const fss_query *)q inPath:(NSString *)path sink:(BOOL (^)(const fss_match *, size_t))sink cancel:(const volatile int *)cancel {
+    const char *root = [[self cacheKeyForPath:path] fileSystemRepresentation];
+    FileSearchIndex *searchIndex = self.searchIndex;
+    int err = ENOENT;
+    if (searchIndex) {
+        CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+        if (now - searchIndex.refreshedAt > FileSearchIndexRefreshInterval) {
+            searchIndex.refreshedAt = now;
+            if (fsi_refresh(searchIndex.index, root, cancel) > FileSearchIndexStaleLimit) [self rebuildSearchIndex];
+        }
+        err = fsi_search(searchIndex.index, root, q, FileSearchBatch, (__bridge void *)sink, cancel);
+    }
+    if (err == ENOENT) err = fss_search(root, q, FileSearchBatch, (__bridge void *)sink, cancel);
+    return err;
+}
+
+- (FileListingRequest *)searchFilesWithQuery:(NSString *)query inPath:(NSString *)path handler:(FileSearchHandler)handler {
+    FileListingRequest *request = [[FileListingRequest alloc] init];
+    fss_query q;
+    NSString *pattern = [self searchQuery:&q fromString:query ?: @""];
+
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+        fss_query search = q;
+        search.pattern = [pattern UTF8String];
+        BOOL (^sink)(const fss_match *, size_t) = ^BOOL(const fss_match *matches, size_t count) {
+            NSMutableArray<FileItem *> *batch = [NSMutableArray arrayWithCapacity:count];
+            for (size_t i = 0; i < count; i++) [batch addObject:FileSearchItem(&matches[i])];
+            dispatch_async(dispatch_get_main_queue(), ^{ if (!request.isCancelled) handler(batch, NO); });
+            return !request.isCancelled;
+        };
+        int err = [self runSearch:&search inPath:path sink:sink cancel:[request cancelFlag]];
+        if (err && err != ECANCELED) [[Logger sharedLogger] log:[NSString stringWithFormat:@"[SEARCH] %@ in %@ failed: %s", query, path, strerror(err)]];
+        dispatch_async(dispatch_get_main_queue(), ^{ if (!request.isCancelled) handler(@[], YES); });
+    });
+    return request;
+}
+
+static FileContentMatch *FileContentMatchMake(const fsg_match *m) {
+    FileContentMatch *match = [[FileContentMatch alloc] init];
+    match.path = [[NSFileManager defaultManager] stringWithFileSystemRepresentation:m->path length:strlen(m->path)];
+    match.offset = m->offset;
+    match.line = (NSUInteger)m->line;
+    // Snippets of non-UTF-8 text still show up, byte for byte.
+    match.snippet = [[NSString alloc] initWithBytes:m->snippet length:m->snippet_length encoding:NSUTF8StringEncoding]
+                 ?: [[NSString alloc] initWithBytes:m->snippet length:m->snippet_length encoding:NSISOLatin1StringEncoding];
+    return match;
+}
+
+static int FileContentSearchBatch(void *ctx, const fsg_match *matches, size_t count) {
+    BOOL (^sink)(const fsg_match *, size_t) = (__bridge BOOL (^)(const fsg_match *, size_t))ctx;
+    return sink(matches, count) ? 0 : 1;
+}
+
+// Ranked files from the text index, or nil when it cannot answer the query.
+- (NSArray<FileContentMatch *> *)indexedMatchesForText:(NSString *)text inPath:(NSString *)path index:(FileTextIndex *)textIndex {
+    fst_hit *hits = malloc(FileTextIndexMaxHits * sizeof(fst_hit));
+    if (!hits) return nil;
+    size_t count = 0;
+    int err = fst_search(textIndex.index, [[self cacheKeyForPath:path] fileSystemRepresentation], [text UTF8String], hits, FileTextIndexMaxHits, &count);
+    NSMutableArray<FileContentMatch *> *matches = err ? nil : [NSMutableArray arrayWithCapacity:count];
+    NSString *root = [[NSFileManager defaultManager] stringWithFileSystemRepresentation:fst_root(textIndex.index) length:strlen(fst_root(textIndex.index))];
+    for (size_t i = 0; i < count; i++) {
+        FileContentMatch *match = [[FileContentMatch alloc] init];
+        match.path = [root stringByAppendingPathComponent:[[NSFileManager defaultManager] stringWithFileSystemRepresentation:hits[i].path length:strlen(hits[i].path)]];
+        match.occurrences = hits[i].count;
+        [matches addObject:match];
+    }
+    free(hits);
+    return matches;
+}
+
+- (FileListingRequest *)searchContentsForText:(NSString *)text inPath:(NSString *)path handler:(FileContentSearchHandler)handler {
+    FileListingRequest *request = [[FileListingRequest alloc] init];
+    NSString *pattern = [text precomposedStringWithCanonicalMapping];
+    int flags = self.showHiddenFiles ? FSG_HIDDEN : 0;
+    FileTextIndex *textIndex = self.textIndexEnabled ? self.textIndex : nil;
+
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+        // Paths outside the home directory and queries without a word fall
+        // back to scanning.
+        NSArray<FileContentMatch *> *indexed = textIndex ? [self indexedMatchesForText:pattern inPath:path index:textIndex] : nil;
+        if (indexed) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                if (request.isCancelled) return;
+                handler(indexed, NO);
+                handler(@[], YES);
+            });
+            return;
+        }
+        fsg_query q;
+        fsg_query_init(&q);
+        q.pattern = [pattern UTF8String];
+        q.flags = flags;
+        q.max_per_file = 100;
+        BOOL (^sink)(const fsg_match *, size_t) = ^BOOL(const fsg_match *matches, size_t count) {
+            NSMutableArray<FileContentMatch *> *batch = [NSMutableArray arrayWithCapacity:count];
+            for (size_t i = 0; i < count; i++) [batch addObject:FileContentMatchMake(&matches[i])];
+            dispatch_async(dispatch_get_main_queue(), ^{ if (!request.isCancelled) handler(batch, NO); });
+            return !request.isCancelled;
+        };
+        int err = fsg_search([[self cacheKeyForPath:path] fileSystemRepresentation], &q, FileContentSearchBatch, (__bridge void *)sink, [request cancelFlag]);
+        if (err && err != ECANCELED) [[Logger sharedLogger] log:[NSString stringWithFormat:@"[SEARCH] Content %@ in %@ failed: %s", text, path, strerror(err)]];
+        dispatch_async(dispatch_get_main_queue(), ^{ if (!request.isCancelled) handler(@[], YES); });
+    });
+    return request;
+}
+
 - (NSArray<FileItem *> *)searchFilesWithQuery:(NSString *)query inPath:(NSString *)path recursive:(BOOL)recursive {
     if (!query || query.length == 0) return @[];
 
+    fss_query q;
+    NSString *pattern = [self searchQuery:&q fromString:query];
     NSMutableArray *results = [NSMutableArray array];
-    NSFileManager *fm = [NSFileManager defaultManager];
-    NSString *lowerQuery = [query lowercaseString];
 
     if (recursive) {
-        NSArray *keys = @[NSURLNameKey, NSURLIsDirectoryKey, NSURLIsSymbolicLinkKey];
-        NSDirectoryEnumerator *enumerator = [fm enumeratorAtURL:[NSURL fileURLWithPath:path]
-                                     includingPropertiesForKeys:keys
-                                                        options:NSDirectoryEnumerationSkipsHiddenFiles
-                                                   errorHandler:^BOOL(NSURL *url, NSError *error) { return YES; }];
-
-        for (NSURL *url in enumerator) {
-            NSString *filename;
-            [url getResourceValue:&filename forKey:NSURLNameKey error:nil];
-
-            if ([filename.lowercaseString containsString:lowerQuery]) {
-                FileItem *item = [[FileItem alloc] init];
-                item.name = filename;
-                item.fullPath = url.path;
-
-                NSNumber *isDir;
-                [url getResourceValue:&isDir forKey:NSURLIsDirectoryKey error:nil];
-                item.isDirectory = [isDir boolValue];
-
-                NSNumber *isSym;
-                [url getResourceValue:&isSym forKey:NSURLIsSymbolicLinkKey error:nil];
-                item.isSymbolicLink = [isSym boolValue];
-
-                if (item.isSymbolicLink) {
-                    item.linkTarget = [fm destinationOfSymbolicLinkAtPath:url.path error:nil];
-                }
-                [results addObject:item];
-            }
-        }
+        q.pattern = [pattern UTF8String];
+        BOOL (^sink)(const fss_match *, size_t) = ^BOOL(const fss_match *matches, size_t count) {
+            for (size_t i = 0; i < count; i++) [results addObject:FileSearchItem(&matches[i])];
+            return YES;
+        };
+        [self runSearch:&q inPath:path sink:sink cancel:NULL];
     } else {
+        NSString *lowerQuery = [pattern lowercaseString];
         NSArray *items = [self contentsOfDirectoryAtPath:path];
         for (FileItem *item in items) {
             if ([item.name.lowercaseString containsString:lowerQuery]) {
@@ -143,53 +1543,62 @@
 
 
 - (NSString *)copyItemAtPath:(NSString *)srcPath toDirectory:(NSString *)destDir uniqueName:(NSString *)preferredName error:(NSError **)error {
-    return [self moveItemAtURL:[NSURL fileURLWithPath:srcPath] toDirectory:destDir uniqueName:preferredName error:error];
+    return [self placeItemAtPath:srcPath toDirectory:destDir uniqueName:preferredName move:NO error:error];
 }
 
 - (NSString *)moveItemAtURL:(NSURL *)srcURL toDirectory:(NSString *)destDir uniqueName:(NSString *)preferredName error:(NSError **)error {
-    NSFileManager *fm = [NSFileManager defaultManager];
-    NSString *baseName = preferredName ?: [srcURL lastPathComponent];
-    NSString *nameWithoutExtension = [baseName stringByDeletingPathExtension];
-    NSString *extension = [baseName pathExtension];
-
-    NSString *destPath = [destDir stringByAppendingPathComponent:baseName];
-    NSString *finalName = baseName;
-
-    int counter = 1;
-    while ([fm fileExistsAtPath:destPath]) {
-        if (extension.length > 0) {
-            finalName = [NSString stringWithFormat:@"%@ (%d).%@", nameWithoutExtension, counter, extension];
-        } else {
-            finalName = [NSString stringWithFormat:@"%@ (%d)", nameWithoutExtension, counter];
+    return [self placeItemAtPath:srcURL.path toDirectory:destDir uniqueName:preferredName move:YES error:error];
+}
+
+// Allocators are kept per destination, which makes a burst of imports into
+// one folder cost a single scan; each notices outside changes by itself.
+- (FileNameAllocator *)nameAllocatorForDirectory:(NSString *)directory error:(int *)error {
+    @synchronized (self.nameAllocators) {
+        FileNameAllocator *allocator = self.nameAllocators[directory];
+        if (allocator) return allocator;
+        fsn_dir *dir = NULL;
+        int err = fsn_open([directory fileSystemRepresentation], &dir);
+        if (err == ENOENT && [[NSFileManager defaultManager] createDirectoryAtPath:directory withIntermediateDirectories:YES attributes:nil error:nil]) {
+            err = fsn_open([directory fileSystemRepresentation], &dir);
+        }
+        if (err) {
+            *error = err;
+            return nil;
         }
-        destPath = [destDir stringByAppendingPathComponent:finalName];
-        counter++;
+        if (self.nameAllocators.count >= FileListingCacheLimit) [self.nameAllocators removeAllObjects];
+        allocator = [[FileNameAllocator alloc] initWithDir:dir];
+        self.nameAllocators[directory] = allocator;
+        return allocator;
     }
+}
 
-    [fm createDirectoryAtPath:destDir withIntermediateDirectories:YES attributes:nil error:nil];
-
-    NSError *moveError = nil;
-    BOOL success = NO;
-    if ([fm fileExistsAtPath:destPath]) [fm removeItemAtPath:destPath error:nil];
-
-    if ([fm fileExistsAtPath:destPath]) [fm removeItemAtPath:destPath error:nil];
-
-    success = [fm moveItemAtURL:srcURL toURL:[NSURL fileURLWithPath:destPath] error:&moveError];
-    if (!success) {
-        success = [fm copyItemAtURL:srcURL toURL:[NSURL fileURLWithPath:destPath] error:&moveError];
-        if (success) [fm removeItemAtURL:srcURL error:nil];
+- (NSString *)placeItemAtPath:(NSString *)srcPath toDirectory:(NSString *)destDir uniqueName:(NSString *)preferredName move:(BOOL)move error:(NSError **)error {
+    NSString *baseName = preferredName ?: [srcPath lastPathComponent];
+    int err = 0;
+    FileNameAllocator *allocator = [self nameAllocatorForDirectory:destDir error:&err];
+    const char *preferred = [baseName fileSystemRepresentation];
+    char name[NAME_MAX + 1];
+    // A same-volume move claims its name with an exclusive rename; copies claim
+    // theirs when fs_copy renames the finished file into place, and come back
+    // for another name if someone got there first.
+    if (allocator && move) {
+        err = fsn_rename(allocator.dir, [srcPath fileSystemRepresentation], preferred, name, sizeof(name));
     }
-
-    if (!success) {
-        NSData *data = [NSData dataWithContentsOfURL:srcURL options:0 error:&moveError];
-        if (data) {
-            success = [data writeToFile:destPath options:NSDataWritingAtomic error:&moveError];
-            if (success) [fm removeItemAtURL:srcURL error:nil];
-        }
+    if (allocator && (!move || err == EXDEV)) {
+        do {
+            err = fsn_reserve(allocator.dir, preferred, name, sizeof(name));
+            if (err) break;
+            NSString *destPath = [destDir stringByAppendingPathComponent:[[NSFileManager defaultManager] stringWithFileSystemRepresentation:name length:strlen(name)]];
+            err = [self transferItemAtPath:srcPath toPath:destPath move:move flags:0 progress:nil cancel:NULL];
+            fsn_finish(allocator.dir, name, err == 0 || err == EEXIST);
+        } while (err == EEXIST);
     }
-
-    if (error) *error = moveError;
-    return success ? finalName : nil;
+    if (err) {
+        if (error) *error = FileCopyError(err, srcPath);
+        return nil;
+    }
+    if (error) *error = nil;
+    return [[NSFileManager defaultManager] stringWithFileSystemRepresentation:name length:strlen(name)];
 }
 
 
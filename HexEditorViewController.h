@@ -3,5 +3,6 @@
 
 @interface HexEditorViewController : UIViewController
 - (instancetype)initWithPath:(NSString *)path;
+- (instancetype)initWithData:(NSData *)data title:(NSString *)title; // read-only
 @end
 
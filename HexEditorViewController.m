@@ -23,10 +23,21 @@
     return self;
 }
 
+- (instancetype)initWithData:(NSData *)data title:(NSString *)title {
+    self = [super init];
+    if (self) {
+        _data = data;
+        _mutableData = [_data mutableCopy];
+        _showASCIIOnly = NO;
+        self.title = title;
+    }
+    return self;
+}
+
 - (void)viewDidLoad {
     [super viewDidLoad];
     self.view.backgroundColor = [ThemeEngine mainBackgroundColor];
-    self.title = [self.path lastPathComponent];
+    if (self.path) self.title = [self.path lastPathComponent];
 
     self.navigationController.navigationBar.barStyle = UIBarStyleBlack;
     self.navigationController.navigationBar.translucent = YES;
@@ -66,7 +77,7 @@
 
     UIBarButtonItem *saveBtn = [[UIBarButtonItem alloc] initWithBarButtonSystemItem:UIBarButtonSystemItemSave target:self action:@selector(saveChanges)];
     UIBarButtonItem *toggleBtn = [[UIBarButtonItem alloc] initWithTitle:@"A/H" style:UIBarButtonItemStylePlain target:self action:@selector(toggleMode)];
-    self.navigationItem.rightBarButtonItems = @[saveBtn, toggleBtn];
+    self.navigationItem.rightBarButtonItems = self.path ? @[saveBtn, toggleBtn] : @[toggleBtn];
 }
 
 - (void)toggleMode {
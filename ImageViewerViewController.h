@@ -3,5 +3,6 @@
 
 @interface ImageViewerViewController : UIViewController
 - (instancetype)initWithPath:(NSString *)path;
+- (instancetype)initWithData:(NSData *)data title:(NSString *)title; // read-only
 @end
 
@@ -5,6 +5,7 @@
 
 @interface ImageViewerViewController () <UIScrollViewDelegate>
 @property (strong, nonatomic) NSString *path;
+@property (strong, nonatomic) NSData *data;
 @property (strong, nonatomic) UIScrollView *scrollView;
 @property (strong, nonatomic) UIImageView *imageView;
 @property (strong, nonatomic) UIImage *originalImage;
@@ -18,10 +19,16 @@
     return self;
 }
 
+- (instancetype)initWithData:(NSData *)data title:(NSString *)title {
+    self = [super init];
+    if (self) { _data = data; self.title = title; }
+    return self;
+}
+
 - (void)viewDidLoad {
     [super viewDidLoad];
     self.view.backgroundColor = [UIColor blackColor];
-    self.title = self.path.lastPathComponent;
+    if (self.path) self.title = self.path.lastPathComponent;
 
     self.scrollView = [[UIScrollView alloc] initWithFrame:self.view.bounds];
     self.scrollView.autoresizingMask = UIViewAutoresizingFlexibleWidth | UIViewAutoresizingFlexibleHeight;
@@ -30,13 +37,14 @@
     self.scrollView.maximumZoomScale = 5.0;
     [self.view addSubview:self.scrollView];
 
-    self.originalImage = [UIImage imageWithContentsOfFile:self.path];
+    self.originalImage = self.data ? [UIImage imageWithData:self.data] : [UIImage imageWithContentsOfFile:self.path];
     self.imageView = [[UIImageView alloc] initWithImage:self.originalImage];
     self.imageView.contentMode = UIViewContentModeScaleAspectFit;
     self.imageView.frame = self.scrollView.bounds;
     self.imageView.autoresizingMask = UIViewAutoresizingFlexibleWidth | UIViewAutoresizingFlexibleHeight;
     [self.scrollView addSubview:self.imageView];
 
+    if (!self.path) return;
     UIBarButtonItem *editBtn = [[UIBarButtonItem alloc] initWithBarButtonSystemItem:UIBarButtonSystemItemEdit target:self action:@selector(showEditMenu)];
     self.navigationItem.rightBarButtonItem = editBtn;
 }
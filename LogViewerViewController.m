@@ -4,6 +4,8 @@
 
 @interface LogViewerViewController ()
 @property (nonatomic, strong) UITextView *textView;
+@property (nonatomic, assign) uint64_t cursor;          // Logger position of the last line shown
+@property (nonatomic, assign) NSUInteger lineCount;
 @end
 
 @implementation LogViewerViewController
@@ -31,7 +33,7 @@
     UIBarButtonItem *refreshBtn = [[UIBarButtonItem alloc] initWithBarButtonSystemItem:UIBarButtonSystemItemRefresh target:self action:@selector(loadLogs)];
     self.navigationItem.rightBarButtonItem = refreshBtn;
 
-    [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(loadLogs) name:@"NewLogAdded" object:nil];
+    [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(appendLogs) name:@"NewLogAdded" object:nil];
 
     [self loadLogs];
 }
@@ -43,14 +45,37 @@
     [logs appendFormat:@"Docs: %@\n", [NSSearchPathForDirectoriesInDomains(NSDocumentDirectory, NSUserDomainMask, YES) firstObject]];
     [logs appendString:@"\n--- APPLICATION LOGS ---\n"];
 
-    for (NSString *log in [Logger sharedLogger].logs) {
+    uint64_t cursor = 0;
+    NSArray<NSString *> *lines = [[Logger sharedLogger] logsSince:&cursor];
+    for (NSString *log in lines) {
         [logs appendFormat:@"%@\n", log];
     }
+    self.cursor = cursor;
+    self.lineCount = lines.count;
 
     self.textView.text = logs;
     [self.textView scrollRangeToVisible:NSMakeRange(self.textView.text.length - 1, 1)];
 }
 
+// Only what arrived since the last update is added; the text is rebuilt once
+// it has grown to twice the Logger's history.
+- (void)appendLogs {
+    uint64_t cursor = self.cursor;
+    NSArray<NSString *> *lines = [[Logger sharedLogger] logsSince:&cursor];
+    self.cursor = cursor;
+    if (lines.count == 0) return;
+    self.lineCount += lines.count;
+    if (self.lineCount > 2048) {
+        [self loadLogs];
+        return;
+    }
+
+    NSString *added = [[lines componentsJoinedByString:@"\n"] stringByAppendingString:@"\n"];
+    NSDictionary *attributes = @{NSFontAttributeName: self.textView.font, NSForegroundColorAttributeName: self.textView.textColor};
+    [self.textView.textStorage appendAttributedString:[[NSAttributedString alloc] initWithString:added attributes:attributes]];
+    [self.textView scrollRangeToVisible:NSMakeRange(self.textView.textStorage.length - 1, 1)];
+}
+
 - (void)dealloc {
     [[NSNotificationCenter defaultCenter] removeObserver:self];
 }
@@ -1,7 +1,28 @@
 #import <Foundation/Foundation.h>
 
+typedef NS_ENUM(NSInteger, LoggerLevel) {
+    LoggerLevelDebug = 0,
+    LoggerLevelInfo,
+    LoggerLevelWarning,
+    LoggerLevelError,
+};
+
+// Callable from any thread at the cost of a string copy: messages go into a
+// lock-free ring and are timestamped, formatted and kept by a background
+// consumer. When logging outruns it, messages are dropped and counted rather
+// than blocking the caller. "NewLogAdded" is posted on the main queue,
+// coalesced across bursts.
+//
+// A message is kept up to LOG_MESSAGE_MAX (1744) bytes of UTF-8, enough for
+// full sandbox paths, URLs and error text; anything longer is cut and its
+// line ends in "…".
 @interface Logger : NSObject
 + (instancetype)sharedLogger;
 - (void)log:(NSString *)message;
+- (void)log:(NSString *)message level:(LoggerLevel)level;
+// The retained history, oldest first.
 @property (nonatomic, strong, readonly) NSArray<NSString *> *logs;
+// Lines added since *cursor, oldest first; *cursor moves past them. Start at
+// 0. Lines that already fell out of the history are skipped.
+- (NSArray<NSString *> *)logsSince:(uint64_t *)cursor;
 @end
@@ -1,7 +1,27 @@
 #import "Logger.h"
+#import "log_ring.h"
+#include <stdio.h>
+#include <time.h>
 
-@interface Logger ()
-@property (nonatomic, strong) NSMutableArray<NSString *> *mutableLogs;
+#define LOGGER_RING 4096               // records in flight between callers and the consumer
+#define LOGGER_HISTORY 1024            // records kept for readers
+#define LOGGER_PREFIX_MAX 64           // timestamp, level and category
+#define LOGGER_LINE_MAX (LOGGER_PREFIX_MAX + LOG_MESSAGE_MAX + 4)
+
+@interface Logger () {
+    log_ring *_ring;
+    log_record *_history;               // circular; consumer queue only
+    uint64_t _stored;                   // records ever kept; the next one goes to _stored % LOGGER_HISTORY
+    uint64_t _reportedDrops;
+    uint64_t _baseMonotonic;            // log_now and the wall clock at the same moment, for lazy timestamps
+    NSTimeInterval _baseWall;
+#if DEBUG
+    BOOL _mirrorTruncated;              // the message being mirrored to stderr was cut
+#endif
+}
+@property (strong, nonatomic) dispatch_queue_t queue;
+@property (strong, nonatomic) dispatch_source_t wake;       // merged by producers, handled on queue
+@property (strong, nonatomic) dispatch_source_t notify;     // merged by the consumer, handled on main
 @end
 
 @implementation Logger
@@ -18,24 +38,168 @@
 - (instancetype)init {
     self = [super init];
     if (self) {
-        _mutableLogs = [NSMutableArray array];
+        log_ring_create(LOGGER_RING, &_ring);
+        _history = calloc(LOGGER_HISTORY, sizeof(log_record));
+        _baseMonotonic = log_now();
+        _baseWall = [[NSDate date] timeIntervalSince1970];
+        _queue = dispatch_queue_create("Logger.Consumer", dispatch_queue_attr_make_with_qos_class(DISPATCH_QUEUE_SERIAL, QOS_CLASS_UTILITY, 0));
+
+        __weak typeof(self) weakSelf = self;
+        _wake = dispatch_source_create(DISPATCH_SOURCE_TYPE_DATA_OR, 0, 0, _queue);
+        dispatch_source_set_event_handler(_wake, ^{
+            [weakSelf drain];
+        });
+        _notify = dispatch_source_create(DISPATCH_SOURCE_TYPE_DATA_ADD, 0, 0, dispatch_get_main_queue());
+        dispatch_source_set_event_handler(_notify, ^{
+            [[NSNotificationCenter defaultCenter] postNotificationName:@"NewLogAdded" object:nil];
+        });
+        dispatch_resume(_wake);
+        dispatch_resume(_notify);
     }
     return self;
 }
 
+#pragma mark - Producers
+
 - (void)log:(NSString *)message {
-    NSString *timestamp = [NSDateFormatter localizedStringFromDate:[NSDate date] dateStyle:NSDateFormatterNoStyle timeStyle:NSDateFormatterMediumStyle];
-    NSString *fullMessage = [NSString stringWithFormat:@"[%@] %@", timestamp, message];
-    NSLog(@"%@", fullMessage);
-    dispatch_async(dispatch_get_main_queue(), ^{
-        [self.mutableLogs addObject:fullMessage];
-        if (self.mutableLogs.count > 1000) [self.mutableLogs removeObjectAtIndex:0];
-        [[NSNotificationCenter defaultCenter] postNotificationName:@"NewLogAdded" object:fullMessage];
+    [self log:message level:LoggerLevelInfo];
+}
+
+- (void)log:(NSString *)message level:(LoggerLevel)level {
+    if (!_ring || !_history) return;
+    char text[LOG_MESSAGE_MAX];
+    NSUInteger used = 0;
+    NSRange rest = NSMakeRange(0, 0);
+    [message getBytes:text maxLength:sizeof(text) usedLength:&used encoding:NSUTF8StringEncoding
+              options:NSStringEncodingConversionAllowLossy range:NSMakeRange(0, message.length) remainingRange:&rest];
+    // Full: counted, and reported by the consumer.
+    if (log_write(_ring, (int)level, NULL, text, used, rest.length > 0) != 0) return;
+    dispatch_source_merge_data(_wake, 1);
+}
+
+#pragma mark - Consumer
+
+// Timestamp, level and category of the message whose first part is r.
+static size_t LoggerPrefix(const log_record *r, uint64_t baseMonotonic, NSTimeInterval baseWall, char *line) {
+    NSTimeInterval wall = baseWall + (double)(int64_t)(r->time_ns - baseMonotonic) / 1e9;
+    time_t seconds = (time_t)wall;
+    struct tm tm;
+    localtime_r(&seconds, &tm);
+    int n = snprintf(line, LOGGER_PREFIX_MAX, "[%02d:%02d:%02d.%03d] ", tm.tm_hour, tm.tm_min, tm.tm_sec, (int)((wall - seconds) * 1000));
+    if (r->level >= LOG_WARN) n += snprintf(line + n, LOGGER_PREFIX_MAX - n, "%s ", r->level == LOG_ERROR ? "ERROR" : "WARN");
+    if (r->category[0]) n += snprintf(line + n, LOGGER_PREFIX_MAX - n, "[%s] ", r->category);
+    return (size_t)n;
+}
+
+// The whole line of a message: r is its first part, the others follow it.
+static size_t LoggerFormat(const log_record *r, uint64_t baseMonotonic, NSTimeInterval baseWall, char *line) {
+    size_t n = LoggerPrefix(r, baseMonotonic, baseWall, line);
+    for (size_t i = 0; i < r->parts; i++) {
+        memcpy(line + n, r[i].text, r[i].length);
+        n += r[i].length;
+    }
+    if (r->truncated) {
+        memcpy(line + n, "…", strlen("…"));
+        n += strlen("…");
+    }
+    return n;
+}
+
+// Moves what the ring holds into the history. Queue only.
+- (void)drain {
+    uint64_t before = _stored;
+    size_t budget = LOGGER_RING;
+    while (budget > 0) {
+        size_t slot = (size_t)(_stored % LOGGER_HISTORY);
+        size_t room = MIN((size_t)(LOGGER_HISTORY - slot), budget);
+        size_t n = log_drain(_ring, &_history[slot], room);
+#if DEBUG
+        // Part by part: a message may straddle the end of the history.
+        for (size_t i = 0; i < n; i++) {
+            const log_record *r = &_history[slot + i];
+            if (r->part == 0) {
+                char prefix[LOGGER_PREFIX_MAX];
+                fwrite(prefix, 1, LoggerPrefix(r, _baseMonotonic, _baseWall, prefix), stderr);
+                if (r->truncated) _mirrorTruncated = YES;
+            }
+            fwrite(r->text, 1, r->length, stderr);
+            if (r->part + 1 == r->parts) {
+                fputs(_mirrorTruncated ? "…\n" : "\n", stderr);
+                _mirrorTruncated = NO;
+            }
+        }
+#endif
+        _stored += n;
+        budget -= n;
+        if (n < room) break;
+    }
+    // Producers keep the wake source pending while they log; this only
+    // matters for a burst that ends exactly at the budget.
+    if (budget == 0) dispatch_source_merge_data(_wake, 1);
+
+    uint64_t dropped = log_dropped(_ring);
+    if (dropped > _reportedDrops) {
+        log_record *r = &_history[_stored % LOGGER_HISTORY];
+        memset(r, 0, sizeof(log_record));
+        r->time_ns = log_now();
+        r->level = LOG_WARN;
+        r->parts = 1;
+        strcpy(r->category, "SYSTEM");
+        r->length = (uint16_t)snprintf(r->text, LOG_TEXT_MAX, "%llu messages dropped, logging outran the consumer", (unsigned long long)(dropped - _reportedDrops));
+        _reportedDrops = dropped;
+        _stored++;
+    }
+    if (_stored != before) dispatch_source_merge_data(_notify, 1);
+}
+
+#pragma mark - Readers
+
+- (NSArray<NSString *> *)logsSince:(uint64_t *)cursor {
+    if (!_ring || !_history) return @[];
+    uint64_t from = *cursor;
+    __block uint64_t first = 0;
+    __block size_t count = 0;
+    __block log_record *copy = NULL;
+    // Only the records are copied under the queue; formatting them is left
+    // to the reader.
+    dispatch_sync(self.queue, ^{
+        [self drain];
+        uint64_t oldest = self->_stored > LOGGER_HISTORY ? self->_stored - LOGGER_HISTORY : 0;
+        first = MIN(MAX(from, oldest), self->_stored);
+        count = (size_t)(self->_stored - first);
+        if (count == 0) return;
+        copy = malloc(count * sizeof(log_record));
+        if (!copy) {
+            count = 0;
+            return;
+        }
+        size_t slot = (size_t)(first % LOGGER_HISTORY);
+        size_t head = MIN(count, (size_t)(LOGGER_HISTORY - slot));
+        memcpy(copy, &self->_history[slot], head * sizeof(log_record));
+        memcpy(copy + head, self->_history, (count - head) * sizeof(log_record));
     });
+
+    // The oldest records may be the tail of a message whose start was
+    // already overwritten; the newest may be a message not yet drained
+    // whole, which is left for the next call.
+    NSMutableArray<NSString *> *lines = [NSMutableArray array];
+    size_t i = 0;
+    while (i < count && copy[i].part != 0) i++;
+    while (i < count && i + copy[i].parts <= count) {
+        char line[LOGGER_LINE_MAX];
+        size_t length = LoggerFormat(&copy[i], _baseMonotonic, _baseWall, line);
+        NSString *text = [[NSString alloc] initWithBytes:line length:length encoding:NSUTF8StringEncoding];
+        [lines addObject:text ?: @""];
+        i += copy[i].parts;
+    }
+    *cursor = first + i;
+    free(copy);
+    return lines;
 }
 
 - (NSArray<NSString *> *)logs {
-    return [self.mutableLogs copy];
+    uint64_t cursor = 0;
+    return [self logsSince:&cursor];
 }
 
 @end
@@ -5,6 +5,7 @@
 #import "CustomMenuView.h"
 #import "WebBrowserViewController.h"
 #import "PersistenceManager.h"
+#import "FileManagerCore.h"
 #import <LocalAuthentication/LocalAuthentication.h>
 
 @interface SettingsViewController () <UITableViewDelegate, UITableViewDataSource>
@@ -49,7 +50,7 @@
         case 3: return 2; // Appearance
         case 4: return 4; // Web: Engine, Homepage, Clear Data, Add Whitelist
         case 5: return [PersistenceManager sharedManager].persistentDomains.count; // Whitelist items
-        case 6: return 1; // Advanced
+        case 6: return 3; // Advanced: Search Index, Text Index, Reset
         case 7: return [BookmarksManager sharedManager].bookmarks.count; // Favorites
         default: return 0;
     }
@@ -121,8 +122,8 @@
     } else if (indexPath.section == 2) {
         cell.textLabel.text = @"並び替え順";
         NSInteger sort = [[NSUserDefaults standardUserDefaults] integerForKey:@"SortMethod"];
-        NSArray *modes = @[@"名前", @"日付", @"サイズ"];
-        cell.detailTextLabel.text = modes[sort % 3];
+        NSArray *modes = @[@"名前", @"日付", @"サイズ", @"名前 (数値順)"];
+        cell.detailTextLabel.text = modes[sort % modes.count];
         cell.accessoryType = UITableViewCellAccessoryDisclosureIndicator;
     } else if (indexPath.section == 3) {
         if (indexPath.row == 0) {
@@ -159,8 +160,21 @@
     } else if (indexPath.section == 5) {
         cell.textLabel.text = [PersistenceManager sharedManager].persistentDomains[indexPath.row];
     } else if (indexPath.section == 6) {
-        cell.textLabel.text = @"全ての設定をリセット";
-        cell.textLabel.textColor = [UIColor systemRedColor];
+        if (indexPath.row == 0) {
+            cell.textLabel.text = @"検索インデックスを再構築";
+            cell.detailTextLabel.text = [FileManagerCore sharedManager].searchIndexSummary ?: @"構築中…";
+        } else if (indexPath.row == 1) {
+            FileManagerCore *core = [FileManagerCore sharedManager];
+            cell.textLabel.text = @"全文インデックス";
+            cell.detailTextLabel.text = core.textIndexEnabled ? (core.textIndexSummary ?: @"構築中…") : @"内容検索を高速化";
+            UISwitch *sw = [[UISwitch alloc] init];
+            sw.on = core.textIndexEnabled;
+            [sw addTarget:self action:@selector(textIndexToggled:) forControlEvents:UIControlEventValueChanged];
+            cell.accessoryView = sw;
+        } else {
+            cell.textLabel.text = @"全ての設定をリセット";
+            cell.textLabel.textColor = [UIColor systemRedColor];
+        }
     } else if (indexPath.section == 7) {
         NSString *path = [BookmarksManager sharedManager].bookmarks[indexPath.row];
         cell.textLabel.text = [path lastPathComponent];
@@ -183,7 +197,10 @@
         else if (indexPath.row == 1) [self editHomepage];
         else if (indexPath.row == 2) [self clearBrowserData];
         else [self addNewPersistentDomain];
-    } else if (indexPath.section == 6) [self confirmResetSettings];
+    } else if (indexPath.section == 6) {
+        if (indexPath.row == 0) [[FileManagerCore sharedManager] rebuildSearchIndex];
+        else if (indexPath.row == 2) [self confirmResetSettings];
+    }
 }
 
 - (BOOL)tableView:(UITableView *)tableView canEditRowAtIndexPath:(NSIndexPath *)indexPath {
@@ -268,7 +285,7 @@
 
 - (void)selectSortMethod {
     CustomMenuView *menu = [CustomMenuView menuWithTitle:[L s:@"並び替え" en:@"Sort"]];
-    NSArray *modes = @[@"名前", @"日付", @"サイズ"];
+    NSArray *modes = @[@"名前", @"日付", @"サイズ", @"名前 (数値順)"];
     for (NSInteger i = 0; i < modes.count; i++) {
         [menu addAction:[CustomMenuAction actionWithTitle:modes[i] systemImage:nil style:CustomMenuActionStyleDefault handler:^{
             [[NSUserDefaults standardUserDefaults] setInteger:i forKey:@"SortMethod"];
@@ -338,6 +355,7 @@
 - (void)confirmDeleteToggled:(UISwitch *)sender { [[NSUserDefaults standardUserDefaults] setBool:sender.on forKey:@"ConfirmDeletion"]; [[NSNotificationCenter defaultCenter] postNotificationName:@"SettingsChanged" object:nil]; }
 - (void)hiddenSwitchToggled:(UISwitch *)sender { [[NSUserDefaults standardUserDefaults] setBool:sender.on forKey:@"ShowHiddenFiles"]; [[NSNotificationCenter defaultCenter] postNotificationName:@"SettingsChanged" object:nil]; }
 - (void)foldersFirstToggled:(UISwitch *)sender { [[NSUserDefaults standardUserDefaults] setBool:sender.on forKey:@"FoldersFirst"]; [[NSNotificationCenter defaultCenter] postNotificationName:@"SettingsChanged" object:nil]; }
+- (void)textIndexToggled:(UISwitch *)sender { [FileManagerCore sharedManager].textIndexEnabled = sender.on; [self.tableView reloadRowsAtIndexPaths:@[[NSIndexPath indexPathForRow:1 inSection:6]] withRowAnimation:UITableViewRowAnimationNone]; }
 - (void)alwaysShowSearchToggled:(UISwitch *)sender { [[NSUserDefaults standardUserDefaults] setBool:sender.on forKey:@"AlwaysShowSearch"]; [[NSNotificationCenter defaultCenter] postNotificationName:@"SettingsChanged" object:nil]; }
 
 
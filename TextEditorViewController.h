@@ -4,5 +4,6 @@
 
 @interface TextEditorViewController : UIViewController
 - (instancetype)initWithPath:(NSString *)path;
+- (instancetype)initWithData:(NSData *)data title:(NSString *)title; // read-only
 @end
 
@@ -5,6 +5,7 @@
 
 @interface TextEditorViewController ()
 @property (strong, nonatomic) NSString *path;
+@property (strong, nonatomic) NSData *data;
 @property (strong, nonatomic) UITextView *textView;
 @end
 
@@ -18,9 +19,18 @@
     return self;
 }
 
+- (instancetype)initWithData:(NSData *)data title:(NSString *)title {
+    self = [super init];
+    if (self) {
+        _data = data;
+        self.title = title;
+    }
+    return self;
+}
+
 - (void)viewDidLoad {
     [super viewDidLoad];
-    self.title = self.path.lastPathComponent;
+    if (self.path) self.title = self.path.lastPathComponent;
     self.view.backgroundColor = [ThemeEngine mainBackgroundColor];
 
     self.textView = [[UITextView alloc] initWithFrame:self.view.bounds];
@@ -30,15 +40,21 @@
     self.textView.font = [UIFont fontWithName:@"Menlo" size:12];
     [self.view addSubview:self.textView];
 
-    UIBarButtonItem *saveBtn = [[UIBarButtonItem alloc] initWithBarButtonSystemItem:UIBarButtonSystemItemSave target:self action:@selector(saveText)];
-    self.navigationItem.rightBarButtonItem = saveBtn;
+    if (self.path) {
+        UIBarButtonItem *saveBtn = [[UIBarButtonItem alloc] initWithBarButtonSystemItem:UIBarButtonSystemItemSave target:self action:@selector(saveText)];
+        self.navigationItem.rightBarButtonItem = saveBtn;
+    } else {
+        self.textView.editable = NO;
+    }
 
     [self loadText];
 }
 
 - (void)loadText {
     NSError *error;
-    NSString *content = [NSString stringWithContentsOfFile:self.path encoding:NSUTF8StringEncoding error:&error];
+    NSString *content = nil;
+    if (self.data) content = [[NSString alloc] initWithData:self.data encoding:NSUTF8StringEncoding] ?: [[NSString alloc] initWithData:self.data encoding:NSISOLatin1StringEncoding];
+    else content = [NSString stringWithContentsOfFile:self.path encoding:NSUTF8StringEncoding error:&error];
     if (content) self.textView.text = content;
 }
 
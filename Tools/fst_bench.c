@@ -0,0 +1,79 @@
+// File: fst_bench.c
+// Location: Tools
+
+// Headless benchmark for fs_text: build throughput, incremental rebuild,
+// index size, open time and query latency. Not part of the app; the guard
+// keeps this file empty should an app build pick it up. See fs_text.h for
+// the build line.
+
+#ifdef FST_BENCH
+
+#include "fs_text.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static uint64_t fst_bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void fst_bench_print(const char* label, int err, const fst_stats* s)
+{
+    if (err)
+    {
+        printf("%s: %s\n", label, strerror(err));
+        return;
+    }
+    double seconds = (double)s->build_ns / 1e9;
+    printf("%s: %.0f ms, %llu docs (%llu read, %.1f MB, %.1f MB/s), %llu terms, %llu tokens, index %.1f MB (postings %.1f MB)\n",
+           label, seconds * 1e3, (unsigned long long)s->docs, (unsigned long long)s->docs_read, (double)s->bytes_read / 1e6,
+           seconds > 0 ? (double)s->bytes_read / 1e6 / seconds : 0, (unsigned long long)s->terms,
+           (unsigned long long)s->tokens, (double)s->file_size / 1e6, (double)s->postings_size / 1e6);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "usage: %s root index [query ...]\n", argv[0]);
+        return 2;
+    }
+    static const char* const extensions[] = {"c", "cpp", "h", "m", "mm", "py", "sh", "plist", "xml", "json", "html",
+                                             "js", "css", "csv", "tsv", "txt", "md", NULL};
+    fst_stats stats;
+    unlink(argv[2]);
+    fst_bench_print("full build", fst_build(argv[1], argv[2], extensions, NULL, &stats), &stats);
+    fst_bench_print("incremental", fst_build(argv[1], argv[2], extensions, NULL, &stats), &stats);
+
+    fst_index* x;
+    uint64_t started = fst_bench_now();
+    int err = fst_open(argv[2], &x);
+    if (err)
+    {
+        printf("open: %s\n", strerror(err));
+        return 1;
+    }
+    printf("open: %.2f ms\n", (double)(fst_bench_now() - started) / 1e6);
+    fst_get_stats(x, &stats);
+    fst_bench_print("on disk", 0, &stats);
+
+    fst_hit hits[10];
+    for (int i = 3; i < argc; i++)
+    {
+        size_t count = 0;
+        const int rounds = 20;
+        started = fst_bench_now();
+        for (int r = 0; r < rounds && !err; r++) err = fst_search(x, argv[1], argv[i], hits, 10, &count);
+        printf("query %s: %.3f ms, %s\n", argv[i], (double)(fst_bench_now() - started) / 1e6 / rounds, err ? strerror(err) : "");
+        for (size_t k = 0; k < count; k++) printf("  %6.2f %4u %s\n", hits[k].score, hits[k].count, hits[k].path);
+        err = 0;
+    }
+    fst_close(x);
+    return 0;
+}
+
+#endif
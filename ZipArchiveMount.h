@@ -0,0 +1,21 @@
+#import <Foundation/Foundation.h>
+#import "FileManagerCore.h"
+
+// Read-only view of a ZIP archive's central directory as a tree of FileItems.
+// Paths are relative to the archive root without a leading slash; @"" is the root.
+@interface ZipArchiveMount : NSObject
+@property (nonatomic, copy, readonly) NSString *archivePath;
+@property (nonatomic, assign, readonly) NSUInteger entryCount;
+
++ (instancetype)mountArchiveAtPath:(NSString *)archivePath error:(NSError **)error;
+
+- (NSArray<FileItem *> *)contentsOfDirectoryAtPath:(NSString *)path;
+- (FileItem *)itemAtPath:(NSString *)path;
+- (BOOL)isDirectoryAtPath:(NSString *)path;
+
+// Decompresses a single entry in fixed-size pieces without touching the disk.
+// Return NO from the block to stop early.
+- (BOOL)readItemAtPath:(NSString *)path usingBlock:(BOOL (^)(const void *bytes, size_t length))block error:(NSError **)error;
+// maxLength of 0 reads the whole entry.
+- (NSData *)dataForItemAtPath:(NSString *)path maxLength:(NSUInteger)maxLength error:(NSError **)error;
+@end
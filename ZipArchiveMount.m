@@ -0,0 +1,200 @@
+#import "ZipArchiveMount.h"
+#import "Logger.h"
+#include "miniz.h"
+
+static const size_t ZipMountReadChunk = 64 * 1024;
+
+@implementation ZipArchiveMount {
+    mz_zip_archive _zip;
+    NSMutableDictionary<NSString *, NSNumber *> *_indexByPath;
+    NSMutableDictionary<NSString *, NSMutableOrderedSet<NSString *> *> *_children;
+    NSMutableSet<NSString *> *_directories;
+}
+
++ (instancetype)mountArchiveAtPath:(NSString *)archivePath error:(NSError **)error {
+    ZipArchiveMount *mount = [[ZipArchiveMount alloc] init];
+    if (![mount openArchiveAtPath:archivePath error:error]) return nil;
+    return mount;
+}
+
+- (void)dealloc {
+    if (_zip.m_zip_mode != MZ_ZIP_MODE_INVALID) mz_zip_reader_end(&_zip);
+}
+
+- (BOOL)openArchiveAtPath:(NSString *)archivePath error:(NSError **)error {
+    memset(&_zip, 0, sizeof(_zip));
+    // Only the central directory is read here; entry data stays on disk until requested.
+    if (!mz_zip_reader_init_file(&_zip, [archivePath fileSystemRepresentation], 0)) {
+        if (error) *error = [self errorWithCode:-1 reason:@"Failed to open ZIP"];
+        memset(&_zip, 0, sizeof(_zip));
+        return NO;
+    }
+    _archivePath = [archivePath copy];
+
+    mz_uint count = mz_zip_reader_get_num_files(&_zip);
+    _entryCount = count;
+    _indexByPath = [NSMutableDictionary dictionaryWithCapacity:count];
+    _children = [NSMutableDictionary dictionary];
+    _directories = [NSMutableSet setWithObject:@""];
+
+    char name[MZ_ZIP_MAX_ARCHIVE_FILENAME_SIZE];
+    for (mz_uint i = 0; i < count; i++) {
+        if (!mz_zip_reader_get_filename(&_zip, i, name, sizeof(name))) continue;
+        NSString *raw = [NSString stringWithUTF8String:name];
+        if (!raw) continue;
+        BOOL isDirectory = [raw hasSuffix:@"/"] || mz_zip_reader_is_file_a_directory(&_zip, i);
+        NSString *path = [self normalizedPath:raw];
+        if (path.length == 0) continue;
+        _indexByPath[path] = @(i);
+        [self addPath:path directory:isDirectory];
+    }
+
+    [[Logger sharedLogger] log:[NSString stringWithFormat:@"[ZIP] Mounted %@ (%lu entries)", [archivePath lastPathComponent], (unsigned long)count]];
+    return YES;
+}
+
+- (NSString *)normalizedPath:(NSString *)path {
+    NSMutableArray *parts = [NSMutableArray array];
+    for (NSString *part in [path componentsSeparatedByString:@"/"]) {
+        if (part.length == 0 || [part isEqualToString:@"."]) continue;
+        [parts addObject:part];
+    }
+    return [parts componentsJoinedByString:@"/"];
+}
+
+// Registers path under its parent and creates any parent directories the
+// archive only implies through deeper entry names.
+- (void)addPath:(NSString *)path directory:(BOOL)isDirectory {
+    while (path.length > 0) {
+        if (isDirectory) {
+            if ([_directories containsObject:path]) return;
+            [_directories addObject:path];
+        }
+        NSString *parent = [path stringByDeletingLastPathComponent];
+        NSMutableOrderedSet *children = _children[parent];
+        if (!children) { children = [NSMutableOrderedSet orderedSet]; _children[parent] = children; }
+        [children addObject:[path lastPathComponent]];
+        path = parent;
+        isDirectory = YES;
+    }
+}
+
+- (NSString *)childPath:(NSString *)name inDirectory:(NSString *)directory {
+    return directory.length ? [directory stringByAppendingFormat:@"/%@", name] : name;
+}
+
+- (NSError *)errorWithCode:(NSInteger)code reason:(NSString *)reason {
+    return [NSError errorWithDomain:@"ZipManager" code:code userInfo:@{NSLocalizedDescriptionKey: reason}];
+}
+
+#pragma mark - Tree
+
+- (BOOL)isDirectoryAtPath:(NSString *)path {
+    return [_directories containsObject:[self normalizedPath:path ?: @""]];
+}
+
+- (NSArray<FileItem *> *)contentsOfDirectoryAtPath:(NSString *)path {
+    path = [self normalizedPath:path ?: @""];
+    NSMutableArray<FileItem *> *items = [NSMutableArray array];
+    for (NSString *name in _children[path]) {
+        FileItem *item = [self itemAtPath:[self childPath:name inDirectory:path]];
+        if (item) [items addObject:item];
+    }
+    [items sortUsingComparator:^NSComparisonResult(FileItem *a, FileItem *b) {
+        if (a.isDirectory != b.isDirectory) return a.isDirectory ? NSOrderedAscending : NSOrderedDescending;
+        return [a.name localizedStandardCompare:b.name];
+    }];
+    return items;
+}
+
+- (FileItem *)itemAtPath:(NSString *)path {
+    path = [self normalizedPath:path ?: @""];
+    BOOL isDirectory = [_directories containsObject:path];
+    NSNumber *index = _indexByPath[path];
+    if (!isDirectory && !index) return nil;
+
+    FileItem *item = [[FileItem alloc] init];
+    item.name = path.length ? [path lastPathComponent] : [self.archivePath lastPathComponent];
+    item.fullPath = [self.archivePath stringByAppendingPathComponent:path];
+    item.isDirectory = isDirectory;
+
+    NSMutableDictionary *attrs = [NSMutableDictionary dictionary];
+    attrs[NSFileType] = isDirectory ? NSFileTypeDirectory : NSFileTypeRegular;
+    if (index) {
+        mz_zip_archive_file_stat st;
+        mz_bool ok;
+        @synchronized (self) { ok = mz_zip_reader_file_stat(&_zip, index.unsignedIntValue, &st); }
+        if (ok) {
+            attrs[NSFileSize] = @(st.m_uncomp_size);
+            attrs[@"ZipCompressedSize"] = @(st.m_comp_size);
+            attrs[NSFileModificationDate] = [NSDate dateWithTimeIntervalSince1970:st.m_time];
+            item.isLocked = st.m_is_encrypted;
+        }
+    }
+    item.attributes = attrs;
+    return item;
+}
+
+#pragma mark - Reading
+
+// Must be called with self locked.
+- (BOOL)locateEntry:(NSString *)path index:(mz_uint32 *)index {
+    NSNumber *known = _indexByPath[path];
+    if (known) { *index = known.unsignedIntValue; return YES; }
+    // Names the hash index does not know verbatim (case differences) fall back to miniz's lookup.
+    return mz_zip_reader_locate_file_v2(&_zip, [path UTF8String], NULL, 0, index);
+}
+
+- (BOOL)readItemAtPath:(NSString *)path usingBlock:(BOOL (^)(const void *bytes, size_t length))block error:(NSError **)error {
+    path = [self normalizedPath:path ?: @""];
+    if ([_directories containsObject:path]) {
+        if (error) *error = [self errorWithCode:-3 reason:@"Entry is a directory"];
+        return NO;
+    }
+
+    @synchronized (self) {
+        mz_uint32 index;
+        if (![self locateEntry:path index:&index]) {
+            if (error) *error = [self errorWithCode:-3 reason:[NSString stringWithFormat:@"%@ not found in archive", path]];
+            return NO;
+        }
+
+        mz_zip_reader_extract_iter_state *state = mz_zip_reader_extract_iter_new(&_zip, index, 0);
+        if (!state) {
+            if (error) *error = [self errorWithCode:-2 reason:@(mz_zip_get_error_string(mz_zip_get_last_error(&_zip)))];
+            return NO;
+        }
+
+        uint8_t *buffer = malloc(ZipMountReadChunk);
+        BOOL stopped = NO;
+        size_t n;
+        while (buffer && (n = mz_zip_reader_extract_iter_read(state, buffer, ZipMountReadChunk)) > 0) {
+            if (!block(buffer, n)) { stopped = YES; break; }
+        }
+        // Freeing the iterator verifies size and CRC, which only applies to a full read.
+        mz_bool ok = mz_zip_reader_extract_iter_free(state);
+        if (!buffer || (!ok && !stopped)) {
+            free(buffer);
+            if (error) *error = [self errorWithCode:-2 reason:@(mz_zip_get_error_string(mz_zip_get_last_error(&_zip)))];
+            return NO;
+        }
+        free(buffer);
+    }
+    return YES;
+}
+
+- (NSData *)dataForItemAtPath:(NSString *)path maxLength:(NSUInteger)maxLength error:(NSError **)error {
+    FileItem *item = [self itemAtPath:path];
+    unsigned long long size = [item.attributes[NSFileSize] unsignedLongLongValue];
+    NSUInteger capacity = (NSUInteger)(maxLength ? MIN(size, (unsigned long long)maxLength) : size);
+    NSMutableData *data = [NSMutableData dataWithCapacity:capacity];
+
+    BOOL ok = [self readItemAtPath:path usingBlock:^BOOL(const void *bytes, size_t length) {
+        if (maxLength && data.length + length > maxLength) length = maxLength - data.length;
+        [data appendBytes:bytes length:length];
+        return !maxLength || data.length < maxLength;
+    } error:error];
+    return ok ? data : nil;
+}
+
+@end
@@ -5,8 +5,19 @@ typedef NS_ENUM(NSInteger, ArchiveFormat) {
     ArchiveFormatUnknown
 };
 
+typedef NS_ENUM(NSInteger, ZipWriteMode) {
+    ZipWriteModeParallel,   // one deflate worker per core
+    ZipWriteModeStreaming   // single pass with a constant few-MB footprint
+};
+
+// Return NO to cancel the operation.
+typedef BOOL (^ZipProgressHandler)(NSString *entryName, uint64_t completedBytes, uint64_t totalBytes);
+
 @interface ZipManager : NSObject
 + (BOOL)extractArchiveAtPath:(NSString *)archivePath toDestination:(NSString *)destPath password:(NSString *)password error:(NSError **)error;
 + (BOOL)compressFiles:(NSArray *)filePaths toPath:(NSString *)archivePath format:(ArchiveFormat)format password:(NSString *)password error:(NSError **)error;
++ (BOOL)compressFiles:(NSArray *)filePaths toPath:(NSString *)archivePath mode:(ZipWriteMode)mode progress:(ZipProgressHandler)progress error:(NSError **)error;
+// levels maps lowercase extensions to 0 (store) or 1-10; other files get a level from sampling their contents.
++ (BOOL)compressFiles:(NSArray *)filePaths toPath:(NSString *)archivePath mode:(ZipWriteMode)mode levels:(NSDictionary<NSString *, NSNumber *> *)levels progress:(ZipProgressHandler)progress error:(NSError **)error;
 + (ArchiveFormat)formatForPath:(NSString *)path;
 @end
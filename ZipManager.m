@@ -1,6 +1,11 @@
 #import "ZipManager.h"
 #import <Foundation/Foundation.h>
+#import "Logger.h"
 #include "miniz.h"
+#include "zip_writer.h"
+#include "zip_extract.h"
+#include "zip_stream.h"
+#include "zip_policy.h"
 
 @implementation ZipManager
 
@@ -14,31 +19,32 @@
     ArchiveFormat format = [self formatForPath:archivePath];
 
     if (format == ArchiveFormatZip) {
-        mz_zip_archive zip_archive;
-        memset(&zip_archive, 0, sizeof(zip_archive));
+        [[NSFileManager defaultManager] createDirectoryAtPath:destPath withIntermediateDirectories:YES attributes:nil error:nil];
 
-        if (!mz_zip_reader_init_file(&zip_archive, [archivePath fileSystemRepresentation], 0)) {
+        zipx_result result;
+        int rc = zipx_extract_archive([archivePath fileSystemRepresentation], [destPath fileSystemRepresentation], NULL, &result);
+        if (rc != 0) {
+            zipx_result_free(&result);
             if (error) *error = [NSError errorWithDomain:@"ZipManager" code:-1 userInfo:@{NSLocalizedDescriptionKey: @"Failed to open ZIP"}];
             return NO;
         }
 
-        mz_uint num_files = mz_zip_reader_get_num_files(&zip_archive);
-        for (mz_uint i = 0; i < num_files; i++) {
-            mz_zip_archive_file_stat file_stat;
-            if (!mz_zip_reader_file_stat(&zip_archive, i, &file_stat)) continue;
-
-            NSString *fileName = [NSString stringWithUTF8String:file_stat.m_filename];
-            NSString *fullDest = [destPath stringByAppendingPathComponent:fileName];
-
-            if (mz_zip_reader_is_file_a_directory(&zip_archive, i)) {
-                [[NSFileManager defaultManager] createDirectoryAtPath:fullDest withIntermediateDirectories:YES attributes:nil error:nil];
-            } else {
-                [[NSFileManager defaultManager] createDirectoryAtPath:[fullDest stringByDeletingLastPathComponent] withIntermediateDirectories:YES attributes:nil error:nil];
-                mz_zip_reader_extract_to_file(&zip_archive, i, [fullDest fileSystemRepresentation], 0);
-            }
+        NSMutableDictionary<NSString *, NSString *> *failures = [NSMutableDictionary dictionary];
+        for (size_t i = 0; i < result.failure_count; i++) {
+            zipx_failure f = result.failures[i];
+            NSString *name = [NSString stringWithUTF8String:f.name] ?: @"?";
+            NSString *reason = f.zip_error ? @(mz_zip_get_error_string((mz_zip_error)f.zip_error)) : @(strerror(f.error));
+            failures[name] = reason;
+            [[Logger sharedLogger] log:[NSString stringWithFormat:@"[ZIP] Failed to extract %@: %@", name, reason]];
         }
+        size_t entries = result.entries;
+        zipx_result_free(&result);
 
-        mz_zip_reader_end(&zip_archive);
+        if (failures.count > 0) {
+            NSString *message = [NSString stringWithFormat:@"%lu of %lu entries could not be extracted", (unsigned long)failures.count, (unsigned long)entries];
+            if (error) *error = [NSError errorWithDomain:@"ZipManager" code:-2 userInfo:@{NSLocalizedDescriptionKey: message, @"FailedEntries": failures}];
+            return NO;
+        }
         return YES;
     }
 
@@ -46,23 +52,70 @@
 }
 
 + (BOOL)compressFiles:(NSArray *)filePaths toPath:(NSString *)archivePath format:(ArchiveFormat)format password:(NSString *)password error:(NSError **)error {
-    if (format == ArchiveFormatZip) {
-        mz_zip_archive zip_archive;
-        memset(&zip_archive, 0, sizeof(zip_archive));
+    if (format != ArchiveFormatZip) return NO;
+    return [self compressFiles:filePaths toPath:archivePath mode:ZipWriteModeParallel progress:nil error:error];
+}
 
-        if (!mz_zip_writer_init_file(&zip_archive, [archivePath fileSystemRepresentation], 0)) {
-            return NO;
-        }
+static int ZipProgressTrampoline(void *ctx, const char *name, uint64_t done, uint64_t total) {
+    ZipProgressHandler handler = (__bridge ZipProgressHandler)ctx;
+    return handler([NSString stringWithUTF8String:name] ?: @"", done, total) ? 0 : 1;
+}
 
-        for (NSString *path in filePaths) {
-            mz_zip_writer_add_file(&zip_archive, [path lastPathComponent].UTF8String, [path fileSystemRepresentation], NULL, 0, MZ_DEFAULT_COMPRESSION);
++ (BOOL)compressFiles:(NSArray *)filePaths toPath:(NSString *)archivePath mode:(ZipWriteMode)mode progress:(ZipProgressHandler)progress error:(NSError **)error {
+    return [self compressFiles:filePaths toPath:archivePath mode:mode levels:nil progress:progress error:error];
+}
+
++ (BOOL)compressFiles:(NSArray *)filePaths toPath:(NSString *)archivePath mode:(ZipWriteMode)mode levels:(NSDictionary<NSString *, NSNumber *> *)levels progress:(ZipProgressHandler)progress error:(NSError **)error {
+    NSArray<NSString *> *extensions = levels.allKeys;
+    zipp_rule *rules = calloc(extensions.count ? extensions.count : 1, sizeof(zipp_rule));
+    for (NSUInteger i = 0; i < extensions.count; i++) {
+        rules[i].extension = [extensions[i] UTF8String];
+        rules[i].level = [levels[extensions[i]] intValue];
+    }
+    zipp_policy policy = { rules, extensions.count, MZ_DEFAULT_LEVEL };
+
+    NSUInteger rootCount = filePaths.count;
+    const char **roots = calloc(rootCount ? rootCount : 1, sizeof(char *));
+    for (NSUInteger i = 0; i < rootCount; i++) roots[i] = [filePaths[i] fileSystemRepresentation];
+
+    int rc = 0;
+    NSString *failed = nil;
+
+    if (mode == ZipWriteModeStreaming) {
+        zips_options opts = { MZ_DEFAULT_LEVEL, progress ? ZipProgressTrampoline : NULL, (__bridge void *)progress, &policy };
+        zips_result result;
+        rc = zips_write_archive([archivePath fileSystemRepresentation], roots, rootCount, &opts, &result);
+        if (rc != 0 && result.failed_name[0]) failed = [NSString stringWithUTF8String:result.failed_name];
+    } else {
+        zips_item *items = NULL;
+        size_t count = 0;
+        rc = zips_collect(roots, rootCount, &items, &count);
+        if (rc == 0) {
+            zipw_entry *entries = calloc(count ? count : 1, sizeof(zipw_entry));
+            // Sampling reads the head of every file, so it is spread across cores like the deflate itself.
+            dispatch_apply(count, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t i) {
+                entries[i].src_path = items[i].src_path;
+                entries[i].archive_name = items[i].archive_name;
+                entries[i].level = items[i].src_path ? zipp_choose_level(&policy, items[i].src_path, items[i].size) : MZ_DEFAULT_LEVEL;
+            });
+            zipw_options opts = { 0, 0, progress ? ZipProgressTrampoline : NULL, (__bridge void *)progress };
+            zipw_result result;
+            rc = zipw_write_archive([archivePath fileSystemRepresentation], entries, count, &opts, &result);
+            if (rc != 0 && result.failed_index < count) failed = [NSString stringWithUTF8String:items[result.failed_index].archive_name];
+            free(entries);
         }
+        zips_free_items(items, count);
+    }
+    free(roots);
+    free(rules);
 
-        mz_zip_writer_finalize_archive(&zip_archive);
-        mz_zip_writer_end(&zip_archive);
-        return YES;
+    if (rc != 0) {
+        NSString *reason = rc == ECANCELED ? @"Compression cancelled" : [NSString stringWithFormat:@"Failed to compress %@: %s", failed ?: [archivePath lastPathComponent], strerror(rc)];
+        [[Logger sharedLogger] log:[NSString stringWithFormat:@"[ZIP] %@", reason]];
+        if (error) *error = [NSError errorWithDomain:@"ZipManager" code:rc userInfo:@{NSLocalizedDescriptionKey: reason}];
+        return NO;
     }
-    return NO;
+    return YES;
 }
 
 @end
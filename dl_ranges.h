@@ -0,0 +1,76 @@
+// File: dl_ranges.h
+// Location: プロジェクト直下
+
+#ifndef DL_RANGES_H
+#define DL_RANGES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Byte ranges of one download fetched over several connections. The file is
+// a list of segments, each [start, end) with a cursor: bytes before the
+// cursor are on disk. Every connection owns one segment and writes what it
+// receives at the cursor with pwrite, so the temp file needs no reordering.
+//
+// A connection that runs out of work steals: it takes the back half of the
+// segment with the most bytes left, which is the slowest one to finish. The
+// owner keeps streaming but dlr_write stops it at the new end. A download
+// therefore starts as one segment and splits into as many as there are
+// connections, and a slow connection keeps getting relieved until the
+// remaining pieces are too small to split.
+//
+// The map can be journaled next to the temp file, so an interrupted
+// download continues where it stopped: a loaded map has every segment
+// released, each remainder waiting for dlr_claim.
+//
+// All functions may be called from any thread.
+
+typedef struct dlr_map dlr_map;
+
+#define DLR_META_MAX (1u << 20)
+
+typedef struct dlr_range
+{
+    int segment;
+    uint64_t start;                // first byte to request
+    uint64_t end;                  // one past the last
+} dlr_range;
+
+// min_split is the smallest piece a steal may leave on either side.
+// Returns 0 or ENOMEM.
+int dlr_create(uint64_t size, uint64_t min_split, dlr_map** out);
+void dlr_free(dlr_map* map);
+
+// Work for a connection that has none: a segment whose connection was
+// released, else half of the one with the most left. Returns 0, or ENOENT
+// when nothing is left that is worth splitting.
+int dlr_claim(dlr_map* map, dlr_range* out);
+// Writes data that arrived for segment at its cursor in fd, cut off at the
+// segment's end, which a steal may have moved. *finished is set once the
+// segment is complete; the connection should then stop. Returns 0 or an
+// errno value.
+int dlr_write(dlr_map* map, int fd, int segment, const void* data, size_t size, int* finished);
+// The segment's connection failed or was stopped early; what it did not get
+// goes to the next dlr_claim.
+void dlr_release(dlr_map* map, int segment);
+
+uint64_t dlr_size(const dlr_map* map);
+uint64_t dlr_done(const dlr_map* map);
+int dlr_complete(const dlr_map* map);
+// Connections currently holding a segment.
+int dlr_active(const dlr_map* map);
+
+// Writes the map and meta, an opaque blob of at most DLR_META_MAX bytes, to
+// file (replaced atomically). fd, when not -1, is synced first, so the
+// journal never claims bytes that are not on disk. Returns 0 or an errno
+// value.
+int dlr_save(dlr_map* map, int fd, const char* file, const void* meta, size_t meta_size);
+// Reads a journal written by dlr_save. *meta is malloc'ed. Returns 0, ENOENT,
+// EINVAL for a damaged journal, or another errno value.
+int dlr_load(const char* file, dlr_map** out, void** meta, size_t* meta_size);
+
+// Reserves size bytes for fd up front, so parallel writes do not fragment
+// the file and a full disk fails before the download rather than during it.
+int dlr_allocate(int fd, uint64_t size);
+
+#endif
@@ -0,0 +1,357 @@
+// File: dl_ranges.c
+// Location: プロジェクト直下
+
+#include "dl_ranges.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DLR_ALIGN (64u << 10)          // steal points fall on 64 KB boundaries
+#define DLR_MAGIC 0x4a524c44u          // "DLRJ"
+#define DLR_VERSION 1u
+
+typedef struct dlr_segment
+{
+    uint64_t start;
+    uint64_t next;                 // cursor: [start, next) is written
+    uint64_t end;
+    int owned;
+} dlr_segment;
+
+struct dlr_map
+{
+    pthread_mutex_t lock;
+    uint64_t size;
+    uint64_t min_split;
+    uint64_t done;
+    dlr_segment* segments;
+    int count;
+    int capacity;
+    int active;
+};
+
+int dlr_create(uint64_t size, uint64_t min_split, dlr_map** out)
+{
+    *out = NULL;
+    dlr_map* m = calloc(1, sizeof(dlr_map));
+    if (!m) return ENOMEM;
+    m->capacity = 16;
+    m->segments = malloc((size_t)m->capacity * sizeof(dlr_segment));
+    if (!m->segments)
+    {
+        free(m);
+        return ENOMEM;
+    }
+    pthread_mutex_init(&m->lock, NULL);
+    m->size = size;
+    m->min_split = min_split < DLR_ALIGN ? DLR_ALIGN : min_split;
+    m->segments[0] = (dlr_segment){0, 0, size, 0};
+    m->count = 1;
+    *out = m;
+    return 0;
+}
+
+void dlr_free(dlr_map* map)
+{
+    if (!map) return;
+    pthread_mutex_destroy(&map->lock);
+    free(map->segments);
+    free(map);
+}
+
+#pragma mark - Segments
+
+int dlr_claim(dlr_map* map, dlr_range* out)
+{
+    pthread_mutex_lock(&map->lock);
+    // A released remainder first: it costs no split.
+    int best = -1;
+    for (int i = 0; i < map->count; i++)
+    {
+        dlr_segment* s = &map->segments[i];
+        if (s->owned || s->next >= s->end) continue;
+        if (best < 0 || s->end - s->next > map->segments[best].end - map->segments[best].next) best = i;
+    }
+    if (best >= 0)
+    {
+        dlr_segment* s = &map->segments[best];
+        s->owned = 1;
+        map->active++;
+        *out = (dlr_range){best, s->next, s->end};
+        pthread_mutex_unlock(&map->lock);
+        return 0;
+    }
+
+    for (int i = 0; i < map->count; i++)
+    {
+        dlr_segment* s = &map->segments[i];
+        if (s->next >= s->end) continue;
+        if (best < 0 || s->end - s->next > map->segments[best].end - map->segments[best].next) best = i;
+    }
+    uint64_t left = best >= 0 ? map->segments[best].end - map->segments[best].next : 0;
+    if (left < 2 * map->min_split)
+    {
+        pthread_mutex_unlock(&map->lock);
+        return ENOENT;
+    }
+    if (map->count == map->capacity)
+    {
+        dlr_segment* grown = realloc(map->segments, (size_t)map->capacity * 2 * sizeof(dlr_segment));
+        if (!grown)
+        {
+            pthread_mutex_unlock(&map->lock);
+            return ENOMEM;
+        }
+        map->segments = grown;
+        map->capacity *= 2;
+    }
+    dlr_segment* victim = &map->segments[best];
+    uint64_t mid = (victim->next + left / 2) & ~(uint64_t)(DLR_ALIGN - 1);
+    if (mid <= victim->next) mid = victim->next + map->min_split;
+    int index = map->count++;
+    map->segments[index] = (dlr_segment){mid, mid, victim->end, 1};
+    victim->end = mid;
+    map->active++;
+    *out = (dlr_range){index, mid, map->segments[index].end};
+    pthread_mutex_unlock(&map->lock);
+    return 0;
+}
+
+int dlr_write(dlr_map* map, int fd, int segment, const void* data, size_t size, int* finished)
+{
+    pthread_mutex_lock(&map->lock);
+    dlr_segment* s = &map->segments[segment];
+    uint64_t offset = s->next;
+    size_t take = s->end - offset < size ? (size_t)(s->end - offset) : size;
+    pthread_mutex_unlock(&map->lock);
+
+    // Only the owner moves a cursor, so the write runs unlocked. A steal
+    // landing meanwhile may move end below what is being written; those bytes
+    // are the ones the thief will write too, so only the count is clamped.
+    const uint8_t* p = data;
+    size_t written = 0;
+    int err = 0;
+    while (written < take)
+    {
+        ssize_t n = pwrite(fd, p + written, take - written, (off_t)(offset + written));
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0)
+        {
+            err = errno;
+            break;
+        }
+        written += (size_t)n;
+    }
+
+    pthread_mutex_lock(&map->lock);
+    s = &map->segments[segment];
+    uint64_t counted = s->next + written <= s->end ? written : s->end > s->next ? s->end - s->next : 0;
+    s->next += counted;
+    map->done += counted;
+    *finished = s->next >= s->end;
+    pthread_mutex_unlock(&map->lock);
+    return err;
+}
+
+void dlr_release(dlr_map* map, int segment)
+{
+    pthread_mutex_lock(&map->lock);
+    dlr_segment* s = &map->segments[segment];
+    if (s->owned)
+    {
+        s->owned = 0;
+        map->active--;
+    }
+    pthread_mutex_unlock(&map->lock);
+}
+
+uint64_t dlr_size(const dlr_map* map)
+{
+    return map->size;
+}
+
+uint64_t dlr_done(const dlr_map* map)
+{
+    pthread_mutex_lock((pthread_mutex_t*)&map->lock);
+    uint64_t done = map->done;
+    pthread_mutex_unlock((pthread_mutex_t*)&map->lock);
+    return done;
+}
+
+int dlr_complete(const dlr_map* map)
+{
+    return dlr_done(map) >= map->size;
+}
+
+int dlr_active(const dlr_map* map)
+{
+    pthread_mutex_lock((pthread_mutex_t*)&map->lock);
+    int active = map->active;
+    pthread_mutex_unlock((pthread_mutex_t*)&map->lock);
+    return active;
+}
+
+#pragma mark - Journal
+
+typedef struct dlr_header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t size;
+    uint64_t min_split;
+    uint32_t count;
+    uint32_t meta_size;
+} dlr_header;
+
+typedef struct dlr_record
+{
+    uint64_t start;
+    uint64_t next;
+    uint64_t end;
+} dlr_record;
+
+static int dlr_write_all(int fd, const void* data, size_t size)
+{
+    const uint8_t* p = data;
+    while (size > 0)
+    {
+        ssize_t n = write(fd, p, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return errno;
+        p += n;
+        size -= (size_t)n;
+    }
+    return 0;
+}
+
+static int dlr_read_all(int fd, void* data, size_t size)
+{
+    uint8_t* p = data;
+    while (size > 0)
+    {
+        ssize_t n = read(fd, p, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return errno;
+        if (n == 0) return EINVAL;
+        p += n;
+        size -= (size_t)n;
+    }
+    return 0;
+}
+
+int dlr_save(dlr_map* map, int fd, const char* file, const void* meta, size_t meta_size)
+{
+    if (meta_size > DLR_META_MAX) return EINVAL;
+    if (fd >= 0 && fsync(fd) != 0) return errno;
+
+    pthread_mutex_lock(&map->lock);
+    dlr_header header = {DLR_MAGIC, DLR_VERSION, map->size, map->min_split, (uint32_t)map->count, (uint32_t)meta_size};
+    dlr_record* records = malloc((size_t)map->count * sizeof(dlr_record));
+    if (records)
+        for (int i = 0; i < map->count; i++)
+            records[i] = (dlr_record){map->segments[i].start, map->segments[i].next, map->segments[i].end};
+    pthread_mutex_unlock(&map->lock);
+    if (!records) return ENOMEM;
+
+    char tmp[PATH_MAX];
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", file) >= (int)sizeof(tmp))
+    {
+        free(records);
+        return ENAMETOOLONG;
+    }
+    int out = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (out < 0)
+    {
+        free(records);
+        return errno;
+    }
+    int err = dlr_write_all(out, &header, sizeof(header));
+    if (!err) err = dlr_write_all(out, records, header.count * sizeof(dlr_record));
+    if (!err && meta_size) err = dlr_write_all(out, meta, meta_size);
+    if (!err && fsync(out) != 0) err = errno;
+    if (close(out) != 0 && !err) err = errno;
+    free(records);
+    if (!err && rename(tmp, file) != 0) err = errno;
+    if (err) unlink(tmp);
+    return err;
+}
+
+int dlr_load(const char* file, dlr_map** out, void** meta, size_t* meta_size)
+{
+    *out = NULL;
+    *meta = NULL;
+    *meta_size = 0;
+    int fd = open(file, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return errno;
+    dlr_header header;
+    int err = dlr_read_all(fd, &header, sizeof(header));
+    if (!err && (header.magic != DLR_MAGIC || header.version != DLR_VERSION || header.count == 0 ||
+                 header.count > (1u << 20) || header.meta_size > DLR_META_MAX))
+        err = EINVAL;
+    dlr_map* m = NULL;
+    if (!err) err = dlr_create(header.size, header.min_split, &m);
+    if (!err && header.count > (uint32_t)m->capacity)
+    {
+        dlr_segment* grown = realloc(m->segments, header.count * sizeof(dlr_segment));
+        if (grown)
+        {
+            m->segments = grown;
+            m->capacity = (int)header.count;
+        }
+        else err = ENOMEM;
+    }
+    for (uint32_t i = 0; !err && i < header.count; i++)
+    {
+        dlr_record r;
+        err = dlr_read_all(fd, &r, sizeof(r));
+        if (!err && !(r.start <= r.next && r.next <= r.end && r.end <= header.size)) err = EINVAL;
+        if (!err)
+        {
+            m->segments[i] = (dlr_segment){r.start, r.next, r.end, 0};
+            m->done += r.next - r.start;
+        }
+    }
+    if (!err) m->count = (int)header.count;
+    void* blob = NULL;
+    if (!err && header.meta_size)
+    {
+        blob = malloc(header.meta_size);
+        err = blob ? dlr_read_all(fd, blob, header.meta_size) : ENOMEM;
+    }
+    close(fd);
+    if (err)
+    {
+        free(blob);
+        dlr_free(m);
+        return err;
+    }
+    *out = m;
+    *meta = blob;
+    *meta_size = header.meta_size;
+    return 0;
+}
+
+#pragma mark - Files
+
+int dlr_allocate(int fd, uint64_t size)
+{
+#if defined(__APPLE__)
+    // Contiguous if possible, else any blocks; APFS may refuse both, which
+    // only costs the up-front check.
+    fstore_t store = {F_ALLOCATECONTIG | F_ALLOCATEALL, F_PEOFPOSMODE, 0, (off_t)size, 0};
+    if (fcntl(fd, F_PREALLOCATE, &store) != 0)
+    {
+        store.fst_flags = F_ALLOCATEALL;
+        fcntl(fd, F_PREALLOCATE, &store);
+    }
+#elif defined(__linux__)
+    int err = posix_fallocate(fd, 0, (off_t)size);
+    if (err && err != EOPNOTSUPP && err != EINVAL) return err;
+#endif
+    return ftruncate(fd, (off_t)size) == 0 ? 0 : errno;
+}
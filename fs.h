@@ -4,6 +4,104 @@
 #ifndef FS_H
 #define FS_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 void fs_list(const char* path);
 
-#endif
\ No newline at end of file
+enum
+{
+    FS_LIST_HIDDEN = 1 << 0,       // include names starting with '.'
+    FS_LIST_STAT = 1 << 1,         // fill size/mtime/mode for every entry
+};
+
+enum
+{
+    FS_ENTRY_DIR = 1 << 0,
+    FS_ENTRY_LINK = 1 << 1,
+    FS_ENTRY_STAT = 1 << 2,        // size, mtime and permission bits are valid
+};
+
+enum
+{
+    FS_SORT_NAME = 0,
+    FS_SORT_DATE = 1,              // newest first
+    FS_SORT_SIZE = 2,              // largest first
+    FS_SORT_NATURAL = 3,           // by name, digit runs by value ("2" before "10")
+};
+
+// One directory read into parallel arrays; names are packed NUL-terminated
+// into a single buffer so a listing costs a handful of allocations.
+typedef struct fs_listing
+{
+    size_t count;
+    uint32_t* name_offset;
+    uint16_t* name_length;
+    uint64_t* size;
+    int64_t* mtime;
+    uint32_t* mode;
+    uint8_t* flags;
+    char* names;
+    size_t names_used;
+    size_t capacity;
+    size_t names_capacity;
+} fs_listing;
+
+static inline const char* fs_listing_name(const fs_listing* l, size_t i)
+{
+    return l->names + l->name_offset[i];
+}
+
+typedef struct fs_list_cursor
+{
+    void* dir;                     // DIR*
+    int fd;
+    int flags;
+    int done;
+} fs_list_cursor;
+
+// Incremental form of fs_list_dir: fs_list_read appends at most max entries
+// to out and sets cursor->done once the directory is exhausted.
+int fs_list_open(fs_list_cursor* cursor, const char* path, int flags);
+int fs_list_read(fs_list_cursor* cursor, fs_listing* out, size_t max);
+void fs_list_close(fs_list_cursor* cursor);
+
+// Reads path with readdir, taking the entry type from d_type and calling
+// fstatat relative to the directory only when FS_LIST_STAT asks for it or the
+// file system does not report a type. Returns 0 or an errno value.
+int fs_list_dir(const char* path, int flags, fs_listing* out);
+void fs_listing_free(fs_listing* listing);
+// Empties a listing but keeps its buffers for the next fs_list_read.
+void fs_listing_clear(fs_listing* listing);
+int fs_listing_copy(const fs_listing* src, fs_listing* dst);
+
+// Writes the display order of the listing into order (count entries).
+void fs_listing_sort(const fs_listing* listing, int sort, int folders_first, uint32_t* order);
+
+// Sorts the records appended since first and merges them into order (n rows
+// already sorted), writing listing->count rows to out. positions receives the
+// row of each new record in out, ascending.
+int fs_listing_merge(const fs_listing* listing, int sort, int folders_first, const uint32_t* order, size_t n,
+                     uint32_t first, uint32_t* out, uint32_t* positions);
+
+// Rows that differ between two sorted listings of the same directory, matched
+// by exact name. removed holds rows of the old order, inserted and changed
+// rows of the new one, all ascending. ordered is 0 when entries both listings
+// share moved relative to each other, in which case only a full reload is
+// correct.
+typedef struct fs_diff
+{
+    uint32_t* removed;
+    size_t removed_count;
+    uint32_t* inserted;
+    size_t inserted_count;
+    uint32_t* changed;
+    size_t changed_count;
+    int ordered;
+} fs_diff;
+
+int fs_listing_diff(const fs_listing* old, const uint32_t* old_order, const fs_listing* now, const uint32_t* now_order,
+                    fs_diff* out);
+void fs_diff_free(fs_diff* diff);
+
+#endif
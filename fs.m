@@ -3,7 +3,14 @@
 
 #include "fs.h"
 #include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 void fs_list(const char* path)
 {
@@ -29,4 +36,785 @@ void fs_list(const char* path)
     }
 
     closedir(dir);
-}
\ No newline at end of file
+}
+
+#pragma mark - Bulk listing
+
+static int fs_listing_grow(fs_listing* l)
+{
+    size_t cap = l->capacity ? l->capacity * 2 : 256;
+    void* p;
+
+#define FS_GROW(field)                                      \
+    p = realloc(l->field, cap * sizeof(*l->field));         \
+    if (!p) return ENOMEM;                                  \
+    l->field = p;
+
+    FS_GROW(name_offset)
+    FS_GROW(name_length)
+    FS_GROW(size)
+    FS_GROW(mtime)
+    FS_GROW(mode)
+    FS_GROW(flags)
+#undef FS_GROW
+
+    l->capacity = cap;
+    return 0;
+}
+
+static int fs_listing_add_name(fs_listing* l, const char* name, size_t len)
+{
+    if (l->names_used + len + 1 > l->names_capacity)
+    {
+        size_t cap = l->names_capacity ? l->names_capacity * 2 : 8192;
+        while (cap < l->names_used + len + 1) cap *= 2;
+        char* p = realloc(l->names, cap);
+        if (!p) return ENOMEM;
+        l->names = p;
+        l->names_capacity = cap;
+    }
+    memcpy(l->names + l->names_used, name, len + 1);
+    l->name_offset[l->count] = (uint32_t)l->names_used;
+    l->name_length[l->count] = (uint16_t)len;
+    l->names_used += len + 1;
+    return 0;
+}
+
+static void fs_listing_fill_stat(fs_listing* l, size_t i, const struct stat* st)
+{
+    l->size[i] = (uint64_t)st->st_size;
+    l->mtime[i] = (int64_t)st->st_mtime;
+    l->mode[i] = (uint32_t)st->st_mode;
+    l->flags[i] = FS_ENTRY_STAT;
+    if (S_ISDIR(st->st_mode)) l->flags[i] |= FS_ENTRY_DIR;
+    if (S_ISLNK(st->st_mode)) l->flags[i] |= FS_ENTRY_LINK;
+}
+
+int fs_list_open(fs_list_cursor* cursor, const char* path, int flags)
+{
+    memset(cursor, 0, sizeof(*cursor));
+    cursor->flags = flags;
+    cursor->fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (cursor->fd < 0) return errno;
+    cursor->dir = fdopendir(cursor->fd);
+    if (!cursor->dir)
+    {
+        int err = errno;
+        close(cursor->fd);
+        cursor->fd = -1;
+        return err;
+    }
+    return 0;
+}
+
+int fs_list_read(fs_list_cursor* cursor, fs_listing* out, size_t max)
+{
+    int err = 0;
+    size_t added = 0;
+    struct dirent* entry;
+    while (added < max && (entry = readdir(cursor->dir)) != NULL)
+    {
+        const char* d = entry->d_name;
+        if (d[0] == '.')
+        {
+            if (d[1] == '\0' || (d[1] == '.' && d[2] == '\0')) continue;
+            if (!(cursor->flags & FS_LIST_HIDDEN)) continue;
+        }
+
+        if (out->count == out->capacity && (err = fs_listing_grow(out)) != 0) return err;
+        size_t len = strlen(d);
+        if ((err = fs_listing_add_name(out, d, len)) != 0) return err;
+
+        size_t i = out->count;
+        out->size[i] = 0;
+        out->mtime[i] = 0;
+        out->mode[i] = 0;
+        out->flags[i] = 0;
+
+        int need_stat = (cursor->flags & FS_LIST_STAT) != 0;
+        switch (entry->d_type)
+        {
+        case DT_DIR: out->flags[i] = FS_ENTRY_DIR; out->mode[i] = S_IFDIR; break;
+        case DT_LNK: out->flags[i] = FS_ENTRY_LINK; out->mode[i] = S_IFLNK; break;
+        case DT_REG: out->mode[i] = S_IFREG; break;
+        case DT_UNKNOWN: need_stat = 1; break;
+        default: break;
+        }
+
+        struct stat st;
+        if (need_stat && fstatat(cursor->fd, d, &st, AT_SYMLINK_NOFOLLOW) == 0) fs_listing_fill_stat(out, i, &st);
+        out->count++;
+        added++;
+    }
+    if (added < max) cursor->done = 1;
+    return 0;
+}
+
+void fs_list_close(fs_list_cursor* cursor)
+{
+    if (cursor->dir) closedir(cursor->dir);
+    cursor->dir = NULL;
+    cursor->fd = -1;
+}
+
+int fs_list_dir(const char* path, int flags, fs_listing* out)
+{
+    memset(out, 0, sizeof(*out));
+
+    fs_list_cursor cursor;
+    int err = fs_list_open(&cursor, path, flags);
+    if (err) return err;
+    err = fs_list_read(&cursor, out, SIZE_MAX);
+    fs_list_close(&cursor);
+
+    if (err) fs_listing_free(out);
+    return err;
+}
+
+int fs_listing_copy(const fs_listing* src, fs_listing* dst)
+{
+    memset(dst, 0, sizeof(*dst));
+    if (src->count == 0) return 0;
+
+    dst->capacity = src->count;
+    dst->names_capacity = src->names_used;
+
+#define FS_COPY(field, n)                                   \
+    dst->field = malloc((n) * sizeof(*dst->field));         \
+    if (!dst->field) goto fail;                             \
+    memcpy(dst->field, src->field, (n) * sizeof(*dst->field));
+
+    FS_COPY(name_offset, src->count)
+    FS_COPY(name_length, src->count)
+    FS_COPY(size, src->count)
+    FS_COPY(mtime, src->count)
+    FS_COPY(mode, src->count)
+    FS_COPY(flags, src->count)
+    FS_COPY(names, src->names_used)
+#undef FS_COPY
+
+    dst->count = src->count;
+    dst->names_used = src->names_used;
+    return 0;
+
+fail:
+    fs_listing_free(dst);
+    return ENOMEM;
+}
+
+void fs_listing_clear(fs_listing* l)
+{
+    l->count = 0;
+    l->names_used = 0;
+}
+
+void fs_listing_free(fs_listing* l)
+{
+    free(l->name_offset);
+    free(l->name_length);
+    free(l->size);
+    free(l->mtime);
+    free(l->mode);
+    free(l->flags);
+    free(l->names);
+    memset(l, 0, sizeof(*l));
+}
+
+#pragma mark - Sorting
+
+// Exact byte order, used to match names between two listings.
+#define FS_SORT_BYTES (-1)
+
+// Every record gets a 64-bit key up front so most comparisons are one integer
+// compare; equal keys only fall back to the full name comparison for the
+// name orders. For date and size the key is the whole order.
+typedef struct fs_sort_ctx
+{
+    const fs_listing* l;
+    int sort;
+    int folders_first;
+    const uint64_t* key;
+} fs_sort_ctx;
+
+static inline int fs_fold(int ch)
+{
+    return ch >= 'A' && ch <= 'Z' ? ch + ('a' - 'A') : ch;
+}
+
+static inline int fs_is_digit(int ch)
+{
+    return ch >= '0' && ch <= '9';
+}
+
+// Natural order spelled as plain bytes: the name folded, with every digit run
+// replaced by '0', the run's length without leading zeros plus one, and those
+// digits. Comparing two of these bytewise orders names as fs_natural_compare
+// does up to case and leading zeros. '0' works as the marker because a digit
+// compares against any other byte the way '0' would. Writes at most
+// 2 * strlen(name) + 2 bytes and returns the length.
+static size_t fs_natural_text(const char* name, unsigned char* out)
+{
+    size_t n = 0;
+    for (const unsigned char* p = (const unsigned char*)name; *p;)
+    {
+        if (!fs_is_digit(*p))
+        {
+            out[n++] = (unsigned char)fs_fold(*p++);
+            continue;
+        }
+        while (*p == '0') p++;
+        size_t len = 0;
+        while (fs_is_digit(p[len])) len++;
+        out[n++] = '0';
+        // Lengths past 253 cannot be told apart in a byte; stop there and let
+        // the full comparison order such names.
+        if (len >= 254)
+        {
+            out[n++] = 255;
+            break;
+        }
+        out[n++] = (unsigned char)(len + 1);
+        memcpy(out + n, p, len);
+        n += len;
+        p += len;
+        while (fs_is_digit(*p)) p++;
+    }
+    return n;
+}
+
+// First eight bytes of a name as a big-endian integer, folded for the
+// case-insensitive order, so unsigned order matches the name order on them.
+static uint64_t fs_text_key(const unsigned char* text, size_t len, int fold)
+{
+    uint64_t key = 0;
+    for (size_t i = 0; i < 8 && i < len; i++) key |= (uint64_t)(fold ? fs_fold(text[i]) : text[i]) << (56 - 8 * i);
+    return key;
+}
+
+static uint64_t fs_name_key(const char* name, size_t len, int sort)
+{
+    if (sort != FS_SORT_NATURAL) return fs_text_key((const unsigned char*)name, len, sort == FS_SORT_NAME);
+    unsigned char stack[2 * 256 + 2];
+    unsigned char* text = len <= 256 ? stack : malloc(2 * len + 2);
+    if (!text) return 0;
+    uint64_t key = fs_text_key(text, fs_natural_text(name, text), 0);
+    if (text != stack) free(text);
+    return key;
+}
+
+static uint64_t* fs_sort_keys(const fs_listing* l, int sort)
+{
+    uint64_t* key = malloc((l->count ? l->count : 1) * sizeof(uint64_t));
+    if (!key) return NULL;
+    for (size_t i = 0; i < l->count; i++)
+    {
+        switch (sort)
+        {
+        case FS_SORT_DATE: key[i] = ~((uint64_t)l->mtime[i] ^ (1ULL << 63)); break;   // newest first
+        case FS_SORT_SIZE: key[i] = ~l->size[i]; break;                                // largest first
+        default: key[i] = fs_name_key(fs_listing_name(l, i), l->name_length[i], sort); break;
+        }
+    }
+    return key;
+}
+
+// Case-insensitive, with runs of digits compared by value ("2" < "10").
+// Names that only differ in leading zeros or case fall back to strcasecmp.
+static int fs_natural_compare(const char* a, const char* b)
+{
+    const unsigned char* p = (const unsigned char*)a;
+    const unsigned char* q = (const unsigned char*)b;
+    while (*p && *q)
+    {
+        if (fs_is_digit(*p) && fs_is_digit(*q))
+        {
+            while (*p == '0') p++;
+            while (*q == '0') q++;
+            size_t lp = 0, lq = 0;
+            while (fs_is_digit(p[lp])) lp++;
+            while (fs_is_digit(q[lq])) lq++;
+            if (lp != lq) return lp < lq ? -1 : 1;
+            int c = memcmp(p, q, lp);
+            if (c) return c;
+            p += lp;
+            q += lq;
+            continue;
+        }
+        int ca = fs_fold(*p), cb = fs_fold(*q);
+        if (ca != cb) return ca < cb ? -1 : 1;
+        p++;
+        q++;
+    }
+    if (*p || *q) return *p ? 1 : -1;
+    return strcasecmp(a, b);
+}
+
+static int fs_compare(const fs_sort_ctx* c, uint32_t a, uint32_t b)
+{
+    const fs_listing* l = c->l;
+    if (c->folders_first)
+    {
+        int da = (l->flags[a] & FS_ENTRY_DIR) != 0;
+        int db = (l->flags[b] & FS_ENTRY_DIR) != 0;
+        if (da != db) return da ? -1 : 1;
+    }
+    if (c->key[a] != c->key[b]) return c->key[a] < c->key[b] ? -1 : 1;
+    switch (c->sort)
+    {
+    case FS_SORT_DATE:
+    case FS_SORT_SIZE:
+        return 0;
+    case FS_SORT_BYTES:
+        return strcmp(fs_listing_name(l, a), fs_listing_name(l, b));
+    case FS_SORT_NATURAL:
+        return fs_natural_compare(fs_listing_name(l, a), fs_listing_name(l, b));
+    default:
+        return strcasecmp(fs_listing_name(l, a), fs_listing_name(l, b));
+    }
+}
+
+typedef int (*fs_index_compare)(const void* ctx, uint32_t a, uint32_t b);
+
+// Stable bottom-up merge sort over indices; qsort_r's argument order differs
+// between the BSD and glibc C libraries. Short inputs use a stack buffer.
+static void fs_merge_sort(uint32_t* idx, size_t n, fs_index_compare compare, const void* ctx)
+{
+    if (n < 2) return;
+    uint32_t stack[64];
+    uint32_t* tmp = n <= 64 ? stack : malloc(n * sizeof(uint32_t));
+    if (!tmp) return;
+
+    uint32_t* src = idx;
+    uint32_t* dst = tmp;
+    for (size_t width = 1; width < n; width *= 2)
+    {
+        for (size_t lo = 0; lo < n; lo += 2 * width)
+        {
+            size_t mid = lo + width < n ? lo + width : n;
+            size_t hi = lo + 2 * width < n ? lo + 2 * width : n;
+            size_t i = lo, j = mid, k = lo;
+            while (i < mid && j < hi) dst[k++] = compare(ctx, src[j], src[i]) < 0 ? src[j++] : src[i++];
+            while (i < mid) dst[k++] = src[i++];
+            while (j < hi) dst[k++] = src[j++];
+        }
+        uint32_t* t = src;
+        src = dst;
+        dst = t;
+    }
+    if (src != idx) memcpy(idx, src, n * sizeof(uint32_t));
+    if (tmp != stack) free(tmp);
+}
+
+static int fs_compare_records(const void* ctx, uint32_t a, uint32_t b)
+{
+    return fs_compare(ctx, a, b);
+}
+
+static void fs_sort_indices(const fs_sort_ctx* c, uint32_t* idx, size_t n)
+{
+    fs_merge_sort(idx, n, fs_compare_records, c);
+}
+
+typedef struct fs_radix_item
+{
+    uint64_t key;
+    uint32_t index;
+} fs_radix_item;
+
+#define FS_RADIX_BITS 11
+#define FS_RADIX_BUCKETS (1 << FS_RADIX_BITS)
+#define FS_RADIX_PASSES ((64 + FS_RADIX_BITS - 1) / FS_RADIX_BITS)
+
+// Stable LSD radix sort of idx by key, 11 bits per pass. Keys travel with
+// their index so every pass streams through memory, all histograms are built
+// in one sweep, and passes where every key shares the digit are skipped:
+// small mtimes or sizes cost only a few passes.
+static int fs_radix_sort(const uint64_t* key, uint32_t* idx, size_t n)
+{
+    fs_radix_item* items = malloc(2 * (n ? n : 1) * sizeof(fs_radix_item));
+    uint32_t(*count)[FS_RADIX_BUCKETS] = calloc(FS_RADIX_PASSES, sizeof(*count));
+    if (!items || !count)
+    {
+        free(items);
+        free(count);
+        return ENOMEM;
+    }
+    fs_radix_item* src = items;
+    fs_radix_item* dst = items + n;
+    for (size_t i = 0; i < n; i++)
+    {
+        uint64_t k = key[idx[i]];
+        src[i].key = k;
+        src[i].index = idx[i];
+        for (int d = 0; d < FS_RADIX_PASSES; d++) count[d][(k >> (d * FS_RADIX_BITS)) & (FS_RADIX_BUCKETS - 1)]++;
+    }
+
+    for (int d = 0; d < FS_RADIX_PASSES; d++)
+    {
+        int shift = d * FS_RADIX_BITS;
+        if (count[d][(src[0].key >> shift) & (FS_RADIX_BUCKETS - 1)] == n) continue;
+        uint32_t pos = 0;
+        for (int b = 0; b < FS_RADIX_BUCKETS; b++)
+        {
+            uint32_t c = count[d][b];
+            count[d][b] = pos;
+            pos += c;
+        }
+        for (size_t i = 0; i < n; i++) dst[count[d][(src[i].key >> shift) & (FS_RADIX_BUCKETS - 1)]++] = src[i];
+        fs_radix_item* t = src;
+        src = dst;
+        dst = t;
+    }
+    for (size_t i = 0; i < n; i++) idx[i] = src[i].index;
+    free(items);
+    free(count);
+    return 0;
+}
+
+// Moves directories ahead of files without disturbing either group's order.
+static int fs_partition_dirs(const fs_listing* l, uint32_t* idx, size_t n)
+{
+    uint32_t* files = malloc((n ? n : 1) * sizeof(uint32_t));
+    if (!files) return ENOMEM;
+    size_t d = 0, f = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (l->flags[idx[i]] & FS_ENTRY_DIR) idx[d++] = idx[i];
+        else files[f++] = idx[i];
+    }
+    memcpy(idx + d, files, f * sizeof(uint32_t));
+    free(files);
+    return 0;
+}
+
+// Runs this short are cheaper to merge sort than to radix sort again.
+#define FS_RADIX_MIN 64
+
+// The bytes the name orders sort by: the names themselves (folded on the fly
+// for FS_SORT_NAME) or their natural text.
+typedef struct fs_text_view
+{
+    const unsigned char* text;
+    const uint32_t* offset;
+    const uint16_t* length;
+    int fold;
+} fs_text_view;
+
+static void fs_sort_text_run(const fs_sort_ctx* c, const fs_text_view* v, uint32_t* idx, size_t n, size_t depth,
+                             uint64_t* scratch);
+
+// key holds bytes depth..depth+7 of every record in idx, which is sorted by it.
+// Each run of equal keys is refined by the next eight bytes; a key ending in
+// NUL means the texts are equal, leaving only natural order's tie-break.
+static void fs_refine_runs(const fs_sort_ctx* c, const fs_text_view* v, const uint64_t* key, uint32_t* idx, size_t n,
+                           size_t depth, uint64_t* scratch)
+{
+    // Recursion overwrites scratch, which may be key, so runs are found first.
+    size_t* lo_of = malloc((n / 2 + 1) * 2 * sizeof(size_t));
+    if (!lo_of)
+    {
+        fs_sort_indices(c, idx, n);
+        return;
+    }
+    size_t* len_of = lo_of + n / 2 + 1;
+    size_t runs = 0;
+    for (size_t lo = 0; lo < n;)
+    {
+        size_t hi = lo + 1;
+        while (hi < n && key[idx[hi]] == key[idx[lo]] &&
+               (!c->folders_first || ((c->l->flags[idx[hi]] ^ c->l->flags[idx[lo]]) & FS_ENTRY_DIR) == 0))
+            hi++;
+        if (hi - lo > 1 && ((key[idx[lo]] & 0xff) || c->sort == FS_SORT_NATURAL))
+        {
+            lo_of[runs] = lo;
+            len_of[runs] = (key[idx[lo]] & 0xff) ? hi - lo : ~(hi - lo);
+            runs++;
+        }
+        lo = hi;
+    }
+    for (size_t r = 0; r < runs; r++)
+    {
+        if ((ptrdiff_t)len_of[r] < 0) fs_sort_indices(c, idx + lo_of[r], ~len_of[r]);
+        else fs_sort_text_run(c, v, idx + lo_of[r], len_of[r], depth + 8, scratch);
+    }
+    free(lo_of);
+}
+
+typedef struct fs_text_ctx
+{
+    const fs_sort_ctx* c;
+    const fs_text_view* v;
+    const uint64_t* key;           // bytes depth..depth+7
+    size_t depth;
+} fs_text_ctx;
+
+// Order of two records that agree on their first depth bytes: the key, then
+// the rest of the text, then fs_compare for natural order's tie-break.
+static int fs_compare_text(const void* ctx, uint32_t a, uint32_t b)
+{
+    const fs_text_ctx* t = ctx;
+    if (t->key[a] != t->key[b]) return t->key[a] < t->key[b] ? -1 : 1;
+    if (t->key[a] & 0xff)
+    {
+        const fs_text_view* v = t->v;
+        size_t skip = t->depth + 8;
+        const unsigned char* p = v->text + v->offset[a] + skip;
+        const unsigned char* q = v->text + v->offset[b] + skip;
+        size_t lp = v->length[a] - skip, lq = v->length[b] - skip;
+        size_t n = lp < lq ? lp : lq;
+        for (size_t i = 0; i < n; i++)
+        {
+            int x = v->fold ? fs_fold(p[i]) : p[i];
+            int y = v->fold ? fs_fold(q[i]) : q[i];
+            if (x != y) return x < y ? -1 : 1;
+        }
+        if (lp != lq) return lp < lq ? -1 : 1;
+    }
+    return t->c->sort == FS_SORT_NATURAL ? fs_compare(t->c, a, b) : 0;
+}
+
+// MSD step: the records in idx agree on their first depth bytes.
+static void fs_sort_text_run(const fs_sort_ctx* c, const fs_text_view* v, uint32_t* idx, size_t n, size_t depth,
+                             uint64_t* scratch)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        uint32_t r = idx[i];
+        scratch[r] = depth < v->length[r] ? fs_text_key(v->text + v->offset[r] + depth, v->length[r] - depth, v->fold) : 0;
+    }
+    if (n < FS_RADIX_MIN || fs_radix_sort(scratch, idx, n) != 0)
+    {
+        fs_text_ctx t = { c, v, scratch, depth };
+        fs_merge_sort(idx, n, fs_compare_text, &t);
+        return;
+    }
+    fs_refine_runs(c, v, scratch, idx, n, depth, scratch);
+}
+
+// Natural text for every record, packed like the names.
+static int fs_natural_view(const fs_listing* l, fs_text_view* v)
+{
+    unsigned char* text = malloc(2 * l->names_used + 2);
+    uint32_t* offset = malloc((l->count ? l->count : 1) * sizeof(uint32_t));
+    uint16_t* length = malloc((l->count ? l->count : 1) * sizeof(uint16_t));
+    if (!text || !offset || !length)
+    {
+        free(text);
+        free(offset);
+        free(length);
+        return ENOMEM;
+    }
+    size_t used = 0;
+    for (size_t i = 0; i < l->count; i++)
+    {
+        offset[i] = (uint32_t)used;
+        size_t n = fs_natural_text(fs_listing_name(l, i), text + used);
+        length[i] = (uint16_t)n;
+        used += n;
+    }
+    v->text = text;
+    v->offset = offset;
+    v->length = length;
+    v->fold = 0;
+    return 0;
+}
+
+// Radix sort on the keys, the folder split, then MSD refinement of runs of
+// equal name keys. Every step is stable, so the result is exactly the stable
+// sort by fs_compare that fs_listing_merge relies on.
+static void fs_sort_records(const fs_sort_ctx* c, uint32_t* idx, size_t n)
+{
+    if (n < 2) return;
+    if (fs_radix_sort(c->key, idx, n) != 0 || (c->folders_first && fs_partition_dirs(c->l, idx, n) != 0))
+    {
+        fs_sort_indices(c, idx, n);
+        return;
+    }
+    if (c->sort == FS_SORT_DATE || c->sort == FS_SORT_SIZE) return;
+
+    const fs_listing* l = c->l;
+    fs_text_view v = { (const unsigned char*)l->names, l->name_offset, l->name_length, c->sort == FS_SORT_NAME };
+    int natural = c->sort == FS_SORT_NATURAL;
+    uint64_t* scratch = malloc((l->count ? l->count : 1) * sizeof(uint64_t));
+    if (!scratch || (natural && fs_natural_view(l, &v) != 0))
+    {
+        free(scratch);
+        scratch = NULL;
+        natural = 0;
+    }
+    if (scratch) fs_refine_runs(c, &v, c->key, idx, n, 0, scratch);
+    else fs_sort_indices(c, idx, n);
+
+    if (natural)
+    {
+        free((void*)v.text);
+        free((void*)v.offset);
+        free((void*)v.length);
+    }
+    free(scratch);
+}
+
+void fs_listing_sort(const fs_listing* listing, int sort, int folders_first, uint32_t* order)
+{
+    for (size_t i = 0; i < listing->count; i++) order[i] = (uint32_t)i;
+    uint64_t* key = fs_sort_keys(listing, sort);
+    if (!key) return;              // left in directory order
+    fs_sort_ctx c = { listing, sort, folders_first, key };
+    fs_sort_records(&c, order, listing->count);
+    free(key);
+}
+
+int fs_listing_merge(const fs_listing* listing, int sort, int folders_first, const uint32_t* order, size_t n,
+                     uint32_t first, uint32_t* out, uint32_t* positions)
+{
+    size_t added = listing->count - first;
+    uint64_t* key = fs_sort_keys(listing, sort);
+    uint32_t* fresh = malloc((added ? added : 1) * sizeof(uint32_t));
+    if (!key || !fresh)
+    {
+        free(key);
+        free(fresh);
+        return ENOMEM;
+    }
+    fs_sort_ctx c = { listing, sort, folders_first, key };
+    for (size_t i = 0; i < added; i++) fresh[i] = first + (uint32_t)i;
+    fs_sort_records(&c, fresh, added);
+
+    // Existing rows win ties so rows already on screen keep their order.
+    size_t i = 0, j = 0, k = 0;
+    while (i < n || j < added)
+    {
+        if (j < added && (i == n || fs_compare(&c, fresh[j], order[i]) < 0))
+        {
+            positions[j] = (uint32_t)k;
+            out[k++] = fresh[j++];
+        }
+        else
+        {
+            out[k++] = order[i++];
+        }
+    }
+    free(fresh);
+    free(key);
+    return 0;
+}
+
+#pragma mark - Diff
+
+static int fs_entry_changed(const fs_listing* a, uint32_t i, const fs_listing* b, uint32_t j)
+{
+    if ((a->flags[i] ^ b->flags[j]) & (FS_ENTRY_DIR | FS_ENTRY_LINK)) return 1;
+    if ((a->flags[i] & FS_ENTRY_STAT) && (b->flags[j] & FS_ENTRY_STAT))
+        return a->size[i] != b->size[j] || a->mtime[i] != b->mtime[j] || a->mode[i] != b->mode[j];
+    return 0;
+}
+
+// Inverse of a display order: row of every record.
+static uint32_t* fs_rows_of(const uint32_t* order, size_t n)
+{
+    uint32_t* rows = malloc((n ? n : 1) * sizeof(uint32_t));
+    if (rows)
+    {
+        for (size_t r = 0; r < n; r++) rows[order[r]] = (uint32_t)r;
+    }
+    return rows;
+}
+
+static int fs_row_compare(const void* a, const void* b)
+{
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+int fs_listing_diff(const fs_listing* old, const uint32_t* old_order, const fs_listing* now, const uint32_t* now_order,
+                    fs_diff* out)
+{
+    memset(out, 0, sizeof(*out));
+    size_t n = old->count, m = now->count;
+
+    uint64_t* key_old = fs_sort_keys(old, FS_SORT_BYTES);
+    uint64_t* key_now = fs_sort_keys(now, FS_SORT_BYTES);
+    fs_sort_ctx co = { old, FS_SORT_BYTES, 0, key_old };
+    fs_sort_ctx cn = { now, FS_SORT_BYTES, 0, key_now };
+    uint32_t* by_name_old = malloc((n ? n : 1) * sizeof(uint32_t));
+    uint32_t* by_name_now = malloc((m ? m : 1) * sizeof(uint32_t));
+    uint32_t* old_rows = fs_rows_of(old_order, n);
+    uint32_t* now_rows = fs_rows_of(now_order, m);
+    // For every old row, the row it moved to, or UINT32_MAX when it is gone.
+    uint32_t* moved = malloc((n ? n : 1) * sizeof(uint32_t));
+    out->removed = malloc((n ? n : 1) * sizeof(uint32_t));
+    out->inserted = malloc((m ? m : 1) * sizeof(uint32_t));
+    out->changed = malloc((m ? m : 1) * sizeof(uint32_t));
+    int err = 0;
+    if (!key_old || !key_now || !by_name_old || !by_name_now || !old_rows || !now_rows || !moved || !out->removed || !out->inserted || !out->changed)
+    {
+        err = ENOMEM;
+        goto done;
+    }
+
+    for (size_t i = 0; i < n; i++) by_name_old[i] = (uint32_t)i;
+    for (size_t j = 0; j < m; j++) by_name_now[j] = (uint32_t)j;
+    fs_sort_records(&co, by_name_old, n);
+    fs_sort_records(&cn, by_name_now, m);
+    for (size_t r = 0; r < n; r++) moved[r] = UINT32_MAX;
+
+    size_t i = 0, j = 0;
+    while (i < n || j < m)
+    {
+        int c = i == n ? 1 : j == m ? -1 : strcmp(fs_listing_name(old, by_name_old[i]), fs_listing_name(now, by_name_now[j]));
+        if (c < 0)
+        {
+            out->removed[out->removed_count++] = old_rows[by_name_old[i++]];
+        }
+        else if (c > 0)
+        {
+            out->inserted[out->inserted_count++] = now_rows[by_name_now[j++]];
+        }
+        else
+        {
+            uint32_t a = by_name_old[i++], b = by_name_now[j++];
+            moved[old_rows[a]] = now_rows[b];
+            if (fs_entry_changed(old, a, now, b)) out->changed[out->changed_count++] = now_rows[b];
+        }
+    }
+
+    qsort(out->removed, out->removed_count, sizeof(uint32_t), fs_row_compare);
+    qsort(out->inserted, out->inserted_count, sizeof(uint32_t), fs_row_compare);
+    qsort(out->changed, out->changed_count, sizeof(uint32_t), fs_row_compare);
+
+    // Deletes and inserts alone can only describe the change when the rows
+    // both listings share are still in the same relative order.
+    out->ordered = 1;
+    uint32_t last = 0;
+    int seen = 0;
+    for (size_t r = 0; r < n; r++)
+    {
+        if (moved[r] == UINT32_MAX) continue;
+        if (seen && moved[r] < last)
+        {
+            out->ordered = 0;
+            break;
+        }
+        last = moved[r];
+        seen = 1;
+    }
+
+done:
+    free(key_old);
+    free(key_now);
+    free(by_name_old);
+    free(by_name_now);
+    free(old_rows);
+    free(now_rows);
+    free(moved);
+    if (err) fs_diff_free(out);
+    return err;
+}
+
+void fs_diff_free(fs_diff* diff)
+{
+    free(diff->removed);
+    free(diff->inserted);
+    free(diff->changed);
+    memset(diff, 0, sizeof(*diff));
+}
@@ -0,0 +1,106 @@
+// File: fs_batch.h
+// Location: プロジェクト直下
+
+#ifndef FS_BATCH_H
+#define FS_BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Multi-item copy, move and delete. fsb_plan looks at the whole batch before
+// anything is touched: it resolves each destination name, counts conflicts,
+// decides per item whether a move is a rename (same device) or a copy plus
+// delete, and expands every copied or deleted folder into its files so the
+// totals are known. fsb_run then creates the folders in order and hands the
+// files to two pools of threads: many for small files, whose cost is the
+// open/create/rename latency, and a couple for large ones, which would only
+// fight over the disk's bandwidth if there were more. Folder modes and times
+// are restored last, deepest first. A failure stops only the item it belongs
+// to, and a moved item's source is removed only when all of it was copied.
+
+enum
+{
+    FSB_COPY = 0,
+    FSB_MOVE = 1,
+    FSB_DELETE = 2,
+};
+
+enum
+{
+    FSB_KEEP_BOTH = 0,             // a taken name becomes "name (1).ext"
+    FSB_SKIP = 1,                  // a taken name leaves the item alone
+};
+
+enum
+{
+    FSB_ITEM_RENAME = 0,
+    FSB_ITEM_COPY = 1,             // copy, then remove the source for a move
+    FSB_ITEM_DELETE = 2,
+    FSB_ITEM_SKIP = 3,             // conflict under FSB_SKIP, or moved onto itself
+};
+
+#define FSB_LARGE_FILE (1u << 20)  // files from this size go to the large pool
+
+typedef struct fsb_summary
+{
+    uint64_t items;
+    uint64_t files;                // entries to process, folders and renames count one each
+    uint64_t bytes;                // regular file data to copy
+    uint64_t conflicts;            // destination names that were taken
+    uint64_t renames;
+    uint64_t copies;
+    uint64_t failed;               // items that failed while planning or running
+} fsb_summary;
+
+typedef struct fsb_progress
+{
+    const char* phase;             // "copy", "delete", ... for logs
+    uint64_t files_done;
+    uint64_t files_total;
+    uint64_t bytes_done;
+    uint64_t bytes_total;
+    uint64_t failed;
+    double rate;                   // bytes per second
+    double file_rate;              // entries per second
+    double eta;                    // seconds left, -1 until there is a rate to go by
+} fsb_progress;
+
+// Called on the thread running fsb_run.
+typedef void (*fsb_progress_fn)(void* ctx, const fsb_progress* progress);
+
+typedef struct fsb_options
+{
+    int small_threads;             // 0 picks the default (8)
+    int large_threads;             // 0 picks the default (2)
+    fsb_progress_fn progress;      // may be NULL
+    void* ctx;
+    uint64_t interval_ns;          // between progress calls
+} fsb_options;
+
+typedef struct fsb_batch fsb_batch;
+
+void fsb_options_init(fsb_options* options);
+
+// Plans op for count paths into dir (ignored for FSB_DELETE). Items that
+// cannot be done (a missing source, a folder moved into itself) are planned
+// as failed rather than failing the batch. Returns 0, ECANCELED, ENOMEM or
+// an errno value for dir.
+int fsb_plan(int op, const char* const* paths, size_t count, const char* dir, int conflicts,
+             const volatile int* cancel, fsb_batch** out);
+void fsb_get_summary(const fsb_batch* batch, fsb_summary* summary);
+
+// Runs a plan once. Returns 0 even when items failed (see fsb_item_error),
+// ECANCELED, or ENOMEM/EAGAIN when the threads could not be set up.
+int fsb_run(fsb_batch* batch, const fsb_options* options, const volatile int* cancel);
+
+size_t fsb_item_count(const fsb_batch* batch);
+int fsb_item_action(const fsb_batch* batch, size_t item);
+const char* fsb_item_source(const fsb_batch* batch, size_t item);
+const char* fsb_item_destination(const fsb_batch* batch, size_t item);   // NULL for deletes and skips
+// 0, or the first errno the item hit and the path it hit it on.
+int fsb_item_error(const fsb_batch* batch, size_t item);
+const char* fsb_item_error_path(const fsb_batch* batch, size_t item);
+
+void fsb_free(fsb_batch* batch);
+
+#endif
@@ -0,0 +1,754 @@
+// File: fs_batch.c
+// Location: プロジェクト直下
+
+#include "fs_batch.h"
+#include "fs.h"
+#include "fs_copy.h"
+#include "fs_names.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__APPLE__)
+#define FSB_ATIME(st) ((st)->st_atimespec)
+#define FSB_MTIME(st) ((st)->st_mtimespec)
+#else
+#define FSB_ATIME(st) ((st)->st_atim)
+#define FSB_MTIME(st) ((st)->st_mtim)
+#endif
+
+#define FSB_DEFAULT_SMALL_THREADS 8
+#define FSB_DEFAULT_LARGE_THREADS 2
+#define FSB_MAX_THREADS 32
+#define FSB_DEFAULT_INTERVAL_NS 100000000ULL
+#define FSB_MAX_DEPTH 1024
+#define FSB_SMALL_BUFFER (64u << 10)
+
+typedef struct fsb_item
+{
+    size_t src;                    // offsets into the path arena; 0 is the empty string
+    size_t dst;
+    int action;
+    _Atomic int error;
+    char* error_path;              // written once, by whoever set error
+    size_t first;                  // its entries
+    size_t count;
+} fsb_item;
+
+// One folder, file or link under a copied or deleted item, folders before
+// their contents.
+typedef struct fsb_entry
+{
+    size_t src;
+    size_t dst;
+    uint64_t size;
+    uint32_t item;
+    uint32_t mode;
+    uint32_t uid;                  // uid, gid and times are only kept for folders
+    uint32_t gid;
+    struct timespec atime;
+    struct timespec mtime;
+} fsb_entry;
+
+struct fsb_batch
+{
+    int op;
+    fsb_item* items;
+    size_t item_count;
+    fsb_entry* entries;
+    size_t entry_count;
+    size_t entry_capacity;
+    char* paths;
+    size_t paths_used;
+    size_t paths_capacity;
+    fsb_summary summary;
+    _Atomic uint64_t failed;
+    int ran;
+};
+
+static uint64_t fsb_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int fsb_cancelled(const volatile int* cancel)
+{
+    return cancel && *cancel;
+}
+
+static int fsb_grow(void** data, size_t* capacity, size_t needed, size_t size)
+{
+    if (needed <= *capacity) return 0;
+    size_t n = *capacity ? *capacity : 64;
+    while (n < needed) n *= 2;
+    void* grown = realloc(*data, n * size);
+    if (!grown) return ENOMEM;
+    *data = grown;
+    *capacity = n;
+    return 0;
+}
+
+static int fsb_intern(fsb_batch* b, const char* path, size_t length, size_t* out)
+{
+    int err = fsb_grow((void**)&b->paths, &b->paths_capacity, b->paths_used + length + 1, 1);
+    if (err) return err;
+    memcpy(b->paths + b->paths_used, path, length);
+    b->paths[b->paths_used + length] = '\0';
+    *out = b->paths_used;
+    b->paths_used += length + 1;
+    return 0;
+}
+
+static const char* fsb_path(const fsb_batch* b, size_t offset)
+{
+    return b->paths + offset;
+}
+
+static void fsb_fail(fsb_batch* b, size_t item, int err, const char* path)
+{
+    int expected = 0;
+    if (!atomic_compare_exchange_strong(&b->items[item].error, &expected, err)) return;
+    b->items[item].error_path = strdup(path);
+    atomic_fetch_add(&b->failed, 1);
+}
+
+static int fsb_item_failed(const fsb_batch* b, size_t item)
+{
+    return atomic_load_explicit(&b->items[item].error, memory_order_relaxed) != 0;
+}
+
+#pragma mark - Plan
+
+static int fsb_add_entry(fsb_batch* b, size_t item, const char* src, size_t src_length, const char* dst, size_t dst_length,
+                         uint32_t mode, uint64_t size, const struct stat* st)
+{
+    int err = fsb_grow((void**)&b->entries, &b->entry_capacity, b->entry_count + 1, sizeof(fsb_entry));
+    if (err) return err;
+    fsb_entry* e = &b->entries[b->entry_count];
+    memset(e, 0, sizeof(*e));
+    e->item = (uint32_t)item;
+    e->mode = mode;
+    e->size = size;
+    if (st)
+    {
+        e->uid = st->st_uid;
+        e->gid = st->st_gid;
+        e->atime = FSB_ATIME(st);
+        e->mtime = FSB_MTIME(st);
+    }
+    err = fsb_intern(b, src, src_length, &e->src);
+    if (!err && dst) err = fsb_intern(b, dst, dst_length, &e->dst);
+    if (err) return err;
+    b->entry_count++;
+    return 0;
+}
+
+static int fsb_append(char* path, size_t length, const char* name, size_t* out)
+{
+    size_t n = strlen(name);
+    if (length + 1 + n >= PATH_MAX) return ENAMETOOLONG;
+    path[length] = '/';
+    memcpy(path + length + 1, name, n + 1);
+    *out = length + 1 + n;
+    return 0;
+}
+
+// Adds the folder at src and everything below it. dst is NULL for deletes.
+// Errors that belong to the item (an unreadable folder) fail the item;
+// only ENOMEM and ECANCELED end the plan.
+static int fsb_expand(fsb_batch* b, size_t item, char* src, size_t src_length, char* dst, size_t dst_length,
+                      const struct stat* st, int depth, const volatile int* cancel)
+{
+    if (depth >= FSB_MAX_DEPTH)
+    {
+        fsb_fail(b, item, ELOOP, src);
+        return 0;
+    }
+    int err = fsb_add_entry(b, item, src, src_length, dst, dst_length, st->st_mode, 0, st);
+    if (err) return err;
+    fs_listing l = {0};
+    err = fs_list_dir(src, FS_LIST_HIDDEN | FS_LIST_STAT, &l);
+    if (err)
+    {
+        fsb_fail(b, item, err, src);
+        return 0;
+    }
+    for (size_t i = 0; i < l.count && !err && !fsb_item_failed(b, item); i++)
+    {
+        if (fsb_cancelled(cancel))
+        {
+            err = ECANCELED;
+            break;
+        }
+        const char* name = fs_listing_name(&l, i);
+        size_t src_child = 0;
+        size_t dst_child = 0;
+        int name_err = fsb_append(src, src_length, name, &src_child);
+        if (!name_err && dst) name_err = fsb_append(dst, dst_length, name, &dst_child);
+        if (name_err) fsb_fail(b, item, name_err, src);
+        else if ((l.flags[i] & (FS_ENTRY_DIR | FS_ENTRY_LINK)) == FS_ENTRY_DIR)
+        {
+            struct stat child;
+            if (lstat(src, &child) != 0) fsb_fail(b, item, errno, src);
+            else err = fsb_expand(b, item, src, src_child, dst, dst_child, &child, depth + 1, cancel);
+        }
+        else
+        {
+            uint64_t size = S_ISREG(l.mode[i]) ? l.size[i] : 0;
+            err = fsb_add_entry(b, item, src, src_child, dst, dst_child, l.mode[i], size, NULL);
+        }
+        src[src_length] = '\0';
+        if (dst) dst[dst_length] = '\0';
+    }
+    fs_listing_free(&l);
+    return err;
+}
+
+static size_t fsb_trim(const char* path)
+{
+    size_t length = strlen(path);
+    while (length > 1 && path[length - 1] == '/') length--;
+    return length;
+}
+
+static int fsb_plan_item(fsb_batch* b, size_t item, const char* path, const char* dir, size_t dir_length,
+                         const struct stat* dir_st, fsn_dir* names, int conflicts, char* src, char* dst,
+                         const volatile int* cancel)
+{
+    fsb_item* it = &b->items[item];
+    size_t src_length = fsb_trim(path);
+    if (src_length == 0 || src_length >= PATH_MAX)
+    {
+        it->action = FSB_ITEM_SKIP;
+        fsb_fail(b, item, src_length ? ENAMETOOLONG : EINVAL, path);
+        return 0;
+    }
+    memcpy(src, path, src_length);
+    src[src_length] = '\0';
+    int err = fsb_intern(b, src, src_length, &it->src);
+    if (err) return err;
+    it->first = b->entry_count;
+
+    struct stat st;
+    if (lstat(src, &st) != 0)
+    {
+        it->action = FSB_ITEM_SKIP;
+        fsb_fail(b, item, errno, src);
+        return 0;
+    }
+    int is_dir = S_ISDIR(st.st_mode);
+
+    if (b->op == FSB_DELETE)
+    {
+        it->action = FSB_ITEM_DELETE;
+        if (is_dir) err = fsb_expand(b, item, src, src_length, NULL, 0, &st, 0, cancel);
+        else err = fsb_add_entry(b, item, src, src_length, NULL, 0, st.st_mode, 0, NULL);
+        it->count = b->entry_count - it->first;
+        b->summary.files += it->count;
+        return err;
+    }
+
+    const char* slash = strrchr(src, '/');
+    const char* name = slash ? slash + 1 : src;
+    memcpy(dst, dir, dir_length);
+    size_t dst_length;
+    if (fsb_append(dst, dir_length, name, &dst_length) != 0)
+    {
+        it->action = FSB_ITEM_SKIP;
+        fsb_fail(b, item, ENAMETOOLONG, src);
+        return 0;
+    }
+    if (strncmp(dst, src, src_length) == 0 && dst[src_length] == '/')
+    {
+        it->action = FSB_ITEM_SKIP;
+        fsb_fail(b, item, EINVAL, src);
+        return 0;
+    }
+    if (b->op == FSB_MOVE && strcmp(dst, src) == 0)
+    {
+        it->action = FSB_ITEM_SKIP;
+        return 0;
+    }
+    // Reserved names stay taken for the rest of the plan, so two items with
+    // the same name get different ones.
+    char picked[NAME_MAX + 1];
+    int name_err = fsn_reserve(names, name, picked, sizeof(picked));
+    if (!name_err && strcmp(picked, name) != 0)
+    {
+        b->summary.conflicts++;
+        if (conflicts == FSB_SKIP)
+        {
+            it->action = FSB_ITEM_SKIP;
+            return 0;
+        }
+        name_err = fsb_append(dst, dir_length, picked, &dst_length);
+    }
+    if (name_err)
+    {
+        it->action = FSB_ITEM_SKIP;
+        fsb_fail(b, item, name_err, src);
+        return name_err == ENOMEM ? ENOMEM : 0;
+    }
+    err = fsb_intern(b, dst, dst_length, &it->dst);
+    if (err) return err;
+
+    if (b->op == FSB_MOVE && st.st_dev == dir_st->st_dev)
+    {
+        it->action = FSB_ITEM_RENAME;
+        b->summary.renames++;
+        b->summary.files++;
+        return 0;
+    }
+    it->action = FSB_ITEM_COPY;
+    b->summary.copies++;
+    if (is_dir) err = fsb_expand(b, item, src, src_length, dst, dst_length, &st, 0, cancel);
+    else err = fsb_add_entry(b, item, src, src_length, dst, dst_length, st.st_mode,
+                             S_ISREG(st.st_mode) ? (uint64_t)st.st_size : 0, NULL);
+    it->count = b->entry_count - it->first;
+    // A move across devices visits every entry twice: copy, then remove.
+    b->summary.files += it->count * (b->op == FSB_MOVE ? 2 : 1);
+    return err;
+}
+
+void fsb_options_init(fsb_options* options)
+{
+    memset(options, 0, sizeof(*options));
+    options->small_threads = FSB_DEFAULT_SMALL_THREADS;
+    options->large_threads = FSB_DEFAULT_LARGE_THREADS;
+    options->interval_ns = FSB_DEFAULT_INTERVAL_NS;
+}
+
+int fsb_plan(int op, const char* const* paths, size_t count, const char* dir, int conflicts,
+             const volatile int* cancel, fsb_batch** out)
+{
+    *out = NULL;
+    if (op < FSB_COPY || op > FSB_DELETE || (op != FSB_DELETE && !dir)) return EINVAL;
+    fsb_batch* b = calloc(1, sizeof(fsb_batch));
+    char* src = malloc(PATH_MAX);
+    char* dst = malloc(PATH_MAX);
+    int err = b && src && dst ? 0 : ENOMEM;
+    if (!err)
+    {
+        b->op = op;
+        b->item_count = count;
+        b->items = calloc(count ? count : 1, sizeof(fsb_item));
+        err = b->items ? fsb_intern(b, "", 0, &(size_t){0}) : ENOMEM;
+    }
+
+    struct stat dir_st;
+    size_t dir_length = 0;
+    fsn_dir* names = NULL;
+    if (!err && op != FSB_DELETE)
+    {
+        dir_length = fsb_trim(dir);
+        if (dir_length >= PATH_MAX) err = ENAMETOOLONG;
+        else if (stat(dir, &dir_st) != 0) err = errno;
+        else err = fsn_open(dir, &names);
+    }
+    for (size_t i = 0; i < count && !err; i++)
+    {
+        if (fsb_cancelled(cancel)) err = ECANCELED;
+        else err = fsb_plan_item(b, i, paths[i], dir, dir_length, &dir_st, names, conflicts, src, dst, cancel);
+    }
+    fsn_close(names);
+    free(src);
+    free(dst);
+    if (err)
+    {
+        fsb_free(b);
+        return err;
+    }
+    b->summary.items = count;
+    for (size_t i = 0; i < b->entry_count; i++)
+        if (b->items[b->entries[i].item].action == FSB_ITEM_COPY) b->summary.bytes += b->entries[i].size;
+    *out = b;
+    return 0;
+}
+
+void fsb_get_summary(const fsb_batch* batch, fsb_summary* summary)
+{
+    *summary = batch->summary;
+    summary->failed = atomic_load(&((fsb_batch*)batch)->failed);
+}
+
+#pragma mark - Run
+
+typedef struct fsb_runner
+{
+    fsb_batch* b;
+    const fsb_options* options;
+    const volatile int* cancel;
+    const char* phase;
+    int removing;                  // the pools delete sources of moved items
+    uint32_t* small;
+    size_t small_count;
+    _Atomic size_t small_next;
+    uint32_t* large;
+    size_t large_count;
+    _Atomic size_t large_next;
+    _Atomic uint64_t files_done;
+    _Atomic uint64_t bytes_done;
+    int running;
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+    uint64_t started;
+    uint64_t last_report;
+} fsb_runner;
+
+typedef struct fsb_worker
+{
+    fsb_runner* r;
+    pthread_t thread;
+    int large;
+    uint64_t reported;             // bytes of the current file already added to bytes_done
+} fsb_worker;
+
+static void fsb_report(fsb_runner* r, int force)
+{
+    if (!r->options->progress) return;
+    uint64_t now = fsb_now();
+    if (!force && now - r->last_report < r->options->interval_ns) return;
+    r->last_report = now;
+    fsb_progress p = {0};
+    p.phase = r->phase;
+    p.files_done = atomic_load(&r->files_done);
+    p.files_total = r->b->summary.files;
+    p.bytes_done = atomic_load(&r->bytes_done);
+    p.bytes_total = r->b->summary.bytes;
+    p.failed = atomic_load(&r->b->failed);
+    double elapsed = (double)(now - r->started) / 1e9;
+    p.rate = elapsed > 0 ? (double)p.bytes_done / elapsed : 0;
+    p.file_rate = elapsed > 0 ? (double)p.files_done / elapsed : 0;
+    // Whichever of bytes and entries is further behind decides: a tree of
+    // tiny files is bound by entries, one big file by bytes.
+    p.eta = -1;
+    if (elapsed >= 0.5)
+    {
+        if (p.rate > 0 && p.bytes_total > p.bytes_done) p.eta = (double)(p.bytes_total - p.bytes_done) / p.rate;
+        if (p.file_rate > 0 && p.files_total >= p.files_done)
+        {
+            double eta = (double)(p.files_total - p.files_done) / p.file_rate;
+            if (eta > p.eta) p.eta = eta;
+        }
+    }
+    r->options->progress(r->options->ctx, &p);
+}
+
+static void fsb_file_progress(void* ctx, const fsc_progress* progress)
+{
+    fsb_worker* w = ctx;
+    if (progress->done > w->reported)
+    {
+        atomic_fetch_add(&w->r->bytes_done, progress->done - w->reported);
+        w->reported = progress->done;
+    }
+}
+
+static void fsb_process(fsb_worker* w, uint32_t index)
+{
+    fsb_runner* r = w->r;
+    fsb_batch* b = r->b;
+    const fsb_entry* e = &b->entries[index];
+    const char* src = fsb_path(b, e->src);
+    int copying = !r->removing && b->items[e->item].action == FSB_ITEM_COPY;
+    w->reported = 0;
+    if (!fsb_item_failed(b, e->item) && !fsb_cancelled(r->cancel))
+    {
+        int err = 0;
+        if (!copying) err = unlink(src) == 0 ? 0 : errno;
+        else
+        {
+            fsc_options options;
+            fsc_options_init(&options);
+            // Small files fit one read; a 1 MB pair per file would only cost page faults.
+            if (e->size < FSB_LARGE_FILE)
+                options.buffer_size = e->size > FSB_SMALL_BUFFER ? (size_t)e->size : FSB_SMALL_BUFFER;
+            else
+            {
+                options.progress = fsb_file_progress;
+                options.ctx = w;
+            }
+            err = fsc_copy(src, fsb_path(b, e->dst), &options, r->cancel);
+        }
+        if (err && err != ECANCELED) fsb_fail(b, e->item, err, src);
+    }
+    if (copying && e->size > w->reported) atomic_fetch_add(&r->bytes_done, e->size - w->reported);
+    atomic_fetch_add(&r->files_done, 1);
+}
+
+static int fsb_next(fsb_runner* r, int large, uint32_t* out)
+{
+    if (large)
+    {
+        size_t i = atomic_fetch_add(&r->large_next, 1);
+        if (i < r->large_count)
+        {
+            *out = r->large[i];
+            return 1;
+        }
+    }
+    // Large workers help with small files once theirs run out; small workers
+    // never take a large one, so at most large_threads stream at a time.
+    size_t i = atomic_fetch_add(&r->small_next, 1);
+    if (i >= r->small_count) return 0;
+    *out = r->small[i];
+    return 1;
+}
+
+static void* fsb_worker_main(void* arg)
+{
+    fsb_worker* w = arg;
+    fsb_runner* r = w->r;
+    uint32_t index;
+    while (!fsb_cancelled(r->cancel) && fsb_next(r, w->large, &index)) fsb_process(w, index);
+    pthread_mutex_lock(&r->lock);
+    r->running--;
+    pthread_cond_signal(&r->done);
+    pthread_mutex_unlock(&r->lock);
+    return NULL;
+}
+
+static int fsb_clamp_threads(int threads, int fallback, size_t work)
+{
+    if (threads <= 0) threads = fallback;
+    if (threads > FSB_MAX_THREADS) threads = FSB_MAX_THREADS;
+    if ((size_t)threads > work) threads = (int)work;
+    return threads;
+}
+
+// Runs the small and large lists on the two pools and reports progress from
+// this thread until they drain.
+static int fsb_run_pools(fsb_runner* r)
+{
+    atomic_store(&r->small_next, 0);
+    atomic_store(&r->large_next, 0);
+    int large = fsb_clamp_threads(r->options->large_threads, FSB_DEFAULT_LARGE_THREADS, r->large_count);
+    int small = fsb_clamp_threads(r->options->small_threads, FSB_DEFAULT_SMALL_THREADS, r->small_count);
+    if (large + small == 0) return 0;
+    fsb_worker* workers = calloc((size_t)(large + small), sizeof(fsb_worker));
+    if (!workers) return ENOMEM;
+    int started = 0;
+    for (; started < large + small; started++)
+    {
+        workers[started].r = r;
+        workers[started].large = started < large;
+        pthread_mutex_lock(&r->lock);
+        r->running++;
+        pthread_mutex_unlock(&r->lock);
+        if (pthread_create(&workers[started].thread, NULL, fsb_worker_main, &workers[started]) != 0)
+        {
+            pthread_mutex_lock(&r->lock);
+            r->running--;
+            pthread_mutex_unlock(&r->lock);
+            break;
+        }
+    }
+    // Without a single thread the lists would never drain; with a few they still do.
+    int err = started == 0 ? EAGAIN : 0;
+
+    pthread_mutex_lock(&r->lock);
+    while (r->running > 0)
+    {
+        struct timeval now;
+        gettimeofday(&now, NULL);
+        uint64_t wake = (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_usec * 1000ULL + r->options->interval_ns;
+        struct timespec deadline = {(time_t)(wake / 1000000000ULL), (long)(wake % 1000000000ULL)};
+        pthread_cond_timedwait(&r->done, &r->lock, &deadline);
+        pthread_mutex_unlock(&r->lock);
+        fsb_report(r, 0);
+        pthread_mutex_lock(&r->lock);
+    }
+    pthread_mutex_unlock(&r->lock);
+    for (int i = 0; i < started; i++) pthread_join(workers[i].thread, NULL);
+    free(workers);
+    return err;
+}
+
+static void fsb_restore_folder(fsb_batch* b, const fsb_entry* e)
+{
+    const char* dst = fsb_path(b, e->dst);
+    int err = chmod(dst, e->mode & 07777) == 0 ? 0 : errno;
+    if (!err && lchown(dst, e->uid, e->gid) != 0 && errno != EPERM) err = errno;
+    struct timespec times[2] = {e->atime, e->mtime};
+    if (!err && utimensat(AT_FDCWD, dst, times, 0) != 0) err = errno;
+    if (err) fsb_fail(b, e->item, err, dst);
+}
+
+// Queues the non-folder entries of the items want() accepts and runs them.
+static int fsb_run_files(fsb_runner* r, int (*want)(const fsb_batch*, const fsb_item*))
+{
+    fsb_batch* b = r->b;
+    r->small_count = 0;
+    r->large_count = 0;
+    for (size_t i = 0; i < b->entry_count; i++)
+    {
+        const fsb_entry* e = &b->entries[i];
+        if (S_ISDIR(e->mode) || !want(b, &b->items[e->item])) continue;
+        int large = !r->removing && e->size >= FSB_LARGE_FILE;
+        if (large) r->large[r->large_count++] = (uint32_t)i;
+        else r->small[r->small_count++] = (uint32_t)i;
+    }
+    return fsb_run_pools(r);
+}
+
+static int fsb_wants_copy(const fsb_batch* b, const fsb_item* it)
+{
+    (void)b;
+    return it->action == FSB_ITEM_COPY || it->action == FSB_ITEM_DELETE;
+}
+
+static int fsb_wants_removal(const fsb_batch* b, const fsb_item* it)
+{
+    return b->op == FSB_MOVE && it->action == FSB_ITEM_COPY && !atomic_load(&it->error);
+}
+
+int fsb_run(fsb_batch* batch, const fsb_options* options, const volatile int* cancel)
+{
+    fsb_options defaults;
+    if (!options)
+    {
+        fsb_options_init(&defaults);
+        options = &defaults;
+    }
+    if (batch->ran) return EINVAL;
+    batch->ran = 1;
+
+    fsb_runner* r = calloc(1, sizeof(fsb_runner));
+    if (!r) return ENOMEM;
+    r->b = batch;
+    r->options = options;
+    r->cancel = cancel;
+    r->small = malloc((batch->entry_count ? batch->entry_count : 1) * sizeof(uint32_t));
+    r->large = malloc((batch->entry_count ? batch->entry_count : 1) * sizeof(uint32_t));
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->done, NULL);
+    r->started = fsb_now();
+    int err = r->small && r->large ? 0 : ENOMEM;
+
+    // Renames are single metadata operations and cheapest done right here.
+    r->phase = "rename";
+    for (size_t i = 0; i < batch->item_count && !err; i++)
+    {
+        fsb_item* it = &batch->items[i];
+        if (it->action != FSB_ITEM_RENAME) continue;
+        if (fsb_cancelled(cancel))
+        {
+            err = ECANCELED;
+            break;
+        }
+        const char* dst = fsb_path(batch, it->dst);
+        int rename_err = fsn_rename_exclusive(fsb_path(batch, it->src), dst);
+        if (rename_err) fsb_fail(batch, i, rename_err, rename_err == EEXIST ? dst : fsb_path(batch, it->src));
+        atomic_fetch_add(&r->files_done, 1);
+        fsb_report(r, 0);
+    }
+
+    // Folders in plan order, parents first; owner-writable until filled.
+    r->phase = "folders";
+    for (size_t i = 0; i < batch->entry_count && !err; i++)
+    {
+        const fsb_entry* e = &batch->entries[i];
+        if (!S_ISDIR(e->mode) || batch->items[e->item].action != FSB_ITEM_COPY) continue;
+        if (fsb_cancelled(cancel)) err = ECANCELED;
+        else if (!fsb_item_failed(batch, e->item) && mkdir(fsb_path(batch, e->dst), 0700) != 0)
+            fsb_fail(batch, e->item, errno, fsb_path(batch, e->dst));
+        atomic_fetch_add(&r->files_done, 1);
+        fsb_report(r, 0);
+    }
+
+    r->phase = batch->op == FSB_DELETE ? "delete" : "copy";
+    if (!err) err = fsb_run_files(r, fsb_wants_copy);
+    if (!err && fsb_cancelled(cancel)) err = ECANCELED;
+
+    // Deepest folders first, so a parent's times are set after its children
+    // stop changing it and a deleted folder is already empty.
+    for (size_t i = batch->entry_count; i-- > 0 && !err;)
+    {
+        const fsb_entry* e = &batch->entries[i];
+        const fsb_item* it = &batch->items[e->item];
+        if (!S_ISDIR(e->mode) || fsb_item_failed(batch, e->item)) continue;
+        if (it->action == FSB_ITEM_COPY) fsb_restore_folder(batch, e);
+        else if (it->action == FSB_ITEM_DELETE)
+        {
+            if (rmdir(fsb_path(batch, e->src)) != 0) fsb_fail(batch, e->item, errno, fsb_path(batch, e->src));
+            atomic_fetch_add(&r->files_done, 1);
+        }
+    }
+
+    if (!err && batch->op == FSB_MOVE)
+    {
+        r->phase = "remove";
+        r->removing = 1;
+        err = fsb_run_files(r, fsb_wants_removal);
+        if (!err && fsb_cancelled(cancel)) err = ECANCELED;
+        for (size_t i = batch->entry_count; i-- > 0 && !err;)
+        {
+            const fsb_entry* e = &batch->entries[i];
+            if (!S_ISDIR(e->mode) || !fsb_wants_removal(batch, &batch->items[e->item])) continue;
+            if (rmdir(fsb_path(batch, e->src)) != 0) fsb_fail(batch, e->item, errno, fsb_path(batch, e->src));
+            atomic_fetch_add(&r->files_done, 1);
+        }
+    }
+    if (!err) fsb_report(r, 1);
+
+    pthread_mutex_destroy(&r->lock);
+    pthread_cond_destroy(&r->done);
+    free(r->small);
+    free(r->large);
+    free(r);
+    return err;
+}
+
+#pragma mark - Results
+
+size_t fsb_item_count(const fsb_batch* batch)
+{
+    return batch->item_count;
+}
+
+int fsb_item_action(const fsb_batch* batch, size_t item)
+{
+    return batch->items[item].action;
+}
+
+const char* fsb_item_source(const fsb_batch* batch, size_t item)
+{
+    return fsb_path(batch, batch->items[item].src);
+}
+
+const char* fsb_item_destination(const fsb_batch* batch, size_t item)
+{
+    const fsb_item* it = &batch->items[item];
+    return it->dst && it->action != FSB_ITEM_SKIP ? fsb_path(batch, it->dst) : NULL;
+}
+
+int fsb_item_error(const fsb_batch* batch, size_t item)
+{
+    return atomic_load(&((fsb_batch*)batch)->items[item].error);
+}
+
+const char* fsb_item_error_path(const fsb_batch* batch, size_t item)
+{
+    return batch->items[item].error_path;
+}
+
+void fsb_free(fsb_batch* batch)
+{
+    if (!batch) return;
+    for (size_t i = 0; batch->items && i < batch->item_count; i++) free(batch->items[i].error_path);
+    free(batch->items);
+    free(batch->entries);
+    free(batch->paths);
+    free(batch);
+}
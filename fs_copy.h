@@ -0,0 +1,61 @@
+// File: fs_copy.h
+// Location: プロジェクト直下
+
+#ifndef FS_COPY_H
+#define FS_COPY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// File and tree copy. Each file is first cloned (clonefile on APFS, FICLONE
+// on Linux), else copied in the kernel (copy_file_range, then sendfile), else
+// through two bounded buffers with reads and writes overlapped. Data goes to
+// a hidden ".<name>.fscopy" next to the destination that is renamed into
+// place once mode, owner, times and extended attributes are set, so a
+// destination name never holds a partial file. Symbolic links are copied as
+// links.
+
+enum
+{
+    FSC_RESUME = 1 << 0,           // continue what an interrupted copy left at dst
+    FSC_SYNC = 1 << 1,             // fsync each file before it is renamed into place
+};
+
+typedef struct fsc_progress
+{
+    const char* path;              // source file being copied
+    uint64_t file_done;
+    uint64_t file_size;
+    uint64_t done;                 // bytes of the whole copy, skipped files included
+    uint64_t total;
+    uint64_t files_done;
+    uint64_t files_total;
+    double file_rate;              // bytes per second written for this file
+    double rate;                   // bytes per second written since the copy started
+} fsc_progress;
+
+// Called on the thread running fsc_copy.
+typedef void (*fsc_progress_fn)(void* ctx, const fsc_progress* progress);
+
+typedef struct fsc_options
+{
+    int flags;
+    size_t buffer_size;            // each of the two buffers; memory use does not grow with file size
+    fsc_progress_fn progress;      // may be NULL
+    void* ctx;
+    uint64_t interval_ns;          // between progress calls; every finished file also reports
+} fsc_options;
+
+void fsc_options_init(fsc_options* options);
+
+// Copies src (file, link or directory tree) to dst, which must not exist.
+// With FSC_RESUME, dst may hold an earlier attempt: files whose size and mtime
+// already match are skipped and a partial file continues from its length,
+// provided it was started from the same source (device, inode, size and
+// mtime); otherwise it is removed and the file is copied again.
+// Without it, a failed or cancelled copy removes its partial file but keeps
+// the files it finished. Returns 0, ECANCELED, EEXIST, EINVAL when dst is
+// inside src, or an errno value.
+int fsc_copy(const char* src, const char* dst, const fsc_options* options, const volatile int* cancel);
+
+#endif
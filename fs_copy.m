@@ -0,0 +1,621 @@
+// File: fs_copy.c
+// Location: プロジェクト直下
+
+#if defined(__linux__)
+#define _GNU_SOURCE                        // copy_file_range
+#endif
+
+#include "fs_copy.h"
+#include "fs.h"
+#include "fs_names.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__APPLE__)
+#include <copyfile.h>
+#include <sys/clonefile.h>
+#define FSC_ATIME(st) ((st)->st_atimespec)
+#define FSC_MTIME(st) ((st)->st_mtimespec)
+#else
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <linux/fs.h>
+#define FSC_ATIME(st) ((st)->st_atim)
+#define FSC_MTIME(st) ((st)->st_mtim)
+#endif
+
+#define FSC_DEFAULT_BUFFER (1u << 20)
+#define FSC_DEFAULT_INTERVAL_NS 100000000ULL
+#define FSC_KERNEL_CHUNK (8u << 20)        // per kernel copy call, so progress and cancel stay responsive
+#define FSC_MAX_DEPTH 1024
+#define FSC_STAMP_XATTR "user.fscopy.source"
+
+typedef struct fsc_job
+{
+    const fsc_options* options;
+    const volatile int* cancel;
+    fsc_progress progress;
+    uint64_t started;
+    uint64_t file_started;
+    uint64_t last_report;
+    uint64_t written;              // bytes this call wrote, for the rates
+    uint64_t file_written;
+    int kernel_copy;               // cleared once the kernel turns copy_file_range down for good
+    uint8_t* buffers[2];
+    char src[PATH_MAX];
+    char dst[PATH_MAX];
+    char partial[PATH_MAX];
+} fsc_job;
+
+static uint64_t fsc_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int fsc_cancelled(const fsc_job* j)
+{
+    return j->cancel && *j->cancel;
+}
+
+static void fsc_report(fsc_job* j, int force)
+{
+    if (!j->options->progress) return;
+    uint64_t now = fsc_now();
+    if (!force && now - j->last_report < j->options->interval_ns) return;
+    j->last_report = now;
+    double elapsed = (double)(now - j->started) / 1e9;
+    double file_elapsed = (double)(now - j->file_started) / 1e9;
+    j->progress.rate = elapsed > 0 ? (double)j->written / elapsed : 0;
+    j->progress.file_rate = file_elapsed > 0 ? (double)j->file_written / file_elapsed : 0;
+    j->options->progress(j->options->ctx, &j->progress);
+}
+
+static void fsc_advance(fsc_job* j, uint64_t bytes)
+{
+    j->progress.file_done += bytes;
+    j->progress.done += bytes;
+    j->written += bytes;
+    j->file_written += bytes;
+    fsc_report(j, 0);
+}
+
+static int fsc_append(char* path, size_t length, const char* name, size_t* out)
+{
+    size_t n = strlen(name);
+    if (length + 1 + n >= PATH_MAX) return ENAMETOOLONG;
+    path[length] = '/';
+    memcpy(path + length + 1, name, n + 1);
+    *out = length + 1 + n;
+    return 0;
+}
+
+#pragma mark - Plan
+
+// Counts the files and bytes under j->src so progress has a total.
+static int fsc_measure(fsc_job* j, size_t length, int depth)
+{
+    if (depth >= FSC_MAX_DEPTH) return ELOOP;
+    fs_listing l = {0};
+    int err = fs_list_dir(j->src, FS_LIST_HIDDEN | FS_LIST_STAT, &l);
+    for (size_t i = 0; i < l.count && !err; i++)
+    {
+        if (fsc_cancelled(j))
+        {
+            err = ECANCELED;
+            break;
+        }
+        if ((l.flags[i] & (FS_ENTRY_DIR | FS_ENTRY_LINK)) == FS_ENTRY_DIR)
+        {
+            size_t n;
+            err = fsc_append(j->src, length, fs_listing_name(&l, i), &n);
+            if (!err) err = fsc_measure(j, n, depth + 1);
+            j->src[length] = '\0';
+            continue;
+        }
+        j->progress.files_total++;
+        if (S_ISREG(l.mode[i])) j->progress.total += l.size[i];
+    }
+    fs_listing_free(&l);
+    return err;
+}
+
+#pragma mark - Data
+
+static int fsc_pwrite_all(int fd, const uint8_t* data, size_t size, uint64_t offset)
+{
+    while (size)
+    {
+        ssize_t n = pwrite(fd, data, size, (off_t)offset);
+        if (n < 0)
+        {
+            if (errno == EINTR) continue;
+            return errno;
+        }
+        data += n;
+        size -= (size_t)n;
+        offset += (uint64_t)n;
+    }
+    return 0;
+}
+
+static ssize_t fsc_pread(int fd, uint8_t* data, size_t size, uint64_t offset)
+{
+    ssize_t n;
+    do n = pread(fd, data, size, (off_t)offset);
+    while (n < 0 && errno == EINTR);
+    return n;
+}
+
+// Two buffers handed back and forth between the caller, which reads, and a
+// writer thread, so reading the next chunk overlaps writing the last one.
+typedef struct fsc_pipe
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint8_t* buffers[2];
+    size_t lengths[2];
+    uint64_t offsets[2];
+    int full[2];
+    int done;
+    int err;
+    int fd;
+    atomic_uint_fast64_t written;
+} fsc_pipe;
+
+static void* fsc_writer_main(void* arg)
+{
+    fsc_pipe* p = arg;
+    for (int i = 0;; i ^= 1)
+    {
+        pthread_mutex_lock(&p->lock);
+        while (!p->full[i] && !p->done && !p->err) pthread_cond_wait(&p->cond, &p->lock);
+        int ready = p->full[i] && !p->err;
+        pthread_mutex_unlock(&p->lock);
+        if (!ready) break;
+
+        size_t length = p->lengths[i];
+        int err = fsc_pwrite_all(p->fd, p->buffers[i], length, p->offsets[i]);
+        if (!err) atomic_fetch_add(&p->written, length);
+        pthread_mutex_lock(&p->lock);
+        if (err && !p->err) p->err = err;
+        p->full[i] = 0;
+        pthread_cond_broadcast(&p->cond);
+        pthread_mutex_unlock(&p->lock);
+        if (err) break;
+    }
+    return NULL;
+}
+
+static int fsc_copy_pipelined(fsc_job* j, int in, int out, uint64_t offset)
+{
+    size_t size = j->options->buffer_size;
+    fsc_pipe p;
+    memset(&p, 0, sizeof(p));
+    pthread_mutex_init(&p.lock, NULL);
+    pthread_cond_init(&p.cond, NULL);
+    p.buffers[0] = j->buffers[0];
+    p.buffers[1] = j->buffers[1];
+    p.fd = out;
+    atomic_init(&p.written, 0);
+    pthread_t writer;
+    int err = pthread_create(&writer, NULL, fsc_writer_main, &p);
+    if (err)
+    {
+        pthread_cond_destroy(&p.cond);
+        pthread_mutex_destroy(&p.lock);
+        return err;
+    }
+
+    uint64_t reported = 0;
+    for (int i = 0;; i ^= 1)
+    {
+        pthread_mutex_lock(&p.lock);
+        if (fsc_cancelled(j) && !p.err) p.err = ECANCELED;
+        while (p.full[i] && !p.err) pthread_cond_wait(&p.cond, &p.lock);
+        int stop = p.err != 0;
+        pthread_mutex_unlock(&p.lock);
+        if (stop) break;
+
+        ssize_t n = fsc_pread(in, p.buffers[i], size, offset);
+        pthread_mutex_lock(&p.lock);
+        if (n < 0 && !p.err) p.err = errno;
+        if (n > 0)
+        {
+            p.lengths[i] = (size_t)n;
+            p.offsets[i] = offset;
+            p.full[i] = 1;
+        }
+        pthread_cond_broadcast(&p.cond);
+        pthread_mutex_unlock(&p.lock);
+        if (n <= 0) break;
+        offset += (uint64_t)n;
+
+        uint64_t written = atomic_load(&p.written);
+        fsc_advance(j, written - reported);
+        reported = written;
+    }
+
+    pthread_mutex_lock(&p.lock);
+    p.done = 1;
+    pthread_cond_broadcast(&p.cond);
+    pthread_mutex_unlock(&p.lock);
+    pthread_join(writer, NULL);
+    fsc_advance(j, atomic_load(&p.written) - reported);
+    err = p.err;
+    pthread_cond_destroy(&p.cond);
+    pthread_mutex_destroy(&p.lock);
+    return err;
+}
+
+// Read/write fallback; small files skip the writer thread.
+static int fsc_copy_buffered(fsc_job* j, int in, int out, uint64_t offset, uint64_t size)
+{
+    size_t buffer = j->options->buffer_size;
+    if (size > offset && size - offset > 2 * (uint64_t)buffer) return fsc_copy_pipelined(j, in, out, offset);
+    for (;;)
+    {
+        if (fsc_cancelled(j)) return ECANCELED;
+        ssize_t n = fsc_pread(in, j->buffers[0], buffer, offset);
+        if (n < 0) return errno;
+        if (n == 0) return 0;
+        int err = fsc_pwrite_all(out, j->buffers[0], (size_t)n, offset);
+        if (err) return err;
+        offset += (uint64_t)n;
+        fsc_advance(j, (uint64_t)n);
+    }
+}
+
+static int fsc_copy_data(fsc_job* j, int in, int out, uint64_t offset, uint64_t size)
+{
+#if defined(__linux__)
+    // Returns to the next method whenever the kernel declines this pair of
+    // files; offsets are explicit, so whatever it already copied stays.
+    while (j->kernel_copy)
+    {
+        if (fsc_cancelled(j)) return ECANCELED;
+        loff_t from = (loff_t)offset;
+        loff_t to = (loff_t)offset;
+        ssize_t n = copy_file_range(in, &from, out, &to, FSC_KERNEL_CHUNK, 0);
+        if (n > 0)
+        {
+            offset += (uint64_t)n;
+            fsc_advance(j, (uint64_t)n);
+            continue;
+        }
+        if (n == 0) return 0;
+        if (errno == EINTR) continue;
+        if (errno == ENOSYS) j->kernel_copy = 0;
+        if (errno != ENOSYS && errno != EXDEV && errno != EINVAL && errno != EOPNOTSUPP && errno != EBADF) return errno;
+        break;
+    }
+    if (lseek(out, (off_t)offset, SEEK_SET) >= 0)
+    {
+        for (;;)
+        {
+            if (fsc_cancelled(j)) return ECANCELED;
+            off_t from = (off_t)offset;
+            ssize_t n = sendfile(out, in, &from, FSC_KERNEL_CHUNK);
+            if (n > 0)
+            {
+                offset += (uint64_t)n;
+                fsc_advance(j, (uint64_t)n);
+                continue;
+            }
+            if (n == 0) return 0;
+            if (errno == EINTR) continue;
+            if (errno != EINVAL && errno != ENOSYS) return errno;
+            break;
+        }
+    }
+#endif
+    return fsc_copy_buffered(j, in, out, offset, size);
+}
+
+#pragma mark - Entries
+
+static int fsc_copy_entry(fsc_job* j, size_t src_length, size_t dst_length, int depth);
+
+// Mode, owner (when allowed), extended attributes and times, in that order so
+// nothing after the times touches them again.
+static int fsc_copy_metadata(const fsc_job* j, int in, int out, const struct stat* st)
+{
+    if (fchmod(out, st->st_mode & 07777) != 0) return errno;
+    // Only root may give files away; the copy then keeps the caller as owner.
+    if (fchown(out, st->st_uid, st->st_gid) != 0 && errno != EPERM) return errno;
+#if defined(__APPLE__)
+    fcopyfile(in, out, NULL, COPYFILE_XATTR);
+#else
+    (void)in;
+#endif
+    struct timespec times[2] = {FSC_ATIME(st), FSC_MTIME(st)};
+    if (futimens(out, times) != 0) return errno;
+    if ((j->options->flags & FSC_SYNC) && fsync(out) != 0) return errno;
+    return 0;
+}
+
+// The source a partial file was started from, kept in an attribute on the
+// partial: a resume continues only from the same version of the source.
+typedef struct fsc_stamp
+{
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+} fsc_stamp;
+
+static fsc_stamp fsc_stamp_of(const struct stat* st)
+{
+    return (fsc_stamp){(uint64_t)st->st_dev, (uint64_t)st->st_ino, (uint64_t)st->st_size,
+                       (int64_t)FSC_MTIME(st).tv_sec, (int64_t)FSC_MTIME(st).tv_nsec};
+}
+
+// Best effort: where attributes are unsupported the partial has no stamp and
+// a resume starts over.
+static void fsc_stamp_set(int fd, const struct stat* st)
+{
+    fsc_stamp stamp = fsc_stamp_of(st);
+#if defined(__APPLE__)
+    fsetxattr(fd, FSC_STAMP_XATTR, &stamp, sizeof(stamp), 0, 0);
+#else
+    fsetxattr(fd, FSC_STAMP_XATTR, &stamp, sizeof(stamp), 0);
+#endif
+}
+
+static int fsc_stamp_matches(int fd, const struct stat* st)
+{
+    fsc_stamp stamp, expected = fsc_stamp_of(st);
+#if defined(__APPLE__)
+    ssize_t n = fgetxattr(fd, FSC_STAMP_XATTR, &stamp, sizeof(stamp), 0, 0);
+#else
+    ssize_t n = fgetxattr(fd, FSC_STAMP_XATTR, &stamp, sizeof(stamp));
+#endif
+    return n == (ssize_t)sizeof(stamp) && memcmp(&stamp, &expected, sizeof(stamp)) == 0;
+}
+
+static void fsc_stamp_clear(int fd)
+{
+#if defined(__APPLE__)
+    fremovexattr(fd, FSC_STAMP_XATTR, 0);
+#else
+    fremovexattr(fd, FSC_STAMP_XATTR);
+#endif
+}
+
+static int fsc_copy_file(fsc_job* j, const struct stat* st)
+{
+    j->progress.path = j->src;
+    j->progress.file_done = 0;
+    j->progress.file_size = (uint64_t)st->st_size;
+    j->file_started = fsc_now();
+    j->file_written = 0;
+    int resume = (j->options->flags & FSC_RESUME) != 0;
+
+    struct stat existing;
+    if (lstat(j->dst, &existing) == 0)
+    {
+        if (!resume || !S_ISREG(existing.st_mode) || existing.st_size != st->st_size
+            || FSC_MTIME(&existing).tv_sec != FSC_MTIME(st).tv_sec || FSC_MTIME(&existing).tv_nsec != FSC_MTIME(st).tv_nsec)
+            return EEXIST;
+        j->progress.file_done = (uint64_t)st->st_size;
+        j->progress.done += (uint64_t)st->st_size;
+        j->progress.files_done++;
+        fsc_report(j, 1);
+        return 0;
+    }
+
+    const char* slash = strrchr(j->dst, '/');
+    int dir_length = slash ? (int)(slash - j->dst) : 0;
+    const char* name = slash ? slash + 1 : j->dst;
+    if (snprintf(j->partial, sizeof(j->partial), "%.*s%s.%s.fscopy", dir_length, j->dst, slash ? "/" : "", name)
+        >= (int)sizeof(j->partial))
+        return ENAMETOOLONG;
+
+    int in = open(j->src, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+    if (in < 0) return errno;
+    uint64_t offset = 0;
+    int cloned = 0;
+    int out = resume ? open(j->partial, O_WRONLY | O_CLOEXEC | O_NOFOLLOW) : -1;
+    if (out >= 0)
+    {
+        struct stat partial;
+        if (fstat(out, &partial) == 0 && S_ISREG(partial.st_mode) && partial.st_size <= st->st_size
+            && fsc_stamp_matches(out, st))
+            offset = (uint64_t)partial.st_size;
+        else
+        {
+            // Left by another version of the source, or by a copy that
+            // could not stamp it: its bytes cannot be trusted.
+            close(out);
+            out = -1;
+            unlink(j->partial);
+        }
+    }
+    if (out < 0)
+    {
+#if defined(__APPLE__)
+        unlink(j->partial);
+        if (clonefile(j->src, j->partial, CLONE_NOFOLLOW) == 0)
+        {
+            out = open(j->partial, O_WRONLY | O_CLOEXEC | O_NOFOLLOW);
+            cloned = out >= 0;
+        }
+#endif
+        if (out < 0) out = open(j->partial, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_NOFOLLOW, 0600);
+#if defined(FICLONE)
+        if (out >= 0 && !cloned) cloned = ioctl(out, FICLONE, in) == 0;
+#endif
+        if (out >= 0 && !cloned) fsc_stamp_set(out, st);
+    }
+    if (out < 0)
+    {
+        int err = errno;
+        close(in);
+        return err;
+    }
+
+    int err = 0;
+    if (cloned) fsc_advance(j, (uint64_t)st->st_size);
+    else
+    {
+        // Resumed bytes count as done but not toward the rates.
+        j->progress.file_done += offset;
+        j->progress.done += offset;
+        err = fsc_copy_data(j, in, out, offset, (uint64_t)st->st_size);
+        if (!err) fsc_stamp_clear(out);
+    }
+    if (!err) err = fsc_copy_metadata(j, in, out, st);
+    if (close(out) != 0 && !err) err = errno;
+    close(in);
+    // Exclusive, so a file that appeared at dst meanwhile is reported, not replaced.
+    if (!err) err = fsn_rename_exclusive(j->partial, j->dst);
+    if (err && !resume) unlink(j->partial);
+    if (err) return err;
+    j->progress.files_done++;
+    fsc_report(j, 1);
+    return 0;
+}
+
+static int fsc_copy_link(fsc_job* j, const struct stat* st)
+{
+    char target[PATH_MAX];
+    ssize_t n = readlink(j->src, target, sizeof(target) - 1);
+    if (n < 0) return errno;
+    target[n] = '\0';
+    if (symlink(target, j->dst) != 0)
+    {
+        int err = errno;
+        char existing[PATH_MAX];
+        ssize_t m = err == EEXIST && (j->options->flags & FSC_RESUME) ? readlink(j->dst, existing, sizeof(existing)) : -1;
+        if (m != n || memcmp(existing, target, (size_t)n) != 0) return err;
+    }
+    if (lchown(j->dst, st->st_uid, st->st_gid) != 0 && errno != EPERM) return errno;
+    struct timespec times[2] = {FSC_ATIME(st), FSC_MTIME(st)};
+    if (utimensat(AT_FDCWD, j->dst, times, AT_SYMLINK_NOFOLLOW) != 0) return errno;
+    j->progress.files_done++;
+    fsc_report(j, 1);
+    return 0;
+}
+
+static int fsc_copy_dir(fsc_job* j, size_t src_length, size_t dst_length, const struct stat* st, int depth)
+{
+    if (depth >= FSC_MAX_DEPTH) return ELOOP;
+    // Owner-writable until its entries are in, whatever the source mode is.
+    if (mkdir(j->dst, 0700) != 0)
+    {
+        int err = errno;
+        struct stat existing;
+        if (err != EEXIST || !(j->options->flags & FSC_RESUME) || lstat(j->dst, &existing) != 0 || !S_ISDIR(existing.st_mode))
+            return err;
+    }
+    fs_listing l = {0};
+    int err = fs_list_dir(j->src, FS_LIST_HIDDEN, &l);
+    for (size_t i = 0; i < l.count && !err; i++)
+    {
+        if (fsc_cancelled(j))
+        {
+            err = ECANCELED;
+            break;
+        }
+        size_t src_child;
+        size_t dst_child;
+        err = fsc_append(j->src, src_length, fs_listing_name(&l, i), &src_child);
+        if (!err) err = fsc_append(j->dst, dst_length, fs_listing_name(&l, i), &dst_child);
+        if (!err) err = fsc_copy_entry(j, src_child, dst_child, depth + 1);
+        j->src[src_length] = '\0';
+        j->dst[dst_length] = '\0';
+    }
+    fs_listing_free(&l);
+    if (err) return err;
+
+    if (chmod(j->dst, st->st_mode & 07777) != 0) return errno;
+    if (lchown(j->dst, st->st_uid, st->st_gid) != 0 && errno != EPERM) return errno;
+    struct timespec times[2] = {FSC_ATIME(st), FSC_MTIME(st)};
+    return utimensat(AT_FDCWD, j->dst, times, 0) == 0 ? 0 : errno;
+}
+
+static int fsc_copy_entry(fsc_job* j, size_t src_length, size_t dst_length, int depth)
+{
+    struct stat st;
+    if (lstat(j->src, &st) != 0) return errno;
+    if (S_ISLNK(st.st_mode)) return fsc_copy_link(j, &st);
+    if (S_ISDIR(st.st_mode)) return fsc_copy_dir(j, src_length, dst_length, &st, depth);
+    if (S_ISREG(st.st_mode)) return fsc_copy_file(j, &st);
+    j->progress.files_done++;      // sockets and devices are left out
+    return 0;
+}
+
+void fsc_options_init(fsc_options* options)
+{
+    memset(options, 0, sizeof(*options));
+    options->buffer_size = FSC_DEFAULT_BUFFER;
+    options->interval_ns = FSC_DEFAULT_INTERVAL_NS;
+}
+
+static size_t fsc_trim(const char* path)
+{
+    size_t length = strlen(path);
+    while (length > 1 && path[length - 1] == '/') length--;
+    return length;
+}
+
+int fsc_copy(const char* src, const char* dst, const fsc_options* options, const volatile int* cancel)
+{
+    fsc_options defaults;
+    if (!options)
+    {
+        fsc_options_init(&defaults);
+        options = &defaults;
+    }
+    size_t src_length = fsc_trim(src);
+    size_t dst_length = fsc_trim(dst);
+    if (src_length == 0 || dst_length == 0 || options->buffer_size == 0) return EINVAL;
+    if (src_length >= PATH_MAX || dst_length >= PATH_MAX) return ENAMETOOLONG;
+    if (strncmp(src, dst, src_length) == 0 && (dst_length == src_length || dst[src_length] == '/')) return EINVAL;
+
+    fsc_job* j = calloc(1, sizeof(fsc_job));
+    if (!j) return ENOMEM;
+    j->options = options;
+    j->cancel = cancel;
+    j->kernel_copy = 1;
+    memcpy(j->src, src, src_length);
+    memcpy(j->dst, dst, dst_length);
+
+    struct stat st;
+    int err = lstat(j->src, &st) == 0 ? 0 : errno;
+    if (!err && S_ISDIR(st.st_mode)) err = fsc_measure(j, src_length, 0);
+    else if (!err)
+    {
+        j->progress.files_total = 1;
+        j->progress.total = S_ISREG(st.st_mode) ? (uint64_t)st.st_size : 0;
+    }
+    if (!err)
+    {
+        j->buffers[0] = malloc(options->buffer_size);
+        j->buffers[1] = malloc(options->buffer_size);
+        if (!j->buffers[0] || !j->buffers[1]) err = ENOMEM;
+    }
+    if (!err)
+    {
+        j->started = fsc_now();
+        j->file_started = j->started;
+        err = fsc_copy_entry(j, src_length, dst_length, 0);
+    }
+    if (!err) fsc_report(j, 1);
+    free(j->buffers[0]);
+    free(j->buffers[1]);
+    free(j);
+    return err;
+}
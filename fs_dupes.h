@@ -0,0 +1,99 @@
+// File: fs_dupes.h
+// Location: プロジェクト直下
+
+#ifndef FS_DUPES_H
+#define FS_DUPES_H
+
+#include "fs_hash.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Duplicate files. fsd_find narrows the files under its roots in stages, so
+// most of them are never read:
+//   1. sizes: only files that share their size with another one go on;
+//   2. edges: a 128-bit hash of the first and last 4 KB of each, read with
+//      pread (files up to 8 KB are hashed whole here and stop);
+//   3. contents: the whole file, read a window at a time on a thread pool,
+//      hashed with FSH_M128 or, with FSD_SHA256, with SHA-256.
+// Files with the same size and content digest form a group. Names that are
+// hard links to one inode are the same file and are listed only once.
+// Symlinks are not followed. With a cache, every digest is looked up by
+// (device, inode, size, mtime) first, so a second run reads almost nothing.
+
+enum
+{
+    FSD_SHA256 = 1 << 0,           // confirm with SHA-256 instead of FSH_M128
+    FSD_HIDDEN = 1 << 1,           // include names starting with '.'
+};
+
+enum
+{
+    FSD_PHASE_SCAN = 0,
+    FSD_PHASE_EDGES = 1,
+    FSD_PHASE_CONTENTS = 2,
+};
+
+#define FSD_EDGE 4096
+
+typedef struct fsd_progress
+{
+    int phase;
+    uint64_t files;                // found so far
+    uint64_t done;                 // files through the current phase
+    uint64_t total;                // files in the current phase
+    uint64_t bytes_done;           // contents hashed
+    uint64_t bytes_total;
+} fsd_progress;
+
+// Called from a worker thread, one call at a time.
+typedef void (*fsd_progress_fn)(void* ctx, const fsd_progress* progress);
+
+typedef struct fsd_options
+{
+    int flags;
+    uint64_t min_size;             // smaller files are ignored; 1 by default
+    int threads;                   // 0 for one per core
+    size_t memory;                 // read buffers across all threads; 0 for 64 MB
+    fsh_cache* cache;              // may be NULL
+    fsd_progress_fn progress;      // may be NULL
+    void* ctx;
+    uint64_t interval_ns;
+} fsd_options;
+
+typedef struct fsd_summary
+{
+    uint64_t files;                // regular files considered
+    uint64_t groups;
+    uint64_t duplicates;           // files beyond the first of every group
+    uint64_t reclaimable;          // bytes freed by keeping one file per group
+    uint64_t bytes_hashed;         // read by this run, not from the cache
+    uint64_t cached;               // digests taken from the cache
+    uint64_t errors;               // files or folders that could not be read
+    uint64_t scan_ns;
+} fsd_summary;
+
+typedef struct fsd_group
+{
+    uint64_t size;                 // of each file
+    size_t count;
+    uint64_t reclaimable;          // size * (count - 1)
+    uint8_t digest[FSH_DIGEST_MAX];
+    size_t digest_size;
+} fsd_group;
+
+typedef struct fsd_result fsd_result;
+
+void fsd_options_init(fsd_options* options);
+
+// Returns 0, ECANCELED, ENOMEM or an errno value for a root.
+int fsd_find(const char* const* roots, size_t count, const fsd_options* options, const volatile int* cancel,
+             fsd_result** out);
+void fsd_free(fsd_result* result);
+
+void fsd_get_summary(const fsd_result* result, fsd_summary* summary);
+// Groups come most reclaimable first; paths within a group are sorted.
+size_t fsd_group_count(const fsd_result* result);
+void fsd_get_group(const fsd_result* result, size_t group, fsd_group* out);
+const char* fsd_path(const fsd_result* result, size_t group, size_t index);
+
+#endif
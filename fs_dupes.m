@@ -0,0 +1,700 @@
+// File: fs_dupes.c
+// Location: プロジェクト直下
+
+#include "fs_dupes.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__APPLE__)
+#define FSD_MTIME(st) ((st)->st_mtimespec)
+#else
+#define FSD_MTIME(st) ((st)->st_mtim)
+#endif
+
+#define FSD_MAX_THREADS 16
+#define FSD_DEFAULT_MEMORY (64u << 20)
+#define FSD_MIN_WINDOW (1u << 20)
+#define FSD_DEFAULT_INTERVAL_NS 100000000ULL
+// Cache kind of the edge digest: FSH_M128 over the first and last FSD_EDGE bytes.
+#define FSD_KIND_EDGES (0x100 | FSH_M128)
+
+typedef struct fsd_file
+{
+    size_t path;                   // offset into names
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t size;
+    int64_t mtime_ns;
+    int error;
+    uint8_t edges[16];
+    uint8_t digest[FSH_DIGEST_MAX];
+} fsd_file;
+
+struct fsd_result
+{
+    char* names;
+    size_t names_used;
+    size_t names_capacity;
+    fsd_file* files;
+    size_t count;
+    size_t capacity;
+    size_t* members;               // file indices, group by group
+    size_t* group_first;           // into members; group_count + 1 entries
+    size_t group_count;
+    size_t digest_size;
+    fsd_summary summary;
+};
+
+typedef struct fsd_pool
+{
+    fsd_result* r;
+    const fsd_options* options;
+    const volatile int* cancel;
+    const size_t* work;
+    size_t work_count;
+    int phase;
+    int algo;
+    size_t window;
+    _Atomic size_t next;
+    _Atomic uint64_t done;
+    _Atomic uint64_t bytes_done;
+    _Atomic uint64_t bytes_hashed;
+    _Atomic uint64_t cached;
+    uint64_t bytes_total;
+    pthread_mutex_t report_lock;
+    uint64_t last_report;
+} fsd_pool;
+
+static uint64_t fsd_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int fsd_cancelled(const volatile int* cancel)
+{
+    return cancel && *cancel;
+}
+
+static const char* fsd_file_path(const fsd_result* r, const fsd_file* f)
+{
+    return r->names + f->path;
+}
+
+// The fields fsh_cache looks at, rebuilt from a file record.
+static void fsd_stat(const fsd_file* f, struct stat* st)
+{
+    memset(st, 0, sizeof(*st));
+    st->st_dev = (dev_t)f->dev;
+    st->st_ino = (ino_t)f->ino;
+    st->st_size = (off_t)f->size;
+    FSD_MTIME(st).tv_sec = (time_t)(f->mtime_ns / 1000000000LL);
+    FSD_MTIME(st).tv_nsec = (long)(f->mtime_ns % 1000000000LL);
+}
+
+static void fsd_report(fsd_pool* p, int force)
+{
+    const fsd_options* o = p->options;
+    if (!o->progress) return;
+    if (!force && pthread_mutex_trylock(&p->report_lock) != 0) return;
+    if (force) pthread_mutex_lock(&p->report_lock);
+    uint64_t now = fsd_now();
+    if (force || now - p->last_report >= o->interval_ns)
+    {
+        p->last_report = now;
+        fsd_progress progress = {p->phase, p->r->count, atomic_load(&p->done), p->work_count,
+                                 atomic_load(&p->bytes_done), p->bytes_total};
+        o->progress(o->ctx, &progress);
+    }
+    pthread_mutex_unlock(&p->report_lock);
+}
+
+#pragma mark - Scan
+
+static int fsd_add_file(fsd_result* r, const char* dir, size_t dir_length, const char* name, const struct stat* st)
+{
+    size_t name_length = strlen(name);
+    int slash = dir_length > 0 && dir[dir_length - 1] != '/';
+    size_t needed = dir_length + slash + name_length + 1;
+    if (r->names_used + needed > r->names_capacity)
+    {
+        size_t capacity = r->names_capacity ? r->names_capacity * 2 : 1 << 16;
+        while (capacity < r->names_used + needed) capacity *= 2;
+        char* names = realloc(r->names, capacity);
+        if (!names) return ENOMEM;
+        r->names = names;
+        r->names_capacity = capacity;
+    }
+    if (r->count == r->capacity)
+    {
+        size_t capacity = r->capacity ? r->capacity * 2 : 1024;
+        fsd_file* files = realloc(r->files, capacity * sizeof(fsd_file));
+        if (!files) return ENOMEM;
+        r->files = files;
+        r->capacity = capacity;
+    }
+    fsd_file* f = &r->files[r->count++];
+    memset(f, 0, sizeof(*f));
+    f->path = r->names_used;
+    f->dev = (uint64_t)st->st_dev;
+    f->ino = (uint64_t)st->st_ino;
+    f->size = (uint64_t)st->st_size;
+    f->mtime_ns = (int64_t)FSD_MTIME(st).tv_sec * 1000000000LL + FSD_MTIME(st).tv_nsec;
+    char* p = r->names + r->names_used;
+    memcpy(p, dir, dir_length);
+    if (slash) p[dir_length] = '/';
+    memcpy(p + dir_length + slash, name, name_length + 1);
+    r->names_used += needed;
+    return 0;
+}
+
+// Depth first with an explicit stack of folder paths; walking is cheap next
+// to hashing, so it runs on the calling thread.
+static int fsd_scan(fsd_result* r, const char* root, fsd_pool* p)
+{
+    size_t capacity = 64, depth = 0;
+    char** stack = malloc(capacity * sizeof(char*));
+    if (!stack) return ENOMEM;
+    stack[depth] = strdup(root);
+    if (!stack[depth++])
+    {
+        free(stack);
+        return ENOMEM;
+    }
+    int err = 0;
+    while (depth > 0 && !err)
+    {
+        char* dir = stack[--depth];
+        DIR* d = fsd_cancelled(p->cancel) ? NULL : opendir(dir);
+        if (!d && !fsd_cancelled(p->cancel)) r->summary.errors++;
+        size_t dir_length = strlen(dir);
+        struct dirent* e;
+        while (d && !err && (e = readdir(d)))
+        {
+            const char* name = e->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+            if (name[0] == '.' && !(p->options->flags & FSD_HIDDEN)) continue;
+            struct stat st;
+            if (fstatat(dirfd(d), name, &st, AT_SYMLINK_NOFOLLOW) != 0) continue;
+            if (S_ISDIR(st.st_mode))
+            {
+                size_t length = dir_length + strlen(name) + 2;
+                if (length > PATH_MAX) continue;
+                if (depth == capacity)
+                {
+                    char** grown = realloc(stack, capacity * 2 * sizeof(char*));
+                    if (!grown)
+                    {
+                        err = ENOMEM;
+                        break;
+                    }
+                    stack = grown;
+                    capacity *= 2;
+                }
+                char* child = malloc(length);
+                if (!child)
+                {
+                    err = ENOMEM;
+                    break;
+                }
+                memcpy(child, dir, dir_length);
+                size_t at = dir_length;
+                if (at == 0 || child[at - 1] != '/') child[at++] = '/';
+                strcpy(child + at, name);
+                stack[depth++] = child;
+            }
+            else if (S_ISREG(st.st_mode) && (uint64_t)st.st_size >= p->options->min_size)
+            {
+                err = fsd_add_file(r, dir, dir_length, name, &st);
+                if (!err && (r->count & 1023) == 0) fsd_report(p, 0);
+            }
+        }
+        if (d) closedir(d);
+        free(dir);
+    }
+    while (depth > 0) free(stack[--depth]);
+    free(stack);
+    if (!err && fsd_cancelled(p->cancel)) err = ECANCELED;
+    return err;
+}
+
+#pragma mark - Hashing
+
+static int fsd_open(const fsd_file* f, const char* path)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+    if (fd < 0) return -errno;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (uint64_t)st.st_dev != f->dev || (uint64_t)st.st_ino != f->ino
+        || (uint64_t)st.st_size != f->size
+        || (int64_t)FSD_MTIME(&st).tv_sec * 1000000000LL + FSD_MTIME(&st).tv_nsec != f->mtime_ns)
+    {
+        // Replaced or rewritten since the scan, even in place at the same
+        // size; leave it out rather than guess.
+        close(fd);
+        return -ESTALE;
+    }
+    return fd;
+}
+
+static int fsd_pread(int fd, uint8_t* data, size_t size, uint64_t offset)
+{
+    size_t got = 0;
+    while (got < size)
+    {
+        ssize_t n = pread(fd, data + got, size - got, (off_t)(offset + got));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return n < 0 ? errno : EIO;
+        got += (size_t)n;
+    }
+    return 0;
+}
+
+static void fsd_hash_edges(fsd_pool* p, fsd_file* f)
+{
+    struct stat st;
+    fsd_stat(f, &st);
+    if (p->options->cache && fsh_cache_get(p->options->cache, &st, FSD_KIND_EDGES, f->edges, 16))
+    {
+        atomic_fetch_add(&p->cached, 1);
+        return;
+    }
+    int fd = fsd_open(f, fsd_file_path(p->r, f));
+    if (fd < 0)
+    {
+        f->error = -fd;
+        return;
+    }
+    uint8_t buffer[2 * FSD_EDGE];
+    size_t head = f->size < FSD_EDGE ? (size_t)f->size : FSD_EDGE;
+    size_t tail = f->size <= 2 * FSD_EDGE ? (size_t)f->size - head : FSD_EDGE;
+    int err = fsd_pread(fd, buffer, head, 0);
+    if (!err && tail) err = fsd_pread(fd, buffer + head, tail, f->size - tail);
+    close(fd);
+    if (err)
+    {
+        f->error = err;
+        return;
+    }
+    fsh_state state;
+    fsh_init(&state, FSH_M128);
+    fsh_update(&state, buffer, head + tail);
+    fsh_final(&state, f->edges);
+    atomic_fetch_add(&p->bytes_hashed, head + tail);
+    if (p->options->cache) fsh_cache_put(p->options->cache, &st, FSD_KIND_EDGES, f->edges, 16);
+}
+
+static void fsd_hash_contents(fsd_pool* p, fsd_file* f)
+{
+    struct stat st;
+    fsd_stat(f, &st);
+    size_t size = fsh_digest_size(p->algo);
+    if (p->options->cache && fsh_cache_get(p->options->cache, &st, p->algo, f->digest, size))
+    {
+        atomic_fetch_add(&p->cached, 1);
+        atomic_fetch_add(&p->bytes_done, f->size);
+        return;
+    }
+    int fd = fsd_open(f, fsd_file_path(p->r, f));
+    if (fd < 0)
+    {
+        f->error = -fd;
+        atomic_fetch_add(&p->bytes_done, f->size);
+        return;
+    }
+    _Atomic uint64_t done = 0;
+    int err = fsh_file(fd, f->size, p->algo, p->window, &done, p->cancel, f->digest);
+    close(fd);
+    // Count what was hashed, and skip the rest of a file that failed.
+    atomic_fetch_add(&p->bytes_hashed, atomic_load(&done));
+    atomic_fetch_add(&p->bytes_done, f->size);
+    if (err)
+    {
+        f->error = err;
+        return;
+    }
+    if (p->options->cache) fsh_cache_put(p->options->cache, &st, p->algo, f->digest, size);
+}
+
+static void* fsd_worker_main(void* arg)
+{
+    fsd_pool* p = arg;
+    for (;;)
+    {
+        if (fsd_cancelled(p->cancel)) break;
+        size_t i = atomic_fetch_add(&p->next, 1);
+        if (i >= p->work_count) break;
+        fsd_file* f = &p->r->files[p->work[i]];
+        if (p->phase == FSD_PHASE_EDGES) fsd_hash_edges(p, f);
+        else fsd_hash_contents(p, f);
+        atomic_fetch_add(&p->done, 1);
+        fsd_report(p, 0);
+    }
+    return NULL;
+}
+
+// Runs one phase over work on the pool; the calling thread is worker 0.
+static void fsd_run_phase(fsd_pool* p, int phase, const size_t* work, size_t count)
+{
+    p->phase = phase;
+    p->work = work;
+    p->work_count = count;
+    atomic_store(&p->next, 0);
+    atomic_store(&p->done, 0);
+    atomic_store(&p->bytes_done, 0);
+    p->bytes_total = 0;
+    if (phase == FSD_PHASE_CONTENTS)
+        for (size_t i = 0; i < count; i++) p->bytes_total += p->r->files[work[i]].size;
+    fsd_report(p, 1);
+    int threads = p->options->threads;
+    if (threads <= 0) threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads < 1) threads = 1;
+    if (threads > FSD_MAX_THREADS) threads = FSD_MAX_THREADS;
+    if ((size_t)threads > count) threads = count ? (int)count : 1;
+    size_t memory = p->options->memory ? p->options->memory : FSD_DEFAULT_MEMORY;
+    p->window = memory / (2 * (size_t)threads);       // two buffers per file being hashed
+    if (p->window < FSD_MIN_WINDOW) p->window = FSD_MIN_WINDOW;
+    if (p->window > FSH_WINDOW_DEFAULT) p->window = FSH_WINDOW_DEFAULT;
+    pthread_t workers[FSD_MAX_THREADS];
+    int started = 1;
+    for (; started < threads; started++)
+        if (pthread_create(&workers[started], NULL, fsd_worker_main, p) != 0) break;
+    fsd_worker_main(p);
+    for (int i = 1; i < started; i++) pthread_join(workers[i], NULL);
+    fsd_report(p, 1);
+}
+
+#pragma mark - Grouping
+
+typedef int (*fsd_compare_fn)(const fsd_result* r, const fsd_file* a, const fsd_file* b);
+
+// Stable bottom-up merge sort over file indices, as fs.m sorts listings;
+// qsort_r's argument order differs between the BSD and glibc C libraries.
+static int fsd_sort(const fsd_result* r, size_t* items, size_t n, fsd_compare_fn compare)
+{
+    if (n < 2) return 0;
+    size_t* tmp = malloc(n * sizeof(size_t));
+    if (!tmp) return ENOMEM;
+    size_t* src = items;
+    size_t* dst = tmp;
+    for (size_t width = 1; width < n; width *= 2)
+    {
+        for (size_t lo = 0; lo < n; lo += 2 * width)
+        {
+            size_t mid = lo + width < n ? lo + width : n;
+            size_t hi = lo + 2 * width < n ? lo + 2 * width : n;
+            size_t i = lo, j = mid, k = lo;
+            while (i < mid && j < hi)
+                dst[k++] = compare(r, &r->files[src[j]], &r->files[src[i]]) < 0 ? src[j++] : src[i++];
+            while (i < mid) dst[k++] = src[i++];
+            while (j < hi) dst[k++] = src[j++];
+        }
+        size_t* t = src;
+        src = dst;
+        dst = t;
+    }
+    if (src != items) memcpy(items, src, n * sizeof(size_t));
+    free(tmp);
+    return 0;
+}
+
+static int fsd_compare_inode(const fsd_result* r, const fsd_file* a, const fsd_file* b)
+{
+    if (a->dev != b->dev) return a->dev < b->dev ? -1 : 1;
+    if (a->ino != b->ino) return a->ino < b->ino ? -1 : 1;
+    return strcmp(fsd_file_path(r, a), fsd_file_path(r, b));
+}
+
+// Largest first, which also hands the pool its longest jobs first.
+static int fsd_compare_size(const fsd_result* r, const fsd_file* a, const fsd_file* b)
+{
+    (void)r;
+    if (a->size != b->size) return a->size > b->size ? -1 : 1;
+    return 0;
+}
+
+static int fsd_compare_edges(const fsd_result* r, const fsd_file* a, const fsd_file* b)
+{
+    int c = fsd_compare_size(r, a, b);
+    return c ? c : memcmp(a->edges, b->edges, 16);
+}
+
+static int fsd_compare_digest(const fsd_result* r, const fsd_file* a, const fsd_file* b)
+{
+    int c = fsd_compare_size(r, a, b);
+    if (!c) c = memcmp(a->digest, b->digest, r->digest_size);
+    return c ? c : strcmp(fsd_file_path(r, a), fsd_file_path(r, b));
+}
+
+static int fsd_same_size(const fsd_result* r, const fsd_file* a, const fsd_file* b)
+{
+    return fsd_compare_size(r, a, b) == 0;
+}
+
+static int fsd_same_edges(const fsd_result* r, const fsd_file* a, const fsd_file* b)
+{
+    return fsd_compare_edges(r, a, b) == 0;
+}
+
+static int fsd_same_digest(const fsd_result* r, const fsd_file* a, const fsd_file* b)
+{
+    return a->size == b->size && memcmp(a->digest, b->digest, r->digest_size) == 0;
+}
+
+// Keeps the runs of at least two items that are equal, in place.
+static size_t fsd_keep_runs(const fsd_result* r, size_t* items, size_t count, fsd_compare_fn equal)
+{
+    size_t kept = 0;
+    for (size_t i = 0; i < count;)
+    {
+        size_t j = i + 1;
+        while (j < count && equal(r, &r->files[items[i]], &r->files[items[j]])) j++;
+        if (j - i >= 2)
+        {
+            memmove(items + kept, items + i, (j - i) * sizeof(size_t));
+            kept += j - i;
+        }
+        i = j;
+    }
+    return kept;
+}
+
+static size_t fsd_drop_failed(const fsd_result* r, size_t* items, size_t count)
+{
+    size_t kept = 0;
+    for (size_t i = 0; i < count; i++)
+        if (!r->files[items[i]].error) items[kept++] = items[i];
+    return kept;
+}
+
+typedef struct fsd_group_key
+{
+    uint64_t reclaimable;
+    size_t from;
+    size_t to;
+} fsd_group_key;
+
+static int fsd_compare_groups(const void* a, const void* b)
+{
+    const fsd_group_key* x = a;
+    const fsd_group_key* y = b;
+    if (x->reclaimable != y->reclaimable) return x->reclaimable > y->reclaimable ? -1 : 1;
+    return x->from < y->from ? -1 : x->from > y->from;
+}
+
+// items holds runs of equal digests; lays them out as groups, most
+// reclaimable first. Takes over items.
+static int fsd_group_result(fsd_result* r, size_t* items, size_t count)
+{
+    size_t groups = 0;
+    fsd_group_key* keys = malloc((count / 2 + 1) * sizeof(fsd_group_key));
+    size_t* members = malloc(count * sizeof(size_t) + 1);
+    size_t* first = malloc((count / 2 + 2) * sizeof(size_t));
+    if (!keys || !members || !first)
+    {
+        free(keys);
+        free(members);
+        free(first);
+        free(items);
+        return ENOMEM;
+    }
+    for (size_t i = 0; i < count;)
+    {
+        size_t j = i + 1;
+        while (j < count && fsd_same_digest(r, &r->files[items[i]], &r->files[items[j]])) j++;
+        uint64_t reclaimable = r->files[items[i]].size * (j - i - 1);
+        keys[groups++] = (fsd_group_key){reclaimable, i, j};
+        r->summary.duplicates += j - i - 1;
+        r->summary.reclaimable += reclaimable;
+        i = j;
+    }
+    qsort(keys, groups, sizeof(fsd_group_key), fsd_compare_groups);
+    size_t used = 0;
+    for (size_t g = 0; g < groups; g++)
+    {
+        first[g] = used;
+        memcpy(members + used, items + keys[g].from, (keys[g].to - keys[g].from) * sizeof(size_t));
+        used += keys[g].to - keys[g].from;
+    }
+    first[groups] = used;
+    free(keys);
+    free(items);
+    r->members = members;
+    r->group_first = first;
+    r->group_count = groups;
+    r->summary.groups = groups;
+    return 0;
+}
+
+#pragma mark - Public
+
+void fsd_options_init(fsd_options* options)
+{
+    memset(options, 0, sizeof(*options));
+    options->min_size = 1;
+    options->interval_ns = FSD_DEFAULT_INTERVAL_NS;
+}
+
+int fsd_find(const char* const* roots, size_t count, const fsd_options* options, const volatile int* cancel,
+             fsd_result** out)
+{
+    *out = NULL;
+    fsd_options defaults;
+    if (!options)
+    {
+        fsd_options_init(&defaults);
+        options = &defaults;
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        struct stat st;
+        if (stat(roots[i], &st) != 0) return errno;
+        if (!S_ISDIR(st.st_mode)) return ENOTDIR;
+    }
+    uint64_t started = fsd_now();
+    fsd_result* r = calloc(1, sizeof(fsd_result));
+    if (!r) return ENOMEM;
+    r->digest_size = fsh_digest_size(options->flags & FSD_SHA256 ? FSH_SHA256 : FSH_M128);
+    fsd_pool pool = {0};
+    pool.r = r;
+    pool.options = options;
+    pool.cancel = cancel;
+    pool.algo = options->flags & FSD_SHA256 ? FSH_SHA256 : FSH_M128;
+    pthread_mutex_init(&pool.report_lock, NULL);
+
+    int err = 0;
+    pool.phase = FSD_PHASE_SCAN;
+    for (size_t i = 0; i < count && !err; i++) err = fsd_scan(r, roots[i], &pool);
+
+    size_t n = r->count;
+    size_t* items = err ? NULL : malloc(n * sizeof(size_t) + 1);
+    if (!err && !items) err = ENOMEM;
+    if (!err)
+    {
+        // One name per inode: overlapping roots and hard links are the same file.
+        for (size_t i = 0; i < n; i++) items[i] = i;
+        err = fsd_sort(r, items, n, fsd_compare_inode);
+    }
+    if (!err)
+    {
+        size_t unique = 0;
+        for (size_t i = 0; i < n; i++)
+        {
+            const fsd_file* f = &r->files[items[i]];
+            if (unique && f->dev == r->files[items[unique - 1]].dev && f->ino == r->files[items[unique - 1]].ino) continue;
+            items[unique++] = items[i];
+        }
+        r->summary.files = unique;
+        err = fsd_sort(r, items, unique, fsd_compare_size);
+        n = fsd_keep_runs(r, items, unique, fsd_same_size);
+    }
+    if (!err)
+    {
+        fsd_run_phase(&pool, FSD_PHASE_EDGES, items, n);
+        if (fsd_cancelled(cancel)) err = ECANCELED;
+    }
+    if (!err)
+    {
+        n = fsd_drop_failed(r, items, n);
+        err = fsd_sort(r, items, n, fsd_compare_edges);
+        n = fsd_keep_runs(r, items, n, fsd_same_edges);
+    }
+    if (!err)
+    {
+        // Edges already cover files up to 2 * FSD_EDGE; only SHA-256 needs them read again.
+        size_t full = 0;
+        for (size_t i = 0; i < n; i++)
+        {
+            fsd_file* f = &r->files[items[i]];
+            if (pool.algo == FSH_M128 && f->size <= 2 * FSD_EDGE) memcpy(f->digest, f->edges, 16);
+            else full++;
+        }
+        size_t* work = malloc(full * sizeof(size_t) + 1);
+        if (!work) err = ENOMEM;
+        else
+        {
+            full = 0;
+            for (size_t i = 0; i < n; i++)
+            {
+                const fsd_file* f = &r->files[items[i]];
+                if (!(pool.algo == FSH_M128 && f->size <= 2 * FSD_EDGE)) work[full++] = items[i];
+            }
+            // items is sorted by size, largest first, which balances the pool.
+            fsd_run_phase(&pool, FSD_PHASE_CONTENTS, work, full);
+            free(work);
+            if (fsd_cancelled(cancel)) err = ECANCELED;
+        }
+    }
+    if (!err)
+    {
+        for (size_t i = 0; i < r->count; i++)
+            if (r->files[i].error) r->summary.errors++;
+        n = fsd_drop_failed(r, items, n);
+        err = fsd_sort(r, items, n, fsd_compare_digest);
+    }
+    if (!err)
+    {
+        n = fsd_keep_runs(r, items, n, fsd_same_digest);
+        err = fsd_group_result(r, items, n);
+        items = NULL;
+    }
+    free(items);
+    pthread_mutex_destroy(&pool.report_lock);
+    if (err)
+    {
+        fsd_free(r);
+        return err;
+    }
+    r->summary.bytes_hashed = atomic_load(&pool.bytes_hashed);
+    r->summary.cached = atomic_load(&pool.cached);
+    r->summary.scan_ns = fsd_now() - started;
+    *out = r;
+    return 0;
+}
+
+void fsd_free(fsd_result* result)
+{
+    if (!result) return;
+    free(result->names);
+    free(result->files);
+    free(result->members);
+    free(result->group_first);
+    free(result);
+}
+
+void fsd_get_summary(const fsd_result* result, fsd_summary* summary)
+{
+    *summary = result->summary;
+}
+
+size_t fsd_group_count(const fsd_result* result)
+{
+    return result->group_count;
+}
+
+void fsd_get_group(const fsd_result* result, size_t group, fsd_group* out)
+{
+    size_t first = result->group_first[group];
+    const fsd_file* f = &result->files[result->members[first]];
+    memset(out, 0, sizeof(*out));
+    out->size = f->size;
+    out->count = result->group_first[group + 1] - first;
+    out->reclaimable = f->size * (out->count - 1);
+    out->digest_size = result->digest_size;
+    memcpy(out->digest, f->digest, result->digest_size);
+}
+
+const char* fsd_path(const fsd_result* result, size_t group, size_t index)
+{
+    return fsd_file_path(result, &result->files[result->members[result->group_first[group] + index]]);
+}
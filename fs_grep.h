@@ -0,0 +1,56 @@
+// File: fs_grep.h
+// Location: プロジェクト直下
+
+#ifndef FS_GREP_H
+#define FS_GREP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Recursive content search. fss_search feeds file paths to one scanner thread
+// per core; each file is read whole (small) or in windows (large), skipped if
+// it looks binary, and scanned for a literal with a word-at-a-time filter on
+// two of its bytes, falling back to Boyer-Moore-Horspool when the filter keeps
+// producing false candidates.
+// At most one match is reported per line.
+
+enum
+{
+    FSG_HIDDEN = 1 << 0,           // search files and folders starting with '.'
+    FSG_CASE_SENSITIVE = 1 << 1,   // otherwise ASCII letters are folded
+};
+
+#define FSG_PATTERN_MAX 1024
+#define FSG_CONTEXT_MAX 512
+
+typedef struct fsg_query
+{
+    const char* pattern;           // literal bytes, 1 to FSG_PATTERN_MAX long
+    int flags;
+    size_t context;                // snippet bytes kept on each side of a match
+    size_t max_per_file;           // 0 for no limit
+    int threads;                   // 0 picks one per core
+} fsg_query;
+
+typedef struct fsg_match
+{
+    const char* path;
+    uint64_t offset;               // byte offset of the match in the file
+    uint64_t line;                 // 1-based
+    const char* snippet;           // part of the line around the match, not NUL-terminated
+    uint32_t snippet_length;
+    uint32_t match_offset;         // where the match starts inside snippet
+} fsg_match;
+
+// Called from scanner threads, one call at a time. Returning non-zero stops
+// the search.
+typedef int (*fsg_batch_fn)(void* ctx, const fsg_match* matches, size_t count);
+
+void fsg_query_init(fsg_query* query);
+
+// Blocks until every file under root is scanned, cancel becomes non-zero or
+// the callback asks to stop. Returns 0, ECANCELED, EINVAL for an empty or
+// oversized pattern, or an errno value for a root that cannot be opened.
+int fsg_search(const char* root, const fsg_query* query, fsg_batch_fn fn, void* ctx, const volatile int* cancel);
+
+#endif
@@ -0,0 +1,621 @@
+// File: fs_grep.c
+// Location: プロジェクト直下
+
+#include "fs_grep.h"
+#include "fs.h"
+#include "fs_search.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define FSG_READ_MAX (1u << 20)            // files up to this size are read whole, larger ones in windows
+#define FSG_WINDOW (1u << 20)              // bytes scanned per window read
+#define FSG_SLACK 4096                     // read past the window so edge matches and snippets fit
+#define FSG_BINARY_PROBE 8192              // a NUL in this prefix marks the file binary
+#define FSG_SWITCH_MIN 4096                // false candidates before the ratio is judged
+#define FSG_QUEUE 1024
+#define FSG_BATCH_MAX 256
+#define FSG_BATCH_INTERVAL_NS 50000000ULL
+#define FSG_MAX_THREADS 16
+#define FSG_DEFAULT_CONTEXT 40
+
+typedef struct fsg_needle
+{
+    unsigned char bytes[FSG_PATTERN_MAX];  // folded unless case-sensitive
+    size_t length;
+    unsigned char fold[256];
+    size_t first;                          // the two rarest needle bytes, compared first
+    size_t second;
+    uint64_t first_lanes;                  // those bytes repeated in every lane
+    uint64_t second_lanes;
+    uint64_t first_case;                   // 0x20 in every lane where that byte is a folded letter
+    uint64_t second_case;
+    size_t shift[256];                     // Horspool, indexed by folded byte
+} fsg_needle;
+
+typedef struct fsg_pool
+{
+    const fsg_query* query;
+    fsg_needle needle;
+    size_t context;
+    fsg_batch_fn fn;
+    void* ctx;
+    const volatile int* cancel;
+    atomic_int stop;
+    pthread_mutex_t emit_lock;
+
+    // Paths handed from the walk to the scanners.
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    pthread_cond_t space;
+    char* queue[FSG_QUEUE];
+    size_t head;
+    size_t count;
+    int done;
+} fsg_pool;
+
+typedef struct fsg_worker
+{
+    fsg_pool* pool;
+    pthread_t thread;
+    unsigned char* buffer;                 // whole-file reads, and line counting before a window
+    size_t buffer_capacity;
+    unsigned char* window;                 // FSG_WINDOW + FSG_SLACK bytes of a large file
+
+    fsg_match batch[FSG_BATCH_MAX];
+    size_t path_offsets[FSG_BATCH_MAX];    // into text; resolved when flushed
+    size_t snippet_offsets[FSG_BATCH_MAX];
+    size_t batch_count;
+    char* text;
+    size_t text_used;
+    size_t text_capacity;
+    uint64_t last_flush;
+} fsg_worker;
+
+// Position inside one file while it is scanned.
+typedef struct fsg_scan
+{
+    const char* path;
+    size_t path_length;
+    int fd;
+    const unsigned char* data;             // bytes of [base, base + length) of the file
+    uint64_t base;
+    uint64_t length;
+    uint64_t counted;                      // newlines are counted up to here
+    uint64_t line;
+    uint64_t hits;
+    uint64_t misses;                       // filter candidates that were not a match
+    int horspool;
+} fsg_scan;
+
+static uint64_t fsg_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+void fsg_query_init(fsg_query* q)
+{
+    memset(q, 0, sizeof(*q));
+    q->pattern = "";
+    q->context = FSG_DEFAULT_CONTEXT;
+}
+
+#pragma mark - Needle
+
+// Rough frequency of a byte in text, higher for more common bytes.
+static int fsg_rank(unsigned char c)
+{
+    static const char common[] = " etaoinsrhldcumfpgwybvk\nETAOINSRHLDCUMFPGWYBVK.,_-/0123456789";
+    const char* hit = c ? strchr(common, c) : NULL;
+    return hit ? 255 - (int)(hit - common) : 0;
+}
+
+static int fsg_is_letter(unsigned char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+static int fsg_prepare(fsg_needle* nd, const fsg_query* q)
+{
+    const char* pattern = q->pattern ? q->pattern : "";
+    size_t n = strlen(pattern);
+    if (n == 0 || n > FSG_PATTERN_MAX) return EINVAL;
+    int insensitive = !(q->flags & FSG_CASE_SENSITIVE);
+    for (int c = 0; c < 256; c++) nd->fold[c] = (unsigned char)(insensitive && c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c);
+    nd->length = n;
+    for (size_t i = 0; i < n; i++) nd->bytes[i] = nd->fold[(unsigned char)pattern[i]];
+
+    // The rarest byte and the rarest one at another position make the pair
+    // the filter tests; ties keep the outermost positions.
+    nd->first = 0;
+    for (size_t i = 1; i < n; i++)
+    {
+        if (fsg_rank(nd->bytes[i]) < fsg_rank(nd->bytes[nd->first])) nd->first = i;
+    }
+    nd->second = nd->first == n - 1 ? 0 : n - 1;
+    for (size_t i = n; i-- > 0;)
+    {
+        if (i != nd->first && fsg_rank(nd->bytes[i]) < fsg_rank(nd->bytes[nd->second])) nd->second = i;
+    }
+    if (n == 1) nd->second = 0;
+
+    const uint64_t ones = 0x0101010101010101ULL;
+    nd->first_lanes = ones * nd->bytes[nd->first];
+    nd->second_lanes = ones * nd->bytes[nd->second];
+    nd->first_case = insensitive && fsg_is_letter(nd->bytes[nd->first]) ? ones * 0x20 : 0;
+    nd->second_case = insensitive && fsg_is_letter(nd->bytes[nd->second]) ? ones * 0x20 : 0;
+
+    for (int c = 0; c < 256; c++) nd->shift[c] = n;
+    for (size_t i = 0; i + 1 < n; i++) nd->shift[nd->bytes[i]] = n - 1 - i;
+    return 0;
+}
+
+static int fsg_equal(const fsg_needle* nd, const unsigned char* s)
+{
+    size_t n = nd->length;
+    if (nd->fold[s[n - 1]] != nd->bytes[n - 1] || nd->fold[s[0]] != nd->bytes[0]) return 0;
+    if (nd->fold['A'] == 'A') return memcmp(s, nd->bytes, n) == 0;
+    for (size_t i = 1; i + 1 < n; i++)
+    {
+        if (nd->fold[s[i]] != nd->bytes[i]) return 0;
+    }
+    return 1;
+}
+
+// High bit set in every byte of x that is zero, and nowhere else.
+static inline uint64_t fsg_zero_bytes(uint64_t x)
+{
+    const uint64_t low = 0x7f7f7f7f7f7f7f7fULL;
+    return ~(((x & low) + low) | x) & ~low;
+}
+
+static inline unsigned fsg_lane(uint64_t mask)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return (unsigned)__builtin_clzll(mask) / 8;
+#else
+    return (unsigned)__builtin_ctzll(mask) / 8;
+#endif
+}
+
+// Next match starting in [p, end); the bytes after end are readable for the
+// rest of the needle. Eight starting positions are tested per step by
+// comparing two needle bytes against whole words, with 0x20 OR-ed into
+// letters to fold them; candidates are then verified. When candidates keep
+// failing, Horspool's skips take over for the rest of the file.
+static const unsigned char* fsg_find(const fsg_needle* nd, fsg_scan* st, const unsigned char* p, const unsigned char* end)
+{
+    size_t n = nd->length;
+    if (!st->horspool)
+    {
+        for (; p + 8 <= end; p += 8)
+        {
+            uint64_t a;
+            uint64_t b;
+            memcpy(&a, p + nd->first, 8);
+            memcpy(&b, p + nd->second, 8);
+            uint64_t hits = fsg_zero_bytes((a | nd->first_case) ^ nd->first_lanes)
+                          & fsg_zero_bytes((b | nd->second_case) ^ nd->second_lanes);
+            while (hits)
+            {
+                unsigned lane = fsg_lane(hits);
+                if (fsg_equal(nd, p + lane)) return p + lane;
+                if (++st->misses > FSG_SWITCH_MIN && st->misses * 16 > (uint64_t)(p - st->data)) st->horspool = 1;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+                hits &= ~(0x8000000000000000ULL >> (lane * 8));
+#else
+                hits &= hits - 1;
+#endif
+            }
+            if (st->horspool)
+            {
+                p += 8;
+                break;
+            }
+        }
+    }
+
+    unsigned char last = nd->bytes[n - 1];
+    while (p < end)
+    {
+        unsigned char c = nd->fold[p[n - 1]];
+        if (c == last && fsg_equal(nd, p)) return p;
+        p += nd->shift[c];
+    }
+    return NULL;
+}
+
+#pragma mark - Lines
+
+// Counts '\n' eight bytes at a time: a byte of x ^ 0x0a.. is zero exactly
+// where a newline was. Lane counts are summed every 255 words before they
+// could overflow.
+static uint64_t fsg_count_lines(const unsigned char* p, size_t n)
+{
+    const uint64_t ones = 0x0101010101010101ULL;
+    const uint64_t low = 0x7f7f7f7f7f7f7f7fULL;
+    uint64_t lines = 0;
+    size_t i = 0;
+    while (i + 8 <= n)
+    {
+        uint64_t lanes = 0;
+        for (int k = 0; k < 255 && i + 8 <= n; k++, i += 8)
+        {
+            uint64_t x;
+            memcpy(&x, p + i, 8);
+            x ^= ones * '\n';
+            lanes += (~(((x & low) + low) | x) >> 7) & ones;
+        }
+        lanes = (lanes & 0x00ff00ff00ff00ffULL) + ((lanes >> 8) & 0x00ff00ff00ff00ffULL);
+        lines += (lanes * 0x0001000100010001ULL) >> 48;
+    }
+    for (; i < n; i++) lines += p[i] == '\n';
+    return lines;
+}
+
+// Brings the line count up to the start of the current window by reading the
+// gap. Only runs once a match needs a line number, so files without matches
+// are never counted.
+static void fsg_count_gap(fsg_worker* w, fsg_scan* st)
+{
+    if (st->counted >= st->base) return;
+    if (w->buffer_capacity < FSG_READ_MAX)
+    {
+        unsigned char* buffer = realloc(w->buffer, FSG_READ_MAX);
+        if (!buffer) return;
+        w->buffer = buffer;
+        w->buffer_capacity = FSG_READ_MAX;
+    }
+    while (st->counted < st->base)
+    {
+        uint64_t want = st->base - st->counted < FSG_READ_MAX ? st->base - st->counted : FSG_READ_MAX;
+        ssize_t n = pread(st->fd, w->buffer, (size_t)want, (off_t)st->counted);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        st->line += fsg_count_lines(w->buffer, (size_t)n);
+        st->counted += (uint64_t)n;
+    }
+    st->counted = st->base;
+}
+
+#pragma mark - Batches
+
+static void fsg_flush(fsg_worker* w)
+{
+    fsg_pool* p = w->pool;
+    if (w->batch_count && !atomic_load(&p->stop))
+    {
+        for (size_t i = 0; i < w->batch_count; i++)
+        {
+            w->batch[i].path = w->text + w->path_offsets[i];
+            w->batch[i].snippet = w->text + w->snippet_offsets[i];
+        }
+        pthread_mutex_lock(&p->emit_lock);
+        int stop = atomic_load(&p->stop) || p->fn(p->ctx, w->batch, w->batch_count);
+        pthread_mutex_unlock(&p->emit_lock);
+        if (stop) atomic_store(&p->stop, 1);
+    }
+    w->batch_count = 0;
+    w->text_used = 0;
+    w->last_flush = fsg_now();
+}
+
+static int fsg_reserve(fsg_worker* w, size_t need)
+{
+    if (w->text_used + need <= w->text_capacity) return 0;
+    size_t cap = w->text_capacity ? w->text_capacity * 2 : 65536;
+    while (cap < w->text_used + need) cap *= 2;
+    char* text = realloc(w->text, cap);
+    if (!text) return ENOMEM;
+    w->text = text;
+    w->text_capacity = cap;
+    return 0;
+}
+
+// Reports the match at file offset pos. Returns the offset where the next
+// search should start: the end of this line.
+static uint64_t fsg_emit(fsg_worker* w, fsg_scan* st, uint64_t pos)
+{
+    const fsg_pool* p = w->pool;
+    const unsigned char* d = st->data - st->base;          // indexed by file offset
+    uint64_t n = p->needle.length;
+    uint64_t lo = pos > st->base + p->context ? pos - p->context : st->base;
+    uint64_t hi = pos + n + p->context < st->base + st->length ? pos + n + p->context : st->base + st->length;
+
+    fsg_count_gap(w, st);
+    st->line += fsg_count_lines(d + st->counted, (size_t)(pos - st->counted));
+    st->counted = pos;
+
+    uint64_t start = pos;
+    while (start > lo && d[start - 1] != '\n') start--;
+    if (start == 0 || (start > st->base && d[start - 1] == '\n'))
+    {
+        while (start < pos && (d[start] == ' ' || d[start] == '\t')) start++;   // indentation
+    }
+    while (start < pos && (d[start] & 0xC0) == 0x80) start++;   // no split UTF-8 sequences
+    uint64_t stop = pos + n;
+    while (stop < hi && d[stop] != '\n' && d[stop] != '\r') stop++;
+    if (stop == hi && stop < st->base + st->length)
+    {
+        while (stop > pos + n && (d[stop] & 0xC0) == 0x80) stop--;
+    }
+
+    size_t length = (size_t)(stop - start);
+    if (fsg_reserve(w, st->path_length + 1 + length) == 0)
+    {
+        fsg_match* m = &w->batch[w->batch_count];
+        m->offset = pos;
+        m->line = st->line;
+        m->snippet_length = (uint32_t)length;
+        m->match_offset = (uint32_t)(pos - start);
+        w->path_offsets[w->batch_count] = w->text_used;
+        memcpy(w->text + w->text_used, st->path, st->path_length + 1);
+        w->text_used += st->path_length + 1;
+        w->snippet_offsets[w->batch_count] = w->text_used;
+        memcpy(w->text + w->text_used, d + start, length);
+        w->text_used += length;
+        if (++w->batch_count == FSG_BATCH_MAX) fsg_flush(w);
+    }
+    st->hits++;
+
+    const unsigned char* eol = memchr(d + pos + n, '\n', (size_t)(st->base + st->length - (pos + n)));
+    return eol ? (uint64_t)(eol - d) + 1 : pos + n;
+}
+
+#pragma mark - Files
+
+static int fsg_stopped(const fsg_pool* p)
+{
+    return atomic_load(&p->stop) || (p->cancel && *p->cancel);
+}
+
+static int fsg_limit(const fsg_pool* p, const fsg_scan* st)
+{
+    return p->query->max_per_file && st->hits >= p->query->max_per_file;
+}
+
+// Scans [from, to) of the bytes in st, all of which may start a match.
+static uint64_t fsg_scan_range(fsg_worker* w, fsg_scan* st, uint64_t from, uint64_t to)
+{
+    const fsg_pool* p = w->pool;
+    const unsigned char* d = st->data - st->base;
+    while (from < to && !fsg_limit(p, st) && !atomic_load(&p->stop))
+    {
+        const unsigned char* hit = fsg_find(&p->needle, st, d + from, d + to);
+        if (!hit) return to;
+        from = fsg_emit(w, st, (uint64_t)(hit - d));
+    }
+    return from;
+}
+
+static int fsg_is_binary(const unsigned char* data, size_t length)
+{
+    return memchr(data, 0, length < FSG_BINARY_PROBE ? length : FSG_BINARY_PROBE) != NULL;
+}
+
+static void fsg_scan_small(fsg_worker* w, fsg_scan* st, int fd, size_t size)
+{
+    if (size > w->buffer_capacity)
+    {
+        unsigned char* buffer = realloc(w->buffer, size);
+        if (!buffer) return;
+        w->buffer = buffer;
+        w->buffer_capacity = size;
+    }
+    size_t got = 0;
+    while (got < size)
+    {
+        ssize_t n = read(fd, w->buffer + got, size - got);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        got += (size_t)n;
+    }
+    size_t n = w->pool->needle.length;
+    if (got < n || fsg_is_binary(w->buffer, got)) return;
+    st->data = w->buffer;
+    st->base = 0;
+    st->length = got;
+    fsg_scan_range(w, st, 0, got - n + 1);
+}
+
+// Reads the whole of [offset, offset + size). 0 when the file ended first:
+// another writer truncated it since it was opened.
+static int fsg_read_at(int fd, unsigned char* data, size_t size, uint64_t offset)
+{
+    size_t got = 0;
+    while (got < size)
+    {
+        ssize_t n = pread(fd, data + got, size - got, (off_t)(offset + got));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return 0;
+        got += (size_t)n;
+    }
+    return 1;
+}
+
+// Large files are read one window at a time so multi-GB logs never need
+// their whole size in memory. The windows are read rather than mapped: a log
+// rotated or rewritten mid-scan ends in a short read, and the file is left,
+// where touching a mapped page past the new end would raise SIGBUS.
+static void fsg_scan_windows(fsg_worker* w, fsg_scan* st, int fd, uint64_t size)
+{
+    const fsg_pool* p = w->pool;
+    if (!w->window && !(w->window = malloc(FSG_WINDOW + FSG_SLACK))) return;
+    uint64_t n = p->needle.length;
+    uint64_t from = 0;
+    while (from + n <= size && !fsg_stopped(p) && !fsg_limit(p, st))
+    {
+        // Starting a little before from keeps context for a match near the start.
+        uint64_t base = from > FSG_SLACK ? from - FSG_SLACK : 0;
+        uint64_t end = base + FSG_WINDOW + FSG_SLACK < size ? base + FSG_WINDOW + FSG_SLACK : size;
+        int last = end == size;
+        if (!fsg_read_at(fd, w->window, (size_t)(end - base), base)) return;
+        st->data = w->window;
+        st->base = base;
+        st->length = end - base;
+
+        if (base == 0 && fsg_is_binary(st->data, (size_t)st->length)) return;
+        uint64_t to = last ? size - n + 1 : base + FSG_WINDOW;
+        if (to <= from) to = from + 1;
+        uint64_t next = fsg_scan_range(w, st, from, to);
+        if (last) break;
+        from = next > to ? next : to;
+    }
+}
+
+static void fsg_scan_file(fsg_worker* w, const char* path)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+    if (fd < 0) return;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && (uint64_t)st.st_size >= w->pool->needle.length)
+    {
+        fsg_scan scan;
+        memset(&scan, 0, sizeof(scan));
+        scan.path = path;
+        scan.path_length = strlen(path);
+        scan.fd = fd;
+        scan.line = 1;
+        if ((uint64_t)st.st_size <= FSG_READ_MAX) fsg_scan_small(w, &scan, fd, (size_t)st.st_size);
+        else fsg_scan_windows(w, &scan, fd, (uint64_t)st.st_size);
+    }
+    close(fd);
+    if (w->batch_count && fsg_now() - w->last_flush >= FSG_BATCH_INTERVAL_NS) fsg_flush(w);
+}
+
+#pragma mark - Pool
+
+// Walk callback: queues every file, waiting while the scanners catch up.
+static int fsg_collect(void* ctx, const fss_match* matches, size_t count)
+{
+    fsg_pool* p = ctx;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (matches[i].flags & (FS_ENTRY_DIR | FS_ENTRY_LINK)) continue;
+        char* path = strdup(matches[i].path);
+        if (!path) continue;
+        pthread_mutex_lock(&p->lock);
+        while (p->count == FSG_QUEUE && !fsg_stopped(p)) pthread_cond_wait(&p->space, &p->lock);
+        if (fsg_stopped(p))
+        {
+            pthread_mutex_unlock(&p->lock);
+            free(path);
+            return 1;
+        }
+        p->queue[(p->head + p->count++) % FSG_QUEUE] = path;
+        pthread_cond_signal(&p->ready);
+        pthread_mutex_unlock(&p->lock);
+    }
+    return fsg_stopped(p);
+}
+
+static char* fsg_next(fsg_pool* p)
+{
+    pthread_mutex_lock(&p->lock);
+    while (p->count == 0 && !p->done) pthread_cond_wait(&p->ready, &p->lock);
+    char* path = NULL;
+    if (p->count)
+    {
+        path = p->queue[p->head];
+        p->head = (p->head + 1) % FSG_QUEUE;
+        p->count--;
+        pthread_cond_signal(&p->space);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return path;
+}
+
+static void* fsg_worker_main(void* arg)
+{
+    fsg_worker* w = arg;
+    fsg_pool* p = w->pool;
+    w->last_flush = fsg_now();
+    char* path;
+    while ((path = fsg_next(p)))
+    {
+        if (!fsg_stopped(p)) fsg_scan_file(w, path);
+        free(path);
+        // Stopped scanners keep draining so the walk never blocks on a full queue.
+        if (fsg_stopped(p))
+        {
+            pthread_mutex_lock(&p->lock);
+            pthread_cond_broadcast(&p->space);
+            pthread_mutex_unlock(&p->lock);
+        }
+    }
+    fsg_flush(w);
+    return NULL;
+}
+
+int fsg_search(const char* root, const fsg_query* query, fsg_batch_fn fn, void* ctx, const volatile int* cancel)
+{
+    fsg_pool* p = calloc(1, sizeof(fsg_pool));
+    if (!p) return ENOMEM;
+    int err = fsg_prepare(&p->needle, query);
+    if (err)
+    {
+        free(p);
+        return err;
+    }
+    p->query = query;
+    p->context = query->context < FSG_CONTEXT_MAX ? query->context : FSG_CONTEXT_MAX;
+    p->fn = fn;
+    p->ctx = ctx;
+    p->cancel = cancel;
+    pthread_mutex_init(&p->emit_lock, NULL);
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->ready, NULL);
+    pthread_cond_init(&p->space, NULL);
+
+    int threads = query->threads;
+    if (threads <= 0) threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads < 1) threads = 1;
+    if (threads > FSG_MAX_THREADS) threads = FSG_MAX_THREADS;
+    fsg_worker* workers = calloc((size_t)threads, sizeof(fsg_worker));
+    int started = 0;
+    for (; workers && started < threads; started++)
+    {
+        workers[started].pool = p;
+        if (pthread_create(&workers[started].thread, NULL, fsg_worker_main, &workers[started]) != 0) break;
+    }
+
+    if (started == 0) err = workers ? EAGAIN : ENOMEM;
+    else
+    {
+        // The walk only lists directories; two walkers keep the scanners fed.
+        fss_query walk;
+        fss_query_init(&walk);
+        walk.flags = (query->flags & FSG_HIDDEN) ? FSS_HIDDEN : 0;
+        walk.threads = 2;
+        err = fss_search(root, &walk, fsg_collect, p, cancel);
+    }
+
+    pthread_mutex_lock(&p->lock);
+    p->done = 1;
+    pthread_cond_broadcast(&p->ready);
+    pthread_mutex_unlock(&p->lock);
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(workers[i].thread, NULL);
+        free(workers[i].buffer);
+        free(workers[i].window);
+        free(workers[i].text);
+    }
+    free(workers);
+    if (!err && cancel && *cancel) err = ECANCELED;
+
+    pthread_mutex_destroy(&p->emit_lock);
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->ready);
+    pthread_cond_destroy(&p->space);
+    free(p);
+    return err;
+}
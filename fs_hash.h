@@ -0,0 +1,155 @@
+// File: fs_hash.h
+// Location: プロジェクト直下
+
+#ifndef FS_HASH_H
+#define FS_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+// File digests and checksums. FSH_M128 is MurmurHash3 x64 128 and FSH_XXH64
+// is xxHash64: fast, not cryptographic, good for telling files apart.
+// FSH_CRC32 is mz_crc32, which zip_checksum runs on the CPU's CRC or
+// carry-less multiply instructions. MD5, SHA-1 and SHA-256 use CommonCrypto
+// (hardware SHA on Apple silicon) on Apple platforms and portable code
+// elsewhere. Digests are written in their usual byte order, so fsh_hex
+// prints what md5sum, sha256sum, crc32 or xxhsum print.
+//
+// A file is read once however many algorithms are asked for; with threads
+// each algorithm runs on a core of its own over the same window.
+//
+// fsh_cache remembers digests by (device, inode, size, mtime) in one file, so
+// a file that has not changed is never read twice.
+
+enum
+{
+    FSH_M128 = 1,
+    FSH_SHA256 = 2,
+    FSH_MD5 = 3,
+    FSH_SHA1 = 4,
+    FSH_CRC32 = 5,
+    FSH_XXH64 = 6,
+    FSH_ALGO_COUNT = 7,
+};
+
+#define FSH_BIT(algo) (1u << (algo))
+#define FSH_DIGEST_MAX 32
+#define FSH_WINDOW_DEFAULT (2u << 20)
+
+typedef struct fsh_state
+{
+    int algo;
+    uint64_t length;
+    union
+    {
+        struct
+        {
+            uint64_t h1, h2;
+            uint8_t tail[16];
+        } m128;
+        struct
+        {
+            uint32_t h[8];         // MD5 uses 4 words, SHA-1 5, SHA-256 8
+            uint8_t block[64];
+        } md;
+        struct
+        {
+            uint64_t v[4];
+            uint8_t stripe[32];
+        } xxh64;
+        uint32_t crc32;
+        uint8_t opaque[256];       // room for a platform context
+    } u;
+} fsh_state;
+
+// 0 for an unknown algorithm.
+size_t fsh_digest_size(int algo);
+// "md5", "sha1", "sha256", "crc32", "xxh64", "m128".
+const char* fsh_name(int algo);
+int fsh_init(fsh_state* state, int algo);
+void fsh_update(fsh_state* state, const void* data, size_t size);
+// Writes fsh_digest_size(algo) bytes.
+void fsh_final(fsh_state* state, uint8_t* digest);
+// Writes 2 * size lower-case hex digits and a NUL.
+void fsh_hex(const uint8_t* digest, size_t size, char* out);
+
+typedef struct fsh_digests
+{
+    uint8_t digest[FSH_ALGO_COUNT][FSH_DIGEST_MAX];   // by algorithm
+} fsh_digests;
+
+// Hashes the whole file once for every algorithm in algos (a set of
+// FSH_BIT), reading it into two buffers of window bytes (0 for
+// FSH_WINDOW_DEFAULT). threads above 1 spreads the algorithms over that many
+// threads. *done, when not NULL, grows as windows are finished and may be
+// read by other threads. Returns 0, ECANCELED, EIO when the file is shorter
+// than size by the time it is read, or an errno value.
+int fsh_file_multi(int fd, uint64_t size, unsigned algos, size_t window, int threads, _Atomic uint64_t* done,
+                   const volatile int* cancel, fsh_digests* out);
+// fsh_file_multi for one algorithm, on the calling thread.
+int fsh_file(int fd, uint64_t size, int algo, size_t window, _Atomic uint64_t* done, const volatile int* cancel,
+             uint8_t* digest);
+
+typedef struct fsh_cache fsh_cache;
+
+// Loads file, which may be missing or damaged; the cache then starts empty.
+// Returns 0 or ENOMEM.
+int fsh_cache_open(const char* file, fsh_cache** out);
+// Writes the cache back if it changed since it was loaded or last flushed,
+// keeping what was used in this session first when it has grown too large.
+// The file is replaced atomically. Returns 0 or an errno value.
+int fsh_cache_flush(fsh_cache* cache);
+// Flushes and frees the cache; the result is fsh_cache_flush's.
+int fsh_cache_close(fsh_cache* cache);
+
+// Digests are stored per kind, an id the caller picks (an algorithm, or an
+// algorithm applied to part of the file), and are at most FSH_DIGEST_MAX
+// bytes. st is the file's stat; an entry whose size or mtime differs is a
+// miss. get returns 1 on a hit. Both may be called from any thread.
+int fsh_cache_get(fsh_cache* cache, const struct stat* st, int kind, uint8_t* digest, size_t size);
+void fsh_cache_put(fsh_cache* cache, const struct stat* st, int kind, const uint8_t* digest, size_t size);
+
+// Checksums of one file, or of every regular file below a folder (hidden
+// names included, symlinks not followed). Files are hashed on a pool of one
+// thread per core, largest first; a single file spreads its algorithms over
+// the cores instead.
+
+typedef struct fsh_progress
+{
+    uint64_t files_done;
+    uint64_t files_total;
+    uint64_t bytes_done;
+    uint64_t bytes_total;
+} fsh_progress;
+
+// Called from a worker thread, one call at a time.
+typedef void (*fsh_progress_fn)(void* ctx, const fsh_progress* progress);
+
+typedef struct fsh_options
+{
+    unsigned algos;                // set of FSH_BIT
+    int threads;                   // 0 for one per core
+    fsh_cache* cache;              // may be NULL
+    fsh_progress_fn progress;      // may be NULL
+    void* ctx;
+    uint64_t interval_ns;
+} fsh_options;
+
+typedef struct fsh_files fsh_files;
+
+void fsh_options_init(fsh_options* options);
+// Returns 0, ECANCELED, ENOMEM or an errno value for path. Files that cannot
+// be read are listed with their error.
+int fsh_hash_path(const char* path, const fsh_options* options, const volatile int* cancel, fsh_files** out);
+void fsh_files_free(fsh_files* files);
+
+// Files come sorted by path.
+size_t fsh_files_count(const fsh_files* files);
+const char* fsh_files_path(const fsh_files* files, size_t i);
+uint64_t fsh_files_size(const fsh_files* files, size_t i);
+int fsh_files_error(const fsh_files* files, size_t i);
+// NULL when algo was not asked for or the file failed.
+const uint8_t* fsh_files_digest(const fsh_files* files, size_t i, int algo);
+
+#endif
@@ -0,0 +1,1493 @@
+// File: fs_hash.c
+// Location: プロジェクト直下
+
+#include "fs_hash.h"
+#include "miniz.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__APPLE__)
+#include <CommonCrypto/CommonDigest.h>
+#define FSH_MTIME(st) ((st)->st_mtimespec)
+#else
+#define FSH_MTIME(st) ((st)->st_mtim)
+#endif
+
+#define FSH_CACHE_MAGIC 0x43485346u    // "FSHC"
+#define FSH_CACHE_VERSION 1u
+#define FSH_CACHE_MAX (1u << 18)       // entries written back
+#define FSH_MAX_THREADS 16
+#define FSH_DEFAULT_INTERVAL_NS 100000000ULL
+
+static uint64_t fsh_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t fsh_rotl(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static uint32_t fsh_rotl32(uint32_t x, int r)
+{
+    return (x << r) | (x >> (32 - r));
+}
+
+static uint64_t fsh_load64(const uint8_t* p)
+{
+    uint64_t v;
+    memcpy(&v, p, 8);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+static uint32_t fsh_load32(const uint8_t* p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint32_t fsh_load32be(const uint8_t* p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static void fsh_store32be(uint8_t* p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+#pragma mark - MurmurHash3 x64 128
+
+#define FSH_C1 0x87c37b91114253d5ULL
+#define FSH_C2 0x4cf5ad432745937fULL
+
+static uint64_t fsh_fmix(uint64_t k)
+{
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+static void fsh_m128_blocks(fsh_state* s, const uint8_t* p, size_t blocks)
+{
+    uint64_t h1 = s->u.m128.h1, h2 = s->u.m128.h2;
+    for (size_t i = 0; i < blocks; i++, p += 16)
+    {
+        uint64_t k1 = fsh_load64(p), k2 = fsh_load64(p + 8);
+        k1 *= FSH_C1;
+        k1 = fsh_rotl(k1, 31);
+        k1 *= FSH_C2;
+        h1 ^= k1;
+        h1 = fsh_rotl(h1, 27);
+        h1 += h2;
+        h1 = h1 * 5 + 0x52dce729;
+        k2 *= FSH_C2;
+        k2 = fsh_rotl(k2, 33);
+        k2 *= FSH_C1;
+        h2 ^= k2;
+        h2 = fsh_rotl(h2, 31);
+        h2 += h1;
+        h2 = h2 * 5 + 0x38495ab5;
+    }
+    s->u.m128.h1 = h1;
+    s->u.m128.h2 = h2;
+}
+
+static void fsh_m128_update(fsh_state* s, const uint8_t* p, size_t size)
+{
+    size_t held = (size_t)(s->length & 15);
+    s->length += size;
+    if (held)
+    {
+        size_t take = 16 - held < size ? 16 - held : size;
+        memcpy(s->u.m128.tail + held, p, take);
+        p += take;
+        size -= take;
+        if (held + take < 16) return;
+        fsh_m128_blocks(s, s->u.m128.tail, 1);
+    }
+    fsh_m128_blocks(s, p, size / 16);
+    memcpy(s->u.m128.tail, p + (size & ~(size_t)15), size & 15);
+}
+
+static void fsh_m128_final(fsh_state* s, uint8_t* digest)
+{
+    const uint8_t* tail = s->u.m128.tail;
+    size_t n = (size_t)(s->length & 15);
+    uint64_t h1 = s->u.m128.h1, h2 = s->u.m128.h2;
+    uint64_t k1 = 0, k2 = 0;
+    for (size_t i = n; i > 8; i--) k2 = (k2 << 8) | tail[i - 1];
+    for (size_t i = n < 8 ? n : 8; i > 0; i--) k1 = (k1 << 8) | tail[i - 1];
+    if (n > 8)
+    {
+        k2 *= FSH_C2;
+        k2 = fsh_rotl(k2, 33);
+        k2 *= FSH_C1;
+        h2 ^= k2;
+    }
+    if (n > 0)
+    {
+        k1 *= FSH_C1;
+        k1 = fsh_rotl(k1, 31);
+        k1 *= FSH_C2;
+        h1 ^= k1;
+    }
+    h1 ^= s->length;
+    h2 ^= s->length;
+    h1 += h2;
+    h2 += h1;
+    h1 = fsh_fmix(h1);
+    h2 = fsh_fmix(h2);
+    h1 += h2;
+    h2 += h1;
+    for (int i = 0; i < 8; i++)
+    {
+        digest[i] = (uint8_t)(h1 >> (8 * i));
+        digest[8 + i] = (uint8_t)(h2 >> (8 * i));
+    }
+}
+
+#pragma mark - xxHash64
+
+#define FSH_P1 11400714785074694791ULL
+#define FSH_P2 14029467366897019727ULL
+#define FSH_P3 1609587929392839161ULL
+#define FSH_P4 9650029242287828579ULL
+#define FSH_P5 2870177450012600261ULL
+
+static uint64_t fsh_xxh_round(uint64_t acc, uint64_t input)
+{
+    acc += input * FSH_P2;
+    acc = fsh_rotl(acc, 31);
+    return acc * FSH_P1;
+}
+
+static uint64_t fsh_xxh_merge(uint64_t acc, uint64_t v)
+{
+    acc ^= fsh_xxh_round(0, v);
+    return acc * FSH_P1 + FSH_P4;
+}
+
+static void fsh_xxh64_stripes(fsh_state* s, const uint8_t* p, size_t stripes)
+{
+    uint64_t v1 = s->u.xxh64.v[0], v2 = s->u.xxh64.v[1], v3 = s->u.xxh64.v[2], v4 = s->u.xxh64.v[3];
+    for (size_t i = 0; i < stripes; i++, p += 32)
+    {
+        v1 = fsh_xxh_round(v1, fsh_load64(p));
+        v2 = fsh_xxh_round(v2, fsh_load64(p + 8));
+        v3 = fsh_xxh_round(v3, fsh_load64(p + 16));
+        v4 = fsh_xxh_round(v4, fsh_load64(p + 24));
+    }
+    s->u.xxh64.v[0] = v1;
+    s->u.xxh64.v[1] = v2;
+    s->u.xxh64.v[2] = v3;
+    s->u.xxh64.v[3] = v4;
+}
+
+static void fsh_xxh64_update(fsh_state* s, const uint8_t* p, size_t size)
+{
+    size_t held = (size_t)(s->length & 31);
+    s->length += size;
+    if (held)
+    {
+        size_t take = 32 - held < size ? 32 - held : size;
+        memcpy(s->u.xxh64.stripe + held, p, take);
+        p += take;
+        size -= take;
+        if (held + take < 32) return;
+        fsh_xxh64_stripes(s, s->u.xxh64.stripe, 1);
+    }
+    fsh_xxh64_stripes(s, p, size / 32);
+    memcpy(s->u.xxh64.stripe, p + (size & ~(size_t)31), size & 31);
+}
+
+static void fsh_xxh64_final(fsh_state* s, uint8_t* digest)
+{
+    const uint64_t* v = s->u.xxh64.v;
+    uint64_t h;
+    if (s->length >= 32)
+    {
+        h = fsh_rotl(v[0], 1) + fsh_rotl(v[1], 7) + fsh_rotl(v[2], 12) + fsh_rotl(v[3], 18);
+        for (int i = 0; i < 4; i++) h = fsh_xxh_merge(h, v[i]);
+    }
+    else h = FSH_P5;                   // seed 0
+    h += s->length;
+    const uint8_t* p = s->u.xxh64.stripe;
+    size_t n = (size_t)(s->length & 31);
+    for (; n >= 8; n -= 8, p += 8)
+    {
+        h ^= fsh_xxh_round(0, fsh_load64(p));
+        h = fsh_rotl(h, 27) * FSH_P1 + FSH_P4;
+    }
+    if (n >= 4)
+    {
+        h ^= (uint64_t)fsh_load32(p) * FSH_P1;
+        h = fsh_rotl(h, 23) * FSH_P2 + FSH_P3;
+        p += 4;
+        n -= 4;
+    }
+    for (; n > 0; n--, p++)
+    {
+        h ^= *p * FSH_P5;
+        h = fsh_rotl(h, 11) * FSH_P1;
+    }
+    h ^= h >> 33;
+    h *= FSH_P2;
+    h ^= h >> 29;
+    h *= FSH_P3;
+    h ^= h >> 32;
+    for (int i = 0; i < 8; i++) digest[i] = (uint8_t)(h >> (56 - 8 * i));
+}
+
+#pragma mark - MD5, SHA-1 and SHA-256
+
+#if !defined(__APPLE__)
+typedef void (*fsh_block_fn)(uint32_t* h, const uint8_t* p, size_t blocks);
+
+static const uint32_t fsh_k256[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static uint32_t fsh_rotr32(uint32_t x, int r)
+{
+    return (x >> r) | (x << (32 - r));
+}
+
+static void fsh_sha256_blocks(uint32_t* h, const uint8_t* p, size_t blocks)
+{
+    for (; blocks > 0; blocks--, p += 64)
+    {
+        uint32_t w[64];
+        for (int i = 0; i < 16; i++) w[i] = fsh_load32be(p + 4 * i);
+        for (int i = 16; i < 64; i++)
+        {
+            uint32_t s0 = fsh_rotr32(w[i - 15], 7) ^ fsh_rotr32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = fsh_rotr32(w[i - 2], 17) ^ fsh_rotr32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], k = h[7];
+        for (int i = 0; i < 64; i++)
+        {
+            uint32_t t1 = k + (fsh_rotr32(e, 6) ^ fsh_rotr32(e, 11) ^ fsh_rotr32(e, 25)) + ((e & f) ^ (~e & g)) +
+                          fsh_k256[i] + w[i];
+            uint32_t t2 = (fsh_rotr32(a, 2) ^ fsh_rotr32(a, 13) ^ fsh_rotr32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            k = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+        h[5] += f;
+        h[6] += g;
+        h[7] += k;
+    }
+}
+
+static void fsh_sha1_blocks(uint32_t* h, const uint8_t* p, size_t blocks)
+{
+    for (; blocks > 0; blocks--, p += 64)
+    {
+        uint32_t w[80];
+        for (int i = 0; i < 16; i++) w[i] = fsh_load32be(p + 4 * i);
+        for (int i = 16; i < 80; i++) w[i] = fsh_rotl32(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; i++)
+        {
+            uint32_t f, k;
+            if (i < 20)
+            {
+                f = (b & c) | (~b & d);
+                k = 0x5a827999;
+            }
+            else if (i < 40)
+            {
+                f = b ^ c ^ d;
+                k = 0x6ed9eba1;
+            }
+            else if (i < 60)
+            {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8f1bbcdc;
+            }
+            else
+            {
+                f = b ^ c ^ d;
+                k = 0xca62c1d6;
+            }
+            uint32_t t = fsh_rotl32(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = fsh_rotl32(b, 30);
+            b = a;
+            a = t;
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+    }
+}
+
+static const uint32_t fsh_md5_k[64] = {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+    0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+    0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+    0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+    0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+    0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391,
+};
+
+static const uint8_t fsh_md5_r[64] = {
+    7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20,
+    4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21,
+};
+
+static void fsh_md5_blocks(uint32_t* h, const uint8_t* p, size_t blocks)
+{
+    for (; blocks > 0; blocks--, p += 64)
+    {
+        uint32_t m[16];
+        for (int i = 0; i < 16; i++) m[i] = fsh_load32(p + 4 * i);
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3];
+        for (int i = 0; i < 64; i++)
+        {
+            uint32_t f;
+            int g;
+            if (i < 16)
+            {
+                f = (b & c) | (~b & d);
+                g = i;
+            }
+            else if (i < 32)
+            {
+                f = (d & b) | (~d & c);
+                g = (5 * i + 1) & 15;
+            }
+            else if (i < 48)
+            {
+                f = b ^ c ^ d;
+                g = (3 * i + 5) & 15;
+            }
+            else
+            {
+                f = c ^ (b | ~d);
+                g = (7 * i) & 15;
+            }
+            f += a + fsh_md5_k[i] + m[g];
+            a = d;
+            d = c;
+            c = b;
+            b += fsh_rotl32(f, fsh_md5_r[i]);
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+    }
+}
+
+static fsh_block_fn fsh_md_blocks(int algo)
+{
+    return algo == FSH_MD5 ? fsh_md5_blocks : algo == FSH_SHA1 ? fsh_sha1_blocks : fsh_sha256_blocks;
+}
+
+static void fsh_md_update(fsh_state* s, const uint8_t* p, size_t size)
+{
+    fsh_block_fn blocks = fsh_md_blocks(s->algo);
+    size_t held = (size_t)(s->length & 63);
+    s->length += size;
+    if (held)
+    {
+        size_t take = 64 - held < size ? 64 - held : size;
+        memcpy(s->u.md.block + held, p, take);
+        p += take;
+        size -= take;
+        if (held + take < 64) return;
+        blocks(s->u.md.h, s->u.md.block, 1);
+    }
+    blocks(s->u.md.h, p, size / 64);
+    memcpy(s->u.md.block, p + (size & ~(size_t)63), size & 63);
+}
+
+// The three share Merkle-Damgård padding; MD5 stores its length and words
+// little-endian.
+static void fsh_md_final(fsh_state* s, uint8_t* digest)
+{
+    int little = s->algo == FSH_MD5;
+    uint64_t bits = s->length * 8;
+    uint8_t pad[72] = {0x80};
+    size_t held = (size_t)(s->length & 63);
+    size_t n = held < 56 ? 56 - held : 120 - held;
+    for (int i = 0; i < 8; i++) pad[n + i] = (uint8_t)(bits >> (little ? 8 * i : 56 - 8 * i));
+    fsh_md_update(s, pad, n + 8);
+    size_t words = fsh_digest_size(s->algo) / 4;
+    for (size_t i = 0; i < words; i++)
+    {
+        if (little)
+            for (int k = 0; k < 4; k++) digest[4 * i + k] = (uint8_t)(s->u.md.h[i] >> (8 * k));
+        else fsh_store32be(digest + 4 * i, s->u.md.h[i]);
+    }
+}
+#endif
+
+#pragma mark - Digests
+
+size_t fsh_digest_size(int algo)
+{
+    switch (algo)
+    {
+    case FSH_M128: return 16;
+    case FSH_SHA256: return 32;
+    case FSH_MD5: return 16;
+    case FSH_SHA1: return 20;
+    case FSH_CRC32: return 4;
+    case FSH_XXH64: return 8;
+    default: return 0;
+    }
+}
+
+const char* fsh_name(int algo)
+{
+    switch (algo)
+    {
+    case FSH_M128: return "m128";
+    case FSH_SHA256: return "sha256";
+    case FSH_MD5: return "md5";
+    case FSH_SHA1: return "sha1";
+    case FSH_CRC32: return "crc32";
+    case FSH_XXH64: return "xxh64";
+    default: return "";
+    }
+}
+
+#if defined(__APPLE__)
+// MD5 and SHA-1 are deprecated for security use, not for checksums.
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wdeprecated-declarations"
+_Static_assert(sizeof(CC_SHA256_CTX) <= sizeof(((fsh_state*)0)->u.opaque), "fsh_state too small");
+_Static_assert(sizeof(CC_SHA1_CTX) <= sizeof(((fsh_state*)0)->u.opaque), "fsh_state too small");
+_Static_assert(sizeof(CC_MD5_CTX) <= sizeof(((fsh_state*)0)->u.opaque), "fsh_state too small");
+#endif
+
+int fsh_init(fsh_state* state, int algo)
+{
+    memset(state, 0, sizeof(*state));
+    state->algo = algo;
+    switch (algo)
+    {
+    case FSH_M128:
+        return 0;
+    case FSH_CRC32:
+        state->u.crc32 = (uint32_t)mz_crc32(0, NULL, 0);
+        return 0;
+    case FSH_XXH64:
+        state->u.xxh64.v[0] = FSH_P1 + FSH_P2;
+        state->u.xxh64.v[1] = FSH_P2;
+        state->u.xxh64.v[2] = 0;
+        state->u.xxh64.v[3] = 0 - FSH_P1;
+        return 0;
+#if defined(__APPLE__)
+    case FSH_SHA256:
+        CC_SHA256_Init((CC_SHA256_CTX*)state->u.opaque);
+        return 0;
+    case FSH_SHA1:
+        CC_SHA1_Init((CC_SHA1_CTX*)state->u.opaque);
+        return 0;
+    case FSH_MD5:
+        CC_MD5_Init((CC_MD5_CTX*)state->u.opaque);
+        return 0;
+#else
+    case FSH_SHA256:
+        {
+            static const uint32_t h[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                          0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+            memcpy(state->u.md.h, h, sizeof(h));
+        }
+        return 0;
+    case FSH_SHA1:
+        {
+            static const uint32_t h[5] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0};
+            memcpy(state->u.md.h, h, sizeof(h));
+        }
+        return 0;
+    case FSH_MD5:
+        {
+            static const uint32_t h[4] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476};
+            memcpy(state->u.md.h, h, sizeof(h));
+        }
+        return 0;
+#endif
+    default:
+        return EINVAL;
+    }
+}
+
+void fsh_update(fsh_state* state, const void* data, size_t size)
+{
+    const uint8_t* p = data;
+    switch (state->algo)
+    {
+    case FSH_M128:
+        fsh_m128_update(state, p, size);
+        break;
+    case FSH_CRC32:
+        state->u.crc32 = (uint32_t)mz_crc32(state->u.crc32, p, size);
+        state->length += size;
+        break;
+    case FSH_XXH64:
+        fsh_xxh64_update(state, p, size);
+        break;
+#if defined(__APPLE__)
+    case FSH_SHA256:
+    case FSH_SHA1:
+    case FSH_MD5:
+        // CC_LONG is 32 bits wide.
+        while (size > 0)
+        {
+            CC_LONG n = size > (1u << 30) ? (1u << 30) : (CC_LONG)size;
+            if (state->algo == FSH_SHA256) CC_SHA256_Update((CC_SHA256_CTX*)state->u.opaque, p, n);
+            else if (state->algo == FSH_SHA1) CC_SHA1_Update((CC_SHA1_CTX*)state->u.opaque, p, n);
+            else CC_MD5_Update((CC_MD5_CTX*)state->u.opaque, p, n);
+            p += n;
+            size -= n;
+        }
+        break;
+#else
+    case FSH_SHA256:
+    case FSH_SHA1:
+    case FSH_MD5:
+        fsh_md_update(state, p, size);
+        break;
+#endif
+    }
+}
+
+void fsh_final(fsh_state* state, uint8_t* digest)
+{
+    switch (state->algo)
+    {
+    case FSH_M128:
+        fsh_m128_final(state, digest);
+        break;
+    case FSH_CRC32:
+        fsh_store32be(digest, state->u.crc32);
+        break;
+    case FSH_XXH64:
+        fsh_xxh64_final(state, digest);
+        break;
+#if defined(__APPLE__)
+    case FSH_SHA256:
+        CC_SHA256_Final(digest, (CC_SHA256_CTX*)state->u.opaque);
+        break;
+    case FSH_SHA1:
+        CC_SHA1_Final(digest, (CC_SHA1_CTX*)state->u.opaque);
+        break;
+    case FSH_MD5:
+        CC_MD5_Final(digest, (CC_MD5_CTX*)state->u.opaque);
+        break;
+#else
+    case FSH_SHA256:
+    case FSH_SHA1:
+    case FSH_MD5:
+        fsh_md_final(state, digest);
+        break;
+#endif
+    }
+}
+
+#if defined(__APPLE__)
+#pragma clang diagnostic pop
+#endif
+
+void fsh_hex(const uint8_t* digest, size_t size, char* out)
+{
+    static const char digits[] = "0123456789abcdef";
+    for (size_t i = 0; i < size; i++)
+    {
+        out[2 * i] = digits[digest[i] >> 4];
+        out[2 * i + 1] = digits[digest[i] & 15];
+    }
+    out[2 * size] = '\0';
+}
+
+#pragma mark - Files
+
+typedef struct fsh_window
+{
+    uint8_t* data;
+    size_t length;
+    int pending;                   // lanes still hashing it
+} fsh_window;
+
+// The whole of [offset, offset + length), or EIO when the file ended early
+// because it shrank after its size was taken.
+static int fsh_read_window(int fd, uint8_t* buffer, size_t length, uint64_t offset)
+{
+    size_t got = 0;
+    while (got < length)
+    {
+        ssize_t n = pread(fd, buffer + got, length - got, (off_t)(offset + got));
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return errno;
+        if (n == 0) return EIO;
+        got += (size_t)n;
+    }
+    return 0;
+}
+
+// One file fed to several hash states. The reader reads window n into slot
+// n % 2 once both lanes are done with window n - 2, so reading the next
+// window overlaps hashing the current one. The windows are read with pread
+// rather than mapped: a file another process truncates meanwhile then ends
+// in a short read instead of SIGBUS.
+typedef struct fsh_feed
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    fsh_window windows[2];
+    uint64_t published;
+    int ended;
+    int lanes;
+    _Atomic uint64_t* done;
+} fsh_feed;
+
+typedef struct fsh_lane
+{
+    fsh_feed* feed;
+    fsh_state* states[FSH_ALGO_COUNT];
+    int count;
+} fsh_lane;
+
+static void fsh_lane_hash(fsh_lane* lane, const fsh_window* w)
+{
+    for (int i = 0; i < lane->count; i++) fsh_update(lane->states[i], w->data, w->length);
+}
+
+static void fsh_lane_finish(fsh_feed* f, fsh_window* w)
+{
+    pthread_mutex_lock(&f->lock);
+    if (--w->pending == 0)
+    {
+        if (f->done) atomic_fetch_add(f->done, w->length);
+        pthread_cond_broadcast(&f->cond);
+    }
+    pthread_mutex_unlock(&f->lock);
+}
+
+static void* fsh_lane_main(void* arg)
+{
+    fsh_lane* lane = arg;
+    fsh_feed* f = lane->feed;
+    for (uint64_t n = 0;; n++)
+    {
+        pthread_mutex_lock(&f->lock);
+        while (f->published <= n && !f->ended) pthread_cond_wait(&f->cond, &f->lock);
+        int stop = f->published <= n;
+        pthread_mutex_unlock(&f->lock);
+        if (stop) break;
+        fsh_window* w = &f->windows[n & 1];
+        fsh_lane_hash(lane, w);
+        fsh_lane_finish(f, w);
+    }
+    return NULL;
+}
+
+int fsh_file_multi(int fd, uint64_t size, unsigned algos, size_t window, int threads, _Atomic uint64_t* done,
+                   const volatile int* cancel, fsh_digests* out)
+{
+    fsh_state states[FSH_ALGO_COUNT];
+    int algo_list[FSH_ALGO_COUNT];
+    int count = 0;
+    for (int algo = 1; algo < FSH_ALGO_COUNT; algo++)
+    {
+        if (!(algos & FSH_BIT(algo))) continue;
+        fsh_init(&states[count], algo);
+        algo_list[count++] = algo;
+    }
+    if (count == 0) return EINVAL;
+    uint64_t page = (uint64_t)sysconf(_SC_PAGESIZE);
+    if (window == 0) window = FSH_WINDOW_DEFAULT;
+    window = (size_t)((window + page - 1) & ~(page - 1));
+    if (size < window) window = size ? (size_t)((size + page - 1) & ~(page - 1)) : (size_t)page;
+    uint8_t* buffers[2] = {NULL, NULL};
+    for (int i = 0; i < 2; i++)
+        if (posix_memalign((void**)&buffers[i], (size_t)page, window) != 0)
+        {
+            free(buffers[0]);
+            return ENOMEM;
+        }
+#if defined(__APPLE__)
+    fcntl(fd, F_RDAHEAD, 1);
+#elif defined(POSIX_FADV_SEQUENTIAL)
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    // Lane 0 runs on the calling thread, which also reads the windows.
+    int lanes = threads < count ? (threads > 1 ? threads : 1) : count;
+    fsh_lane lane[FSH_ALGO_COUNT];
+    fsh_feed feed = {0};
+    feed.lanes = lanes;
+    feed.done = done;
+    pthread_mutex_init(&feed.lock, NULL);
+    pthread_cond_init(&feed.cond, NULL);
+    for (int i = 0; i < lanes; i++)
+    {
+        lane[i].feed = &feed;
+        lane[i].count = 0;
+    }
+    for (int i = 0; i < count; i++) lane[i % lanes].states[lane[i % lanes].count++] = &states[i];
+    pthread_t workers[FSH_ALGO_COUNT];
+    int started = 1;
+    for (; started < lanes; started++)
+        if (pthread_create(&workers[started], NULL, fsh_lane_main, &lane[started]) != 0) break;
+    // States a lane failed to start with go to the calling thread.
+    for (int i = started; i < lanes; i++)
+        for (int k = 0; k < lane[i].count; k++) lane[0].states[lane[0].count++] = lane[i].states[k];
+    feed.lanes = started;
+
+    int err = 0;
+    uint64_t n = 0;
+    for (uint64_t offset = 0; offset < size; offset += window, n++)
+    {
+        if (cancel && *cancel)
+        {
+            err = ECANCELED;
+            break;
+        }
+        fsh_window* w = &feed.windows[n & 1];
+        pthread_mutex_lock(&feed.lock);
+        while (w->pending) pthread_cond_wait(&feed.cond, &feed.lock);
+        pthread_mutex_unlock(&feed.lock);
+        size_t length = size - offset < window ? (size_t)(size - offset) : window;
+        err = fsh_read_window(fd, buffers[n & 1], length, offset);
+        if (err) break;
+        pthread_mutex_lock(&feed.lock);
+        w->data = buffers[n & 1];
+        w->length = length;
+        w->pending = feed.lanes;
+        feed.published++;
+        pthread_cond_broadcast(&feed.cond);
+        pthread_mutex_unlock(&feed.lock);
+        fsh_lane_hash(&lane[0], w);
+        fsh_lane_finish(&feed, w);
+    }
+    pthread_mutex_lock(&feed.lock);
+    feed.ended = 1;
+    pthread_cond_broadcast(&feed.cond);
+    while (feed.windows[0].pending || feed.windows[1].pending) pthread_cond_wait(&feed.cond, &feed.lock);
+    pthread_mutex_unlock(&feed.lock);
+    for (int i = 1; i < started; i++) pthread_join(workers[i], NULL);
+    free(buffers[0]);
+    free(buffers[1]);
+    pthread_mutex_destroy(&feed.lock);
+    pthread_cond_destroy(&feed.cond);
+    if (err) return err;
+    for (int i = 0; i < count; i++) fsh_final(&states[i], out->digest[algo_list[i]]);
+    return 0;
+}
+
+int fsh_file(int fd, uint64_t size, int algo, size_t window, _Atomic uint64_t* done, const volatile int* cancel,
+             uint8_t* digest)
+{
+    if (!fsh_digest_size(algo)) return EINVAL;
+    fsh_digests digests;
+    int err = fsh_file_multi(fd, size, FSH_BIT(algo), window, 1, done, cancel, &digests);
+    if (!err) memcpy(digest, digests.digest[algo], fsh_digest_size(algo));
+    return err;
+}
+
+#pragma mark - Cache
+
+typedef struct fsh_record
+{
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t size;
+    int64_t mtime_ns;
+    int32_t kind;
+    uint32_t length;
+    uint8_t digest[FSH_DIGEST_MAX];
+} fsh_record;
+
+typedef struct fsh_file_header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t count;
+} fsh_file_header;
+
+struct fsh_cache
+{
+    pthread_mutex_t lock;
+    char* file;
+    fsh_record* records;
+    uint8_t* used;                 // looked up or stored in this session
+    size_t count;
+    size_t capacity;
+    uint32_t* slots;               // record + 1
+    size_t mask;
+    int dirty;
+};
+
+static size_t fsh_slot(const fsh_cache* c, uint64_t dev, uint64_t ino, int kind)
+{
+    uint64_t h = (ino ^ (dev * 0x9E3779B97F4A7C15ULL) ^ ((uint64_t)(uint32_t)kind << 40)) * 0xBF58476D1CE4E5B9ULL;
+    size_t i = (size_t)(h ^ (h >> 31)) & c->mask;
+    for (; c->slots[i]; i = (i + 1) & c->mask)
+    {
+        const fsh_record* r = &c->records[c->slots[i] - 1];
+        if (r->dev == dev && r->ino == ino && r->kind == kind) break;
+    }
+    return i;
+}
+
+static int fsh_cache_grow(fsh_cache* c)
+{
+    size_t capacity = c->capacity ? c->capacity * 2 : 1024;
+    fsh_record* records = realloc(c->records, capacity * sizeof(fsh_record));
+    if (!records) return ENOMEM;
+    c->records = records;
+    uint8_t* used = realloc(c->used, capacity);
+    if (!used) return ENOMEM;
+    c->used = used;
+    uint32_t* slots = calloc(capacity * 2, sizeof(uint32_t));
+    if (!slots) return ENOMEM;
+    free(c->slots);
+    c->slots = slots;
+    c->mask = capacity * 2 - 1;
+    c->capacity = capacity;
+    for (size_t k = 0; k < c->count; k++)
+    {
+        const fsh_record* r = &c->records[k];
+        c->slots[fsh_slot(c, r->dev, r->ino, r->kind)] = (uint32_t)k + 1;
+    }
+    return 0;
+}
+
+int fsh_cache_open(const char* file, fsh_cache** out)
+{
+    *out = NULL;
+    fsh_cache* c = calloc(1, sizeof(fsh_cache));
+    if (!c) return ENOMEM;
+    pthread_mutex_init(&c->lock, NULL);
+    c->file = strdup(file);
+    if (!c->file || fsh_cache_grow(c) != 0)
+    {
+        fsh_cache_close(c);
+        return ENOMEM;
+    }
+    FILE* f = fopen(file, "rb");
+    fsh_file_header header;
+    if (f && fread(&header, sizeof(header), 1, f) == 1 && header.magic == FSH_CACHE_MAGIC &&
+        header.version == FSH_CACHE_VERSION && header.count <= FSH_CACHE_MAX)
+    {
+        fsh_record r;
+        for (uint64_t k = 0; k < header.count && fread(&r, sizeof(r), 1, f) == 1; k++)
+        {
+            if (r.length > FSH_DIGEST_MAX) break;
+            if (c->count == c->capacity && fsh_cache_grow(c) != 0) break;
+            size_t slot = fsh_slot(c, r.dev, r.ino, r.kind);
+            if (c->slots[slot]) continue;
+            c->records[c->count] = r;
+            c->used[c->count] = 0;
+            c->slots[slot] = (uint32_t)++c->count;
+        }
+    }
+    if (f) fclose(f);
+    *out = c;
+    return 0;
+}
+
+static int fsh_cache_write(fsh_cache* c)
+{
+    size_t keep = c->count;
+    size_t spare = 0;
+    if (keep > FSH_CACHE_MAX)
+    {
+        size_t used = 0;
+        for (size_t k = 0; k < c->count; k++) used += c->used[k];
+        spare = used < FSH_CACHE_MAX ? FSH_CACHE_MAX - used : 0;
+        keep = FSH_CACHE_MAX;
+    }
+    size_t length = strlen(c->file);
+    char* temp = malloc(length + 5);
+    if (!temp) return ENOMEM;
+    memcpy(temp, c->file, length);
+    memcpy(temp + length, ".tmp", 5);
+    FILE* f = fopen(temp, "wb");
+    if (!f)
+    {
+        int err = errno;
+        free(temp);
+        return err;
+    }
+    fsh_file_header header = {FSH_CACHE_MAGIC, FSH_CACHE_VERSION, keep};
+    int ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    size_t written = 0;
+    for (size_t k = 0; ok && k < c->count && written < keep; k++)
+    {
+        if (c->count > FSH_CACHE_MAX && !c->used[k])
+        {
+            if (spare == 0) continue;
+            spare--;
+        }
+        ok = fwrite(&c->records[k], sizeof(fsh_record), 1, f) == 1;
+        written++;
+    }
+    int err = 0;
+    if (fclose(f) != 0 || !ok) err = errno ? errno : EIO;
+    if (!err && rename(temp, c->file) != 0) err = errno;
+    if (err) unlink(temp);
+    free(temp);
+    return err;
+}
+
+int fsh_cache_flush(fsh_cache* cache)
+{
+    pthread_mutex_lock(&cache->lock);
+    int err = cache->dirty && cache->file ? fsh_cache_write(cache) : 0;
+    if (!err) cache->dirty = 0;
+    pthread_mutex_unlock(&cache->lock);
+    return err;
+}
+
+int fsh_cache_close(fsh_cache* cache)
+{
+    if (!cache) return 0;
+    int err = cache->file ? fsh_cache_flush(cache) : 0;
+    pthread_mutex_destroy(&cache->lock);
+    free(cache->file);
+    free(cache->records);
+    free(cache->used);
+    free(cache->slots);
+    free(cache);
+    return err;
+}
+
+static int64_t fsh_mtime(const struct stat* st)
+{
+    return (int64_t)FSH_MTIME(st).tv_sec * 1000000000LL + FSH_MTIME(st).tv_nsec;
+}
+
+int fsh_cache_get(fsh_cache* cache, const struct stat* st, int kind, uint8_t* digest, size_t size)
+{
+    int hit = 0;
+    pthread_mutex_lock(&cache->lock);
+    size_t slot = fsh_slot(cache, (uint64_t)st->st_dev, (uint64_t)st->st_ino, kind);
+    if (cache->slots[slot])
+    {
+        size_t k = cache->slots[slot] - 1;
+        const fsh_record* r = &cache->records[k];
+        if (r->size == (uint64_t)st->st_size && r->mtime_ns == fsh_mtime(st) && r->length == size)
+        {
+            memcpy(digest, r->digest, size);
+            cache->used[k] = 1;
+            hit = 1;
+        }
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return hit;
+}
+
+void fsh_cache_put(fsh_cache* cache, const struct stat* st, int kind, const uint8_t* digest, size_t size)
+{
+    if (size > FSH_DIGEST_MAX) return;
+    pthread_mutex_lock(&cache->lock);
+    size_t slot = fsh_slot(cache, (uint64_t)st->st_dev, (uint64_t)st->st_ino, kind);
+    size_t k;
+    if (cache->slots[slot]) k = cache->slots[slot] - 1;
+    else
+    {
+        if (cache->count == cache->capacity)
+        {
+            if (fsh_cache_grow(cache) != 0)
+            {
+                pthread_mutex_unlock(&cache->lock);
+                return;
+            }
+            slot = fsh_slot(cache, (uint64_t)st->st_dev, (uint64_t)st->st_ino, kind);
+        }
+        k = cache->count++;
+        cache->slots[slot] = (uint32_t)k + 1;
+    }
+    fsh_record* r = &cache->records[k];
+    memset(r, 0, sizeof(*r));
+    r->dev = (uint64_t)st->st_dev;
+    r->ino = (uint64_t)st->st_ino;
+    r->size = (uint64_t)st->st_size;
+    r->mtime_ns = fsh_mtime(st);
+    r->kind = kind;
+    r->length = (uint32_t)size;
+    memcpy(r->digest, digest, size);
+    cache->used[k] = 1;
+    cache->dirty = 1;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+#pragma mark - Trees
+
+typedef struct fsh_item
+{
+    size_t path;                   // offset into names
+    uint64_t size;
+    uint64_t ino;
+    int error;
+} fsh_item;
+
+struct fsh_files
+{
+    char* names;
+    size_t names_used;
+    size_t names_capacity;
+    fsh_item* items;
+    size_t count;
+    size_t capacity;
+    unsigned algos;
+    size_t offsets[FSH_ALGO_COUNT]; // of each digest within a record
+    size_t stride;
+    uint8_t* digests;              // stride bytes per item
+};
+
+typedef struct fsh_pool
+{
+    fsh_files* files;
+    const fsh_options* options;
+    const volatile int* cancel;
+    const size_t* order;
+    int lanes;                     // algorithm threads per file
+    _Atomic size_t next;
+    _Atomic uint64_t files_done;
+    _Atomic uint64_t bytes_done;
+    uint64_t bytes_total;
+    pthread_mutex_t report_lock;
+    uint64_t last_report;
+} fsh_pool;
+
+static int fsh_cancelled(const volatile int* cancel)
+{
+    return cancel && *cancel;
+}
+
+static void fsh_report(fsh_pool* p, int force)
+{
+    const fsh_options* o = p->options;
+    if (!o->progress) return;
+    if (!force && pthread_mutex_trylock(&p->report_lock) != 0) return;
+    if (force) pthread_mutex_lock(&p->report_lock);
+    uint64_t now = fsh_now();
+    if (force || now - p->last_report >= o->interval_ns)
+    {
+        p->last_report = now;
+        uint64_t bytes = atomic_load(&p->bytes_done);
+        fsh_progress progress = {atomic_load(&p->files_done), p->files->count,
+                                 bytes < p->bytes_total ? bytes : p->bytes_total, p->bytes_total};
+        o->progress(o->ctx, &progress);
+    }
+    pthread_mutex_unlock(&p->report_lock);
+}
+
+static int fsh_add(fsh_files* f, const char* dir, size_t dir_length, const char* name, const struct stat* st,
+                   int error)
+{
+    size_t name_length = strlen(name);
+    int slash = dir_length > 0 && name_length > 0 && dir[dir_length - 1] != '/';
+    size_t needed = dir_length + slash + name_length + 1;
+    if (f->names_used + needed > f->names_capacity)
+    {
+        size_t capacity = f->names_capacity ? f->names_capacity * 2 : 1 << 12;
+        while (capacity < f->names_used + needed) capacity *= 2;
+        char* names = realloc(f->names, capacity);
+        if (!names) return ENOMEM;
+        f->names = names;
+        f->names_capacity = capacity;
+    }
+    if (f->count == f->capacity)
+    {
+        size_t capacity = f->capacity ? f->capacity * 2 : 64;
+        fsh_item* items = realloc(f->items, capacity * sizeof(fsh_item));
+        if (!items) return ENOMEM;
+        f->items = items;
+        f->capacity = capacity;
+    }
+    fsh_item* item = &f->items[f->count++];
+    item->path = f->names_used;
+    item->size = st ? (uint64_t)st->st_size : 0;
+    item->ino = st ? (uint64_t)st->st_ino : 0;
+    item->error = error;
+    char* p = f->names + f->names_used;
+    memcpy(p, dir, dir_length);
+    if (slash) p[dir_length] = '/';
+    memcpy(p + dir_length + slash, name, name_length + 1);
+    f->names_used += needed;
+    return 0;
+}
+
+// Depth first with an explicit stack, as fs_dupes walks. Folders that cannot
+// be opened are listed with their error so the caller can tell a partial
+// result from a complete one.
+static int fsh_walk(fsh_files* f, const char* root, const volatile int* cancel)
+{
+    size_t capacity = 64, depth = 0;
+    char** stack = malloc(capacity * sizeof(char*));
+    if (!stack) return ENOMEM;
+    stack[depth] = strdup(root);
+    if (!stack[depth++])
+    {
+        free(stack);
+        return ENOMEM;
+    }
+    int err = 0;
+    while (depth > 0 && !err)
+    {
+        char* dir = stack[--depth];
+        size_t dir_length = strlen(dir);
+        DIR* d = fsh_cancelled(cancel) ? NULL : opendir(dir);
+        if (!d && !fsh_cancelled(cancel)) err = fsh_add(f, dir, dir_length, "", NULL, errno);
+        struct dirent* e;
+        while (d && !err && (e = readdir(d)))
+        {
+            const char* name = e->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+            struct stat st;
+            if (fstatat(dirfd(d), name, &st, AT_SYMLINK_NOFOLLOW) != 0) continue;
+            if (S_ISDIR(st.st_mode))
+            {
+                size_t length = dir_length + strlen(name) + 2;
+                if (length > PATH_MAX) continue;
+                if (depth == capacity)
+                {
+                    char** grown = realloc(stack, capacity * 2 * sizeof(char*));
+                    if (!grown)
+                    {
+                        err = ENOMEM;
+                        break;
+                    }
+                    stack = grown;
+                    capacity *= 2;
+                }
+                char* child = malloc(length);
+                if (!child)
+                {
+                    err = ENOMEM;
+                    break;
+                }
+                memcpy(child, dir, dir_length);
+                size_t at = dir_length;
+                if (at == 0 || child[at - 1] != '/') child[at++] = '/';
+                strcpy(child + at, name);
+                stack[depth++] = child;
+            }
+            else if (S_ISREG(st.st_mode)) err = fsh_add(f, dir, dir_length, name, &st, 0);
+        }
+        if (d) closedir(d);
+        free(dir);
+    }
+    while (depth > 0) free(stack[--depth]);
+    free(stack);
+    if (!err && fsh_cancelled(cancel)) err = ECANCELED;
+    return err;
+}
+
+static void fsh_hash_item(fsh_pool* p, size_t index)
+{
+    fsh_files* f = p->files;
+    fsh_item* item = &f->items[index];
+    if (item->error) return;
+    uint8_t* record = f->digests + index * f->stride;
+    fsh_cache* cache = p->options->cache;
+    int fd = open(f->names + item->path, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0)
+    {
+        item->error = errno;
+        if (fd >= 0) close(fd);
+        atomic_fetch_add(&p->bytes_done, item->size);
+        return;
+    }
+    // Rewritten since the walk: hash what is there now. The progress total
+    // may then be off by the difference; fsh_report clamps it.
+    item->size = (uint64_t)st.st_size;
+    item->ino = (uint64_t)st.st_ino;
+
+    // Only the algorithms the cache does not already know cost a read.
+    unsigned missing = 0;
+    for (int algo = 1; algo < FSH_ALGO_COUNT; algo++)
+    {
+        if (!(f->algos & FSH_BIT(algo))) continue;
+        if (!cache || !fsh_cache_get(cache, &st, algo, record + f->offsets[algo], fsh_digest_size(algo)))
+            missing |= FSH_BIT(algo);
+    }
+    if (!missing)
+    {
+        close(fd);
+        atomic_fetch_add(&p->bytes_done, item->size);
+        return;
+    }
+    fsh_digests digests;
+    int err = fsh_file_multi(fd, item->size, missing, 0, p->lanes, &p->bytes_done, p->cancel, &digests);
+    close(fd);
+    if (err)
+    {
+        item->error = err;
+        // Overshoots by what was hashed; fsh_report clamps it.
+        atomic_fetch_add(&p->bytes_done, item->size);
+        return;
+    }
+    for (int algo = 1; algo < FSH_ALGO_COUNT; algo++)
+    {
+        if (!(missing & FSH_BIT(algo))) continue;
+        size_t size = fsh_digest_size(algo);
+        memcpy(record + f->offsets[algo], digests.digest[algo], size);
+        if (cache) fsh_cache_put(cache, &st, algo, digests.digest[algo], size);
+    }
+}
+
+static void* fsh_worker_main(void* arg)
+{
+    fsh_pool* p = arg;
+    for (;;)
+    {
+        if (fsh_cancelled(p->cancel)) break;
+        size_t i = atomic_fetch_add(&p->next, 1);
+        if (i >= p->files->count) break;
+        fsh_hash_item(p, p->order[i]);
+        atomic_fetch_add(&p->files_done, 1);
+        fsh_report(p, 0);
+    }
+    return NULL;
+}
+
+typedef int (*fsh_compare_fn)(const fsh_files* f, const fsh_item* a, const fsh_item* b);
+
+// Stable bottom-up merge sort over item indices, as fs_dupes sorts.
+static int fsh_sort(const fsh_files* f, size_t* items, size_t n, fsh_compare_fn compare)
+{
+    if (n < 2) return 0;
+    size_t* tmp = malloc(n * sizeof(size_t));
+    if (!tmp) return ENOMEM;
+    size_t* src = items;
+    size_t* dst = tmp;
+    for (size_t width = 1; width < n; width *= 2)
+    {
+        for (size_t lo = 0; lo < n; lo += 2 * width)
+        {
+            size_t mid = lo + width < n ? lo + width : n;
+            size_t hi = lo + 2 * width < n ? lo + 2 * width : n;
+            size_t i = lo, j = mid, k = lo;
+            while (i < mid && j < hi)
+                dst[k++] = compare(f, &f->items[src[j]], &f->items[src[i]]) < 0 ? src[j++] : src[i++];
+            while (i < mid) dst[k++] = src[i++];
+            while (j < hi) dst[k++] = src[j++];
+        }
+        size_t* t = src;
+        src = dst;
+        dst = t;
+    }
+    if (src != items) memcpy(items, src, n * sizeof(size_t));
+    free(tmp);
+    return 0;
+}
+
+// Largest first hands the pool its longest jobs while others can still
+// balance them.
+static int fsh_compare_size(const fsh_files* f, const fsh_item* a, const fsh_item* b)
+{
+    (void)f;
+    if (a->size != b->size) return a->size > b->size ? -1 : 1;
+    return 0;
+}
+
+static int fsh_compare_path(const fsh_files* f, const fsh_item* a, const fsh_item* b)
+{
+    return strcmp(f->names + a->path, f->names + b->path);
+}
+
+// Puts items and their digest records in path order.
+static int fsh_order_by_path(fsh_files* f)
+{
+    size_t* order = malloc((f->count ? f->count : 1) * sizeof(size_t));
+    fsh_item* items = malloc((f->count ? f->count : 1) * sizeof(fsh_item));
+    uint8_t* digests = malloc((f->count ? f->count : 1) * f->stride);
+    int err = order && items && digests ? 0 : ENOMEM;
+    if (!err)
+    {
+        for (size_t i = 0; i < f->count; i++) order[i] = i;
+        err = fsh_sort(f, order, f->count, fsh_compare_path);
+    }
+    if (!err)
+    {
+        for (size_t i = 0; i < f->count; i++)
+        {
+            items[i] = f->items[order[i]];
+            memcpy(digests + i * f->stride, f->digests + order[i] * f->stride, f->stride);
+        }
+        free(f->items);
+        free(f->digests);
+        f->items = items;
+        f->digests = digests;
+        f->capacity = f->count ? f->count : 1;
+        items = NULL;
+        digests = NULL;
+    }
+    free(order);
+    free(items);
+    free(digests);
+    return err;
+}
+
+void fsh_options_init(fsh_options* options)
+{
+    memset(options, 0, sizeof(*options));
+    options->algos = FSH_BIT(FSH_SHA256);
+    options->interval_ns = FSH_DEFAULT_INTERVAL_NS;
+}
+
+int fsh_hash_path(const char* path, const fsh_options* options, const volatile int* cancel, fsh_files** out)
+{
+    *out = NULL;
+    fsh_options defaults;
+    if (!options)
+    {
+        fsh_options_init(&defaults);
+        options = &defaults;
+    }
+    unsigned algos = options->algos & (FSH_BIT(FSH_ALGO_COUNT) - 2);
+    if (!algos) return EINVAL;
+    struct stat st;
+    if (lstat(path, &st) != 0) return errno;
+    if (!S_ISDIR(st.st_mode) && !S_ISREG(st.st_mode)) return EINVAL;
+
+    fsh_files* f = calloc(1, sizeof(fsh_files));
+    if (!f) return ENOMEM;
+    f->algos = algos;
+    for (int algo = 1; algo < FSH_ALGO_COUNT; algo++)
+    {
+        if (!(algos & FSH_BIT(algo))) continue;
+        f->offsets[algo] = f->stride;
+        f->stride += fsh_digest_size(algo);
+    }
+    int err = S_ISDIR(st.st_mode) ? fsh_walk(f, path, cancel) : fsh_add(f, path, strlen(path), "", &st, 0);
+    size_t* order = NULL;
+    if (!err)
+    {
+        f->digests = calloc(f->count ? f->count : 1, f->stride);
+        order = malloc((f->count ? f->count : 1) * sizeof(size_t));
+        if (!f->digests || !order) err = ENOMEM;
+    }
+    if (!err)
+    {
+        for (size_t i = 0; i < f->count; i++) order[i] = i;
+        err = fsh_sort(f, order, f->count, fsh_compare_size);
+    }
+    if (!err)
+    {
+        fsh_pool p;
+        memset(&p, 0, sizeof(p));
+        p.files = f;
+        p.options = options;
+        p.cancel = cancel;
+        p.order = order;
+        for (size_t i = 0; i < f->count; i++) p.bytes_total += f->items[i].size;
+        pthread_mutex_init(&p.report_lock, NULL);
+        int threads = options->threads;
+        if (threads <= 0) threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        if (threads < 1) threads = 1;
+        if (threads > FSH_MAX_THREADS) threads = FSH_MAX_THREADS;
+        // Fewer files than cores leaves cores to spread each file's
+        // algorithms over; a single file gets them all.
+        int workers = (size_t)threads > f->count ? (f->count ? (int)f->count : 1) : threads;
+        p.lanes = threads / workers;
+        fsh_report(&p, 1);
+        pthread_t pool[FSH_MAX_THREADS];
+        int started = 1;
+        for (; started < workers; started++)
+            if (pthread_create(&pool[started], NULL, fsh_worker_main, &p) != 0) break;
+        fsh_worker_main(&p);
+        for (int i = 1; i < started; i++) pthread_join(pool[i], NULL);
+        fsh_report(&p, 1);
+        pthread_mutex_destroy(&p.report_lock);
+        if (fsh_cancelled(cancel)) err = ECANCELED;
+    }
+    free(order);
+    if (!err) err = fsh_order_by_path(f);
+    if (err)
+    {
+        fsh_files_free(f);
+        return err;
+    }
+    *out = f;
+    return 0;
+}
+
+void fsh_files_free(fsh_files* files)
+{
+    if (!files) return;
+    free(files->names);
+    free(files->items);
+    free(files->digests);
+    free(files);
+}
+
+size_t fsh_files_count(const fsh_files* files)
+{
+    return files->count;
+}
+
+const char* fsh_files_path(const fsh_files* files, size_t i)
+{
+    return files->names + files->items[i].path;
+}
+
+uint64_t fsh_files_size(const fsh_files* files, size_t i)
+{
+    return files->items[i].size;
+}
+
+int fsh_files_error(const fsh_files* files, size_t i)
+{
+    return files->items[i].error;
+}
+
+const uint8_t* fsh_files_digest(const fsh_files* files, size_t i, int algo)
+{
+    if (algo <= 0 || algo >= FSH_ALGO_COUNT || !(files->algos & FSH_BIT(algo)) || files->items[i].error) return NULL;
+    return files->digests + i * files->stride + files->offsets[algo];
+}
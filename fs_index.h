@@ -0,0 +1,55 @@
+// File: fs_index.h
+// Location: プロジェクト直下
+
+#ifndef FS_INDEX_H
+#define FS_INDEX_H
+
+#include "fs_search.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Persistent file name index. fsi_build walks a tree once and writes every
+// entry, the distinct names in sorted order, a suffix array over those names
+// and a modification stamp per directory into one file that fsi_open maps
+// read-only. A search then only touches the mapping, except for directories
+// whose stamp is stale: those are listed live, and subdirectories created
+// under them are walked with fss_search.
+
+typedef struct fsi_index fsi_index;
+
+typedef struct fsi_stats
+{
+    uint64_t entries;
+    uint64_t dirs;
+    uint64_t names;                // distinct names
+    uint64_t file_size;            // bytes on disk
+    uint64_t build_ns;             // time fsi_build spent walking and writing
+    int64_t built_at;              // seconds since the epoch
+    uint64_t stale;                // directories currently answered live
+} fsi_stats;
+
+// Walks root (hidden names included, symlinks not followed) and atomically
+// replaces file. Returns 0, ECANCELED or an errno value. stats may be NULL.
+int fsi_build(const char* root, const char* file, const volatile int* cancel, fsi_stats* stats);
+
+// Returns 0, EINVAL for a file that is damaged or was written by another
+// version, or an errno value.
+int fsi_open(const char* file, fsi_index** out);
+void fsi_close(fsi_index* index);
+const char* fsi_root(const fsi_index* index);
+void fsi_get_stats(const fsi_index* index, fsi_stats* stats);
+
+// Marks one directory stale, e.g. from a change event. Safe while searches
+// run. Returns 0, or ENOENT when the directory is not in the index.
+int fsi_invalidate(fsi_index* index, const char* path);
+
+// Stats every indexed directory under root and marks those whose stamp no
+// longer matches. Returns the number of stale directories under root.
+size_t fsi_refresh(fsi_index* index, const char* root, const volatile int* cancel);
+
+// Same contract as fss_search. Returns ENOENT when root is not a directory of
+// the index; the caller then walks it live.
+int fsi_search(fsi_index* index, const char* root, const fss_query* query, fss_batch_fn fn, void* ctx,
+               const volatile int* cancel);
+
+#endif
@@ -0,0 +1,995 @@
+// File: fs_index.c
+// Location: プロジェクト直下
+
+#include "fs_index.h"
+#include "fs.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define FSI_MAGIC "FSINDEX"
+#define FSI_VERSION 1
+#define FSI_BYTE_ORDER 0x01020304u
+#define FSI_NONE UINT32_MAX
+#define FSI_MAX_DEPTH 1024
+#define FSI_BATCH_MAX 256
+
+#if defined(__APPLE__)
+#define FSI_STAMP(st) ((int64_t)(st).st_mtimespec.tv_sec * 1000000000 + (st).st_mtimespec.tv_nsec)
+#else
+#define FSI_STAMP(st) ((int64_t)(st).st_mtim.tv_sec * 1000000000 + (st).st_mtim.tv_nsec)
+#endif
+
+// On-disk layout: header, then the sections below, each 8-byte aligned.
+typedef struct fsi_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t file_size;
+    uint64_t build_ns;
+    int64_t built_at;
+    uint32_t dir_count;
+    uint32_t entry_count;
+    uint32_t name_count;
+    uint32_t suffix_count;
+    uint64_t text_size;
+    uint64_t dirs_offset;
+    uint64_t entries_offset;
+    uint64_t names_offset;
+    uint64_t suffixes_offset;
+    uint64_t text_offset;
+} fsi_header;
+
+// Directories are numbered in preorder, so the subtree of d is [d, end).
+typedef struct fsi_dir
+{
+    int64_t stamp;                 // mtime in ns, taken before the directory was read
+    uint32_t parent;               // FSI_NONE for the root
+    uint32_t end;
+    uint32_t name;                 // text offset; the root holds its full path
+    uint32_t hidden;               // nearest ancestor-or-self starting with '.', 0 if none
+} fsi_dir;
+
+typedef struct fsi_entry
+{
+    uint64_t size;
+    int64_t mtime;
+    uint32_t dir;                  // directory holding the entry
+    uint32_t flags;                // FS_ENTRY_*
+} fsi_entry;
+
+// Distinct names sorted with ASCII letters folded; entries are grouped by name.
+typedef struct fsi_name
+{
+    uint32_t text;
+    uint32_t first;
+    uint32_t count;
+} fsi_name;
+
+struct fsi_index
+{
+    void* map;
+    size_t map_size;
+    const fsi_header* header;
+    const fsi_dir* dirs;
+    const fsi_entry* entries;
+    const fsi_name* names;
+    const uint32_t* suffixes;      // name suffixes sorted folded, by text offset
+    const char* text;
+    atomic_uchar* stale;           // per directory; lives only in memory
+};
+
+static uint64_t fsi_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static inline unsigned char fsi_fold(unsigned char c)
+{
+    return c >= 'A' && c <= 'Z' ? (unsigned char)(c + ('a' - 'A')) : c;
+}
+
+static int fsi_fold_compare(const char* a, const char* b)
+{
+    const unsigned char* x = (const unsigned char*)a;
+    const unsigned char* y = (const unsigned char*)b;
+    while (*x && fsi_fold(*x) == fsi_fold(*y))
+    {
+        x++;
+        y++;
+    }
+    return (int)fsi_fold(*x) - (int)fsi_fold(*y);
+}
+
+// Orders s against a folded needle of n bytes, looking at s's first n bytes.
+static int fsi_prefix_compare(const char* s, const unsigned char* needle, size_t n)
+{
+    const unsigned char* p = (const unsigned char*)s;
+    for (size_t i = 0; i < n; i++)
+    {
+        int d = (int)fsi_fold(p[i]) - (int)needle[i];
+        if (d) return d;           // also stops at the end of s
+    }
+    return 0;
+}
+
+static int fsi_grow(void** items, size_t* capacity, size_t need, size_t size)
+{
+    if (need <= *capacity) return 0;
+    size_t cap = *capacity ? *capacity : 1024;
+    while (cap < need) cap *= 2;
+    void* grown = realloc(*items, cap * size);
+    if (!grown) return ENOMEM;
+    *items = grown;
+    *capacity = cap;
+    return 0;
+}
+
+#pragma mark - Build
+
+typedef struct fsi_raw
+{
+    uint64_t size;
+    int64_t mtime;
+    uint32_t name;                 // offset into the builder text
+    uint32_t dir;
+    uint32_t flags;
+} fsi_raw;
+
+typedef struct fsi_builder
+{
+    const volatile int* cancel;
+    fsi_raw* raw;
+    size_t raw_count;
+    size_t raw_capacity;
+    fsi_dir* dirs;
+    uint32_t* dir_raw;             // entry naming each directory
+    size_t dir_count;
+    size_t dir_capacity;
+    size_t dir_raw_capacity;
+    char* text;
+    size_t text_used;
+    size_t text_capacity;
+    char path[PATH_MAX];
+} fsi_builder;
+
+typedef struct fsi_sorted
+{
+    const char* name;
+    uint32_t raw;
+} fsi_sorted;
+
+static uint32_t fsi_add_text(fsi_builder* b, const char* s, size_t n)
+{
+    if (b->text_used + n + 1 > UINT32_MAX) return FSI_NONE;
+    if (fsi_grow((void**)&b->text, &b->text_capacity, b->text_used + n + 1, 1) != 0) return FSI_NONE;
+    uint32_t offset = (uint32_t)b->text_used;
+    memcpy(b->text + offset, s, n);
+    b->text[offset + n] = '\0';
+    b->text_used += n + 1;
+    return offset;
+}
+
+static uint32_t fsi_add_dir(fsi_builder* b, uint32_t parent, uint32_t raw)
+{
+    if (fsi_grow((void**)&b->dirs, &b->dir_capacity, b->dir_count + 1, sizeof(fsi_dir)) != 0) return FSI_NONE;
+    if (fsi_grow((void**)&b->dir_raw, &b->dir_raw_capacity, b->dir_count + 1, sizeof(uint32_t)) != 0) return FSI_NONE;
+    uint32_t d = (uint32_t)b->dir_count++;
+    fsi_dir* dir = &b->dirs[d];
+    memset(dir, 0, sizeof(*dir));
+    dir->stamp = -1;
+    dir->parent = parent;
+    dir->end = d + 1;
+    b->dir_raw[d] = raw;
+    if (parent != FSI_NONE) dir->hidden = b->text[b->raw[raw].name] == '.' ? d : b->dirs[parent].hidden;
+    return d;
+}
+
+static int fsi_walk(fsi_builder* b, size_t length, uint32_t dir, int depth)
+{
+    if (b->cancel && *b->cancel) return ECANCELED;
+
+    // Stamp first: a change racing the read leaves the stamp older than the disk.
+    struct stat st;
+    if (stat(b->path, &st) == 0) b->dirs[dir].stamp = FSI_STAMP(st);
+
+    fs_listing l;
+    if (fs_list_dir(b->path, FS_LIST_HIDDEN | FS_LIST_STAT, &l) != 0) return 0;   // unreadable: indexed empty
+
+    int err = 0;
+    size_t first = b->raw_count;
+    if (first + l.count > UINT32_MAX || fsi_grow((void**)&b->raw, &b->raw_capacity, first + l.count, sizeof(fsi_raw)) != 0)
+        err = ENOMEM;
+    for (size_t i = 0; i < l.count && !err; i++)
+    {
+        fsi_raw* r = &b->raw[first + i];
+        r->name = fsi_add_text(b, fs_listing_name(&l, i), l.name_length[i]);
+        if (r->name == FSI_NONE) err = ENOMEM;
+        r->dir = dir;
+        r->flags = l.flags[i];
+        r->size = l.size[i];
+        r->mtime = l.mtime[i];
+    }
+    if (!err) b->raw_count = first + l.count;
+
+    for (size_t i = 0; i < l.count && !err; i++)
+    {
+        // Symbolic links are indexed but never followed.
+        if ((l.flags[i] & (FS_ENTRY_DIR | FS_ENTRY_LINK)) != FS_ENTRY_DIR) continue;
+        size_t n = l.name_length[i];
+        size_t sep = b->path[length - 1] == '/' ? 0 : 1;
+        if (length + sep + n >= sizeof(b->path) || depth >= FSI_MAX_DEPTH) continue;
+
+        uint32_t child = fsi_add_dir(b, dir, (uint32_t)(first + i));
+        if (child == FSI_NONE)
+        {
+            err = ENOMEM;
+            break;
+        }
+        if (sep) b->path[length] = '/';
+        memcpy(b->path + length + sep, fs_listing_name(&l, i), n + 1);
+        err = fsi_walk(b, length + sep + n, child, depth + 1);
+        b->dirs[child].end = (uint32_t)b->dir_count;
+        b->path[length] = '\0';
+    }
+    fs_listing_free(&l);
+    return err;
+}
+
+static int fsi_sorted_compare(const void* a, const void* b)
+{
+    const fsi_sorted* x = a;
+    const fsi_sorted* y = b;
+    int d = fsi_fold_compare(x->name, y->name);
+    if (!d) d = strcmp(x->name, y->name);
+    if (!d) d = x->raw < y->raw ? -1 : x->raw > y->raw;
+    return d;
+}
+
+static int fsi_suffix_compare(const void* a, const void* b)
+{
+    const char* x = *(const char* const*)a;
+    const char* y = *(const char* const*)b;
+    int d = fsi_fold_compare(x, y);
+    return d ? d : (x < y ? -1 : x > y);
+}
+
+static int fsi_write_all(int fd, const void* data, size_t size)
+{
+    const char* p = data;
+    while (size)
+    {
+        ssize_t n = write(fd, p, size);
+        if (n < 0)
+        {
+            if (errno == EINTR) continue;
+            return errno;
+        }
+        p += n;
+        size -= (size_t)n;
+    }
+    return 0;
+}
+
+static uint64_t fsi_align(uint64_t offset)
+{
+    return (offset + 7) & ~(uint64_t)7;
+}
+
+static int fsi_write_section(int fd, uint64_t* at, uint64_t offset, const void* data, size_t size)
+{
+    static const char zeros[8];
+    int err = fsi_write_all(fd, zeros, (size_t)(offset - *at));
+    if (!err) err = fsi_write_all(fd, data, size);
+    *at = offset + size;
+    return err;
+}
+
+// Turns the walk into the final tables and writes them to fd.
+static int fsi_write(fsi_builder* b, const char* root, int fd, uint64_t started, fsi_header* h)
+{
+    size_t count = b->raw_count;
+    fsi_sorted* sorted = malloc((count ? count : 1) * sizeof(fsi_sorted));
+    uint32_t* raw_name = malloc((count ? count : 1) * sizeof(uint32_t));
+    fsi_entry* entries = malloc((count ? count : 1) * sizeof(fsi_entry));
+    fsi_name* names = malloc((count ? count : 1) * sizeof(fsi_name));
+    char* text = malloc(b->text_used + strlen(root) + 1);
+    const char** suffix_names = NULL;
+    uint32_t* suffixes = NULL;
+    int err = 0;
+    if (!sorted || !raw_name || !entries || !names || !text)
+    {
+        err = ENOMEM;
+        goto done;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        sorted[i].name = b->text + b->raw[i].name;
+        sorted[i].raw = (uint32_t)i;
+    }
+    qsort(sorted, count, sizeof(fsi_sorted), fsi_sorted_compare);
+
+    size_t name_count = 0;
+    size_t text_used = 0;
+    size_t suffix_count = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        const fsi_raw* r = &b->raw[sorted[i].raw];
+        if (i == 0 || strcmp(sorted[i].name, sorted[i - 1].name) != 0)
+        {
+            size_t n = strlen(sorted[i].name);
+            names[name_count].text = (uint32_t)text_used;
+            names[name_count].first = (uint32_t)i;
+            names[name_count].count = 0;
+            memcpy(text + text_used, sorted[i].name, n + 1);
+            text_used += n + 1;
+            // Queries are valid UTF-8, so no match starts on a continuation byte.
+            for (size_t k = 0; k < n; k++) suffix_count += ((unsigned char)sorted[i].name[k] & 0xC0) != 0x80;
+            name_count++;
+        }
+        names[name_count - 1].count++;
+        raw_name[sorted[i].raw] = (uint32_t)(name_count - 1);
+        entries[i].size = r->size;
+        entries[i].mtime = r->mtime;
+        entries[i].dir = r->dir;
+        entries[i].flags = r->flags;
+    }
+    size_t names_end = text_used;
+    b->dirs[0].name = (uint32_t)text_used;
+    memcpy(text + text_used, root, strlen(root) + 1);
+    text_used += strlen(root) + 1;
+    for (size_t d = 1; d < b->dir_count; d++) b->dirs[d].name = names[raw_name[b->dir_raw[d]]].text;
+
+    suffix_names = malloc((suffix_count ? suffix_count : 1) * sizeof(char*));
+    suffixes = malloc((suffix_count ? suffix_count : 1) * sizeof(uint32_t));
+    if (!suffix_names || !suffixes)
+    {
+        err = ENOMEM;
+        goto done;
+    }
+    size_t s = 0;
+    for (size_t p = 0; p < names_end; p++)
+    {
+        unsigned char c = (unsigned char)text[p];
+        if (c && (c & 0xC0) != 0x80) suffix_names[s++] = text + p;
+    }
+    qsort(suffix_names, suffix_count, sizeof(char*), fsi_suffix_compare);
+    for (size_t i = 0; i < suffix_count; i++) suffixes[i] = (uint32_t)(suffix_names[i] - text);
+
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, FSI_MAGIC, sizeof(h->magic));
+    h->version = FSI_VERSION;
+    h->byte_order = FSI_BYTE_ORDER;
+    h->built_at = (int64_t)time(NULL);
+    h->dir_count = (uint32_t)b->dir_count;
+    h->entry_count = (uint32_t)count;
+    h->name_count = (uint32_t)name_count;
+    h->suffix_count = (uint32_t)suffix_count;
+    h->text_size = text_used;
+    h->dirs_offset = fsi_align(sizeof(fsi_header));
+    h->entries_offset = fsi_align(h->dirs_offset + b->dir_count * sizeof(fsi_dir));
+    h->names_offset = fsi_align(h->entries_offset + count * sizeof(fsi_entry));
+    h->suffixes_offset = fsi_align(h->names_offset + name_count * sizeof(fsi_name));
+    h->text_offset = fsi_align(h->suffixes_offset + suffix_count * sizeof(uint32_t));
+    h->file_size = h->text_offset + text_used;
+    h->build_ns = fsi_now() - started;
+
+    uint64_t at = 0;
+    err = fsi_write_section(fd, &at, 0, h, sizeof(*h));
+    if (!err) err = fsi_write_section(fd, &at, h->dirs_offset, b->dirs, b->dir_count * sizeof(fsi_dir));
+    if (!err) err = fsi_write_section(fd, &at, h->entries_offset, entries, count * sizeof(fsi_entry));
+    if (!err) err = fsi_write_section(fd, &at, h->names_offset, names, name_count * sizeof(fsi_name));
+    if (!err) err = fsi_write_section(fd, &at, h->suffixes_offset, suffixes, suffix_count * sizeof(uint32_t));
+    if (!err) err = fsi_write_section(fd, &at, h->text_offset, text, text_used);
+
+done:
+    free(sorted);
+    free(raw_name);
+    free(entries);
+    free(names);
+    free(text);
+    free(suffix_names);
+    free(suffixes);
+    return err;
+}
+
+int fsi_build(const char* root, const char* file, const volatile int* cancel, fsi_stats* stats)
+{
+    uint64_t started = fsi_now();
+    size_t length = strlen(root);
+    while (length > 1 && root[length - 1] == '/') length--;
+
+    struct stat st;
+    if (length == 0) return EINVAL;
+    if (length >= PATH_MAX) return ENAMETOOLONG;
+    if (stat(root, &st) != 0) return errno;
+    if (!S_ISDIR(st.st_mode)) return ENOTDIR;
+
+    fsi_builder* b = calloc(1, sizeof(fsi_builder));
+    if (!b) return ENOMEM;
+    b->cancel = cancel;
+    memcpy(b->path, root, length);
+    b->path[length] = '\0';
+
+    int err = fsi_add_dir(b, FSI_NONE, FSI_NONE) == FSI_NONE ? ENOMEM : 0;
+    if (!err) err = fsi_walk(b, length, 0, 0);
+    if (!err) b->dirs[0].end = (uint32_t)b->dir_count;
+
+    fsi_header h;
+    char temp[PATH_MAX];
+    if (!err && (size_t)snprintf(temp, sizeof(temp), "%s.tmp", file) >= sizeof(temp)) err = ENAMETOOLONG;
+    if (!err)
+    {
+        int fd = open(temp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) err = errno;
+        else
+        {
+            b->path[length] = '\0';
+            err = fsi_write(b, b->path, fd, started, &h);
+            if (close(fd) != 0 && !err) err = errno;
+            if (!err && rename(temp, file) != 0) err = errno;
+            if (err) unlink(temp);
+        }
+    }
+    if (!err && stats)
+    {
+        memset(stats, 0, sizeof(*stats));
+        stats->entries = h.entry_count;
+        stats->dirs = h.dir_count;
+        stats->names = h.name_count;
+        stats->file_size = h.file_size;
+        stats->build_ns = h.build_ns;
+        stats->built_at = h.built_at;
+    }
+
+    free(b->raw);
+    free(b->dirs);
+    free(b->dir_raw);
+    free(b->text);
+    free(b);
+    return err;
+}
+
+#pragma mark - Open
+
+static int fsi_section_fits(const fsi_header* h, uint64_t offset, uint64_t count, uint64_t size)
+{
+    return offset % 8 == 0 && offset >= sizeof(fsi_header) && offset <= h->file_size
+        && count <= (h->file_size - offset) / size;
+}
+
+// Everything a search dereferences is checked once here, so a damaged file
+// is rejected instead of read out of bounds.
+static int fsi_validate(const fsi_index* x)
+{
+    const fsi_header* h = x->header;
+    if (!fsi_section_fits(h, h->dirs_offset, h->dir_count, sizeof(fsi_dir))) return 0;
+    if (!fsi_section_fits(h, h->entries_offset, h->entry_count, sizeof(fsi_entry))) return 0;
+    if (!fsi_section_fits(h, h->names_offset, h->name_count, sizeof(fsi_name))) return 0;
+    if (!fsi_section_fits(h, h->suffixes_offset, h->suffix_count, sizeof(uint32_t))) return 0;
+    if (!fsi_section_fits(h, h->text_offset, h->text_size, 1)) return 0;
+    if (h->dir_count == 0 || h->text_size == 0 || h->text_size > UINT32_MAX || x->text[h->text_size - 1] != '\0') return 0;
+
+    for (uint32_t d = 0; d < h->dir_count; d++)
+    {
+        const fsi_dir* dir = &x->dirs[d];
+        if (dir->name >= h->text_size || dir->end <= d || dir->end > h->dir_count) return 0;
+        if (d == 0 ? dir->parent != FSI_NONE || dir->end != h->dir_count : dir->parent >= d) return 0;
+        if (d && dir->end > x->dirs[dir->parent].end) return 0;
+        if (dir->hidden > d) return 0;
+    }
+    for (uint32_t i = 0; i < h->entry_count; i++)
+    {
+        if (x->entries[i].dir >= h->dir_count) return 0;
+    }
+    for (uint32_t k = 0; k < h->name_count; k++)
+    {
+        const fsi_name* n = &x->names[k];
+        if (n->text >= h->text_size || n->first > h->entry_count || n->count > h->entry_count - n->first) return 0;
+        if (k && n->text <= x->names[k - 1].text) return 0;
+    }
+    for (uint32_t i = 0; i < h->suffix_count; i++)
+    {
+        if (x->suffixes[i] >= h->text_size) return 0;
+    }
+    return 1;
+}
+
+int fsi_open(const char* file, fsi_index** out)
+{
+    *out = NULL;
+    int fd = open(file, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return errno;
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        int err = errno;
+        close(fd);
+        return err;
+    }
+    if ((uint64_t)st.st_size < sizeof(fsi_header))
+    {
+        close(fd);
+        return EINVAL;
+    }
+    void* map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    int err = map == MAP_FAILED ? errno : 0;
+    close(fd);
+    if (err) return err;
+
+    fsi_index* x = calloc(1, sizeof(fsi_index));
+    if (!x)
+    {
+        munmap(map, (size_t)st.st_size);
+        return ENOMEM;
+    }
+    x->map = map;
+    x->map_size = (size_t)st.st_size;
+    x->header = map;
+    const fsi_header* h = x->header;
+    const char* base = map;
+    if (memcmp(h->magic, FSI_MAGIC, sizeof(h->magic)) != 0 || h->version != FSI_VERSION
+        || h->byte_order != FSI_BYTE_ORDER || h->file_size != (uint64_t)st.st_size)
+    {
+        fsi_close(x);
+        return EINVAL;
+    }
+    x->dirs = (const fsi_dir*)(base + h->dirs_offset);
+    x->entries = (const fsi_entry*)(base + h->entries_offset);
+    x->names = (const fsi_name*)(base + h->names_offset);
+    x->suffixes = (const uint32_t*)(base + h->suffixes_offset);
+    x->text = base + h->text_offset;
+    if (!fsi_validate(x))
+    {
+        fsi_close(x);
+        return EINVAL;
+    }
+    x->stale = calloc(h->dir_count, sizeof(atomic_uchar));
+    if (!x->stale)
+    {
+        fsi_close(x);
+        return ENOMEM;
+    }
+    *out = x;
+    return 0;
+}
+
+void fsi_close(fsi_index* x)
+{
+    if (!x) return;
+    munmap(x->map, x->map_size);
+    free(x->stale);
+    free(x);
+}
+
+const char* fsi_root(const fsi_index* x)
+{
+    return x->text + x->dirs[0].name;
+}
+
+void fsi_get_stats(const fsi_index* x, fsi_stats* stats)
+{
+    const fsi_header* h = x->header;
+    memset(stats, 0, sizeof(*stats));
+    stats->entries = h->entry_count;
+    stats->dirs = h->dir_count;
+    stats->names = h->name_count;
+    stats->file_size = h->file_size;
+    stats->build_ns = h->build_ns;
+    stats->built_at = h->built_at;
+    for (uint32_t d = 0; d < h->dir_count; d++) stats->stale += atomic_load_explicit(&x->stale[d], memory_order_relaxed);
+}
+
+#pragma mark - Directories
+
+static uint32_t fsi_find_dir(const fsi_index* x, const char* path)
+{
+    const char* root = fsi_root(x);
+    size_t n = strlen(root);
+    if (strncmp(path, root, n) != 0) return FSI_NONE;
+    const char* p = path + n;
+    if (*p && *p != '/' && root[n - 1] != '/') return FSI_NONE;   // "/a/bc" is not under "/a/b"
+
+    uint32_t d = 0;
+    for (;;)
+    {
+        while (*p == '/') p++;
+        if (!*p) return d;
+        const char* slash = strchr(p, '/');
+        size_t length = slash ? (size_t)(slash - p) : strlen(p);
+        uint32_t found = FSI_NONE;
+        for (uint32_t c = d + 1; c < x->dirs[d].end; c = x->dirs[c].end)
+        {
+            const char* name = x->text + x->dirs[c].name;
+            if (strncmp(name, p, length) == 0 && name[length] == '\0')
+            {
+                found = c;
+                break;
+            }
+        }
+        if (found == FSI_NONE) return FSI_NONE;
+        d = found;
+        p += length;
+    }
+}
+
+// Writes the path of d into out and returns its length, or 0 if it does not fit.
+static size_t fsi_dir_path(const fsi_index* x, uint32_t d, char* out, size_t capacity)
+{
+    uint32_t chain[FSI_MAX_DEPTH + 1];
+    size_t depth = 0;
+    for (; d != 0 && depth <= FSI_MAX_DEPTH; d = x->dirs[d].parent) chain[depth++] = d;
+    if (d != 0) return 0;
+
+    const char* root = fsi_root(x);
+    size_t length = strlen(root);
+    if (length >= capacity) return 0;
+    memcpy(out, root, length + 1);
+    while (depth--)
+    {
+        const char* name = x->text + x->dirs[chain[depth]].name;
+        size_t n = strlen(name);
+        size_t sep = out[length - 1] == '/' ? 0 : 1;
+        if (length + sep + n >= capacity) return 0;
+        if (sep) out[length] = '/';
+        memcpy(out + length + sep, name, n + 1);
+        length += sep + n;
+    }
+    return length;
+}
+
+int fsi_invalidate(fsi_index* x, const char* path)
+{
+    uint32_t d = fsi_find_dir(x, path);
+    if (d == FSI_NONE) return ENOENT;
+    atomic_store(&x->stale[d], 1);
+    return 0;
+}
+
+size_t fsi_refresh(fsi_index* x, const char* root, const volatile int* cancel)
+{
+    uint32_t top = fsi_find_dir(x, root);
+    if (top == FSI_NONE) return 0;
+    char path[PATH_MAX];
+    size_t stale = 0;
+    for (uint32_t d = top; d < x->dirs[top].end; d++)
+    {
+        if (!atomic_load_explicit(&x->stale[d], memory_order_relaxed))
+        {
+            if (cancel && *cancel) break;
+            struct stat st;
+            if (fsi_dir_path(x, d, path, sizeof(path)) == 0) continue;
+            if (stat(path, &st) == 0 && S_ISDIR(st.st_mode) && FSI_STAMP(st) == x->dirs[d].stamp) continue;
+            atomic_store(&x->stale[d], 1);
+        }
+        stale++;
+    }
+    return stale;
+}
+
+#pragma mark - Search
+
+typedef struct fsi_emitter
+{
+    fss_batch_fn fn;
+    void* ctx;
+    const volatile int* cancel;
+    int stop;
+
+    fss_match batch[FSI_BATCH_MAX];
+    size_t offsets[FSI_BATCH_MAX];
+    size_t count;
+    char* text;
+    size_t text_used;
+    size_t text_capacity;
+
+    uint32_t dir;                  // directory whose path is in dir_path
+    size_t dir_length;
+    char dir_path[PATH_MAX];
+} fsi_emitter;
+
+static int fsi_stopped(const fsi_emitter* e)
+{
+    return e->stop || (e->cancel && *e->cancel);
+}
+
+static void fsi_flush(fsi_emitter* e)
+{
+    if (e->count && !e->stop)
+    {
+        for (size_t i = 0; i < e->count; i++) e->batch[i].path = e->text + e->offsets[i];
+        if (e->fn(e->ctx, e->batch, e->count)) e->stop = 1;
+    }
+    e->count = 0;
+    e->text_used = 0;
+}
+
+static void fsi_emit(fsi_emitter* e, const char* dir, size_t dir_length, const char* name, uint32_t flags, uint64_t size,
+                     int64_t mtime)
+{
+    size_t name_length = strlen(name);
+    size_t need = dir_length + 1 + name_length + 1;
+    if (fsi_grow((void**)&e->text, &e->text_capacity, e->text_used + need, 1) != 0) return;
+    char* out = e->text + e->text_used;
+    memcpy(out, dir, dir_length);
+    size_t n = dir_length;
+    if (n == 0 || out[n - 1] != '/') out[n++] = '/';
+    memcpy(out + n, name, name_length + 1);
+
+    fss_match* m = &e->batch[e->count];
+    m->size = size;
+    m->mtime = mtime;
+    m->flags = (uint8_t)flags;
+    e->offsets[e->count++] = e->text_used;
+    e->text_used += n + name_length + 1;
+    if (e->count == FSI_BATCH_MAX) fsi_flush(e);
+}
+
+// Passes live-walk batches through and notes whether the caller stopped.
+static int fsi_forward(void* ctx, const fss_match* matches, size_t count)
+{
+    fsi_emitter* e = ctx;
+    if (!e->stop && e->fn(e->ctx, matches, count)) e->stop = 1;
+    return e->stop;
+}
+
+enum
+{
+    FSI_SKIP_ENTRIES = 1,          // the directory's own entries were listed live
+    FSI_SKIP_GONE = 2,             // the directory no longer exists
+};
+
+static int fsi_is_indexed_child(const fsi_index* x, uint32_t d, const char* name)
+{
+    for (uint32_t c = d + 1; c < x->dirs[d].end; c = x->dirs[c].end)
+    {
+        if (strcmp(x->text + x->dirs[c].name, name) == 0) return 1;
+    }
+    return 0;
+}
+
+static void fsi_mark_gone(const fsi_index* x, uint32_t top, uint32_t d, uint8_t* skip)
+{
+    memset(skip + (d - top), FSI_SKIP_GONE, x->dirs[d].end - d);
+}
+
+// Answers a stale directory from disk: its own entries are matched live,
+// vanished subdirectories are dropped and new ones walked with fss_search.
+static int fsi_search_stale(const fsi_index* x, uint32_t top, uint32_t d, const fss_matcher* m, uint8_t* skip,
+                            fsi_emitter* e)
+{
+    const fss_query* q = m->query;
+    skip[d - top] = FSI_SKIP_ENTRIES;
+    if (!(q->flags & FSS_HIDDEN) && x->dirs[d].hidden > top) return 0;
+
+    char path[PATH_MAX];
+    size_t length = fsi_dir_path(x, d, path, sizeof(path));
+    fs_listing l;
+    if (length == 0 || fs_list_dir(path, m->list_flags | FS_LIST_HIDDEN, &l) != 0)
+    {
+        fsi_mark_gone(x, top, d, skip);
+        return 0;
+    }
+
+    for (size_t i = 0; i < l.count && !fsi_stopped(e); i++)
+    {
+        const char* name = fs_listing_name(&l, i);
+        if (fss_matcher_accept(m, name, l.flags[i], l.size[i], l.mtime[i]))
+            fsi_emit(e, path, length, name, l.flags[i], l.size[i], l.mtime[i]);
+    }
+    for (uint32_t c = d + 1; c < x->dirs[d].end; c = x->dirs[c].end)
+    {
+        const char* name = x->text + x->dirs[c].name;
+        size_t i = 0;
+        while (i < l.count && ((l.flags[i] & (FS_ENTRY_DIR | FS_ENTRY_LINK)) != FS_ENTRY_DIR || strcmp(fs_listing_name(&l, i), name) != 0)) i++;
+        if (i == l.count) fsi_mark_gone(x, top, c, skip);
+    }
+
+    int err = 0;
+    for (size_t i = 0; i < l.count && !err && !fsi_stopped(e); i++)
+    {
+        const char* name = fs_listing_name(&l, i);
+        if ((l.flags[i] & (FS_ENTRY_DIR | FS_ENTRY_LINK)) != FS_ENTRY_DIR) continue;
+        if ((!(q->flags & FSS_HIDDEN) && name[0] == '.') || fsi_is_indexed_child(x, d, name)) continue;
+
+        size_t n = l.name_length[i];
+        if (length + 1 + n >= sizeof(path)) continue;
+        size_t sep = path[length - 1] == '/' ? 0 : 1;
+        if (sep) path[length] = '/';
+        memcpy(path + length + sep, name, n + 1);
+        fsi_flush(e);
+        err = fss_search(path, q, fsi_forward, e, e->cancel);
+        if (err == ENOENT || err == ENOTDIR || err == EACCES || err == ECANCELED) err = 0;
+        path[length] = '\0';
+    }
+    fs_listing_free(&l);
+    return err;
+}
+
+static int fsi_u32_compare(const void* a, const void* b)
+{
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+// Names containing the folded needle, found through the suffix array; returns
+// sorted distinct name numbers or NULL when out of memory.
+static uint32_t* fsi_substring_names(const fsi_index* x, const unsigned char* needle, size_t n, size_t* out_count)
+{
+    const uint32_t* sa = x->suffixes;
+    size_t lo = 0;
+    size_t hi = x->header->suffix_count;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (fsi_prefix_compare(x->text + sa[mid], needle, n) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    size_t first = lo;
+    hi = x->header->suffix_count;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (fsi_prefix_compare(x->text + sa[mid], needle, n) <= 0) lo = mid + 1;
+        else hi = mid;
+    }
+
+    size_t count = lo - first;
+    uint32_t* ids = malloc((count ? count : 1) * sizeof(uint32_t));
+    if (!ids) return NULL;
+    for (size_t i = 0; i < count; i++)
+    {
+        // The name holding this suffix is the last one starting at or before it.
+        uint32_t pos = sa[first + i];
+        size_t a = 0;
+        size_t b = x->header->name_count;
+        while (a < b)
+        {
+            size_t mid = a + (b - a) / 2;
+            if (x->names[mid].text <= pos) a = mid + 1;
+            else b = mid;
+        }
+        ids[i] = (uint32_t)(a - 1);
+    }
+    qsort(ids, count, sizeof(uint32_t), fsi_u32_compare);
+    size_t unique = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (unique == 0 || ids[unique - 1] != ids[i]) ids[unique++] = ids[i];
+    }
+    *out_count = unique;
+    return ids;
+}
+
+// Range of names starting with the folded prefix.
+static void fsi_prefix_names(const fsi_index* x, const unsigned char* prefix, size_t n, uint32_t* first, uint32_t* end)
+{
+    size_t lo = 0;
+    size_t hi = x->header->name_count;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (fsi_prefix_compare(x->text + x->names[mid].text, prefix, n) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    *first = (uint32_t)lo;
+    hi = x->header->name_count;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (fsi_prefix_compare(x->text + x->names[mid].text, prefix, n) <= 0) lo = mid + 1;
+        else hi = mid;
+    }
+    *end = (uint32_t)lo;
+}
+
+static void fsi_search_name(const fsi_index* x, uint32_t top, uint32_t k, const fss_matcher* m, const uint8_t* skip,
+                            fsi_emitter* e)
+{
+    const fss_query* q = m->query;
+    const char* name = x->text + x->names[k].text;
+    if (!fss_matcher_name(m, name)) return;
+    int bounded = m->filter_size || q->newer_than || q->older_than;
+    uint32_t end = x->dirs[top].end;
+
+    const fsi_name* n = &x->names[k];
+    for (uint32_t i = n->first; i < n->first + n->count && !e->stop; i++)
+    {
+        const fsi_entry* entry = &x->entries[i];
+        uint32_t d = entry->dir;
+        if (d < top || d >= end || skip[d - top]) continue;
+        if (!(q->flags & FSS_HIDDEN) && x->dirs[d].hidden > top) continue;
+        if (bounded && !fss_matcher_accept(m, name, (uint8_t)entry->flags, entry->size, entry->mtime)) continue;
+        if (e->dir != d)
+        {
+            e->dir_length = fsi_dir_path(x, d, e->dir_path, sizeof(e->dir_path));
+            e->dir = e->dir_length ? d : FSI_NONE;
+            if (!e->dir_length) continue;
+        }
+        fsi_emit(e, e->dir_path, e->dir_length, name, entry->flags, entry->size, entry->mtime);
+    }
+}
+
+int fsi_search(fsi_index* x, const char* root, const fss_query* query, fss_batch_fn fn, void* ctx,
+               const volatile int* cancel)
+{
+    uint32_t top = fsi_find_dir(x, root);
+    if (top == FSI_NONE) return ENOENT;
+
+    fss_matcher m;
+    int err = fss_matcher_init(&m, query);
+    if (err) return err;
+    uint32_t end = x->dirs[top].end;
+    fsi_emitter* e = calloc(1, sizeof(fsi_emitter));
+    uint8_t* skip = calloc(end - top, 1);
+    if (!e || !skip)
+    {
+        free(e);
+        free(skip);
+        fss_matcher_free(&m);
+        return ENOMEM;
+    }
+    e->fn = fn;
+    e->ctx = ctx;
+    e->cancel = cancel;
+    e->dir = FSI_NONE;
+
+    // Stale directories first: they decide which index rows are still valid.
+    for (uint32_t d = top; d < end && !err && !fsi_stopped(e); d++)
+    {
+        if (skip[d - top] == FSI_SKIP_GONE) d = x->dirs[d].end - 1;
+        else if (atomic_load_explicit(&x->stale[d], memory_order_relaxed)) err = fsi_search_stale(x, top, d, &m, skip, e);
+    }
+
+    const char* pattern = query->pattern ? query->pattern : "";
+    unsigned char* folded = malloc(strlen(pattern) + 1);
+    size_t folded_length = 0;
+    if (!folded && !err) err = ENOMEM;
+    if (!err && query->match == FSS_MATCH_SUBSTRING && pattern[0])
+    {
+        for (; pattern[folded_length]; folded_length++) folded[folded_length] = fsi_fold((unsigned char)pattern[folded_length]);
+        size_t count = 0;
+        uint32_t* ids = fsi_substring_names(x, folded, folded_length, &count);
+        if (!ids) err = ENOMEM;
+        for (size_t i = 0; ids && i < count && !fsi_stopped(e); i++) fsi_search_name(x, top, ids[i], &m, skip, e);
+        free(ids);
+    }
+    else if (!err)
+    {
+        // A glob's literal head narrows the sorted names to one range.
+        if (query->match == FSS_MATCH_GLOB)
+        {
+            while (pattern[folded_length] && !strchr("*?[", pattern[folded_length]))
+            {
+                folded[folded_length] = fsi_fold((unsigned char)pattern[folded_length]);
+                folded_length++;
+            }
+        }
+        uint32_t first;
+        uint32_t last;
+        fsi_prefix_names(x, folded, folded_length, &first, &last);
+        for (uint32_t k = first; k < last && !fsi_stopped(e); k++) fsi_search_name(x, top, k, &m, skip, e);
+    }
+    fsi_flush(e);
+
+    if (!err && cancel && *cancel) err = ECANCELED;
+    free(folded);
+    free(e->text);
+    free(e);
+    free(skip);
+    fss_matcher_free(&m);
+    return err;
+}
@@ -0,0 +1,48 @@
+// File: fs_names.h
+// Location: プロジェクト直下
+
+#ifndef FS_NAMES_H
+#define FS_NAMES_H
+
+#include <stddef.h>
+
+// Free names in one directory. fsn_open reads the directory once and keeps
+// the names in it together with the highest " (n)" suffix used for every
+// stem and extension, so "report.pdf" in a folder that already holds
+// "report (1).pdf" to "report (40).pdf" becomes "report (41).pdf" without a
+// single probe. Names handed out stay taken until fsn_finish says they were
+// not used. The directory's mtime is checked on every call and a change made
+// by someone else triggers a new scan; a name that was taken behind the
+// allocator's back is still caught, because callers claim names with
+// O_EXCL, mkdir or fsn_rename_exclusive and come back on EEXIST.
+//
+// An fsn_dir may be shared by any number of threads.
+
+typedef struct fsn_dir fsn_dir;
+
+// Returns 0, ENOMEM or an errno value for dir.
+int fsn_open(const char* dir, fsn_dir** out);
+void fsn_close(fsn_dir* d);
+
+// Writes preferred, or "stem (n).ext" when it is taken, to name (size bytes,
+// NAME_MAX + 1 is enough) and marks it taken. The extension is split off the
+// way NSString does it. Returns 0, EINVAL for an empty name or one with a
+// '/', or ENAMETOOLONG.
+int fsn_reserve(fsn_dir* d, const char* preferred, char* name, size_t size);
+
+// Reports what became of a reserved name: taken when it now exists (the
+// caller created it, or got EEXIST), otherwise it is free to hand out again.
+void fsn_finish(fsn_dir* d, const char* name, int taken);
+
+// Moves src into the directory under a fresh name for preferred, never
+// replacing anything, and writes the name it got. Returns 0, EXDEV when src
+// is on another device, or an errno value.
+int fsn_rename(fsn_dir* d, const char* src, const char* preferred, char* name, size_t size);
+
+// rename() that fails with EEXIST instead of replacing to (renameat2 with
+// RENAME_NOREPLACE, renamex_np with RENAME_EXCL). Where the file system has
+// no such rename, files are linked and unlinked instead and folders fall
+// back to a check followed by rename().
+int fsn_rename_exclusive(const char* from, const char* to);
+
+#endif
@@ -0,0 +1,399 @@
+// File: fs_names.c
+// Location: プロジェクト直下
+
+#if defined(__linux__)
+#define _GNU_SOURCE                        // renameat2
+#endif
+
+#include "fs_names.h"
+#include "fs.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__APPLE__)
+#define FSN_MTIME(st) ((st)->st_mtimespec)
+#else
+#define FSN_MTIME(st) ((st)->st_mtim)
+#endif
+
+#define FSN_TOMBSTONE SIZE_MAX
+#define FSN_MAX_ATTEMPTS 64               // EEXIST races before fsn_rename gives up
+
+typedef struct fsn_stem
+{
+    size_t key;                    // arena offset + 1 of "stem/ext"; '/' cannot occur in a name
+    unsigned long max;
+} fsn_stem;
+
+struct fsn_dir
+{
+    pthread_mutex_t lock;
+    char* path;
+    struct timespec mtime;         // of the directory when names was last known to be complete
+    char* arena;
+    size_t arena_used;
+    size_t arena_capacity;
+    size_t* names;                 // open addressing, arena offset + 1, FSN_TOMBSTONE when removed
+    size_t names_capacity;
+    size_t names_used;             // live entries and tombstones
+    fsn_stem* stems;
+    size_t stems_capacity;
+    size_t stems_count;
+    char** pending;                // reserved and not finished; kept across rescans
+    size_t pending_count;
+    size_t pending_capacity;
+};
+
+static uint64_t fsn_hash(const char* s, size_t n)
+{
+    uint64_t h = 1469598103934665603ULL;
+    for (size_t i = 0; i < n; i++) h = (h ^ (uint8_t)s[i]) * 1099511628211ULL;
+    return h;
+}
+
+static int fsn_intern(fsn_dir* d, const char* s, size_t n, size_t* out)
+{
+    if (d->arena_used + n + 1 > d->arena_capacity)
+    {
+        size_t capacity = d->arena_capacity ? d->arena_capacity : 4096;
+        while (capacity < d->arena_used + n + 1) capacity *= 2;
+        char* grown = realloc(d->arena, capacity);
+        if (!grown) return ENOMEM;
+        d->arena = grown;
+        d->arena_capacity = capacity;
+    }
+    memcpy(d->arena + d->arena_used, s, n);
+    d->arena[d->arena_used + n] = '\0';
+    *out = d->arena_used;
+    d->arena_used += n + 1;
+    return 0;
+}
+
+#pragma mark - Sets
+
+static size_t* fsn_find(const fsn_dir* d, const char* name)
+{
+    if (!d->names_capacity) return NULL;
+    size_t mask = d->names_capacity - 1;
+    for (size_t i = fsn_hash(name, strlen(name)) & mask; d->names[i]; i = (i + 1) & mask)
+        if (d->names[i] != FSN_TOMBSTONE && strcmp(d->arena + d->names[i] - 1, name) == 0) return &d->names[i];
+    return NULL;
+}
+
+static int fsn_rehash(fsn_dir* d, size_t capacity)
+{
+    size_t* table = calloc(capacity, sizeof(size_t));
+    if (!table) return ENOMEM;
+    size_t used = 0;
+    for (size_t i = 0; i < d->names_capacity; i++)
+    {
+        size_t v = d->names[i];
+        if (!v || v == FSN_TOMBSTONE) continue;
+        const char* s = d->arena + v - 1;
+        size_t j = fsn_hash(s, strlen(s)) & (capacity - 1);
+        while (table[j]) j = (j + 1) & (capacity - 1);
+        table[j] = v;
+        used++;
+    }
+    free(d->names);
+    d->names = table;
+    d->names_capacity = capacity;
+    d->names_used = used;
+    return 0;
+}
+
+static fsn_stem* fsn_stem_slot(fsn_dir* d, const char* key, size_t n)
+{
+    size_t mask = d->stems_capacity - 1;
+    size_t i = fsn_hash(key, n) & mask;
+    for (; d->stems[i].key; i = (i + 1) & mask)
+    {
+        const char* k = d->arena + d->stems[i].key - 1;
+        if (strncmp(k, key, n) == 0 && k[n] == '\0') break;
+    }
+    return &d->stems[i];
+}
+
+static int fsn_grow_stems(fsn_dir* d)
+{
+    if ((d->stems_count + 1) * 2 <= d->stems_capacity) return 0;
+    size_t capacity = d->stems_capacity ? d->stems_capacity * 2 : 64;
+    fsn_stem* table = calloc(capacity, sizeof(fsn_stem));
+    if (!table) return ENOMEM;
+    fsn_stem* old = d->stems;
+    size_t old_capacity = d->stems_capacity;
+    d->stems = table;
+    d->stems_capacity = capacity;
+    for (size_t i = 0; i < old_capacity; i++)
+    {
+        if (!old[i].key) continue;
+        const char* k = d->arena + old[i].key - 1;
+        *fsn_stem_slot(d, k, strlen(k)) = old[i];
+    }
+    free(old);
+    return 0;
+}
+
+// The extension starts at the last '.', unless that is the first character;
+// "stem (n)" before it carries a suffix.
+static void fsn_split(const char* name, size_t* stem, const char** ext, unsigned long* suffix)
+{
+    const char* dot = strrchr(name, '.');
+    if (dot == name) dot = NULL;
+    *ext = dot ? dot : name + strlen(name);
+    size_t base = (size_t)(*ext - name);
+    *stem = base;
+    *suffix = 0;
+    if (base < 4 || name[base - 1] != ')') return;
+    size_t i = base - 1;
+    unsigned long n = 0, scale = 1;
+    while (i > 0 && name[i - 1] >= '0' && name[i - 1] <= '9' && scale <= 100000000UL)
+    {
+        n += (unsigned long)(name[i - 1] - '0') * scale;
+        scale *= 10;
+        i--;
+    }
+    if (scale == 1 || i < 3 || name[i - 1] != '(' || name[i - 2] != ' ') return;
+    *stem = i - 2;
+    *suffix = n;
+}
+
+static int fsn_stem_key(const char* name, size_t stem, const char* ext, char* key, size_t* n)
+{
+    size_t ext_length = strlen(ext);
+    if (stem + 1 + ext_length >= PATH_MAX) return ENAMETOOLONG;
+    memcpy(key, name, stem);
+    key[stem] = '/';
+    memcpy(key + stem + 1, ext, ext_length + 1);
+    *n = stem + 1 + ext_length;
+    return 0;
+}
+
+static int fsn_add(fsn_dir* d, const char* name)
+{
+    if (fsn_find(d, name)) return 0;
+    if ((d->names_used + 1) * 2 > d->names_capacity)
+    {
+        int err = fsn_rehash(d, d->names_capacity ? d->names_capacity * 2 : 256);
+        if (err) return err;
+    }
+    size_t offset;
+    int err = fsn_intern(d, name, strlen(name), &offset);
+    if (err) return err;
+    size_t mask = d->names_capacity - 1;
+    size_t i = fsn_hash(name, strlen(name)) & mask;
+    while (d->names[i] && d->names[i] != FSN_TOMBSTONE) i = (i + 1) & mask;
+    if (!d->names[i]) d->names_used++;
+    d->names[i] = offset + 1;
+
+    size_t stem;
+    const char* ext;
+    unsigned long suffix;
+    fsn_split(name, &stem, &ext, &suffix);
+    char key[PATH_MAX];
+    size_t n;
+    if (suffix == 0 || fsn_stem_key(name, stem, ext, key, &n) != 0) return 0;
+    err = fsn_grow_stems(d);
+    if (err) return err;
+    fsn_stem* slot = fsn_stem_slot(d, key, n);
+    if (!slot->key)
+    {
+        size_t key_offset;
+        err = fsn_intern(d, key, n, &key_offset);
+        if (err) return err;
+        slot = fsn_stem_slot(d, key, n);
+        slot->key = key_offset + 1;
+        d->stems_count++;
+    }
+    if (suffix > slot->max) slot->max = suffix;
+    return 0;
+}
+
+#pragma mark - Scan
+
+static int fsn_scan(fsn_dir* d, const struct stat* st)
+{
+    d->arena_used = 0;
+    d->names_used = 0;
+    d->stems_count = 0;
+    if (d->names) memset(d->names, 0, d->names_capacity * sizeof(size_t));
+    if (d->stems) memset(d->stems, 0, d->stems_capacity * sizeof(fsn_stem));
+    fs_listing l = {0};
+    int err = fs_list_dir(d->path, FS_LIST_HIDDEN, &l);
+    for (size_t i = 0; i < l.count && !err; i++) err = fsn_add(d, fs_listing_name(&l, i));
+    for (size_t i = 0; i < d->pending_count && !err; i++) err = fsn_add(d, d->pending[i]);
+    fs_listing_free(&l);
+    if (!err) d->mtime = FSN_MTIME(st);
+    return err;
+}
+
+// Rescans when something other than this allocator changed the directory.
+static int fsn_refresh(fsn_dir* d)
+{
+    struct stat st;
+    if (stat(d->path, &st) != 0) return errno;
+    if (FSN_MTIME(&st).tv_sec == d->mtime.tv_sec && FSN_MTIME(&st).tv_nsec == d->mtime.tv_nsec) return 0;
+    return fsn_scan(d, &st);
+}
+
+int fsn_open(const char* dir, fsn_dir** out)
+{
+    *out = NULL;
+    struct stat st;
+    if (stat(dir, &st) != 0) return errno;
+    if (!S_ISDIR(st.st_mode)) return ENOTDIR;
+    fsn_dir* d = calloc(1, sizeof(fsn_dir));
+    if (!d) return ENOMEM;
+    pthread_mutex_init(&d->lock, NULL);
+    d->path = strdup(dir);
+    int err = d->path ? fsn_scan(d, &st) : ENOMEM;
+    if (err)
+    {
+        fsn_close(d);
+        return err;
+    }
+    *out = d;
+    return 0;
+}
+
+void fsn_close(fsn_dir* d)
+{
+    if (!d) return;
+    pthread_mutex_destroy(&d->lock);
+    for (size_t i = 0; i < d->pending_count; i++) free(d->pending[i]);
+    free(d->pending);
+    free(d->names);
+    free(d->stems);
+    free(d->arena);
+    free(d->path);
+    free(d);
+}
+
+#pragma mark - Reserve
+
+static int fsn_pick(fsn_dir* d, const char* preferred, char* name, size_t size)
+{
+    size_t length = strlen(preferred);
+    if (length == 0 || strchr(preferred, '/')) return EINVAL;
+    if (length > NAME_MAX || length >= size) return ENAMETOOLONG;
+    if (!fsn_find(d, preferred))
+    {
+        memcpy(name, preferred, length + 1);
+        return 0;
+    }
+    size_t stem;
+    const char* ext;
+    unsigned long suffix;
+    fsn_split(preferred, &stem, &ext, &suffix);
+    // "report (3).pdf" taken again continues the "report" series.
+    char key[PATH_MAX];
+    size_t n;
+    int err = fsn_stem_key(preferred, stem, ext, key, &n);
+    if (err) return err;
+    fsn_stem* slot = d->stems_capacity ? fsn_stem_slot(d, key, n) : NULL;
+    unsigned long next = (slot && slot->key ? slot->max : 0) + 1;
+    for (;; next++)
+    {
+        int written = snprintf(name, size, "%.*s (%lu)%s", (int)stem, preferred, next, ext);
+        if (written < 0 || (size_t)written >= size || written > NAME_MAX) return ENAMETOOLONG;
+        if (!fsn_find(d, name)) return 0;
+    }
+}
+
+int fsn_reserve(fsn_dir* d, const char* preferred, char* name, size_t size)
+{
+    pthread_mutex_lock(&d->lock);
+    int err = fsn_refresh(d);
+    if (!err) err = fsn_pick(d, preferred, name, size);
+    if (!err && d->pending_count == d->pending_capacity)
+    {
+        size_t capacity = d->pending_capacity ? d->pending_capacity * 2 : 8;
+        char** grown = realloc(d->pending, capacity * sizeof(char*));
+        if (grown)
+        {
+            d->pending = grown;
+            d->pending_capacity = capacity;
+        }
+        else err = ENOMEM;
+    }
+    char* copy = err ? NULL : strdup(name);
+    if (!err && !copy) err = ENOMEM;
+    if (!err) err = fsn_add(d, name);
+    if (!err) d->pending[d->pending_count++] = copy;
+    else free(copy);
+    pthread_mutex_unlock(&d->lock);
+    return err;
+}
+
+void fsn_finish(fsn_dir* d, const char* name, int taken)
+{
+    pthread_mutex_lock(&d->lock);
+    for (size_t i = 0; i < d->pending_count; i++)
+    {
+        if (strcmp(d->pending[i], name) != 0) continue;
+        free(d->pending[i]);
+        d->pending[i] = d->pending[--d->pending_count];
+        break;
+    }
+    if (taken)
+    {
+        // The change is ours; only later ones should cause a rescan.
+        struct stat st;
+        if (stat(d->path, &st) == 0) d->mtime = FSN_MTIME(&st);
+    }
+    else
+    {
+        size_t* slot = fsn_find(d, name);
+        if (slot) *slot = FSN_TOMBSTONE;
+    }
+    pthread_mutex_unlock(&d->lock);
+}
+
+#pragma mark - Rename
+
+int fsn_rename_exclusive(const char* from, const char* to)
+{
+#if defined(__APPLE__)
+    if (renamex_np(from, to, RENAME_EXCL) == 0) return 0;
+    if (errno != ENOTSUP && errno != EINVAL) return errno;
+#elif defined(__linux__)
+    if (renameat2(AT_FDCWD, from, AT_FDCWD, to, RENAME_NOREPLACE) == 0) return 0;
+    if (errno != EINVAL && errno != ENOSYS) return errno;
+#endif
+    struct stat st;
+    if (lstat(from, &st) != 0) return errno;
+    if (S_ISREG(st.st_mode))
+    {
+        if (link(from, to) == 0) return unlink(from) == 0 ? 0 : errno;
+        if (errno == EEXIST) return EEXIST;
+    }
+    if (lstat(to, &st) == 0) return EEXIST;
+    return rename(from, to) == 0 ? 0 : errno;
+}
+
+int fsn_rename(fsn_dir* d, const char* src, const char* preferred, char* name, size_t size)
+{
+    char to[PATH_MAX];
+    for (int attempt = 0; attempt < FSN_MAX_ATTEMPTS; attempt++)
+    {
+        int err = fsn_reserve(d, preferred, name, size);
+        if (err) return err;
+        if (snprintf(to, sizeof(to), "%s/%s", d->path, name) >= (int)sizeof(to))
+        {
+            fsn_finish(d, name, 0);
+            return ENAMETOOLONG;
+        }
+        err = fsn_rename_exclusive(src, to);
+        fsn_finish(d, name, err == 0 || err == EEXIST);
+        if (err != EEXIST) return err;
+    }
+    return EEXIST;
+}
@@ -0,0 +1,80 @@
+// File: fs_search.h
+// Location: プロジェクト直下
+
+#ifndef FS_SEARCH_H
+#define FS_SEARCH_H
+
+#include <regex.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Recursive file name search. A pool of walker threads shares the directory
+// tree through work-stealing deques, matches names as bytes (ASCII letters
+// case-folded, UTF-8 compared as is) and hands matches back in batches.
+
+enum
+{
+    FSS_MATCH_SUBSTRING = 0,
+    FSS_MATCH_GLOB = 1,            // * ? [a-z] [!x], whole name
+    FSS_MATCH_REGEX = 2,           // POSIX extended, anywhere in the name
+};
+
+enum
+{
+    FSS_HIDDEN = 1 << 0,           // visit names starting with '.'
+    FSS_CASE_SENSITIVE = 1 << 1,
+};
+
+typedef struct fss_query
+{
+    const char* pattern;           // UTF-8; empty matches every name
+    int match;
+    int flags;
+    int64_t min_size;              // files only; -1 for no bound
+    int64_t max_size;
+    int64_t newer_than;            // mtime in seconds; 0 for no bound
+    int64_t older_than;
+    int threads;                   // 0 picks one per core
+} fss_query;
+
+typedef struct fss_match
+{
+    const char* path;
+    uint64_t size;                 // valid when the query has size or date bounds
+    int64_t mtime;
+    uint8_t flags;                 // FS_ENTRY_* from fs.h
+} fss_match;
+
+// Called from walker threads, one call at a time. Returning non-zero stops the
+// search.
+typedef int (*fss_batch_fn)(void* ctx, const fss_match* matches, size_t count);
+
+void fss_query_init(fss_query* query);
+
+// Compiled name pattern and bounds of a query, shared by the live walk and
+// the persistent index. Hidden names are rejected unless FSS_HIDDEN is set.
+typedef struct fss_matcher
+{
+    const fss_query* query;
+    unsigned char fold[256];
+    unsigned char* needle;         // folded substring pattern
+    size_t needle_length;
+    regex_t regex;
+    int has_regex;
+    int filter_size;
+    int list_flags;                // FS_LIST_* a walk needs for this query
+} fss_matcher;
+
+// Returns 0, EINVAL for a pattern that does not compile, or ENOMEM.
+int fss_matcher_init(fss_matcher* matcher, const fss_query* query);
+void fss_matcher_free(fss_matcher* matcher);
+int fss_matcher_name(const fss_matcher* matcher, const char* name);
+// Name, size and date check for an entry with FS_ENTRY_* flags.
+int fss_matcher_accept(const fss_matcher* matcher, const char* name, uint8_t flags, uint64_t size, int64_t mtime);
+
+// Blocks until the tree under root is searched, cancel becomes non-zero or the
+// callback asks to stop. Returns 0, ECANCELED, or an errno value for a root
+// that cannot be opened or a pattern that does not compile (EINVAL).
+int fss_search(const char* root, const fss_query* query, fss_batch_fn fn, void* ctx, const volatile int* cancel);
+
+#endif
@@ -0,0 +1,517 @@
+// File: fs_search.c
+// Location: プロジェクト直下
+
+#include "fs_search.h"
+#include "fs.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define FSS_BATCH_MAX 256
+#define FSS_BATCH_INTERVAL_NS 50000000ULL   // flush at least every 50 ms
+#define FSS_READ_CHUNK 4096
+#define FSS_MAX_THREADS 16
+
+// Owner pushes and pops at the tail (depth first, warm caches); thieves take
+// the oldest directory at the head, which tends to be the largest subtree.
+typedef struct fss_deque
+{
+    pthread_mutex_t lock;
+    char** items;
+    size_t head;
+    size_t tail;
+    size_t capacity;
+} fss_deque;
+
+typedef struct fss_pool
+{
+    const fss_query* query;
+    fss_batch_fn fn;
+    void* ctx;
+    const volatile int* cancel;
+    fss_matcher matcher;
+
+    fss_deque* deques;
+    int count;
+    atomic_size_t pending;         // directories queued or being read
+    atomic_int stop;
+    atomic_int idle;
+    pthread_mutex_t idle_lock;
+    pthread_cond_t idle_cond;
+    pthread_mutex_t emit_lock;
+} fss_pool;
+
+typedef struct fss_worker
+{
+    fss_pool* pool;
+    int id;
+    unsigned seed;
+    pthread_t thread;
+    fs_listing listing;
+
+    fss_match batch[FSS_BATCH_MAX];
+    size_t offsets[FSS_BATCH_MAX];   // into text; resolved when flushed
+    size_t batch_count;
+    char* text;
+    size_t text_used;
+    size_t text_capacity;
+    uint64_t last_flush;
+} fss_worker;
+
+static uint64_t fss_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+void fss_query_init(fss_query* q)
+{
+    memset(q, 0, sizeof(*q));
+    q->pattern = "";
+    q->min_size = -1;
+    q->max_size = -1;
+}
+
+#pragma mark - Deques
+
+static int fss_push(fss_deque* d, char* item)
+{
+    pthread_mutex_lock(&d->lock);
+    if (d->tail == d->capacity)
+    {
+        if (d->head > 0)
+        {
+            memmove(d->items, d->items + d->head, (d->tail - d->head) * sizeof(char*));
+            d->tail -= d->head;
+            d->head = 0;
+        }
+        else
+        {
+            size_t cap = d->capacity ? d->capacity * 2 : 64;
+            char** items = realloc(d->items, cap * sizeof(char*));
+            if (!items)
+            {
+                pthread_mutex_unlock(&d->lock);
+                return ENOMEM;
+            }
+            d->items = items;
+            d->capacity = cap;
+        }
+    }
+    d->items[d->tail++] = item;
+    pthread_mutex_unlock(&d->lock);
+    return 0;
+}
+
+static char* fss_pop(fss_deque* d)
+{
+    char* item = NULL;
+    pthread_mutex_lock(&d->lock);
+    if (d->tail > d->head) item = d->items[--d->tail];
+    pthread_mutex_unlock(&d->lock);
+    return item;
+}
+
+static char* fss_steal(fss_deque* d)
+{
+    char* item = NULL;
+    pthread_mutex_lock(&d->lock);
+    if (d->tail > d->head) item = d->items[d->head++];
+    pthread_mutex_unlock(&d->lock);
+    return item;
+}
+
+#pragma mark - Matching
+
+static int fss_substring(const fss_matcher* m, const unsigned char* name)
+{
+    size_t n = m->needle_length;
+    if (n == 0) return 1;
+    const unsigned char* fold = m->fold;
+    unsigned char first = m->needle[0];
+    for (; *name; name++)
+    {
+        if (fold[*name] != first) continue;
+        size_t i = 1;
+        while (i < n && name[i] && fold[name[i]] == m->needle[i]) i++;
+        if (i == n) return 1;
+        if (!name[i]) return 0;    // ran out of name
+    }
+    return 0;
+}
+
+// Matches one [...] class at *pat against c; advances *pat past the class.
+static int fss_glob_class(const unsigned char** pat, unsigned char c, const unsigned char* fold)
+{
+    const unsigned char* p = *pat + 1;
+    int negate = *p == '!' || *p == '^';
+    if (negate) p++;
+    int hit = 0;
+    int first = 1;
+    while (*p && (*p != ']' || first))
+    {
+        unsigned char lo = fold[*p];
+        unsigned char hi = lo;
+        if (p[1] == '-' && p[2] && p[2] != ']')
+        {
+            hi = fold[p[2]];
+            p += 2;
+        }
+        if (c >= lo && c <= hi) hit = 1;
+        p++;
+        first = 0;
+    }
+    if (*p != ']') return -1;      // unterminated: treat '[' literally
+    *pat = p + 1;
+    return hit != negate;
+}
+
+// Iterative glob with a single backtrack point per '*', linear in practice.
+static int fss_glob(const unsigned char* pat, const unsigned char* name, const unsigned char* fold)
+{
+    const unsigned char* star = NULL;
+    const unsigned char* resume = NULL;
+    while (*name)
+    {
+        if (*pat == '*')
+        {
+            star = ++pat;
+            resume = name;
+            continue;
+        }
+        if (*pat == '[')
+        {
+            const unsigned char* p = pat;
+            int r = fss_glob_class(&p, fold[*name], fold);
+            if (r == 1)
+            {
+                pat = p;
+                name++;
+                continue;
+            }
+            if (r == -1 && *name == '[')
+            {
+                pat++;
+                name++;
+                continue;
+            }
+        }
+        else if (*pat == '?' || (*pat && fold[*pat] == fold[*name]))
+        {
+            pat++;
+            name++;
+            continue;
+        }
+        if (!star) return 0;
+        pat = star;
+        name = ++resume;
+    }
+    while (*pat == '*') pat++;
+    return *pat == '\0';
+}
+
+int fss_matcher_name(const fss_matcher* m, const char* name)
+{
+    if (!(m->query->flags & FSS_HIDDEN) && name[0] == '.') return 0;
+    switch (m->query->match)
+    {
+    case FSS_MATCH_GLOB: return fss_glob((const unsigned char*)m->query->pattern, (const unsigned char*)name, m->fold);
+    case FSS_MATCH_REGEX: return regexec(&m->regex, name, 0, NULL, 0) == 0;
+    default: return fss_substring(m, (const unsigned char*)name);
+    }
+}
+
+int fss_matcher_accept(const fss_matcher* m, const char* name, uint8_t flags, uint64_t size, int64_t mtime)
+{
+    const fss_query* q = m->query;
+    if (!fss_matcher_name(m, name)) return 0;
+    if (!m->filter_size && !q->newer_than && !q->older_than) return 1;
+    if (!(flags & FS_ENTRY_STAT)) return 0;
+    if (m->filter_size)
+    {
+        if (flags & FS_ENTRY_DIR) return 0;
+        if (q->min_size >= 0 && size < (uint64_t)q->min_size) return 0;
+        if (q->max_size >= 0 && size > (uint64_t)q->max_size) return 0;
+    }
+    if (q->newer_than && mtime < q->newer_than) return 0;
+    if (q->older_than && mtime >= q->older_than) return 0;
+    return 1;
+}
+
+int fss_matcher_init(fss_matcher* m, const fss_query* q)
+{
+    memset(m, 0, sizeof(*m));
+    m->query = q;
+    int insensitive = !(q->flags & FSS_CASE_SENSITIVE);
+    for (int c = 0; c < 256; c++) m->fold[c] = (unsigned char)(insensitive && c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c);
+
+    const char* pattern = q->pattern ? q->pattern : "";
+    if (q->match == FSS_MATCH_REGEX)
+    {
+        int cflags = REG_EXTENDED | REG_NOSUB | (insensitive ? REG_ICASE : 0);
+        if (regcomp(&m->regex, pattern, cflags) != 0) return EINVAL;
+        m->has_regex = 1;
+    }
+    else if (q->match == FSS_MATCH_SUBSTRING)
+    {
+        m->needle_length = strlen(pattern);
+        m->needle = malloc(m->needle_length + 1);
+        if (!m->needle) return ENOMEM;
+        for (size_t i = 0; i <= m->needle_length; i++) m->needle[i] = m->fold[(unsigned char)pattern[i]];
+    }
+
+    m->filter_size = q->min_size >= 0 || q->max_size >= 0;
+    m->list_flags = (q->flags & FSS_HIDDEN) ? FS_LIST_HIDDEN : 0;
+    // Directory entries carry the type; only size and date bounds need a stat per entry.
+    if (m->filter_size || q->newer_than || q->older_than) m->list_flags |= FS_LIST_STAT;
+    return 0;
+}
+
+void fss_matcher_free(fss_matcher* m)
+{
+    free(m->needle);
+    m->needle = NULL;
+    if (m->has_regex) regfree(&m->regex);
+    m->has_regex = 0;
+}
+
+#pragma mark - Batches
+
+static void fss_flush(fss_worker* w)
+{
+    fss_pool* p = w->pool;
+    if (w->batch_count && !atomic_load(&p->stop))
+    {
+        for (size_t i = 0; i < w->batch_count; i++) w->batch[i].path = w->text + w->offsets[i];
+        pthread_mutex_lock(&p->emit_lock);
+        int stop = atomic_load(&p->stop) || p->fn(p->ctx, w->batch, w->batch_count);
+        pthread_mutex_unlock(&p->emit_lock);
+        if (stop) atomic_store(&p->stop, 1);
+    }
+    w->batch_count = 0;
+    w->text_used = 0;
+    w->last_flush = fss_now();
+}
+
+static void fss_emit(fss_worker* w, const char* dir, size_t dir_length, const fs_listing* l, size_t i)
+{
+    size_t name_length = l->name_length[i];
+    size_t need = dir_length + 1 + name_length + 1;
+    if (w->text_used + need > w->text_capacity)
+    {
+        size_t cap = w->text_capacity ? w->text_capacity * 2 : 16384;
+        while (cap < w->text_used + need) cap *= 2;
+        char* text = realloc(w->text, cap);
+        if (!text) return;
+        w->text = text;
+        w->text_capacity = cap;
+    }
+    char* out = w->text + w->text_used;
+    memcpy(out, dir, dir_length);
+    size_t n = dir_length;
+    if (n == 0 || out[n - 1] != '/') out[n++] = '/';
+    memcpy(out + n, fs_listing_name(l, i), name_length + 1);
+
+    fss_match* m = &w->batch[w->batch_count];
+    m->size = l->size[i];
+    m->mtime = l->mtime[i];
+    m->flags = l->flags[i];
+    w->offsets[w->batch_count++] = w->text_used;
+    w->text_used += n + name_length + 1;
+    if (w->batch_count == FSS_BATCH_MAX) fss_flush(w);
+}
+
+#pragma mark - Walkers
+
+static int fss_stopped(const fss_pool* p)
+{
+    return atomic_load(&p->stop) || (p->cancel && *p->cancel);
+}
+
+static void fss_queue(fss_worker* w, const char* dir, size_t dir_length, const char* name, size_t name_length)
+{
+    fss_pool* p = w->pool;
+    char* child = malloc(dir_length + name_length + 2);
+    if (!child) return;
+    memcpy(child, dir, dir_length);
+    size_t n = dir_length;
+    if (n == 0 || child[n - 1] != '/') child[n++] = '/';
+    memcpy(child + n, name, name_length + 1);
+
+    atomic_fetch_add(&p->pending, 1);
+    if (fss_push(&p->deques[w->id], child) != 0)
+    {
+        atomic_fetch_sub(&p->pending, 1);
+        free(child);
+        return;
+    }
+    if (atomic_load(&p->idle)) pthread_cond_signal(&p->idle_cond);
+}
+
+static void fss_walk(fss_worker* w, const char* dir)
+{
+    fss_pool* p = w->pool;
+    fs_list_cursor cursor;
+    if (fs_list_open(&cursor, dir, p->matcher.list_flags) != 0) return;
+    size_t dir_length = strlen(dir);
+
+    do
+    {
+        fs_listing_clear(&w->listing);
+        if (fs_list_read(&cursor, &w->listing, FSS_READ_CHUNK) != 0) break;
+        const fs_listing* l = &w->listing;
+        for (size_t i = 0; i < l->count; i++)
+        {
+            // Symbolic links are reported but never followed.
+            if ((l->flags[i] & (FS_ENTRY_DIR | FS_ENTRY_LINK)) == FS_ENTRY_DIR)
+                fss_queue(w, dir, dir_length, fs_listing_name(l, i), l->name_length[i]);
+            if (fss_matcher_accept(&p->matcher, fs_listing_name(l, i), l->flags[i], l->size[i], l->mtime[i])) fss_emit(w, dir, dir_length, l, i);
+        }
+    } while (!cursor.done && !fss_stopped(p));
+    fs_list_close(&cursor);
+
+    if (w->batch_count && fss_now() - w->last_flush >= FSS_BATCH_INTERVAL_NS) fss_flush(w);
+}
+
+static char* fss_next(fss_worker* w)
+{
+    fss_pool* p = w->pool;
+    char* dir = fss_pop(&p->deques[w->id]);
+    if (dir) return dir;
+    int start = (int)(rand_r(&w->seed) % (unsigned)p->count);
+    for (int k = 0; k < p->count && !dir; k++)
+    {
+        int victim = (start + k) % p->count;
+        if (victim != w->id) dir = fss_steal(&p->deques[victim]);
+    }
+    return dir;
+}
+
+static void* fss_worker_main(void* arg)
+{
+    fss_worker* w = arg;
+    fss_pool* p = w->pool;
+    w->last_flush = fss_now();
+
+    while (!fss_stopped(p))
+    {
+        char* dir = fss_next(w);
+        if (!dir)
+        {
+            if (atomic_load(&p->pending) == 0) break;
+            // Idle until someone queues work or the walk ends; the timeout
+            // covers a signal sent just before this thread started waiting.
+            if (w->batch_count) fss_flush(w);
+            pthread_mutex_lock(&p->idle_lock);
+            atomic_fetch_add(&p->idle, 1);
+            if (atomic_load(&p->pending) != 0)
+            {
+                struct timespec ts;
+                clock_gettime(CLOCK_REALTIME, &ts);
+                ts.tv_nsec += 2000000;
+                if (ts.tv_nsec >= 1000000000)
+                {
+                    ts.tv_sec++;
+                    ts.tv_nsec -= 1000000000;
+                }
+                pthread_cond_timedwait(&p->idle_cond, &p->idle_lock, &ts);
+            }
+            atomic_fetch_sub(&p->idle, 1);
+            pthread_mutex_unlock(&p->idle_lock);
+            continue;
+        }
+
+        fss_walk(w, dir);
+        free(dir);
+        if (atomic_fetch_sub(&p->pending, 1) == 1)
+        {
+            pthread_mutex_lock(&p->idle_lock);
+            pthread_cond_broadcast(&p->idle_cond);
+            pthread_mutex_unlock(&p->idle_lock);
+        }
+    }
+    fss_flush(w);
+    return NULL;
+}
+
+#pragma mark - Public
+
+int fss_search(const char* root, const fss_query* query, fss_batch_fn fn, void* ctx, const volatile int* cancel)
+{
+    struct stat st;
+    if (stat(root, &st) != 0) return errno;
+    if (!S_ISDIR(st.st_mode)) return ENOTDIR;
+
+    fss_pool pool;
+    memset(&pool, 0, sizeof(pool));
+    pool.query = query;
+    pool.fn = fn;
+    pool.ctx = ctx;
+    pool.cancel = cancel;
+    int err = fss_matcher_init(&pool.matcher, query);
+
+    int threads = query->threads;
+    if (threads <= 0) threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads < 1) threads = 1;
+    if (threads > FSS_MAX_THREADS) threads = FSS_MAX_THREADS;
+    pool.count = threads;
+    pool.deques = calloc((size_t)threads, sizeof(fss_deque));
+    fss_worker* workers = calloc((size_t)threads, sizeof(fss_worker));
+    char* first = strdup(root);
+    if (!err && (!pool.deques || !workers || !first)) err = ENOMEM;
+    if (err)
+    {
+        free(first);
+        free(workers);
+        free(pool.deques);
+        fss_matcher_free(&pool.matcher);
+        return err;
+    }
+
+    pthread_mutex_init(&pool.idle_lock, NULL);
+    pthread_cond_init(&pool.idle_cond, NULL);
+    pthread_mutex_init(&pool.emit_lock, NULL);
+    for (int i = 0; i < threads; i++)
+    {
+        pthread_mutex_init(&pool.deques[i].lock, NULL);
+        workers[i].pool = &pool;
+        workers[i].id = i;
+        workers[i].seed = (unsigned)i * 2654435761u + 1;
+    }
+    atomic_store(&pool.pending, 1);
+    fss_push(&pool.deques[0], first);
+
+    // The calling thread is worker 0.
+    int started = 1;
+    for (; started < threads; started++)
+    {
+        if (pthread_create(&workers[started].thread, NULL, fss_worker_main, &workers[started]) != 0) break;
+    }
+    fss_worker_main(&workers[0]);
+    for (int i = 1; i < started; i++) pthread_join(workers[i].thread, NULL);
+
+    // Anything left is from a stopped search.
+    for (int i = 0; i < threads; i++)
+    {
+        fss_deque* d = &pool.deques[i];
+        for (size_t k = d->head; k < d->tail; k++) free(d->items[k]);
+        free(d->items);
+        pthread_mutex_destroy(&d->lock);
+        fs_listing_free(&workers[i].listing);
+        free(workers[i].text);
+    }
+    free(workers);
+    free(pool.deques);
+    fss_matcher_free(&pool.matcher);
+    pthread_mutex_destroy(&pool.idle_lock);
+    pthread_cond_destroy(&pool.idle_cond);
+    pthread_mutex_destroy(&pool.emit_lock);
+
+    return (cancel && *cancel) ? ECANCELED : 0;
+}
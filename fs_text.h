@@ -0,0 +1,77 @@
+// File: fs_text.h
+// Location: プロジェクト直下
+
+#ifndef FS_TEXT_H
+#define FS_TEXT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Full-text inverted index. fst_build tokenizes the text files under a root
+// and writes every distinct term with a posting list (document deltas, term
+// frequency and position deltas, all LEB128 varints) into one file that
+// fst_open maps read-only. Rebuilding over an existing file only reads the
+// files whose size or mtime changed; the postings of the others are carried
+// over from the old index.
+//
+// Tokens are runs of ASCII letters, digits and '_' folded to lower case (full
+// width forms are folded to ASCII first), with other non-ASCII letters kept as
+// part of the word. Kana, kanji and hangul have no word breaks and are indexed
+// as overlapping bigrams, so a single such character only matches on its own.
+//
+// Benchmark without the app (Tools/fst_bench.c):
+//   cc -O2 -DFST_BENCH -I. -x c Tools/fst_bench.c fs_text.m fs_search.m fs.m -lpthread -lm -o fst_bench
+//   ./fst_bench <root> <index file> [query ...]
+
+typedef struct fst_index fst_index;
+
+#define FST_TERM_MAX 64            // longer tokens are cut to this many bytes
+#define FST_FILE_MAX (8u << 20)    // larger files are recorded but not read
+
+typedef struct fst_stats
+{
+    uint64_t docs;
+    uint64_t terms;
+    uint64_t tokens;
+    uint64_t postings_size;        // bytes of encoded posting lists
+    uint64_t file_size;
+    uint64_t docs_read;            // files tokenized by the last build
+    uint64_t bytes_read;
+    uint64_t build_ns;
+    int64_t built_at;              // seconds since the epoch
+} fst_stats;
+
+typedef struct fst_hit
+{
+    const char* path;              // relative to fst_root, points into the index
+    double score;                  // BM25
+    uint32_t count;                // occurrences of the matched terms and phrases
+    uint64_t size;
+    int64_t mtime;                 // seconds
+} fst_hit;
+
+// Indexes the files under root whose extension is in extensions (lower case,
+// without the dot, NULL-terminated), skipping hidden names, symlinks and files
+// with a NUL byte in their first 8 KB. An existing index at file with the same
+// root is reused for unchanged files; file is replaced atomically. Returns 0,
+// ECANCELED or an errno value. stats may be NULL.
+int fst_build(const char* root, const char* file, const char* const* extensions, const volatile int* cancel,
+              fst_stats* stats);
+
+// Returns 0, EINVAL for a file that is damaged or was written by another
+// version, or an errno value.
+int fst_open(const char* file, fst_index** out);
+void fst_close(fst_index* index);
+const char* fst_root(const fst_index* index);
+void fst_get_stats(const fst_index* index, fst_stats* stats);
+
+// Query syntax: words are ANDed, "quoted words" must appear as a phrase, OR
+// between two clauses accepts either, and -word or -"phrase" excludes files.
+// Fills hits with up to capacity files under root, best first, and sets
+// *count. Returns 0, EINVAL for a query without a positive term, ENOENT when
+// root is outside the index, or ENOMEM. The index is only read, so any number
+// of searches may run at once.
+int fst_search(const fst_index* index, const char* root, const char* query, fst_hit* hits, size_t capacity,
+               size_t* count);
+
+#endif
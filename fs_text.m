@@ -0,0 +1,1480 @@
+// File: fs_text.c
+// Location: プロジェクト直下
+
+#include "fs_text.h"
+#include "fs.h"
+#include "fs_search.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define FST_MAGIC "FSTEXT"
+#define FST_VERSION 1
+#define FST_BYTE_ORDER 0x01020304u
+#define FST_NONE UINT32_MAX
+#define FST_BINARY_PROBE 8192
+#define FST_WRITE_BUFFER (64 * 1024)
+#define FST_BM25_K1 1.2
+#define FST_BM25_B 0.75
+
+enum
+{
+    FST_SEP = 0,
+    FST_WORD = 1,
+    FST_CJK = 2,
+};
+
+// On-disk layout: header, the posting lists, then docs, terms and text, each
+// section 8-byte aligned.
+typedef struct fst_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t file_size;
+    uint64_t build_ns;
+    int64_t built_at;
+    uint32_t doc_count;
+    uint32_t term_count;
+    uint64_t tokens;
+    uint64_t text_docs;            // docs with at least one token
+    uint64_t docs_read;
+    uint64_t bytes_read;
+    uint64_t postings_size;
+    uint64_t text_size;
+    uint64_t postings_offset;
+    uint64_t docs_offset;
+    uint64_t terms_offset;
+    uint64_t text_offset;
+    uint32_t root;                 // text offset of the root path
+    uint32_t reserved;
+} fst_header;
+
+// Docs are sorted by path, so every subtree is a range of doc ids.
+typedef struct fst_doc
+{
+    uint64_t size;
+    int64_t mtime;
+    uint32_t path;                 // text offset, relative to the root
+    uint32_t tokens;
+} fst_doc;
+
+// Terms are sorted bytewise. A posting list holds, per doc in increasing
+// order: doc delta, term frequency, then that many position deltas.
+typedef struct fst_term
+{
+    uint64_t postings;             // offset into the postings section
+    uint32_t length;
+    uint32_t text;
+    uint32_t df;
+    uint32_t reserved;
+} fst_term;
+
+struct fst_index
+{
+    void* map;
+    size_t map_size;
+    const fst_header* header;
+    const uint8_t* postings;
+    const fst_doc* docs;
+    const fst_term* terms;
+    const char* text;
+};
+
+static uint64_t fst_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int fst_grow(void** items, size_t* capacity, size_t need, size_t size)
+{
+    if (need <= *capacity) return 0;
+    size_t cap = *capacity ? *capacity : 1024;
+    while (cap < need) cap *= 2;
+    void* grown = realloc(*items, cap * size);
+    if (!grown) return ENOMEM;
+    *items = grown;
+    *capacity = cap;
+    return 0;
+}
+
+static uint64_t fst_align(uint64_t offset)
+{
+    return (offset + 7) & ~(uint64_t)7;
+}
+
+static size_t fst_put_varint(uint8_t* out, uint64_t v)
+{
+    size_t n = 0;
+    while (v >= 0x80)
+    {
+        out[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    out[n++] = (uint8_t)v;
+    return n;
+}
+
+// Returns 0 for a truncated or overlong varint.
+static int fst_get_varint(const uint8_t** p, const uint8_t* end, uint64_t* out)
+{
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64 && *p < end; shift += 7)
+    {
+        uint8_t c = *(*p)++;
+        v |= (uint64_t)(c & 0x7F) << shift;
+        if (!(c & 0x80))
+        {
+            *out = v;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+#pragma mark - Tokens
+
+typedef void (*fst_token_fn)(void* ctx, const unsigned char* term, size_t length);
+
+// Returns the bytes consumed; *cp is FST_NONE for an invalid sequence.
+static size_t fst_decode(const unsigned char* p, size_t n, uint32_t* cp)
+{
+    unsigned char c = p[0];
+    size_t length;
+    uint32_t v;
+    uint32_t min;
+    if ((c & 0xE0) == 0xC0)
+    {
+        length = 2;
+        v = c & 0x1F;
+        min = 0x80;
+    }
+    else if ((c & 0xF0) == 0xE0)
+    {
+        length = 3;
+        v = c & 0x0F;
+        min = 0x800;
+    }
+    else if ((c & 0xF8) == 0xF0)
+    {
+        length = 4;
+        v = c & 0x07;
+        min = 0x10000;
+    }
+    else
+    {
+        *cp = FST_NONE;
+        return 1;
+    }
+    if (length > n)
+    {
+        *cp = FST_NONE;
+        return 1;
+    }
+    for (size_t i = 1; i < length; i++)
+    {
+        if ((p[i] & 0xC0) != 0x80)
+        {
+            *cp = FST_NONE;
+            return 1;
+        }
+        v = (v << 6) | (p[i] & 0x3F);
+    }
+    *cp = v < min || v > 0x10FFFF || (v >= 0xD800 && v <= 0xDFFF) ? FST_NONE : v;
+    return *cp == FST_NONE ? 1 : length;
+}
+
+static int fst_class(uint32_t cp)
+{
+    if (cp < 0x80)
+        return (cp >= '0' && cp <= '9') || (cp >= 'a' && cp <= 'z') || (cp >= 'A' && cp <= 'Z') || cp == '_' ? FST_WORD
+                                                                                                              : FST_SEP;
+    if (cp == FST_NONE || cp < 0xC0 || cp == 0xD7 || cp == 0xF7) return FST_SEP;
+    if ((cp >= 0x2000 && cp < 0x2C00) || (cp >= 0x3000 && cp < 0x3040) || cp == 0x30FB) return FST_SEP;
+    if ((cp >= 0xFE30 && cp < 0xFE70) || (cp >= 0xFF00 && cp < 0xFF66) || (cp >= 0x1F000 && cp < 0x20000)) return FST_SEP;
+    if ((cp >= 0x3040 && cp < 0xA000) || (cp >= 0xAC00 && cp < 0xD7B0) || (cp >= 0xF900 && cp < 0xFB00)) return FST_CJK;
+    if ((cp >= 0xFF66 && cp < 0xFFA0) || cp >= 0x20000) return FST_CJK;
+    return FST_WORD;
+}
+
+// Splits s into terms (see fs_text.h) and hands each to fn in order.
+static void fst_tokenize(const unsigned char* s, size_t n, fst_token_fn fn, void* ctx)
+{
+    unsigned char word[FST_TERM_MAX];
+    size_t word_length = 0;
+    int in_word = 0;
+    int full = 0;                  // the word reached FST_TERM_MAX
+    unsigned char prev[4];
+    size_t prev_length = 0;
+    size_t run = 0;                // CJK characters in the current run
+
+    for (size_t i = 0; i <= n;)
+    {
+        uint32_t cp = ' ';
+        size_t length = 1;
+        if (i < n)
+        {
+            if (s[i] < 0x80) cp = s[i];
+            else
+            {
+                length = fst_decode(s + i, n - i, &cp);
+                if (cp >= 0xFF01 && cp <= 0xFF5E) cp -= 0xFEE0;   // full width ASCII
+            }
+        }
+        int cls = fst_class(cp);
+        if (cls != FST_WORD && in_word)
+        {
+            fn(ctx, word, word_length);
+            in_word = 0;
+            full = 0;
+            word_length = 0;
+        }
+        if (cls != FST_CJK && run)
+        {
+            if (run == 1) fn(ctx, prev, prev_length);
+            run = 0;
+        }
+        if (cls == FST_WORD)
+        {
+            in_word = 1;
+            size_t bytes = cp < 0x80 ? 1 : length;
+            if (full || word_length + bytes > FST_TERM_MAX) full = 1;   // cut on a character boundary
+            else if (cp < 0x80) word[word_length++] = cp >= 'A' && cp <= 'Z' ? (unsigned char)(cp + 32) : (unsigned char)cp;
+            else
+            {
+                memcpy(word + word_length, s + i, length);
+                word_length += length;
+            }
+        }
+        else if (cls == FST_CJK)
+        {
+            if (run)
+            {
+                unsigned char pair[8];
+                memcpy(pair, prev, prev_length);
+                memcpy(pair + prev_length, s + i, length);
+                fn(ctx, pair, prev_length + length);
+            }
+            memcpy(prev, s + i, length);
+            prev_length = length;
+            run++;
+        }
+        i += length;
+    }
+}
+
+#pragma mark - Build
+
+typedef struct fst_file
+{
+    uint32_t path;                 // builder text offset
+    uint32_t tokens;
+    uint64_t size;
+    int64_t mtime;
+} fst_file;
+
+typedef struct fst_sorted
+{
+    const char* path;
+    uint32_t file;
+} fst_sorted;
+
+// A term seen in the files read by this build, with its postings in memory.
+typedef struct fst_new_term
+{
+    uint32_t text;                 // offset into term_text
+    uint32_t length;
+    uint32_t last_doc;
+    uint32_t df;
+    uint8_t* postings;
+    size_t used;
+    size_t capacity;
+} fst_new_term;
+
+typedef struct fst_builder
+{
+    const volatile int* cancel;
+    const char* const* extensions;
+    size_t skip;                   // bytes of root prefix in a walk path
+    int err;
+
+    char* text;                    // relative doc paths
+    size_t text_used;
+    size_t text_capacity;
+    fst_file* files;
+    size_t file_count;
+    size_t file_capacity;
+
+    fst_new_term* terms;
+    size_t term_count;
+    size_t term_capacity;
+    char* term_text;
+    size_t term_text_used;
+    size_t term_text_capacity;
+    uint64_t* table;               // open addressing: hash << 32 | term index + 1
+    size_t table_size;
+
+    uint64_t* pairs;               // term << 32 | position, for the file being read
+    size_t pair_count;
+    size_t pair_capacity;
+    unsigned char* buffer;
+    size_t buffer_capacity;
+
+    uint64_t docs_read;
+    uint64_t bytes_read;
+} fst_builder;
+
+static int fst_wanted(const fst_builder* b, const char* path)
+{
+    if (strstr(path, "/.")) return 0;
+    const char* name = strrchr(path, '/');
+    name = name ? name + 1 : path;
+    const char* dot = strrchr(name, '.');
+    if (!dot || dot == name || strlen(dot + 1) > 15) return 0;
+    char ext[16];
+    size_t n = 0;
+    for (const char* c = dot + 1; *c; c++) ext[n++] = *c >= 'A' && *c <= 'Z' ? (char)(*c + 32) : *c;
+    ext[n] = '\0';
+    for (const char* const* e = b->extensions; *e; e++)
+    {
+        if (strcmp(*e, ext) == 0) return 1;
+    }
+    return 0;
+}
+
+static int fst_collect(void* ctx, const fss_match* matches, size_t count)
+{
+    fst_builder* b = ctx;
+    for (size_t i = 0; i < count && !b->err; i++)
+    {
+        const fss_match* m = &matches[i];
+        if ((m->flags & (FS_ENTRY_DIR | FS_ENTRY_LINK)) || !(m->flags & FS_ENTRY_STAT)) continue;
+        const char* rel = m->path + b->skip;
+        if (!fst_wanted(b, rel)) continue;
+        size_t n = strlen(rel) + 1;
+        if (b->text_used + n > UINT32_MAX || fst_grow((void**)&b->text, &b->text_capacity, b->text_used + n, 1)
+            || fst_grow((void**)&b->files, &b->file_capacity, b->file_count + 1, sizeof(fst_file)))
+        {
+            b->err = ENOMEM;
+            break;
+        }
+        fst_file* f = &b->files[b->file_count++];
+        f->path = (uint32_t)b->text_used;
+        f->tokens = 0;
+        f->size = m->size;
+        f->mtime = m->mtime;
+        memcpy(b->text + b->text_used, rel, n);
+        b->text_used += n;
+    }
+    return b->err || (b->cancel && *b->cancel);
+}
+
+static uint64_t fst_hash(const unsigned char* s, size_t n)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < n; i++) h = (h ^ s[i]) * 0x100000001b3ULL;
+    return h;                      // callers use the well mixed high half
+}
+
+static int fst_rehash(fst_builder* b)
+{
+    size_t size = b->table_size ? b->table_size * 2 : 1 << 16;
+    uint64_t* table = calloc(size, sizeof(uint64_t));
+    if (!table) return ENOMEM;
+    for (size_t i = 0; i < b->table_size; i++)
+    {
+        if (!b->table[i]) continue;
+        size_t slot = (b->table[i] >> 32) & (size - 1);
+        while (table[slot]) slot = (slot + 1) & (size - 1);
+        table[slot] = b->table[i];
+    }
+    free(b->table);
+    b->table = table;
+    b->table_size = size;
+    return 0;
+}
+
+static uint32_t fst_intern(fst_builder* b, const unsigned char* s, size_t n)
+{
+    if ((b->term_count + 1) * 2 > b->table_size && fst_rehash(b)) return FST_NONE;
+    size_t mask = b->table_size - 1;
+    uint64_t hash = fst_hash(s, n) & 0xFFFFFFFF00000000ULL;
+    size_t slot = (size_t)(hash >> 32) & mask;
+    // The stored hash bits rule out most other terms without touching them.
+    for (uint64_t e; (e = b->table[slot]); slot = (slot + 1) & mask)
+    {
+        if ((e & 0xFFFFFFFF00000000ULL) != hash) continue;
+        const fst_new_term* term = &b->terms[(uint32_t)e - 1];
+        if (term->length == n && memcmp(b->term_text + term->text, s, n) == 0) return (uint32_t)e - 1;
+    }
+    if (b->term_count >= FST_NONE - 1 || b->term_text_used + n + 1 > UINT32_MAX) return FST_NONE;
+    if (fst_grow((void**)&b->terms, &b->term_capacity, b->term_count + 1, sizeof(fst_new_term))
+        || fst_grow((void**)&b->term_text, &b->term_text_capacity, b->term_text_used + n + 1, 1))
+        return FST_NONE;
+    fst_new_term* term = &b->terms[b->term_count];
+    memset(term, 0, sizeof(*term));
+    term->text = (uint32_t)b->term_text_used;
+    term->length = (uint32_t)n;
+    memcpy(b->term_text + b->term_text_used, s, n);
+    b->term_text[b->term_text_used + n] = '\0';
+    b->term_text_used += n + 1;
+    b->table[slot] = hash | (uint32_t)++b->term_count;
+    return (uint32_t)(b->term_count - 1);
+}
+
+static void fst_add_token(void* ctx, const unsigned char* s, size_t n)
+{
+    fst_builder* b = ctx;
+    if (b->err) return;
+    if (b->pair_count >= FST_NONE)
+    {
+        b->err = EFBIG;
+        return;
+    }
+    uint32_t t = fst_intern(b, s, n);
+    if (t == FST_NONE || fst_grow((void**)&b->pairs, &b->pair_capacity, b->pair_count + 1, sizeof(uint64_t)))
+    {
+        b->err = ENOMEM;
+        return;
+    }
+    b->pairs[b->pair_count] = (uint64_t)t << 32 | (uint32_t)b->pair_count;
+    b->pair_count++;
+}
+
+// Sorts the (term, position) pairs of one file by term; positions stay in
+// order because they are the low bits and already ascending.
+static int fst_sort_pairs(fst_builder* b)
+{
+    size_t n = b->pair_count;
+    if (n < 2) return 0;
+    uint64_t* scratch = malloc(n * sizeof(uint64_t));
+    if (!scratch) return ENOMEM;
+    uint64_t* from = b->pairs;
+    uint64_t* to = scratch;
+    size_t counts[2048];
+    int passes = 0;
+    for (int shift = 32; shift < 64; shift += 11)
+    {
+        if ((b->term_count - 1) >> (shift - 32) == 0 && shift > 32) break;
+        memset(counts, 0, sizeof(counts));
+        for (size_t i = 0; i < n; i++) counts[(from[i] >> shift) & 2047]++;
+        size_t sum = 0;
+        for (size_t k = 0; k < 2048; k++)
+        {
+            size_t c = counts[k];
+            counts[k] = sum;
+            sum += c;
+        }
+        for (size_t i = 0; i < n; i++) to[counts[(from[i] >> shift) & 2047]++] = from[i];
+        uint64_t* t = from;
+        from = to;
+        to = t;
+        passes++;
+    }
+    if (passes & 1) memcpy(b->pairs, scratch, n * sizeof(uint64_t));
+    free(scratch);
+    return 0;
+}
+
+static int fst_append(fst_new_term* t, const uint8_t* data, size_t n)
+{
+    if (fst_grow((void**)&t->postings, &t->capacity, t->used + n, 1)) return ENOMEM;
+    memcpy(t->postings + t->used, data, n);
+    t->used += n;
+    return 0;
+}
+
+static int fst_read_file(fst_builder* b, const char* root, size_t root_length, uint32_t doc)
+{
+    fst_file* f = &b->files[doc];
+    if (f->size == 0 || f->size > FST_FILE_MAX) return 0;
+    char path[PATH_MAX];
+    const char* rel = b->text + f->path;
+    if ((size_t)snprintf(path, sizeof(path), "%.*s/%s", (int)root_length, root, rel) >= sizeof(path)) return 0;
+    int fd = open(path, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+    if (fd < 0) return 0;
+    struct stat st;
+    size_t size = 0;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && (uint64_t)st.st_size <= FST_FILE_MAX
+        && !fst_grow((void**)&b->buffer, &b->buffer_capacity, (size_t)st.st_size + 1, 1))
+    {
+        while (size < (size_t)st.st_size)
+        {
+            ssize_t n = read(fd, b->buffer + size, (size_t)st.st_size - size);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            size += (size_t)n;
+        }
+    }
+    close(fd);
+    b->docs_read++;
+    b->bytes_read += size;
+    if (size == 0 || memchr(b->buffer, 0, size < FST_BINARY_PROBE ? size : FST_BINARY_PROBE)) return 0;
+
+    b->pair_count = 0;
+    fst_tokenize(b->buffer, size, fst_add_token, b);
+    if (b->err) return b->err;
+    if (fst_sort_pairs(b)) return ENOMEM;
+
+    uint8_t head[20];
+    uint8_t varint[10];
+    for (size_t i = 0; i < b->pair_count;)
+    {
+        uint32_t t = (uint32_t)(b->pairs[i] >> 32);
+        size_t end = i + 1;
+        while (end < b->pair_count && (uint32_t)(b->pairs[end] >> 32) == t) end++;
+        fst_new_term* term = &b->terms[t];
+        size_t n = fst_put_varint(head, doc - term->last_doc);
+        n += fst_put_varint(head + n, end - i);
+        if (fst_append(term, head, n)) return ENOMEM;
+        uint32_t last = 0;
+        for (size_t k = i; k < end; k++)
+        {
+            uint32_t position = (uint32_t)b->pairs[k];
+            if (fst_append(term, varint, fst_put_varint(varint, position - last))) return ENOMEM;
+            last = position;
+        }
+        term->last_doc = doc;
+        term->df++;
+        i = end;
+    }
+    f->tokens = (uint32_t)b->pair_count;
+    return 0;
+}
+
+// Buffered sequential output of the index file.
+typedef struct fst_writer
+{
+    int fd;
+    int err;
+    uint64_t at;
+    size_t used;
+    uint8_t buffer[FST_WRITE_BUFFER];
+} fst_writer;
+
+static void fst_flush_writer(fst_writer* w)
+{
+    const uint8_t* p = w->buffer;
+    size_t size = w->used;
+    while (size && !w->err)
+    {
+        ssize_t n = write(w->fd, p, size);
+        if (n < 0)
+        {
+            if (errno != EINTR) w->err = errno;
+            continue;
+        }
+        p += n;
+        size -= (size_t)n;
+    }
+    w->used = 0;
+}
+
+static void fst_write(fst_writer* w, const void* data, size_t size)
+{
+    const uint8_t* p = data;
+    w->at += size;
+    while (size)
+    {
+        size_t n = FST_WRITE_BUFFER - w->used < size ? FST_WRITE_BUFFER - w->used : size;
+        if (p) memcpy(w->buffer + w->used, p, n);
+        else memset(w->buffer + w->used, 0, n);
+        w->used += n;
+        if (p) p += n;
+        size -= n;
+        if (w->used == FST_WRITE_BUFFER) fst_flush_writer(w);
+    }
+}
+
+static void fst_pad(fst_writer* w)
+{
+    fst_write(w, NULL, (size_t)(fst_align(w->at) - w->at));
+}
+
+// Walks one posting list; positions are left encoded for copying.
+typedef struct fst_cursor
+{
+    const uint8_t* p;
+    const uint8_t* end;
+    uint32_t doc_count;
+    uint32_t doc;
+    uint32_t tf;
+    int started;
+    const uint8_t* positions;
+    size_t positions_length;
+} fst_cursor;
+
+static void fst_cursor_init(fst_cursor* c, const uint8_t* postings, size_t length, uint32_t doc_count)
+{
+    memset(c, 0, sizeof(*c));
+    c->p = postings;
+    c->end = postings + length;
+    c->doc_count = doc_count;
+}
+
+// Returns 0 at the end of the list or on malformed data.
+static int fst_cursor_next(fst_cursor* c)
+{
+    uint64_t delta;
+    uint64_t tf;
+    if (c->p >= c->end || !fst_get_varint(&c->p, c->end, &delta) || !fst_get_varint(&c->p, c->end, &tf)) return 0;
+    if ((c->started && delta == 0) || c->doc + delta >= c->doc_count || tf == 0 || tf > (uint64_t)(c->end - c->p))
+    {
+        c->p = c->end;
+        return 0;
+    }
+    c->doc += (uint32_t)delta;
+    c->started = 1;
+    c->tf = (uint32_t)tf;
+    c->positions = c->p;
+    for (uint64_t k = 0; k < tf; k++)
+    {
+        uint64_t skip;
+        if (!fst_get_varint(&c->p, c->end, &skip))
+        {
+            c->p = c->end;
+            return 0;
+        }
+    }
+    c->positions_length = (size_t)(c->p - c->positions);
+    return 1;
+}
+
+// Merges the carried-over postings of one term (old doc ids mapped through
+// remap) with the postings read by this build into out. Returns the df.
+static uint32_t fst_merge_postings(const uint8_t* old, size_t old_length, uint32_t old_docs, const uint32_t* remap,
+                                   const fst_new_term* fresh, uint32_t new_docs, uint8_t** out, size_t* out_capacity,
+                                   size_t* out_length, int* err)
+{
+    fst_cursor a;
+    fst_cursor b;
+    fst_cursor_init(&a, old, old_length, old_docs);
+    fst_cursor_init(&b, fresh ? fresh->postings : NULL, fresh ? fresh->used : 0, new_docs);
+    int has_a = 0;
+    int has_b = fst_cursor_next(&b);
+    uint32_t mapped = FST_NONE;
+    while ((has_a = fst_cursor_next(&a)) && (mapped = remap[a.doc]) == FST_NONE) {}
+
+    uint32_t df = 0;
+    uint32_t last = 0;
+    *out_length = 0;
+    while (has_a || has_b)
+    {
+        fst_cursor* c;
+        uint32_t doc;
+        if (has_a && (!has_b || mapped < b.doc))
+        {
+            c = &a;
+            doc = mapped;
+        }
+        else
+        {
+            c = &b;
+            doc = b.doc;
+        }
+        if (fst_grow((void**)out, out_capacity, *out_length + 20 + c->positions_length, 1))
+        {
+            *err = ENOMEM;
+            return 0;
+        }
+        size_t n = *out_length;
+        n += fst_put_varint(*out + n, doc - last);
+        n += fst_put_varint(*out + n, c->tf);
+        memcpy(*out + n, c->positions, c->positions_length);
+        *out_length = n + c->positions_length;
+        last = doc;
+        df++;
+        if (c == &a)
+        {
+            while ((has_a = fst_cursor_next(&a)) && (mapped = remap[a.doc]) == FST_NONE) {}
+        }
+        else has_b = fst_cursor_next(&b);
+    }
+    return df;
+}
+
+static int fst_sorted_compare(const void* a, const void* b)
+{
+    return strcmp(((const fst_sorted*)a)->path, ((const fst_sorted*)b)->path);
+}
+
+// Writes the index: posting lists merged term by term, then docs, terms and
+// text. The header goes last, at offset 0.
+static int fst_write_index(fst_builder* b, const fst_index* old, const uint32_t* remap, const char* root, int fd,
+                           uint64_t started, fst_header* h)
+{
+    size_t new_count = b->term_count;
+    fst_sorted* fresh = malloc((new_count ? new_count : 1) * sizeof(fst_sorted));
+    fst_writer* w = malloc(sizeof(fst_writer));
+    fst_term* terms = NULL;
+    size_t term_count = 0;
+    size_t term_capacity = 0;
+    char* text = NULL;
+    size_t text_used = 0;
+    size_t text_capacity = 0;
+    uint8_t* scratch = NULL;
+    size_t scratch_capacity = 0;
+    fst_doc* docs = malloc((b->file_count ? b->file_count : 1) * sizeof(fst_doc));
+    int err = 0;
+    if (!fresh || !w || !docs)
+    {
+        err = ENOMEM;
+        goto done;
+    }
+    for (size_t t = 0; t < new_count; t++)
+    {
+        fresh[t].path = b->term_text + b->terms[t].text;
+        fresh[t].file = (uint32_t)t;
+    }
+    qsort(fresh, new_count, sizeof(fst_sorted), fst_sorted_compare);
+
+    size_t root_length = strlen(root);
+    err = fst_grow((void**)&text, &text_capacity, root_length + 1 + b->text_used, 1);
+    if (err) goto done;
+    memcpy(text, root, root_length + 1);
+    memcpy(text + root_length + 1, b->text, b->text_used);
+    text_used = root_length + 1 + b->text_used;
+
+    memset(h, 0, sizeof(*h));
+    w->fd = fd;
+    w->err = 0;
+    w->at = 0;
+    w->used = 0;
+    fst_write(w, NULL, sizeof(fst_header));
+    fst_pad(w);
+    h->postings_offset = w->at;
+
+    size_t old_count = old ? old->header->term_count : 0;
+    uint32_t old_docs = old ? old->header->doc_count : 0;
+    size_t i = 0;
+    size_t j = 0;
+    while ((i < old_count || j < new_count) && !err && !w->err)
+    {
+        if (b->cancel && *b->cancel)
+        {
+            err = ECANCELED;
+            break;
+        }
+        const char* name;
+        const uint8_t* old_postings = NULL;
+        size_t old_length = 0;
+        const fst_new_term* term = NULL;
+        int d = i == old_count ? 1 : j == new_count ? -1 : strcmp(old->text + old->terms[i].text, fresh[j].path);
+        if (d <= 0)
+        {
+            name = old->text + old->terms[i].text;
+            old_postings = old->postings + old->terms[i].postings;
+            old_length = old->terms[i].length;
+            i++;
+        }
+        if (d >= 0)
+        {
+            name = fresh[j].path;
+            term = &b->terms[fresh[j].file];
+            j++;
+        }
+        size_t length = 0;
+        uint32_t df = fst_merge_postings(old_postings, old_length, old_docs, remap, term, (uint32_t)b->file_count,
+                                         &scratch, &scratch_capacity, &length, &err);
+        if (err || df == 0) continue;
+        size_t n = strlen(name) + 1;
+        if (length > UINT32_MAX || text_used + n > UINT32_MAX)
+        {
+            err = EFBIG;
+            break;
+        }
+        if (fst_grow((void**)&terms, &term_capacity, term_count + 1, sizeof(fst_term))
+            || fst_grow((void**)&text, &text_capacity, text_used + n, 1))
+        {
+            err = ENOMEM;
+            break;
+        }
+        fst_term* out = &terms[term_count++];
+        out->postings = w->at - h->postings_offset;
+        out->length = (uint32_t)length;
+        out->text = (uint32_t)text_used;
+        out->df = df;
+        out->reserved = 0;
+        memcpy(text + text_used, name, n);
+        text_used += n;
+        fst_write(w, scratch, length);
+    }
+    if (err) goto done;
+
+    uint64_t tokens = 0;
+    uint64_t text_docs = 0;
+    for (size_t f = 0; f < b->file_count; f++)
+    {
+        docs[f].size = b->files[f].size;
+        docs[f].mtime = b->files[f].mtime;
+        docs[f].path = (uint32_t)(root_length + 1 + b->files[f].path);
+        docs[f].tokens = b->files[f].tokens;
+        tokens += docs[f].tokens;
+        text_docs += docs[f].tokens != 0;
+    }
+
+    h->postings_size = w->at - h->postings_offset;
+    fst_pad(w);
+    h->docs_offset = w->at;
+    fst_write(w, docs, b->file_count * sizeof(fst_doc));
+    fst_pad(w);
+    h->terms_offset = w->at;
+    fst_write(w, terms, term_count * sizeof(fst_term));
+    fst_pad(w);
+    h->text_offset = w->at;
+    fst_write(w, text, text_used);
+    fst_flush_writer(w);
+    err = w->err;
+    if (err) goto done;
+
+    memcpy(h->magic, FST_MAGIC, sizeof(FST_MAGIC));
+    h->version = FST_VERSION;
+    h->byte_order = FST_BYTE_ORDER;
+    h->file_size = w->at;
+    h->built_at = (int64_t)time(NULL);
+    h->doc_count = (uint32_t)b->file_count;
+    h->term_count = (uint32_t)term_count;
+    h->tokens = tokens;
+    h->text_docs = text_docs;
+    h->docs_read = b->docs_read;
+    h->bytes_read = b->bytes_read;
+    h->text_size = text_used;
+    h->root = 0;
+    h->build_ns = fst_now() - started;
+    if (pwrite(fd, h, sizeof(*h), 0) != (ssize_t)sizeof(*h)) err = errno ? errno : EIO;
+
+done:
+    free(fresh);
+    free(w);
+    free(terms);
+    free(text);
+    free(scratch);
+    free(docs);
+    return err;
+}
+
+int fst_build(const char* root, const char* file, const char* const* extensions, const volatile int* cancel,
+              fst_stats* stats)
+{
+    uint64_t started = fst_now();
+    size_t length = strlen(root);
+    while (length > 1 && root[length - 1] == '/') length--;
+
+    struct stat st;
+    if (length == 0 || !extensions) return EINVAL;
+    if (length >= PATH_MAX) return ENAMETOOLONG;
+    if (stat(root, &st) != 0) return errno;
+    if (!S_ISDIR(st.st_mode)) return ENOTDIR;
+
+    fst_builder* b = calloc(1, sizeof(fst_builder));
+    if (!b) return ENOMEM;
+    char normalized[PATH_MAX];
+    memcpy(normalized, root, length);
+    normalized[length] = '\0';
+    b->cancel = cancel;
+    b->extensions = extensions;
+    b->skip = length == 1 ? 1 : length + 1;
+
+    fss_query walk;
+    fss_query_init(&walk);
+    walk.min_size = 0;             // asks the walk for size and mtime
+    int err = fss_search(normalized, &walk, fst_collect, b, cancel);
+    if (!err) err = b->err;
+
+    // Doc ids follow path order, so subtrees are contiguous and the ids of
+    // carried-over docs keep their relative order.
+    fst_sorted* sorted = NULL;
+    fst_file* files = NULL;
+    if (!err)
+    {
+        sorted = malloc((b->file_count ? b->file_count : 1) * sizeof(fst_sorted));
+        files = malloc((b->file_count ? b->file_count : 1) * sizeof(fst_file));
+        if (!sorted || !files) err = ENOMEM;
+    }
+    if (!err)
+    {
+        for (size_t i = 0; i < b->file_count; i++)
+        {
+            sorted[i].path = b->text + b->files[i].path;
+            sorted[i].file = (uint32_t)i;
+        }
+        qsort(sorted, b->file_count, sizeof(fst_sorted), fst_sorted_compare);
+        for (size_t i = 0; i < b->file_count; i++) files[i] = b->files[sorted[i].file];
+        free(b->files);
+        b->files = files;
+        files = NULL;
+    }
+
+    fst_index* old = NULL;
+    uint32_t* remap = NULL;
+    if (!err && fst_open(file, &old) == 0 && strcmp(fst_root(old), normalized) != 0)
+    {
+        fst_close(old);
+        old = NULL;
+    }
+    if (!err)
+    {
+        uint32_t old_docs = old ? old->header->doc_count : 0;
+        remap = malloc((old_docs ? old_docs : 1) * sizeof(uint32_t));
+        if (!remap) err = ENOMEM;
+        for (uint32_t k = 0; k < old_docs && remap; k++) remap[k] = FST_NONE;
+        uint32_t k = 0;
+        for (size_t i = 0; i < b->file_count && !err; i++)
+        {
+            fst_file* f = &b->files[i];
+            const char* path = b->text + f->path;
+            int d = 1;
+            while (k < old_docs && (d = strcmp(old->text + old->docs[k].path, path)) < 0) k++;
+            if (k < old_docs && d == 0 && old->docs[k].size == f->size && old->docs[k].mtime == f->mtime)
+            {
+                remap[k] = (uint32_t)i;
+                f->tokens = old->docs[k].tokens;
+                continue;
+            }
+            if (cancel && *cancel) err = ECANCELED;
+            else err = fst_read_file(b, normalized, length, (uint32_t)i);
+        }
+    }
+
+    fst_header h;
+    char temp[PATH_MAX];
+    if (!err && (size_t)snprintf(temp, sizeof(temp), "%s.tmp", file) >= sizeof(temp)) err = ENAMETOOLONG;
+    if (!err)
+    {
+        int fd = open(temp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) err = errno;
+        else
+        {
+            err = fst_write_index(b, old, remap, normalized, fd, started, &h);
+            if (close(fd) != 0 && !err) err = errno;
+            // The old mapping stays valid after the rename replaces its file.
+            if (!err && rename(temp, file) != 0) err = errno;
+            if (err) unlink(temp);
+        }
+    }
+    if (!err && stats)
+    {
+        memset(stats, 0, sizeof(*stats));
+        stats->docs = h.doc_count;
+        stats->terms = h.term_count;
+        stats->tokens = h.tokens;
+        stats->postings_size = h.postings_size;
+        stats->file_size = h.file_size;
+        stats->docs_read = h.docs_read;
+        stats->bytes_read = h.bytes_read;
+        stats->build_ns = h.build_ns;
+        stats->built_at = h.built_at;
+    }
+
+    fst_close(old);
+    free(remap);
+    free(sorted);
+    free(files);
+    for (size_t t = 0; t < b->term_count; t++) free(b->terms[t].postings);
+    free(b->terms);
+    free(b->term_text);
+    free(b->table);
+    free(b->pairs);
+    free(b->buffer);
+    free(b->text);
+    free(b->files);
+    free(b);
+    return err;
+}
+
+#pragma mark - Open
+
+static int fst_section_fits(const fst_header* h, uint64_t offset, uint64_t count, uint64_t size)
+{
+    return offset % 8 == 0 && offset >= sizeof(fst_header) && offset <= h->file_size
+        && count <= (h->file_size - offset) / size;
+}
+
+// Checks everything a search dereferences except the posting lists, which
+// are decoded with bounds checks.
+static int fst_validate(const fst_index* x)
+{
+    const fst_header* h = x->header;
+    if (!fst_section_fits(h, h->postings_offset, h->postings_size, 1)) return 0;
+    if (!fst_section_fits(h, h->docs_offset, h->doc_count, sizeof(fst_doc))) return 0;
+    if (!fst_section_fits(h, h->terms_offset, h->term_count, sizeof(fst_term))) return 0;
+    if (!fst_section_fits(h, h->text_offset, h->text_size, 1)) return 0;
+    if (h->text_size == 0 || h->text_size > UINT32_MAX || x->text[h->text_size - 1] != '\0' || h->root >= h->text_size)
+        return 0;
+    for (uint32_t d = 0; d < h->doc_count; d++)
+    {
+        if (x->docs[d].path >= h->text_size) return 0;
+        if (d && strcmp(x->text + x->docs[d - 1].path, x->text + x->docs[d].path) >= 0) return 0;
+    }
+    for (uint32_t t = 0; t < h->term_count; t++)
+    {
+        const fst_term* term = &x->terms[t];
+        if (term->text >= h->text_size || term->postings > h->postings_size
+            || term->length > h->postings_size - term->postings)
+            return 0;
+        if (t && strcmp(x->text + x->terms[t - 1].text, x->text + term->text) >= 0) return 0;
+    }
+    return 1;
+}
+
+int fst_open(const char* file, fst_index** out)
+{
+    *out = NULL;
+    int fd = open(file, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return errno;
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        int err = errno;
+        close(fd);
+        return err;
+    }
+    if ((uint64_t)st.st_size < sizeof(fst_header))
+    {
+        close(fd);
+        return EINVAL;
+    }
+    void* map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    int err = map == MAP_FAILED ? errno : 0;
+    close(fd);
+    if (err) return err;
+
+    fst_index* x = calloc(1, sizeof(fst_index));
+    if (!x)
+    {
+        munmap(map, (size_t)st.st_size);
+        return ENOMEM;
+    }
+    x->map = map;
+    x->map_size = (size_t)st.st_size;
+    x->header = map;
+    const fst_header* h = x->header;
+    const char* base = map;
+    if (memcmp(h->magic, FST_MAGIC, sizeof(FST_MAGIC)) != 0 || h->version != FST_VERSION
+        || h->byte_order != FST_BYTE_ORDER || h->file_size != (uint64_t)st.st_size)
+    {
+        fst_close(x);
+        return EINVAL;
+    }
+    x->postings = (const uint8_t*)(base + h->postings_offset);
+    x->docs = (const fst_doc*)(base + h->docs_offset);
+    x->terms = (const fst_term*)(base + h->terms_offset);
+    x->text = base + h->text_offset;
+    if (!fst_validate(x))
+    {
+        fst_close(x);
+        return EINVAL;
+    }
+    *out = x;
+    return 0;
+}
+
+void fst_close(fst_index* x)
+{
+    if (!x) return;
+    munmap(x->map, x->map_size);
+    free(x);
+}
+
+const char* fst_root(const fst_index* x)
+{
+    return x->text + x->header->root;
+}
+
+void fst_get_stats(const fst_index* x, fst_stats* stats)
+{
+    const fst_header* h = x->header;
+    memset(stats, 0, sizeof(*stats));
+    stats->docs = h->doc_count;
+    stats->terms = h->term_count;
+    stats->tokens = h->tokens;
+    stats->postings_size = h->postings_size;
+    stats->file_size = h->file_size;
+    stats->docs_read = h->docs_read;
+    stats->bytes_read = h->bytes_read;
+    stats->build_ns = h->build_ns;
+    stats->built_at = h->built_at;
+}
+
+#pragma mark - Search
+
+// Documents matched by a clause or a combination of clauses, by doc id.
+typedef struct fst_result
+{
+    uint32_t doc;
+    uint32_t count;
+    double score;
+} fst_result;
+
+typedef struct fst_results
+{
+    fst_result* items;
+    size_t count;
+    size_t capacity;
+} fst_results;
+
+typedef struct fst_clause
+{
+    uint32_t terms[FST_TERM_MAX];  // term indices of the phrase, FST_NONE if unknown
+    size_t count;
+    int negate;
+    int group;
+} fst_clause;
+
+typedef struct fst_parse
+{
+    const fst_index* index;
+    fst_clause* clause;
+} fst_parse;
+
+static uint32_t fst_find_term(const fst_index* x, const unsigned char* s, size_t n)
+{
+    size_t lo = 0;
+    size_t hi = x->header->term_count;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        const unsigned char* t = (const unsigned char*)x->text + x->terms[mid].text;
+        int d = strncmp((const char*)t, (const char*)s, n);
+        if (d == 0) d = t[n] != '\0';
+        if (d < 0) lo = mid + 1;
+        else if (d > 0) hi = mid;
+        else return (uint32_t)mid;
+    }
+    return FST_NONE;
+}
+
+static void fst_add_query_token(void* ctx, const unsigned char* s, size_t n)
+{
+    fst_parse* p = ctx;
+    if (p->clause->count < FST_TERM_MAX) p->clause->terms[p->clause->count++] = fst_find_term(p->index, s, n);
+}
+
+static int fst_push(fst_results* r, uint32_t doc, uint32_t count, double score)
+{
+    if (fst_grow((void**)&r->items, &r->capacity, r->count + 1, sizeof(fst_result))) return ENOMEM;
+    r->items[r->count++] = (fst_result){doc, count, score};
+    return 0;
+}
+
+static int fst_decode_positions(const fst_cursor* c, uint32_t** out, size_t* capacity)
+{
+    if (fst_grow((void**)out, capacity, c->tf, sizeof(uint32_t))) return ENOMEM;
+    const uint8_t* p = c->positions;
+    uint64_t position = 0;
+    for (uint32_t k = 0; k < c->tf; k++)
+    {
+        uint64_t delta = 0;
+        fst_get_varint(&p, c->positions + c->positions_length, &delta);
+        position += delta;
+        (*out)[k] = (uint32_t)position;
+    }
+    return 0;
+}
+
+// Counts the starts p in the first list with p + k in list k for every k.
+static uint32_t fst_phrase_count(uint32_t** lists, const uint32_t* lengths, size_t n)
+{
+    size_t at[FST_TERM_MAX] = {0};
+    uint32_t count = 0;
+    for (size_t i = 0; i < lengths[0]; i++)
+    {
+        uint32_t start = lists[0][i];
+        size_t k = 1;
+        for (; k < n; k++)
+        {
+            uint32_t want = start + (uint32_t)k;
+            while (at[k] < lengths[k] && lists[k][at[k]] < want) at[k]++;
+            if (at[k] == lengths[k]) return count;
+            if (lists[k][at[k]] != want) break;
+        }
+        count += k == n;
+    }
+    return count;
+}
+
+// Docs in [lo, hi) containing the clause, with its occurrence count.
+static int fst_match_clause(const fst_index* x, const fst_clause* c, uint32_t lo, uint32_t hi, fst_results* out)
+{
+    out->count = 0;
+    if (c->count == 0) return 0;
+    for (size_t k = 0; k < c->count; k++)
+    {
+        if (c->terms[k] == FST_NONE) return 0;
+    }
+    fst_cursor cursors[FST_TERM_MAX];
+    int live[FST_TERM_MAX];
+    for (size_t k = 0; k < c->count; k++)
+    {
+        const fst_term* t = &x->terms[c->terms[k]];
+        fst_cursor_init(&cursors[k], x->postings + t->postings, t->length, x->header->doc_count);
+        live[k] = fst_cursor_next(&cursors[k]);
+    }
+    if (c->count == 1)
+    {
+        for (; live[0]; live[0] = fst_cursor_next(&cursors[0]))
+        {
+            if (cursors[0].doc >= hi) break;
+            if (cursors[0].doc >= lo && fst_push(out, cursors[0].doc, cursors[0].tf, 0)) return ENOMEM;
+        }
+        return 0;
+    }
+
+    uint32_t* lists[FST_TERM_MAX] = {0};
+    size_t capacities[FST_TERM_MAX] = {0};
+    uint32_t lengths[FST_TERM_MAX];
+    int err = 0;
+    while (live[0] && cursors[0].doc < hi && !err)
+    {
+        uint32_t doc = cursors[0].doc;
+        int all = doc >= lo;
+        for (size_t k = 1; k < c->count && all; k++)
+        {
+            while (live[k] && cursors[k].doc < doc) live[k] = fst_cursor_next(&cursors[k]);
+            if (!live[k]) goto done;
+            all = cursors[k].doc == doc;
+        }
+        if (all)
+        {
+            for (size_t k = 0; k < c->count && !err; k++)
+            {
+                err = fst_decode_positions(&cursors[k], &lists[k], &capacities[k]);
+                lengths[k] = cursors[k].tf;
+            }
+            uint32_t n = err ? 0 : fst_phrase_count(lists, lengths, c->count);
+            if (n && fst_push(out, doc, n, 0)) err = ENOMEM;
+        }
+        live[0] = fst_cursor_next(&cursors[0]);
+    }
+done:
+    for (size_t k = 0; k < c->count; k++) free(lists[k]);
+    return err;
+}
+
+static void fst_score(const fst_index* x, fst_results* r, uint32_t docs)
+{
+    const fst_header* h = x->header;
+    double average = h->text_docs ? (double)h->tokens / (double)h->text_docs : 1;
+    double df = (double)r->count;
+    double idf = log(1 + ((double)docs - df + 0.5) / (df + 0.5));
+    for (size_t i = 0; i < r->count; i++)
+    {
+        double tf = r->items[i].count;
+        double length = x->docs[r->items[i].doc].tokens;
+        r->items[i].score = idf * tf * (FST_BM25_K1 + 1)
+                          / (tf + FST_BM25_K1 * (1 - FST_BM25_B + FST_BM25_B * length / average));
+    }
+}
+
+enum
+{
+    FST_UNION,
+    FST_INTERSECT,
+    FST_SUBTRACT,
+};
+
+// Combines two doc-sorted lists into out, adding counts and scores.
+static int fst_combine(const fst_results* a, const fst_results* b, int op, fst_results* out)
+{
+    out->count = 0;
+    size_t i = 0;
+    size_t j = 0;
+    while (i < a->count || (op == FST_UNION && j < b->count))
+    {
+        if (j == b->count || (i < a->count && a->items[i].doc < b->items[j].doc))
+        {
+            if (op != FST_INTERSECT && fst_push(out, a->items[i].doc, a->items[i].count, a->items[i].score)) return ENOMEM;
+            i++;
+        }
+        else if (i == a->count || b->items[j].doc < a->items[i].doc)
+        {
+            if (op == FST_UNION && fst_push(out, b->items[j].doc, b->items[j].count, b->items[j].score)) return ENOMEM;
+            j++;
+        }
+        else
+        {
+            const fst_result* x = &a->items[i++];
+            const fst_result* y = &b->items[j++];
+            if (op != FST_SUBTRACT && fst_push(out, x->doc, x->count + y->count, x->score + y->score)) return ENOMEM;
+        }
+    }
+    return 0;
+}
+
+// Replaces *into with the combination of *into and with.
+static int fst_apply(fst_results* into, const fst_results* with, int op, fst_results* scratch)
+{
+    int err = fst_combine(into, with, op, scratch);
+    fst_results t = *into;
+    *into = *scratch;
+    *scratch = t;
+    return err;
+}
+
+static int fst_result_compare(const void* a, const void* b)
+{
+    const fst_result* x = a;
+    const fst_result* y = b;
+    if (x->score != y->score) return x->score > y->score ? -1 : 1;
+    return x->doc < y->doc ? -1 : x->doc > y->doc;
+}
+
+// Splits a query into clauses; OR puts its neighbours into the same group.
+static size_t fst_parse_query(const fst_index* x, const char* query, fst_clause* clauses, size_t capacity)
+{
+    const unsigned char* s = (const unsigned char*)query;
+    size_t count = 0;
+    int group = -1;
+    int pending_or = 0;
+    for (;;)
+    {
+        while (*s == ' ' || *s == '\t' || *s == '\n' || *s == '\r' || (s[0] == 0xE3 && s[1] == 0x80 && s[2] == 0x80))
+            s += *s == 0xE3 ? 3 : 1;
+        if (!*s || count == capacity) break;
+        const unsigned char* start = s;
+        while (*s && *s != ' ' && *s != '\t' && *s != '\n' && *s != '\r' && *s != '"' && !(s[0] == 0xE3 && s[1] == 0x80 && s[2] == 0x80)) s++;
+        if (s - start == 2 && start[0] == 'O' && start[1] == 'R' && count)
+        {
+            pending_or = 1;
+            continue;
+        }
+        s = start;
+        fst_clause* c = &clauses[count];
+        c->count = 0;
+        c->negate = *s == '-';
+        if (c->negate) s++;
+        const unsigned char* text = s;
+        size_t length;
+        if (*s == '"')
+        {
+            text = ++s;
+            while (*s && *s != '"') s++;
+            length = (size_t)(s - text);
+            if (*s) s++;
+        }
+        else
+        {
+            while (*s && *s != ' ' && *s != '\t' && *s != '\n' && *s != '\r' && !(s[0] == 0xE3 && s[1] == 0x80 && s[2] == 0x80)) s++;
+            length = (size_t)(s - text);
+        }
+        fst_parse p = {x, c};
+        fst_tokenize(text, length, fst_add_query_token, &p);
+        if (c->count == 0) continue;
+        int joins = pending_or && !c->negate && !clauses[count - 1].negate;
+        c->group = joins ? group : ++group;
+        pending_or = 0;
+        count++;
+    }
+    return count;
+}
+
+// Finds the doc ids under root, a subtree of the index root.
+static int fst_range(const fst_index* x, const char* root, uint32_t* lo, uint32_t* hi)
+{
+    const char* base = fst_root(x);
+    size_t base_length = strlen(base);
+    size_t length = strlen(root);
+    while (length > 1 && root[length - 1] == '/') length--;
+    *lo = 0;
+    *hi = x->header->doc_count;
+    if (length == base_length && strncmp(root, base, length) == 0) return 0;
+    size_t skip = base_length == 1 ? 1 : base_length + 1;
+    if (length <= skip || strncmp(root, base, base_length) != 0 || root[skip - 1] != '/') return ENOENT;
+
+    char prefix[PATH_MAX];
+    size_t n = length - skip;
+    if (n + 2 > sizeof(prefix)) return ENOENT;
+    memcpy(prefix, root + skip, n);
+    prefix[n++] = '/';
+    prefix[n] = '\0';
+    size_t a = 0;
+    size_t b = x->header->doc_count;
+    while (a < b)
+    {
+        size_t mid = a + (b - a) / 2;
+        if (strncmp(x->text + x->docs[mid].path, prefix, n) < 0) a = mid + 1;
+        else b = mid;
+    }
+    *lo = (uint32_t)a;
+    b = x->header->doc_count;
+    while (a < b)
+    {
+        size_t mid = a + (b - a) / 2;
+        if (strncmp(x->text + x->docs[mid].path, prefix, n) <= 0) a = mid + 1;
+        else b = mid;
+    }
+    *hi = (uint32_t)a;
+    return 0;
+}
+
+int fst_search(const fst_index* x, const char* root, const char* query, fst_hit* hits, size_t capacity, size_t* count)
+{
+    *count = 0;
+    uint32_t lo;
+    uint32_t hi;
+    int err = fst_range(x, root, &lo, &hi);
+    if (err) return err;
+
+    fst_clause clauses[32];
+    size_t clause_count = fst_parse_query(x, query, clauses, sizeof(clauses) / sizeof(clauses[0]));
+    int groups = 0;
+    for (size_t i = 0; i < clause_count; i++) groups += !clauses[i].negate && (i == 0 || clauses[i].group != clauses[i - 1].group);
+    if (groups == 0) return EINVAL;
+
+    fst_results matched = {0};
+    fst_results group = {0};
+    fst_results clause = {0};
+    fst_results scratch = {0};
+    int have = 0;
+    for (size_t i = 0; i < clause_count && !err; i++)
+    {
+        if (clauses[i].negate) continue;
+        err = fst_match_clause(x, &clauses[i], lo, hi, &clause);
+        if (err) break;
+        fst_score(x, &clause, hi - lo);
+        err = fst_apply(&group, &clause, FST_UNION, &scratch);
+        int last = i + 1 == clause_count || clauses[i + 1].group != clauses[i].group;
+        if (err || !last) continue;
+        if (have) err = fst_apply(&matched, &group, FST_INTERSECT, &scratch);
+        else err = fst_apply(&matched, &group, FST_UNION, &scratch);
+        have = 1;
+        group.count = 0;
+    }
+    for (size_t i = 0; i < clause_count && !err && matched.count; i++)
+    {
+        if (!clauses[i].negate) continue;
+        err = fst_match_clause(x, &clauses[i], lo, hi, &clause);
+        if (!err) err = fst_apply(&matched, &clause, FST_SUBTRACT, &scratch);
+    }
+
+    if (!err)
+    {
+        if (matched.count) qsort(matched.items, matched.count, sizeof(fst_result), fst_result_compare);
+        size_t n = matched.count < capacity ? matched.count : capacity;
+        for (size_t i = 0; i < n; i++)
+        {
+            const fst_doc* d = &x->docs[matched.items[i].doc];
+            hits[i].path = x->text + d->path;
+            hits[i].score = matched.items[i].score;
+            hits[i].count = matched.items[i].count;
+            hits[i].size = d->size;
+            hits[i].mtime = d->mtime;
+        }
+        *count = n;
+    }
+    free(matched.items);
+    free(group.items);
+    free(clause.items);
+    free(scratch.items);
+    return err;
+}
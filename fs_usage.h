@@ -0,0 +1,92 @@
+// File: fs_usage.h
+// Location: プロジェクト直下
+
+#ifndef FS_USAGE_H
+#define FS_USAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Recursive disk usage. fsu_scan walks a tree on a pool of threads, reading
+// each folder with readdir and fstatat, and keeps one record per folder: its
+// own entries' apparent and allocated sizes and the names of its subfolders.
+// Files with more than one link are counted once per (device, inode), like du.
+//
+// A later scan handed the previous one reuses the record of every folder
+// whose device, inode and mtime are unchanged, so only changed folders are
+// read again and the rest cost one lstat each. A folder's mtime changes when
+// entries are added, removed or renamed (which includes atomic saves), not
+// when a file in it is rewritten in place; pass FSU_FULL to read everything.
+
+enum
+{
+    FSU_FULL = 1 << 0,             // ignore the previous scan
+};
+
+typedef struct fsu_totals
+{
+    uint64_t apparent;             // st_size
+    uint64_t allocated;            // st_blocks * 512
+    uint64_t files;                // everything that is not a folder
+    uint64_t dirs;                 // the folder itself included
+} fsu_totals;
+
+typedef struct fsu_stats
+{
+    uint64_t dirs_read;            // folders listed by this scan
+    uint64_t dirs_reused;          // folders taken over from the previous scan
+    uint64_t errors;               // folders that could not be read
+    uint64_t scan_ns;
+} fsu_stats;
+
+typedef struct fsu_progress
+{
+    uint64_t dirs;
+    uint64_t files;
+    uint64_t allocated;
+} fsu_progress;
+
+// Called from a walker thread, one call at a time.
+typedef void (*fsu_progress_fn)(void* ctx, const fsu_progress* progress);
+
+typedef struct fsu_options
+{
+    int flags;
+    int threads;                   // 0 picks two per core, for I/O latency
+    fsu_progress_fn progress;      // may be NULL
+    void* ctx;
+    uint64_t interval_ns;
+} fsu_options;
+
+typedef struct fsu_usage fsu_usage;
+
+typedef struct fsu_entry
+{
+    const char* name;
+    int is_dir;
+    fsu_totals totals;             // the whole subtree for a folder
+} fsu_entry;
+
+void fsu_options_init(fsu_options* options);
+
+// Scans root. previous may be NULL or any earlier scan, of root or of a tree
+// that overlaps it, and may be freed as soon as this returns. Returns 0,
+// ECANCELED, ENOMEM or an errno value for root; folders below root that
+// cannot be read are counted in fsu_stats.errors.
+int fsu_scan(const char* root, const fsu_usage* previous, const fsu_options* options, const volatile int* cancel,
+             fsu_usage** out);
+void fsu_free(fsu_usage* usage);
+
+const char* fsu_root(const fsu_usage* usage);
+void fsu_get_stats(const fsu_usage* usage, fsu_stats* stats);
+
+// Totals of root or a folder below it; ENOENT when the scan does not have it.
+int fsu_totals_at(const fsu_usage* usage, const char* path, fsu_totals* totals);
+
+// The entries directly inside path, largest allocated size first, for a
+// treemap: folders from the scan, files read from disk now. Writes at most
+// limit entries to a block the caller frees with free(); names live in the
+// same block. Returns 0, ENOENT or ENOMEM.
+int fsu_largest(const fsu_usage* usage, const char* path, size_t limit, fsu_entry** out, size_t* count);
+
+#endif
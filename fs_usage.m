@@ -0,0 +1,706 @@
+// File: fs_usage.c
+// Location: プロジェクト直下
+
+#include "fs_usage.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__APPLE__)
+#define FSU_MTIME(st) ((st)->st_mtimespec)
+#else
+#define FSU_MTIME(st) ((st)->st_mtim)
+#endif
+
+#define FSU_BLOCK_SHIFT 12
+#define FSU_BLOCK (1u << FSU_BLOCK_SHIFT)
+#define FSU_MAX_BLOCKS 16384               // 64M folders
+#define FSU_MAX_THREADS 32
+#define FSU_MAX_DEPTH 1024
+#define FSU_NONE UINT32_MAX
+#define FSU_DEFAULT_INTERVAL_NS 100000000ULL
+// An mtime this close to when the previous scan started may hide a change
+// made in the same clock tick, so that folder is read again.
+#define FSU_RACY_NS 2000000000LL
+
+typedef struct fsu_link
+{
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t apparent;
+    uint64_t allocated;
+} fsu_link;
+
+typedef struct fsu_node
+{
+    uint32_t parent;
+    uint32_t first_child;          // linked once the walk is over
+    uint32_t next_sibling;
+    uint32_t link_count;
+    uint32_t child_count;
+    int error;                     // errno when the folder could not be read
+    char* name;                    // the root's is the root path
+    char* children;                // subfolder names, each NUL-terminated
+    size_t children_size;
+    fsu_link* links;               // entries with more than one link
+    uint64_t dev;
+    uint64_t ino;
+    int64_t mtime_ns;
+    fsu_totals own;                // the folder itself and its other single-link entries
+    fsu_totals total;
+} fsu_node;
+
+struct fsu_usage
+{
+    char* root;
+    fsu_node** blocks;
+    uint32_t count;
+    int64_t started_ns;            // wall clock
+    fsu_stats stats;
+};
+
+typedef struct fsu_walk
+{
+    fsu_usage* u;
+    const fsu_usage* previous;
+    uint32_t* old;                 // (dev, inode) -> previous node + 1
+    size_t old_mask;
+    const fsu_options* options;
+    const volatile int* cancel;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t* stack;
+    size_t stack_count;
+    size_t stack_capacity;
+    size_t busy;
+    int err;
+    _Atomic uint64_t files;
+    _Atomic uint64_t allocated;
+    _Atomic uint64_t dirs_read;
+    _Atomic uint64_t dirs_reused;
+    _Atomic uint64_t errors;
+    uint64_t last_report;
+} fsu_walk;
+
+static uint64_t fsu_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int fsu_cancelled(const volatile int* cancel)
+{
+    return cancel && *cancel;
+}
+
+static fsu_node* fsu_get(const fsu_usage* u, uint32_t index)
+{
+    return &u->blocks[index >> FSU_BLOCK_SHIFT][index & (FSU_BLOCK - 1)];
+}
+
+static uint64_t fsu_hash(uint64_t dev, uint64_t ino)
+{
+    uint64_t h = (ino ^ (dev * 0x9E3779B97F4A7C15ULL)) * 0xBF58476D1CE4E5B9ULL;
+    return h ^ (h >> 31);
+}
+
+static void fsu_add(fsu_totals* to, const fsu_totals* from)
+{
+    to->apparent += from->apparent;
+    to->allocated += from->allocated;
+    to->files += from->files;
+    to->dirs += from->dirs;
+}
+
+#pragma mark - Nodes
+
+// Called with the walk lock held. Node addresses never move, so workers use
+// them without the lock.
+static int fsu_new_node(fsu_usage* u, uint32_t* out)
+{
+    uint32_t index = u->count;
+    size_t block = index >> FSU_BLOCK_SHIFT;
+    if (block >= FSU_MAX_BLOCKS) return ENOMEM;
+    if (!u->blocks[block])
+    {
+        u->blocks[block] = calloc(FSU_BLOCK, sizeof(fsu_node));
+        if (!u->blocks[block]) return ENOMEM;
+    }
+    fsu_node* n = fsu_get(u, index);
+    n->parent = FSU_NONE;
+    n->first_child = FSU_NONE;
+    n->next_sibling = FSU_NONE;
+    u->count++;
+    *out = index;
+    return 0;
+}
+
+static int fsu_path(const fsu_usage* u, uint32_t index, char* path)
+{
+    const char* parts[FSU_MAX_DEPTH];
+    size_t depth = 0;
+    for (uint32_t i = index; i != FSU_NONE; i = fsu_get(u, i)->parent)
+    {
+        if (depth == FSU_MAX_DEPTH) return ELOOP;
+        parts[depth++] = fsu_get(u, i)->name;
+    }
+    size_t length = 0;
+    while (depth-- > 0)
+    {
+        size_t n = strlen(parts[depth]);
+        int slash = length > 0 && path[length - 1] != '/';
+        if (length + slash + n >= PATH_MAX) return ENAMETOOLONG;
+        if (slash) path[length++] = '/';
+        memcpy(path + length, parts[depth], n);
+        length += n;
+    }
+    path[length] = '\0';
+    return 0;
+}
+
+static const fsu_node* fsu_find_old(const fsu_walk* w, uint64_t dev, uint64_t ino)
+{
+    if (!w->old) return NULL;
+    for (size_t i = fsu_hash(dev, ino) & w->old_mask; w->old[i]; i = (i + 1) & w->old_mask)
+    {
+        const fsu_node* n = fsu_get(w->previous, w->old[i] - 1);
+        if (n->dev == dev && n->ino == ino) return n;
+    }
+    return NULL;
+}
+
+static int fsu_index_previous(fsu_walk* w)
+{
+    const fsu_usage* p = w->previous;
+    size_t capacity = 64;
+    while (capacity < (size_t)p->count * 2) capacity *= 2;
+    w->old = calloc(capacity, sizeof(uint32_t));
+    if (!w->old) return ENOMEM;
+    w->old_mask = capacity - 1;
+    for (uint32_t k = 0; k < p->count; k++)
+    {
+        const fsu_node* n = fsu_get(p, k);
+        if (n->error) continue;
+        size_t i = fsu_hash(n->dev, n->ino) & w->old_mask;
+        while (w->old[i]) i = (i + 1) & w->old_mask;
+        w->old[i] = k + 1;
+    }
+    return 0;
+}
+
+#pragma mark - Walk
+
+static int fsu_append_child(fsu_node* n, size_t* capacity, const char* name)
+{
+    size_t length = strlen(name) + 1;
+    if (n->children_size + length > *capacity)
+    {
+        size_t grown = *capacity ? *capacity * 2 : 256;
+        while (grown < n->children_size + length) grown *= 2;
+        char* children = realloc(n->children, grown);
+        if (!children) return ENOMEM;
+        n->children = children;
+        *capacity = grown;
+    }
+    memcpy(n->children + n->children_size, name, length);
+    n->children_size += length;
+    n->child_count++;
+    return 0;
+}
+
+static int fsu_append_link(fsu_node* n, uint32_t* capacity, const struct stat* st)
+{
+    if (n->link_count == *capacity)
+    {
+        uint32_t grown = *capacity ? *capacity * 2 : 8;
+        fsu_link* links = realloc(n->links, grown * sizeof(fsu_link));
+        if (!links) return ENOMEM;
+        n->links = links;
+        *capacity = grown;
+    }
+    fsu_link* l = &n->links[n->link_count++];
+    l->dev = (uint64_t)st->st_dev;
+    l->ino = (uint64_t)st->st_ino;
+    l->apparent = (uint64_t)st->st_size;
+    l->allocated = (uint64_t)st->st_blocks * 512;
+    return 0;
+}
+
+static int fsu_reuse(fsu_node* n, const fsu_node* old)
+{
+    n->own = old->own;
+    if (old->children_size)
+    {
+        n->children = malloc(old->children_size);
+        if (!n->children) return ENOMEM;
+        memcpy(n->children, old->children, old->children_size);
+        n->children_size = old->children_size;
+        n->child_count = old->child_count;
+    }
+    if (old->link_count)
+    {
+        n->links = malloc(old->link_count * sizeof(fsu_link));
+        if (!n->links) return ENOMEM;
+        memcpy(n->links, old->links, old->link_count * sizeof(fsu_link));
+        n->link_count = old->link_count;
+    }
+    return 0;
+}
+
+static int fsu_read(fsu_node* n, const char* path)
+{
+    DIR* dir = opendir(path);
+    if (!dir) return errno;
+    int fd = dirfd(dir);
+    size_t children_capacity = 0;
+    uint32_t links_capacity = 0;
+    int err = 0;
+    struct dirent* e;
+    while (!err && (e = readdir(dir)))
+    {
+        const char* name = e->d_name;
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+        struct stat st;
+        if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) continue;
+        if (S_ISDIR(st.st_mode)) err = fsu_append_child(n, &children_capacity, name);
+        else if (st.st_nlink > 1) err = fsu_append_link(n, &links_capacity, &st);
+        else
+        {
+            n->own.apparent += (uint64_t)st.st_size;
+            n->own.allocated += (uint64_t)st.st_blocks * 512;
+            n->own.files++;
+        }
+    }
+    closedir(dir);
+    return err;
+}
+
+static void fsu_report(fsu_walk* w, int force)
+{
+    if (!w->options->progress) return;
+    uint64_t now = fsu_now();
+    if (!force && now - w->last_report < w->options->interval_ns) return;
+    w->last_report = now;
+    fsu_progress p;
+    p.dirs = w->u->count;
+    p.files = atomic_load(&w->files);
+    p.allocated = atomic_load(&w->allocated);
+    w->options->progress(w->options->ctx, &p);
+}
+
+// Lists (or takes over) one folder and queues its subfolders.
+static int fsu_visit(fsu_walk* w, uint32_t index, char* path)
+{
+    fsu_usage* u = w->u;
+    fsu_node* n = fsu_get(u, index);
+    struct stat st;
+    int err = fsu_path(u, index, path);
+    if (!err && (index == 0 ? stat(path, &st) : lstat(path, &st)) != 0) err = errno;
+    if (err)
+    {
+        n->error = err;
+        atomic_fetch_add(&w->errors, 1);
+        return 0;
+    }
+    n->dev = (uint64_t)st.st_dev;
+    n->ino = (uint64_t)st.st_ino;
+    n->mtime_ns = (int64_t)FSU_MTIME(&st).tv_sec * 1000000000LL + FSU_MTIME(&st).tv_nsec;
+    const fsu_node* old = fsu_find_old(w, n->dev, n->ino);
+    if (old && old->mtime_ns == n->mtime_ns && n->mtime_ns < w->previous->started_ns - FSU_RACY_NS)
+    {
+        err = fsu_reuse(n, old);
+        atomic_fetch_add(&w->dirs_reused, 1);
+    }
+    else
+    {
+        n->own.apparent = (uint64_t)st.st_size;
+        n->own.allocated = (uint64_t)st.st_blocks * 512;
+        err = fsu_read(n, path);
+        if (err && err != ENOMEM)
+        {
+            n->error = err;
+            atomic_fetch_add(&w->errors, 1);
+            err = 0;
+        }
+        atomic_fetch_add(&w->dirs_read, 1);
+    }
+    n->own.dirs = 1;
+    if (err) return err;
+    atomic_fetch_add(&w->files, n->own.files + n->link_count);
+    atomic_fetch_add(&w->allocated, n->own.allocated);
+
+    pthread_mutex_lock(&w->lock);
+    size_t needed = w->stack_count + n->child_count;
+    if (needed > w->stack_capacity)
+    {
+        size_t capacity = w->stack_capacity ? w->stack_capacity : 1024;
+        while (capacity < needed) capacity *= 2;
+        uint32_t* stack = realloc(w->stack, capacity * sizeof(uint32_t));
+        if (stack)
+        {
+            w->stack = stack;
+            w->stack_capacity = capacity;
+        }
+        else err = ENOMEM;
+    }
+    const char* name = n->children;
+    for (uint32_t i = 0; i < n->child_count && !err; i++, name += strlen(name) + 1)
+    {
+        uint32_t child;
+        err = fsu_new_node(u, &child);
+        if (err) break;
+        fsu_node* c = fsu_get(u, child);
+        c->parent = index;
+        c->name = strdup(name);
+        if (!c->name) err = ENOMEM;
+        w->stack[w->stack_count++] = child;
+    }
+    fsu_report(w, 0);
+    pthread_mutex_unlock(&w->lock);
+    return err;
+}
+
+static void* fsu_worker_main(void* arg)
+{
+    fsu_walk* w = arg;
+    char* path = malloc(PATH_MAX);
+    pthread_mutex_lock(&w->lock);
+    if (!path && !w->err) w->err = ENOMEM;
+    for (;;)
+    {
+        while (w->stack_count == 0 && w->busy > 0 && !w->err && !fsu_cancelled(w->cancel))
+            pthread_cond_wait(&w->cond, &w->lock);
+        if (w->stack_count == 0 || w->err || fsu_cancelled(w->cancel)) break;
+        uint32_t index = w->stack[--w->stack_count];
+        w->busy++;
+        pthread_mutex_unlock(&w->lock);
+        int err = fsu_visit(w, index, path);
+        pthread_mutex_lock(&w->lock);
+        if (err && !w->err) w->err = err;
+        w->busy--;
+        pthread_cond_broadcast(&w->cond);
+    }
+    pthread_cond_broadcast(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+    free(path);
+    return NULL;
+}
+
+// Adds every folder's totals to its parent, children first (a child always
+// has a larger index), and counts each multiply linked file once.
+static int fsu_sum(fsu_usage* u)
+{
+    size_t links = 0;
+    for (uint32_t i = 0; i < u->count; i++) links += fsu_get(u, i)->link_count;
+    size_t capacity = 64;
+    while (capacity < links * 2) capacity *= 2;
+    fsu_link** seen = links ? calloc(capacity, sizeof(fsu_link*)) : NULL;
+    if (links && !seen) return ENOMEM;
+    for (uint32_t i = u->count; i-- > 0;)
+    {
+        fsu_node* n = fsu_get(u, i);
+        fsu_add(&n->total, &n->own);
+        for (uint32_t k = 0; k < n->link_count; k++)
+        {
+            fsu_link* l = &n->links[k];
+            size_t slot = fsu_hash(l->dev, l->ino) & (capacity - 1);
+            while (seen[slot] && (seen[slot]->dev != l->dev || seen[slot]->ino != l->ino)) slot = (slot + 1) & (capacity - 1);
+            if (seen[slot]) continue;
+            seen[slot] = l;
+            n->total.apparent += l->apparent;
+            n->total.allocated += l->allocated;
+            n->total.files++;
+        }
+        if (n->parent == FSU_NONE) continue;
+        fsu_node* p = fsu_get(u, n->parent);
+        fsu_add(&p->total, &n->total);
+        n->next_sibling = p->first_child;
+        p->first_child = i;
+    }
+    free(seen);
+    return 0;
+}
+
+#pragma mark - Public
+
+void fsu_options_init(fsu_options* options)
+{
+    memset(options, 0, sizeof(*options));
+    options->interval_ns = FSU_DEFAULT_INTERVAL_NS;
+}
+
+static size_t fsu_trim(const char* path)
+{
+    size_t length = strlen(path);
+    while (length > 1 && path[length - 1] == '/') length--;
+    return length;
+}
+
+int fsu_scan(const char* root, const fsu_usage* previous, const fsu_options* options, const volatile int* cancel,
+             fsu_usage** out)
+{
+    *out = NULL;
+    fsu_options defaults;
+    if (!options)
+    {
+        fsu_options_init(&defaults);
+        options = &defaults;
+    }
+    struct stat st;
+    if (stat(root, &st) != 0) return errno;
+    if (!S_ISDIR(st.st_mode)) return ENOTDIR;
+    size_t length = fsu_trim(root);
+    if (length >= PATH_MAX) return ENAMETOOLONG;
+
+    uint64_t started = fsu_now();
+    struct timespec wall;
+    clock_gettime(CLOCK_REALTIME, &wall);
+    fsu_usage* u = calloc(1, sizeof(fsu_usage));
+    fsu_walk* w = calloc(1, sizeof(fsu_walk));
+    int err = u && w ? 0 : ENOMEM;
+    if (!err)
+    {
+        u->started_ns = (int64_t)wall.tv_sec * 1000000000LL + wall.tv_nsec;
+        u->root = strndup(root, length);
+        u->blocks = calloc(FSU_MAX_BLOCKS, sizeof(fsu_node*));
+        if (!u->root || !u->blocks) err = ENOMEM;
+    }
+    if (!err)
+    {
+        w->u = u;
+        w->options = options;
+        w->cancel = cancel;
+        if (previous && !(options->flags & FSU_FULL))
+        {
+            w->previous = previous;
+            err = fsu_index_previous(w);
+        }
+    }
+    uint32_t first;
+    if (!err) err = fsu_new_node(u, &first);
+    if (!err)
+    {
+        fsu_get(u, first)->name = strdup(u->root);
+        w->stack = malloc(1024 * sizeof(uint32_t));
+        w->stack_capacity = 1024;
+        if (!fsu_get(u, first)->name || !w->stack) err = ENOMEM;
+    }
+    if (err)
+    {
+        if (w) free(w->old);
+        if (w) free(w->stack);
+        free(w);
+        fsu_free(u);
+        return err;
+    }
+    w->stack[w->stack_count++] = first;
+
+    int threads = options->threads;
+    if (threads <= 0) threads = 2 * (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads < 1) threads = 1;
+    if (threads > FSU_MAX_THREADS) threads = FSU_MAX_THREADS;
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->cond, NULL);
+    pthread_t workers[FSU_MAX_THREADS];
+    // The calling thread is worker 0.
+    int started_threads = 1;
+    for (; started_threads < threads; started_threads++)
+        if (pthread_create(&workers[started_threads], NULL, fsu_worker_main, w) != 0) break;
+    fsu_worker_main(w);
+    for (int i = 1; i < started_threads; i++) pthread_join(workers[i], NULL);
+    pthread_mutex_destroy(&w->lock);
+    pthread_cond_destroy(&w->cond);
+
+    err = w->err;
+    if (!err && fsu_cancelled(cancel)) err = ECANCELED;
+    if (!err) err = fsu_sum(u);
+    if (!err)
+    {
+        fsu_report(w, 1);
+        u->stats.dirs_read = atomic_load(&w->dirs_read);
+        u->stats.dirs_reused = atomic_load(&w->dirs_reused);
+        u->stats.errors = atomic_load(&w->errors);
+        u->stats.scan_ns = fsu_now() - started;
+    }
+    free(w->old);
+    free(w->stack);
+    free(w);
+    if (err)
+    {
+        fsu_free(u);
+        return err;
+    }
+    *out = u;
+    return 0;
+}
+
+void fsu_free(fsu_usage* usage)
+{
+    if (!usage) return;
+    for (uint32_t i = 0; usage->blocks && i < usage->count; i++)
+    {
+        fsu_node* n = fsu_get(usage, i);
+        free(n->name);
+        free(n->children);
+        free(n->links);
+    }
+    for (size_t b = 0; usage->blocks && b < FSU_MAX_BLOCKS && usage->blocks[b]; b++) free(usage->blocks[b]);
+    free(usage->blocks);
+    free(usage->root);
+    free(usage);
+}
+
+const char* fsu_root(const fsu_usage* usage)
+{
+    return usage->root;
+}
+
+void fsu_get_stats(const fsu_usage* usage, fsu_stats* stats)
+{
+    *stats = usage->stats;
+}
+
+static const fsu_node* fsu_lookup(const fsu_usage* u, const char* path)
+{
+    size_t root_length = strlen(u->root);
+    size_t length = fsu_trim(path);
+    if (strncmp(path, u->root, root_length) != 0) return NULL;
+    const char* rest = path + root_length;
+    if (root_length > 1 && rest < path + length && *rest != '/') return NULL;
+    const fsu_node* n = fsu_get(u, 0);
+    const char* end = path + length;
+    while (rest < end)
+    {
+        while (rest < end && *rest == '/') rest++;
+        if (rest >= end) break;
+        const char* slash = memchr(rest, '/', (size_t)(end - rest));
+        size_t part = slash ? (size_t)(slash - rest) : (size_t)(end - rest);
+        const fsu_node* found = NULL;
+        for (uint32_t c = n->first_child; c != FSU_NONE && !found; c = fsu_get(u, c)->next_sibling)
+        {
+            const fsu_node* child = fsu_get(u, c);
+            if (strncmp(child->name, rest, part) == 0 && child->name[part] == '\0') found = child;
+        }
+        if (!found) return NULL;
+        n = found;
+        rest += part;
+    }
+    return n;
+}
+
+int fsu_totals_at(const fsu_usage* usage, const char* path, fsu_totals* totals)
+{
+    const fsu_node* n = fsu_lookup(usage, path);
+    if (!n) return ENOENT;
+    *totals = n->total;
+    return 0;
+}
+
+static int fsu_compare_entries(const void* a, const void* b)
+{
+    const fsu_entry* x = a;
+    const fsu_entry* y = b;
+    if (x->totals.allocated != y->totals.allocated) return x->totals.allocated < y->totals.allocated ? 1 : -1;
+    return strcmp(x->name, y->name);
+}
+
+int fsu_largest(const fsu_usage* usage, const char* path, size_t limit, fsu_entry** out, size_t* count)
+{
+    *out = NULL;
+    *count = 0;
+    const fsu_node* n = fsu_lookup(usage, path);
+    if (!n) return ENOENT;
+
+    // Names point into the node or into the dirent copies until the block is packed.
+    size_t capacity = 64;
+    size_t used = 0;
+    fsu_entry* entries = malloc(capacity * sizeof(fsu_entry));
+    char** owned = calloc(capacity, sizeof(char*));
+    int err = entries && owned ? 0 : ENOMEM;
+    for (uint32_t c = n->first_child; c != FSU_NONE && !err; c = fsu_get(usage, c)->next_sibling)
+    {
+        if (used == capacity)
+        {
+            capacity *= 2;
+            fsu_entry* grown = realloc(entries, capacity * sizeof(fsu_entry));
+            char** grown_owned = grown ? realloc(owned, capacity * sizeof(char*)) : NULL;
+            if (grown) entries = grown;
+            if (grown_owned) owned = grown_owned;
+            if (!grown || !grown_owned)
+            {
+                err = ENOMEM;
+                break;
+            }
+        }
+        const fsu_node* child = fsu_get(usage, c);
+        entries[used] = (fsu_entry){child->name, 1, child->total};
+        owned[used++] = NULL;
+    }
+    DIR* dir = err ? NULL : opendir(path);
+    struct dirent* e;
+    while (dir && !err && (e = readdir(dir)))
+    {
+        struct stat st;
+        if (fstatat(dirfd(dir), e->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0 || S_ISDIR(st.st_mode)) continue;
+        if (used == capacity)
+        {
+            capacity *= 2;
+            fsu_entry* grown = realloc(entries, capacity * sizeof(fsu_entry));
+            char** grown_owned = grown ? realloc(owned, capacity * sizeof(char*)) : NULL;
+            if (grown) entries = grown;
+            if (grown_owned) owned = grown_owned;
+            if (!grown || !grown_owned)
+            {
+                err = ENOMEM;
+                break;
+            }
+        }
+        char* name = strdup(e->d_name);
+        if (!name)
+        {
+            err = ENOMEM;
+            break;
+        }
+        fsu_totals totals = {(uint64_t)st.st_size, (uint64_t)st.st_blocks * 512, 1, 0};
+        entries[used] = (fsu_entry){name, 0, totals};
+        owned[used++] = name;
+    }
+    if (dir) closedir(dir);
+
+    if (!err)
+    {
+        qsort(entries, used, sizeof(fsu_entry), fsu_compare_entries);
+        size_t keep = used < limit ? used : limit;
+        size_t names = 0;
+        for (size_t i = 0; i < keep; i++) names += strlen(entries[i].name) + 1;
+        fsu_entry* block = malloc(keep * sizeof(fsu_entry) + names + 1);
+        if (!block) err = ENOMEM;
+        else
+        {
+            char* text = (char*)(block + keep);
+            for (size_t i = 0; i < keep; i++)
+            {
+                size_t n_length = strlen(entries[i].name) + 1;
+                memcpy(text, entries[i].name, n_length);
+                block[i] = entries[i];
+                block[i].name = text;
+                text += n_length;
+            }
+            *out = block;
+            *count = keep;
+        }
+    }
+    for (size_t i = 0; owned && i < used; i++) free(owned[i]);
+    free(owned);
+    free(entries);
+    return err;
+}
@@ -0,0 +1,23 @@
+// File: fs_watch.h
+// Location: プロジェクト直下
+
+#ifndef FS_WATCH_H
+#define FS_WATCH_H
+
+// Directory change notifications behind one interface: inotify on Linux,
+// kqueue (EVFILT_VNODE) on Darwin and the BSDs. The callback runs on the
+// watcher's own thread and only says that path changed, not how.
+
+typedef void (*fs_watch_fn)(void* ctx, const char* path);
+
+typedef struct fs_watcher fs_watcher;
+
+fs_watcher* fs_watch_create(fs_watch_fn fn, void* ctx);
+void fs_watch_destroy(fs_watcher* watcher);
+
+// Watches the entries of a single directory (not recursive). Returns 0 or an
+// errno value; ENOTSUP when the platform has no backend.
+int fs_watch_add(fs_watcher* watcher, const char* path);
+void fs_watch_remove(fs_watcher* watcher, const char* path);
+
+#endif
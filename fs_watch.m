@@ -0,0 +1,333 @@
+// File: fs_watch.c
+// Location: プロジェクト直下
+
+#include "fs_watch.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#define FS_WATCH_INOTIFY 1
+#include <poll.h>
+#include <sys/inotify.h>
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__)
+#define FS_WATCH_KQUEUE 1
+#include <sys/event.h>
+#endif
+
+typedef struct fs_watch_entry
+{
+    char* path;
+    int id;                        // inotify watch descriptor or kqueue fd
+} fs_watch_entry;
+
+struct fs_watcher
+{
+    fs_watch_fn fn;
+    void* ctx;
+    int queue;                     // inotify or kqueue descriptor
+    int wake[2];                   // pipe that stops the thread
+    pthread_t thread;
+    pthread_mutex_t lock;
+    fs_watch_entry* entries;
+    size_t count;
+    size_t capacity;
+};
+
+#pragma mark - Entries
+
+static ssize_t fs_watch_find_path(fs_watcher* w, const char* path)
+{
+    for (size_t i = 0; i < w->count; i++)
+    {
+        if (strcmp(w->entries[i].path, path) == 0) return (ssize_t)i;
+    }
+    return -1;
+}
+
+static ssize_t fs_watch_find_id(fs_watcher* w, int id)
+{
+    for (size_t i = 0; i < w->count; i++)
+    {
+        if (w->entries[i].id == id) return (ssize_t)i;
+    }
+    return -1;
+}
+
+static int fs_watch_store(fs_watcher* w, const char* path, int id)
+{
+    if (w->count == w->capacity)
+    {
+        size_t cap = w->capacity ? w->capacity * 2 : 16;
+        fs_watch_entry* entries = realloc(w->entries, cap * sizeof(fs_watch_entry));
+        if (!entries) return ENOMEM;
+        w->entries = entries;
+        w->capacity = cap;
+    }
+    char* copy = strdup(path);
+    if (!copy) return ENOMEM;
+    w->entries[w->count].path = copy;
+    w->entries[w->count].id = id;
+    w->count++;
+    return 0;
+}
+
+static void fs_watch_drop(fs_watcher* w, size_t i)
+{
+    free(w->entries[i].path);
+    w->entries[i] = w->entries[--w->count];
+}
+
+// Copies the path out under the lock so the callback can run without it.
+static char* fs_watch_path_for_id(fs_watcher* w, int id)
+{
+    char* path = NULL;
+    pthread_mutex_lock(&w->lock);
+    ssize_t i = fs_watch_find_id(w, id);
+    if (i >= 0) path = strdup(w->entries[i].path);
+    pthread_mutex_unlock(&w->lock);
+    return path;
+}
+
+static void fs_watch_notify(fs_watcher* w, int id)
+{
+    char* path = fs_watch_path_for_id(w, id);
+    if (!path) return;
+    w->fn(w->ctx, path);
+    free(path);
+}
+
+#pragma mark - inotify
+
+#if FS_WATCH_INOTIFY
+
+#define FS_WATCH_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF)
+
+static int fs_watch_backend_open(void)
+{
+    return inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+}
+
+static int fs_watch_backend_add(fs_watcher* w, const char* path)
+{
+    int wd = inotify_add_watch(w->queue, path, FS_WATCH_MASK | IN_ONLYDIR);
+    return wd < 0 ? -errno : wd;
+}
+
+static void fs_watch_backend_remove(fs_watcher* w, int id)
+{
+    inotify_rm_watch(w->queue, id);
+}
+
+static void* fs_watch_thread(void* arg)
+{
+    fs_watcher* w = arg;
+    char buf[16384] __attribute__((aligned(__alignof__(struct inotify_event))));
+    struct pollfd fds[2] = { { w->queue, POLLIN, 0 }, { w->wake[0], POLLIN, 0 } };
+
+    for (;;)
+    {
+        if (poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (fds[1].revents) break;
+
+        ssize_t n = read(w->queue, buf, sizeof(buf));
+        if (n <= 0) continue;
+
+        // One notification per directory per read, however many events arrived.
+        int last = -1;
+        for (char* p = buf; p < buf + n;)
+        {
+            struct inotify_event* ev = (struct inotify_event*)p;
+            if (ev->wd != last && !(ev->mask & IN_IGNORED)) fs_watch_notify(w, ev->wd);
+            last = ev->wd;
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+    return NULL;
+}
+
+#pragma mark - kqueue
+
+#elif FS_WATCH_KQUEUE
+
+#if defined(O_EVTONLY)
+#define FS_WATCH_OPEN_FLAGS (O_EVTONLY | O_CLOEXEC)
+#else
+#define FS_WATCH_OPEN_FLAGS (O_RDONLY | O_CLOEXEC)
+#endif
+
+static int fs_watch_backend_open(void)
+{
+    return kqueue();
+}
+
+static int fs_watch_backend_add(fs_watcher* w, const char* path)
+{
+    int fd = open(path, FS_WATCH_OPEN_FLAGS | O_DIRECTORY);
+    if (fd < 0) return -errno;
+
+    struct kevent kev;
+    EV_SET(&kev, fd, EVFILT_VNODE, EV_ADD | EV_CLEAR,
+           NOTE_WRITE | NOTE_EXTEND | NOTE_ATTRIB | NOTE_DELETE | NOTE_RENAME | NOTE_REVOKE, 0, NULL);
+    if (kevent(w->queue, &kev, 1, NULL, 0, NULL) < 0)
+    {
+        int err = errno;
+        close(fd);
+        return -err;
+    }
+    return fd;
+}
+
+static void fs_watch_backend_remove(fs_watcher* w, int id)
+{
+    (void)w;
+    close(id);                     // closing the descriptor removes its kevent
+}
+
+static void* fs_watch_thread(void* arg)
+{
+    fs_watcher* w = arg;
+    struct kevent events[32];
+
+    for (;;)
+    {
+        int n = kevent(w->queue, NULL, 0, events, 32, NULL);
+        if (n < 0)
+        {
+            if (errno == EINTR) continue;
+            break;
+        }
+        int stop = 0;
+        for (int i = 0; i < n; i++)
+        {
+            if (events[i].filter == EVFILT_READ && (int)events[i].ident == w->wake[0]) stop = 1;
+            else if (events[i].filter == EVFILT_VNODE) fs_watch_notify(w, (int)events[i].ident);
+        }
+        if (stop) break;
+    }
+    return NULL;
+}
+
+#endif
+
+#pragma mark - Public
+
+#if FS_WATCH_INOTIFY || FS_WATCH_KQUEUE
+
+fs_watcher* fs_watch_create(fs_watch_fn fn, void* ctx)
+{
+    fs_watcher* w = calloc(1, sizeof(fs_watcher));
+    if (!w) return NULL;
+    w->fn = fn;
+    w->ctx = ctx;
+    w->queue = fs_watch_backend_open();
+    if (w->queue < 0) goto fail;
+    if (pipe(w->wake) != 0) goto fail_queue;
+    fcntl(w->wake[0], F_SETFD, FD_CLOEXEC);
+    fcntl(w->wake[1], F_SETFD, FD_CLOEXEC);
+
+#if FS_WATCH_KQUEUE
+    struct kevent kev;
+    EV_SET(&kev, w->wake[0], EVFILT_READ, EV_ADD, 0, 0, NULL);
+    if (kevent(w->queue, &kev, 1, NULL, 0, NULL) < 0) goto fail_pipe;
+#endif
+
+    pthread_mutex_init(&w->lock, NULL);
+    if (pthread_create(&w->thread, NULL, fs_watch_thread, w) != 0)
+    {
+        pthread_mutex_destroy(&w->lock);
+        goto fail_pipe;
+    }
+    return w;
+
+fail_pipe:
+    close(w->wake[0]);
+    close(w->wake[1]);
+fail_queue:
+    close(w->queue);
+fail:
+    free(w);
+    return NULL;
+}
+
+void fs_watch_destroy(fs_watcher* w)
+{
+    if (!w) return;
+    char byte = 0;
+    while (write(w->wake[1], &byte, 1) < 0 && errno == EINTR) {}
+    pthread_join(w->thread, NULL);
+
+    for (size_t i = 0; i < w->count; i++)
+    {
+        fs_watch_backend_remove(w, w->entries[i].id);
+        free(w->entries[i].path);
+    }
+    free(w->entries);
+    close(w->wake[0]);
+    close(w->wake[1]);
+    close(w->queue);
+    pthread_mutex_destroy(&w->lock);
+    free(w);
+}
+
+int fs_watch_add(fs_watcher* w, const char* path)
+{
+    pthread_mutex_lock(&w->lock);
+    int err = 0;
+    if (fs_watch_find_path(w, path) < 0)
+    {
+        int id = fs_watch_backend_add(w, path);
+        if (id < 0) err = -id;
+        else if ((err = fs_watch_store(w, path, id)) != 0) fs_watch_backend_remove(w, id);
+    }
+    pthread_mutex_unlock(&w->lock);
+    return err;
+}
+
+void fs_watch_remove(fs_watcher* w, const char* path)
+{
+    pthread_mutex_lock(&w->lock);
+    ssize_t i = fs_watch_find_path(w, path);
+    if (i >= 0)
+    {
+        fs_watch_backend_remove(w, w->entries[i].id);
+        fs_watch_drop(w, (size_t)i);
+    }
+    pthread_mutex_unlock(&w->lock);
+}
+
+#else
+
+fs_watcher* fs_watch_create(fs_watch_fn fn, void* ctx)
+{
+    (void)fn;
+    (void)ctx;
+    return NULL;
+}
+
+void fs_watch_destroy(fs_watcher* w)
+{
+    (void)w;
+}
+
+int fs_watch_add(fs_watcher* w, const char* path)
+{
+    (void)w;
+    (void)path;
+    return ENOTSUP;
+}
+
+void fs_watch_remove(fs_watcher* w, const char* path)
+{
+    (void)w;
+    (void)path;
+}
+
+#endif
@@ -0,0 +1,80 @@
+// File: log_ring.h
+// Location: プロジェクト直下
+
+#ifndef LOG_RING_H
+#define LOG_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Log records handed from any number of threads to one consumer without
+// locks: a bounded queue after Vyukov. A producer claims a slot with one
+// compare-and-swap, fills it in place and publishes it with a release store;
+// it never waits. When the consumer is a whole ring behind, records are
+// dropped and counted instead of stalling the caller.
+//
+// A message longer than one record spans up to LOG_PARTS_MAX consecutive
+// ones, claimed with the same single compare-and-swap and published first
+// part last, so the consumer never sees part of a message and no other
+// message lands between its parts.
+//
+// A producer that is preempted between log_begin and log_commit holds up
+// the consumer at its slot, not the other producers.
+
+enum
+{
+    LOG_DEBUG = 0,
+    LOG_INFO = 1,
+    LOG_WARN = 2,
+    LOG_ERROR = 3,
+};
+
+#define LOG_CATEGORY_MAX 16
+#define LOG_TEXT_MAX 218               // per record; a record is 256 bytes
+#define LOG_PARTS_MAX 8
+#define LOG_MESSAGE_MAX (LOG_PARTS_MAX * LOG_TEXT_MAX)
+
+typedef struct log_record
+{
+    uint64_t time_ns;                  // log_now when it was begun
+    uint64_t sequence;                 // 1, 2, ... in the order slots were claimed
+    uint8_t level;
+    uint8_t truncated;                 // the message was cut; set on its first part
+    uint16_t length;
+    uint8_t part;                      // 0 for the first record of a message
+    uint8_t parts;                     // records the message spans
+    char category[LOG_CATEGORY_MAX];   // NUL-terminated, may be empty; first part only
+    char text[LOG_TEXT_MAX];           // length bytes, not terminated
+} log_record;
+
+typedef struct log_ring log_ring;
+
+// capacity is rounded up to a power of two of at least LOG_PARTS_MAX.
+// Returns 0 or ENOMEM.
+int log_ring_create(size_t capacity, log_ring** out);
+void log_ring_free(log_ring* ring);
+
+// Claims a slot for a one-record message and fills in time, sequence, level
+// and parts; the caller writes category, text and length, then calls
+// log_commit. NULL when the ring is full. Any thread.
+log_record* log_begin(log_ring* ring, int level);
+void log_commit(log_ring* ring, log_record* record);
+// Moves a leading "[TAG] " of the text into category.
+void log_take_category(log_record* record);
+// Copies a message of up to LOG_MESSAGE_MAX bytes into as many records as it
+// needs; longer text is cut. A NULL category is taken from a leading "[TAG] "
+// of text. truncated marks text the caller already had to cut. Returns 0 or
+// EAGAIN when the ring has no room for the whole message. Any thread.
+int log_write(log_ring* ring, int level, const char* category, const char* text, size_t length, int truncated);
+
+// Copies up to max published records out, oldest first, and frees their
+// slots. A message may be split across calls when max cuts it. One consumer
+// at a time.
+size_t log_drain(log_ring* ring, log_record* out, size_t max);
+// Messages lost to a full ring so far.
+uint64_t log_dropped(const log_ring* ring);
+
+// CLOCK_MONOTONIC in nanoseconds.
+uint64_t log_now(void);
+
+#endif
@@ -0,0 +1,222 @@
+// File: log_ring.c
+// Location: プロジェクト直下
+
+#include "log_ring.h"
+#include <errno.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define LOG_LINE 64                    // cache line; head and the slots stay off the consumer's line
+
+typedef struct log_slot
+{
+    // pos while free for the producer claiming position pos, pos + 1 once
+    // published, pos + capacity after the consumer took it.
+    _Atomic uint64_t turn;
+    log_record record;
+} log_slot;
+
+struct log_ring
+{
+    _Alignas(LOG_LINE) _Atomic uint64_t head;   // next position to claim
+    _Alignas(LOG_LINE) uint64_t tail;           // next position to drain; consumer only
+    _Atomic uint64_t dropped;
+    uint64_t mask;
+    log_slot* slots;
+};
+
+uint64_t log_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+int log_ring_create(size_t capacity, log_ring** out)
+{
+    *out = NULL;
+    size_t size = LOG_PARTS_MAX;
+    while (size < capacity) size <<= 1;
+    log_ring* ring = NULL;
+    if (posix_memalign((void**)&ring, LOG_LINE, sizeof(log_ring)) != 0) return ENOMEM;
+    memset(ring, 0, sizeof(log_ring));
+    ring->slots = calloc(size, sizeof(log_slot));
+    if (!ring->slots)
+    {
+        free(ring);
+        return ENOMEM;
+    }
+    for (size_t i = 0; i < size; i++) atomic_init(&ring->slots[i].turn, i);
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->dropped, 0);
+    ring->mask = size - 1;
+    *out = ring;
+    return 0;
+}
+
+void log_ring_free(log_ring* ring)
+{
+    if (!ring) return;
+    free(ring->slots);
+    free(ring);
+}
+
+#pragma mark - Producers
+
+_Static_assert(sizeof(log_record) == 256, "log_record is meant to be 256 bytes");
+
+// Claims count consecutive positions. Slots are freed in order, so the last
+// one being free means all of them are.
+static int log_claim(log_ring* ring, uint64_t count, uint64_t* out)
+{
+    uint64_t pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    for (;;)
+    {
+        log_slot* last = &ring->slots[(pos + count - 1) & ring->mask];
+        uint64_t turn = atomic_load_explicit(&last->turn, memory_order_acquire);
+        int64_t diff = (int64_t)(turn - (pos + count - 1));
+        if (diff == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&ring->head, &pos, pos + count, memory_order_relaxed,
+                                                      memory_order_relaxed))
+            {
+                *out = pos;
+                return 1;
+            }
+        }
+        else if (diff < 0)
+        {
+            // The slot still holds a record from a lap ago: full.
+            atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+            return 0;
+        }
+        else
+        {
+            pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+        }
+    }
+}
+
+static log_record* log_fill(log_ring* ring, uint64_t pos, int level, uint64_t time_ns, size_t part, size_t parts)
+{
+    log_record* r = &ring->slots[pos & ring->mask].record;
+    r->time_ns = time_ns;
+    r->sequence = pos + 1;
+    r->level = (uint8_t)level;
+    r->truncated = 0;
+    r->length = 0;
+    r->part = (uint8_t)part;
+    r->parts = (uint8_t)parts;
+    r->category[0] = 0;
+    return r;
+}
+
+log_record* log_begin(log_ring* ring, int level)
+{
+    uint64_t pos;
+    if (!log_claim(ring, 1, &pos)) return NULL;
+    return log_fill(ring, pos, level, log_now(), 0, 1);
+}
+
+void log_commit(log_ring* ring, log_record* record)
+{
+    (void)ring;
+    log_slot* slot = (log_slot*)((char*)record - offsetof(log_slot, record));
+    atomic_store_explicit(&slot->turn, record->sequence, memory_order_release);
+}
+
+// Length of a leading "[TAG]" plus one space, with TAG copied to category;
+// 0 when text does not start with one.
+static size_t log_split_category(const char* text, size_t length, char* category)
+{
+    if (length < 3 || text[0] != '[') return 0;
+    size_t limit = length < LOG_CATEGORY_MAX + 1 ? length : LOG_CATEGORY_MAX + 1;
+    const char* close = memchr(text + 1, ']', limit - 1);
+    if (!close) return 0;
+    size_t tag = (size_t)(close - text) - 1;
+    if (tag == 0 || tag >= LOG_CATEGORY_MAX) return 0;
+    memcpy(category, text + 1, tag);
+    category[tag] = 0;
+    size_t skip = tag + 2;
+    if (skip < length && text[skip] == ' ') skip++;
+    return skip;
+}
+
+void log_take_category(log_record* record)
+{
+    size_t skip = log_split_category(record->text, record->length, record->category);
+    if (!skip) return;
+    memmove(record->text, record->text + skip, record->length - skip);
+    record->length = (uint16_t)(record->length - skip);
+}
+
+int log_write(log_ring* ring, int level, const char* category, const char* text, size_t length, int truncated)
+{
+    char tag[LOG_CATEGORY_MAX] = {0};
+    if (category)
+    {
+        size_t n = strnlen(category, LOG_CATEGORY_MAX - 1);
+        memcpy(tag, category, n);
+    }
+    else
+    {
+        size_t skip = log_split_category(text, length, tag);
+        text += skip;
+        length -= skip;
+    }
+    if (length > LOG_MESSAGE_MAX)
+    {
+        length = LOG_MESSAGE_MAX;
+        truncated = 1;
+    }
+    size_t parts = length ? (length + LOG_TEXT_MAX - 1) / LOG_TEXT_MAX : 1;
+
+    uint64_t pos;
+    if (!log_claim(ring, parts, &pos)) return EAGAIN;
+    uint64_t now = log_now();
+    log_record* first = NULL;
+    for (size_t i = 0; i < parts; i++)
+    {
+        log_record* r = log_fill(ring, pos + i, level, now, i, parts);
+        size_t take = length - i * LOG_TEXT_MAX < LOG_TEXT_MAX ? length - i * LOG_TEXT_MAX : LOG_TEXT_MAX;
+        memcpy(r->text, text + i * LOG_TEXT_MAX, take);
+        r->length = (uint16_t)take;
+        if (i == 0)
+        {
+            memcpy(r->category, tag, sizeof(tag));
+            r->truncated = (uint8_t)(truncated != 0);
+            first = r;
+        }
+    }
+    // The first part last: once the consumer can take it, it can take the
+    // rest of the message too.
+    for (size_t i = parts; i-- > 1;) log_commit(ring, &ring->slots[(pos + i) & ring->mask].record);
+    log_commit(ring, first);
+    return 0;
+}
+
+#pragma mark - Consumer
+
+size_t log_drain(log_ring* ring, log_record* out, size_t max)
+{
+    size_t n = 0;
+    uint64_t capacity = ring->mask + 1;
+    while (n < max)
+    {
+        log_slot* slot = &ring->slots[ring->tail & ring->mask];
+        uint64_t turn = atomic_load_explicit(&slot->turn, memory_order_acquire);
+        if (turn != ring->tail + 1) break;     // not published yet
+        out[n++] = slot->record;
+        atomic_store_explicit(&slot->turn, ring->tail + capacity, memory_order_release);
+        ring->tail++;
+    }
+    return n;
+}
+
+uint64_t log_dropped(const log_ring* ring)
+{
+    return atomic_load_explicit(&((log_ring*)ring)->dropped, memory_order_relaxed);
+}
@@ -156,6 +156,10 @@
 /* Define MINIZ_NO_ZLIB_COMPATIBLE_NAME to disable zlib names, to prevent conflicts against stock zlib. */
 /*#define MINIZ_NO_ZLIB_COMPATIBLE_NAMES */
 
+/* mz_crc32() and mz_adler32() come from zip_checksum.c, which picks a hardware backend at runtime. */
+#define USE_EXTERNAL_MZCRC
+#define USE_EXTERNAL_MZADLER32
+
 /* Define MINIZ_NO_MALLOC to disable all calls to malloc, free, and realloc.
    Note if MINIZ_NO_MALLOC is defined then the user must always provide custom user alloc/free/realloc
    callbacks to the zlib and archive API's, and a few stand-alone helper API's which don't provide custom user
@@ -38,6 +38,10 @@ extern "C"
 
     /* ------------------- zlib-style API's */
 
+#if defined(USE_EXTERNAL_MZADLER32)
+    /* Provided alongside mz_crc32() by the external checksum module. */
+    mz_ulong mz_adler32(mz_ulong adler, const unsigned char *ptr, size_t buf_len);
+#else
     mz_ulong mz_adler32(mz_ulong adler, const unsigned char *ptr, size_t buf_len)
     {
         mz_uint32 i, s1 = (mz_uint32)(adler & 0xffff), s2 = (mz_uint32)(adler >> 16);
@@ -65,6 +69,7 @@ extern "C"
         }
         return (s2 << 16) + s1;
     }
+#endif
 
 /* Karl Malbrain's compact CRC-32. See "A compact CCITT crc16 and crc32 C implementation that balances processor cache usage against speed": http://www.geocities.com/malbrain/ */
 #if 0
@@ -0,0 +1,20 @@
+// File: zip_checksum.h
+// Location: プロジェクト直下
+
+#ifndef ZIP_CHECKSUM_H
+#define ZIP_CHECKSUM_H
+
+// Provides mz_crc32() and mz_adler32() for miniz (USE_EXTERNAL_MZCRC /
+// USE_EXTERNAL_MZADLER32). The fastest backend the CPU supports is picked on
+// first use, after it has been checked against the scalar reference tables.
+
+// Name of the backend in use, e.g. "pclmul", "armv8-crc", "slice8".
+const char* zipc_crc32_backend(void);
+const char* zipc_adler32_backend(void);
+
+// Compares every backend available on this CPU against the byte-at-a-time
+// reference over assorted lengths and alignments. Returns 0 when all of them
+// are bit-exact, otherwise the number of mismatching backends.
+int zipc_self_check(void);
+
+#endif
@@ -0,0 +1,630 @@
+// File: zip_checksum.c
+// Location: プロジェクト直下
+
+#include "zip_checksum.h"
+#include "miniz.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define ZIPC_X86 1
+#include <immintrin.h>
+#define ZIPC_TARGET_PCLMUL __attribute__((target("pclmul,sse4.1")))
+#define ZIPC_TARGET_SSSE3 __attribute__((target("ssse3")))
+#endif
+
+#if defined(__aarch64__)
+#define ZIPC_ARM64 1
+#include <arm_neon.h>
+#if defined(__APPLE__)
+#include <sys/sysctl.h>
+#elif defined(__linux__)
+#include <sys/auxv.h>
+#endif
+#if defined(__clang__)
+#define ZIPC_HAVE_ARM_CRC 1
+#define ZIPC_TARGET_CRC __attribute__((target("crc")))
+#define zipc_crc32b __builtin_arm_crc32b
+#define zipc_crc32w __builtin_arm_crc32w
+#define zipc_crc32d __builtin_arm_crc32d
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define ZIPC_HAVE_ARM_CRC 1
+#define ZIPC_TARGET_CRC
+#define zipc_crc32b __crc32b
+#define zipc_crc32w __crc32w
+#define zipc_crc32d __crc32d
+#endif
+#endif
+
+#define ZIPC_ADLER_BASE 65521u
+#define ZIPC_ADLER_NMAX 5552
+#define ZIPC_CHECK_SIZE (3 * ZIPC_ADLER_NMAX + 64)
+
+// CRC backends work on the inverted register; mz_crc32 applies the pre/post
+// conditioning once so backends can be chained on a single buffer.
+typedef uint32_t (*zipc_crc_fn)(uint32_t crc, const uint8_t* p, size_t n);
+typedef uint32_t (*zipc_adler_fn)(uint32_t adler, const uint8_t* p, size_t n);
+
+typedef struct zipc_crc_backend
+{
+    const char* name;
+    zipc_crc_fn fn;
+} zipc_crc_backend;
+
+typedef struct zipc_adler_backend
+{
+    const char* name;
+    zipc_adler_fn fn;
+} zipc_adler_backend;
+
+// The table miniz has always used; every other backend is validated against it.
+static const uint32_t zipc_crc_reference[256] = {
+    0x00000000, 0x77073096, 0xEE0E612C, 0x990951BA, 0x076DC419, 0x706AF48F, 0xE963A535,
+    0x9E6495A3, 0x0EDB8832, 0x79DCB8A4, 0xE0D5E91E, 0x97D2D988, 0x09B64C2B, 0x7EB17CBD,
+    0xE7B82D07, 0x90BF1D91, 0x1DB71064, 0x6AB020F2, 0xF3B97148, 0x84BE41DE, 0x1ADAD47D,
+    0x6DDDE4EB, 0xF4D4B551, 0x83D385C7, 0x136C9856, 0x646BA8C0, 0xFD62F97A, 0x8A65C9EC,
+    0x14015C4F, 0x63066CD9, 0xFA0F3D63, 0x8D080DF5, 0x3B6E20C8, 0x4C69105E, 0xD56041E4,
+    0xA2677172, 0x3C03E4D1, 0x4B04D447, 0xD20D85FD, 0xA50AB56B, 0x35B5A8FA, 0x42B2986C,
+    0xDBBBC9D6, 0xACBCF940, 0x32D86CE3, 0x45DF5C75, 0xDCD60DCF, 0xABD13D59, 0x26D930AC,
+    0x51DE003A, 0xC8D75180, 0xBFD06116, 0x21B4F4B5, 0x56B3C423, 0xCFBA9599, 0xB8BDA50F,
+    0x2802B89E, 0x5F058808, 0xC60CD9B2, 0xB10BE924, 0x2F6F7C87, 0x58684C11, 0xC1611DAB,
+    0xB6662D3D, 0x76DC4190, 0x01DB7106, 0x98D220BC, 0xEFD5102A, 0x71B18589, 0x06B6B51F,
+    0x9FBFE4A5, 0xE8B8D433, 0x7807C9A2, 0x0F00F934, 0x9609A88E, 0xE10E9818, 0x7F6A0DBB,
+    0x086D3D2D, 0x91646C97, 0xE6635C01, 0x6B6B51F4, 0x1C6C6162, 0x856530D8, 0xF262004E,
+    0x6C0695ED, 0x1B01A57B, 0x8208F4C1, 0xF50FC457, 0x65B0D9C6, 0x12B7E950, 0x8BBEB8EA,
+    0xFCB9887C, 0x62DD1DDF, 0x15DA2D49, 0x8CD37CF3, 0xFBD44C65, 0x4DB26158, 0x3AB551CE,
+    0xA3BC0074, 0xD4BB30E2, 0x4ADFA541, 0x3DD895D7, 0xA4D1C46D, 0xD3D6F4FB, 0x4369E96A,
+    0x346ED9FC, 0xAD678846, 0xDA60B8D0, 0x44042D73, 0x33031DE5, 0xAA0A4C5F, 0xDD0D7CC9,
+    0x5005713C, 0x270241AA, 0xBE0B1010, 0xC90C2086, 0x5768B525, 0x206F85B3, 0xB966D409,
+    0xCE61E49F, 0x5EDEF90E, 0x29D9C998, 0xB0D09822, 0xC7D7A8B4, 0x59B33D17, 0x2EB40D81,
+    0xB7BD5C3B, 0xC0BA6CAD, 0xEDB88320, 0x9ABFB3B6, 0x03B6E20C, 0x74B1D29A, 0xEAD54739,
+    0x9DD277AF, 0x04DB2615, 0x73DC1683, 0xE3630B12, 0x94643B84, 0x0D6D6A3E, 0x7A6A5AA8,
+    0xE40ECF0B, 0x9309FF9D, 0x0A00AE27, 0x7D079EB1, 0xF00F9344, 0x8708A3D2, 0x1E01F268,
+    0x6906C2FE, 0xF762575D, 0x806567CB, 0x196C3671, 0x6E6B06E7, 0xFED41B76, 0x89D32BE0,
+    0x10DA7A5A, 0x67DD4ACC, 0xF9B9DF6F, 0x8EBEEFF9, 0x17B7BE43, 0x60B08ED5, 0xD6D6A3E8,
+    0xA1D1937E, 0x38D8C2C4, 0x4FDFF252, 0xD1BB67F1, 0xA6BC5767, 0x3FB506DD, 0x48B2364B,
+    0xD80D2BDA, 0xAF0A1B4C, 0x36034AF6, 0x41047A60, 0xDF60EFC3, 0xA867DF55, 0x316E8EEF,
+    0x4669BE79, 0xCB61B38C, 0xBC66831A, 0x256FD2A0, 0x5268E236, 0xCC0C7795, 0xBB0B4703,
+    0x220216B9, 0x5505262F, 0xC5BA3BBE, 0xB2BD0B28, 0x2BB45A92, 0x5CB36A04, 0xC2D7FFA7,
+    0xB5D0CF31, 0x2CD99E8B, 0x5BDEAE1D, 0x9B64C2B0, 0xEC63F226, 0x756AA39C, 0x026D930A,
+    0x9C0906A9, 0xEB0E363F, 0x72076785, 0x05005713, 0x95BF4A82, 0xE2B87A14, 0x7BB12BAE,
+    0x0CB61B38, 0x92D28E9B, 0xE5D5BE0D, 0x7CDCEFB7, 0x0BDBDF21, 0x86D3D2D4, 0xF1D4E242,
+    0x68DDB3F8, 0x1FDA836E, 0x81BE16CD, 0xF6B9265B, 0x6FB077E1, 0x18B74777, 0x88085AE6,
+    0xFF0F6A70, 0x66063BCA, 0x11010B5C, 0x8F659EFF, 0xF862AE69, 0x616BFFD3, 0x166CCF45,
+    0xA00AE278, 0xD70DD2EE, 0x4E048354, 0x3903B3C2, 0xA7672661, 0xD06016F7, 0x4969474D,
+    0x3E6E77DB, 0xAED16A4A, 0xD9D65ADC, 0x40DF0B66, 0x37D83BF0, 0xA9BCAE53, 0xDEBB9EC5,
+    0x47B2CF7F, 0x30B5FFE9, 0xBDBDF21C, 0xCABAC28A, 0x53B39330, 0x24B4A3A6, 0xBAD03605,
+    0xCDD70693, 0x54DE5729, 0x23D967BF, 0xB3667A2E, 0xC4614AB8, 0x5D681B02, 0x2A6F2B94,
+    0xB40BBE37, 0xC30C8EA1, 0x5A05DF1B, 0x2D02EF8D
+};
+
+static uint32_t zipc_crc_slice[8][256];
+
+static pthread_once_t zipc_once = PTHREAD_ONCE_INIT;
+static zipc_crc_backend zipc_crc;
+static zipc_adler_backend zipc_adler;
+
+#pragma mark - Scalar
+
+static uint32_t zipc_crc32_bytewise(uint32_t c, const uint8_t* p, size_t n)
+{
+    while (n--) c = (c >> 8) ^ zipc_crc_reference[(c ^ *p++) & 0xFF];
+    return c;
+}
+
+static void zipc_build_slice_tables(void)
+{
+    memcpy(zipc_crc_slice[0], zipc_crc_reference, sizeof(zipc_crc_reference));
+    for (int k = 1; k < 8; k++)
+    {
+        for (int i = 0; i < 256; i++)
+        {
+            uint32_t prev = zipc_crc_slice[k - 1][i];
+            zipc_crc_slice[k][i] = (prev >> 8) ^ zipc_crc_slice[0][prev & 0xFF];
+        }
+    }
+}
+
+// Slicing-by-8: eight independent table lookups per 64-bit word.
+static uint32_t zipc_crc32_slice8(uint32_t c, const uint8_t* p, size_t n)
+{
+#if MINIZ_LITTLE_ENDIAN
+    const uint32_t(*t)[256] = (const uint32_t(*)[256])zipc_crc_slice;
+    while (n >= 8)
+    {
+        uint32_t lo, hi;
+        memcpy(&lo, p, 4);
+        memcpy(&hi, p + 4, 4);
+        lo ^= c;
+        c = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] ^
+            t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+        p += 8;
+        n -= 8;
+    }
+#endif
+    return zipc_crc32_bytewise(c, p, n);
+}
+
+static uint32_t zipc_adler32_scalar(uint32_t adler, const uint8_t* ptr, size_t buf_len)
+{
+    uint32_t i, s1 = adler & 0xffff, s2 = adler >> 16;
+    size_t block_len = buf_len % ZIPC_ADLER_NMAX;
+    while (buf_len)
+    {
+        for (i = 0; i + 7 < block_len; i += 8, ptr += 8)
+        {
+            s1 += ptr[0], s2 += s1;
+            s1 += ptr[1], s2 += s1;
+            s1 += ptr[2], s2 += s1;
+            s1 += ptr[3], s2 += s1;
+            s1 += ptr[4], s2 += s1;
+            s1 += ptr[5], s2 += s1;
+            s1 += ptr[6], s2 += s1;
+            s1 += ptr[7], s2 += s1;
+        }
+        for (; i < block_len; ++i)
+            s1 += *ptr++, s2 += s1;
+        s1 %= ZIPC_ADLER_BASE, s2 %= ZIPC_ADLER_BASE;
+        buf_len -= block_len;
+        block_len = ZIPC_ADLER_NMAX;
+    }
+    return (s2 << 16) + s1;
+}
+
+#pragma mark - x86
+
+#if ZIPC_X86
+
+static int zipc_has_pclmul(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+}
+
+static int zipc_has_ssse3(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("ssse3");
+}
+
+// Carry-less multiplication folding ("Fast CRC Computation for Generic
+// Polynomials Using PCLMULQDQ", Intel 2009). n must be a multiple of 16, >= 64.
+ZIPC_TARGET_PCLMUL static uint32_t zipc_crc32_fold(uint32_t crc, const uint8_t* buf, size_t n)
+{
+    static const uint64_t k1k2[2] = { 0x0154442bd4ull, 0x01c6e41596ull };
+    static const uint64_t k3k4[2] = { 0x01751997d0ull, 0x00ccaa009eull };
+    static const uint64_t k5k0[2] = { 0x0163cd6124ull, 0x0000000000ull };
+    static const uint64_t poly[2] = { 0x01db710641ull, 0x01f7011641ull };
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+    x1 = _mm_loadu_si128((const __m128i*)(buf + 0x00));
+    x2 = _mm_loadu_si128((const __m128i*)(buf + 0x10));
+    x3 = _mm_loadu_si128((const __m128i*)(buf + 0x20));
+    x4 = _mm_loadu_si128((const __m128i*)(buf + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+    x0 = _mm_loadu_si128((const __m128i*)k1k2);
+    buf += 64;
+    n -= 64;
+
+    // Four independent 128-bit lanes keep the multiplier pipeline full.
+    while (n >= 64)
+    {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+        y5 = _mm_loadu_si128((const __m128i*)(buf + 0x00));
+        y6 = _mm_loadu_si128((const __m128i*)(buf + 0x10));
+        y7 = _mm_loadu_si128((const __m128i*)(buf + 0x20));
+        y8 = _mm_loadu_si128((const __m128i*)(buf + 0x30));
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+        buf += 64;
+        n -= 64;
+    }
+
+    // Fold the four lanes into one.
+    x0 = _mm_loadu_si128((const __m128i*)k3k4);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    while (n >= 16)
+    {
+        x2 = _mm_loadu_si128((const __m128i*)buf);
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+        buf += 16;
+        n -= 16;
+    }
+
+    // 128 -> 64 bits.
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_srli_si128(x1, 8);
+    x1 = _mm_xor_si128(x1, x2);
+    x0 = _mm_loadl_epi64((const __m128i*)k5k0);
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    // Barrett reduction to 32 bits.
+    x0 = _mm_loadu_si128((const __m128i*)poly);
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+    return (uint32_t)_mm_extract_epi32(x1, 1);
+}
+
+static uint32_t zipc_crc32_pclmul(uint32_t c, const uint8_t* p, size_t n)
+{
+    if (n >= 64)
+    {
+        size_t chunk = n & ~(size_t)15;
+        c = zipc_crc32_fold(c, p, chunk);
+        p += chunk;
+        n -= chunk;
+    }
+    return zipc_crc32_slice8(c, p, n);
+}
+
+// 32 bytes per step: SAD gives the byte sums for s1, multiply-add against the
+// descending taps gives the weighted sums for s2.
+ZIPC_TARGET_SSSE3 static uint32_t zipc_adler32_ssse3(uint32_t adler, const uint8_t* p, size_t n)
+{
+    uint32_t s1 = adler & 0xffff;
+    uint32_t s2 = adler >> 16;
+    size_t blocks = n / 32;
+    n -= blocks * 32;
+
+    const __m128i tap1 = _mm_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17);
+    const __m128i tap2 = _mm_setr_epi8(16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi16(1);
+
+    while (blocks)
+    {
+        size_t round = ZIPC_ADLER_NMAX / 32;
+        if (round > blocks) round = blocks;
+        blocks -= round;
+
+        __m128i v_ps = _mm_set_epi32(0, 0, 0, (int)(s1 * round));
+        __m128i v_s2 = _mm_set_epi32(0, 0, 0, (int)s2);
+        __m128i v_s1 = _mm_setzero_si128();
+        do
+        {
+            const __m128i b1 = _mm_loadu_si128((const __m128i*)p);
+            const __m128i b2 = _mm_loadu_si128((const __m128i*)(p + 16));
+            v_ps = _mm_add_epi32(v_ps, v_s1);
+            v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(b1, zero));
+            v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(_mm_maddubs_epi16(b1, tap1), ones));
+            v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(b2, zero));
+            v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(_mm_maddubs_epi16(b2, tap2), ones));
+            p += 32;
+        } while (--round);
+        v_s2 = _mm_add_epi32(v_s2, _mm_slli_epi32(v_ps, 5));
+
+        v_s1 = _mm_add_epi32(v_s1, _mm_shuffle_epi32(v_s1, _MM_SHUFFLE(1, 0, 3, 2)));
+        s1 += (uint32_t)_mm_cvtsi128_si32(v_s1);
+        v_s2 = _mm_add_epi32(v_s2, _mm_shuffle_epi32(v_s2, _MM_SHUFFLE(2, 3, 0, 1)));
+        v_s2 = _mm_add_epi32(v_s2, _mm_shuffle_epi32(v_s2, _MM_SHUFFLE(1, 0, 3, 2)));
+        s2 = (uint32_t)_mm_cvtsi128_si32(v_s2);
+        s1 %= ZIPC_ADLER_BASE;
+        s2 %= ZIPC_ADLER_BASE;
+    }
+    return zipc_adler32_scalar((s2 << 16) | s1, p, n);
+}
+
+#endif
+
+#pragma mark - arm64
+
+#if ZIPC_ARM64
+
+#if ZIPC_HAVE_ARM_CRC
+static int zipc_has_arm_crc(void)
+{
+#if defined(__ARM_FEATURE_CRC32)
+    return 1;
+#elif defined(__APPLE__)
+    int value = 0;
+    size_t len = sizeof(value);
+    return sysctlbyname("hw.optional.armv8_crc32", &value, &len, NULL, 0) == 0 && value;
+#elif defined(__linux__) && defined(HWCAP_CRC32)
+    return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+#else
+    return 0;
+#endif
+}
+
+ZIPC_TARGET_CRC static uint32_t zipc_crc32_armv8(uint32_t c, const uint8_t* p, size_t n)
+{
+    while (n && ((uintptr_t)p & 7))
+    {
+        c = zipc_crc32b(c, *p++);
+        n--;
+    }
+    while (n >= 32)
+    {
+        uint64_t w[4];
+        memcpy(w, p, sizeof(w));
+        c = zipc_crc32d(c, w[0]);
+        c = zipc_crc32d(c, w[1]);
+        c = zipc_crc32d(c, w[2]);
+        c = zipc_crc32d(c, w[3]);
+        p += 32;
+        n -= 32;
+    }
+    while (n >= 8)
+    {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        c = zipc_crc32d(c, w);
+        p += 8;
+        n -= 8;
+    }
+    if (n >= 4)
+    {
+        uint32_t w;
+        memcpy(&w, p, 4);
+        c = zipc_crc32w(c, w);
+        p += 4;
+        n -= 4;
+    }
+    while (n--) c = zipc_crc32b(c, *p++);
+    return c;
+}
+#endif
+
+// 16 bytes per step. Per-column byte sums are kept in 16-bit lanes and weighted
+// once per round, so a round is capped at 256 steps to keep them from overflowing.
+static uint32_t zipc_adler32_neon(uint32_t adler, const uint8_t* p, size_t n)
+{
+    static const uint16_t taps[16] = { 16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1 };
+    uint32_t s1 = adler & 0xffff;
+    uint32_t s2 = adler >> 16;
+    size_t blocks = n / 16;
+    n -= blocks * 16;
+
+    while (blocks)
+    {
+        size_t round = blocks < 256 ? blocks : 256;
+        blocks -= round;
+        uint64_t prefix = (uint64_t)s1 * 16 * round;
+
+        uint32x4_t v_s1 = vdupq_n_u32(0);
+        uint32x4_t v_ps = vdupq_n_u32(0);
+        uint16x8_t col_lo = vdupq_n_u16(0);
+        uint16x8_t col_hi = vdupq_n_u16(0);
+        for (size_t i = 0; i < round; i++)
+        {
+            uint8x16_t b = vld1q_u8(p);
+            v_ps = vaddq_u32(v_ps, v_s1);
+            v_s1 = vpadalq_u16(v_s1, vpaddlq_u8(b));
+            col_lo = vaddw_u8(col_lo, vget_low_u8(b));
+            col_hi = vaddw_u8(col_hi, vget_high_u8(b));
+            p += 16;
+        }
+
+        uint32x4_t v_s2 = vshlq_n_u32(v_ps, 4);
+        v_s2 = vmlal_u16(v_s2, vget_low_u16(col_lo), vld1_u16(taps + 0));
+        v_s2 = vmlal_u16(v_s2, vget_high_u16(col_lo), vld1_u16(taps + 4));
+        v_s2 = vmlal_u16(v_s2, vget_low_u16(col_hi), vld1_u16(taps + 8));
+        v_s2 = vmlal_u16(v_s2, vget_high_u16(col_hi), vld1_u16(taps + 12));
+
+        s2 = (uint32_t)((s2 + prefix + vaddvq_u32(v_s2)) % ZIPC_ADLER_BASE);
+        s1 = (uint32_t)((s1 + (uint64_t)vaddvq_u32(v_s1)) % ZIPC_ADLER_BASE);
+    }
+    return zipc_adler32_scalar((s2 << 16) | s1, p, n);
+}
+
+#endif
+
+#pragma mark - Selection
+
+static void zipc_fill_check_buffer(uint8_t* buf, size_t size, uint32_t seed)
+{
+    uint32_t x = seed;
+    for (size_t i = 0; i < size; i++)
+    {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        buf[i] = (uint8_t)(x >> 24);
+    }
+}
+
+static const size_t zipc_check_lengths[] = { 0, 1, 3, 7, 8, 15, 16, 17, 31, 32, 33, 63, 64, 65, 127, 128, 129,
+                                             255, 1000, 4096, ZIPC_ADLER_NMAX, ZIPC_ADLER_NMAX + 1, 3 * ZIPC_ADLER_NMAX };
+
+static int zipc_check_crc(zipc_crc_fn fn, const uint8_t* buf)
+{
+    for (size_t i = 0; i < sizeof(zipc_check_lengths) / sizeof(zipc_check_lengths[0]); i++)
+    {
+        for (size_t ofs = 0; ofs < 8; ofs += 3)
+        {
+            size_t n = zipc_check_lengths[i];
+            if (fn(0x12345678u, buf + ofs, n) != zipc_crc32_bytewise(0x12345678u, buf + ofs, n)) return 1;
+            if (fn(fn(~0u, buf + ofs, n / 2), buf + ofs + n / 2, n - n / 2) != zipc_crc32_bytewise(~0u, buf + ofs, n)) return 1;
+        }
+    }
+    return 0;
+}
+
+static int zipc_check_adler(zipc_adler_fn fn, const uint8_t* buf)
+{
+    for (size_t i = 0; i < sizeof(zipc_check_lengths) / sizeof(zipc_check_lengths[0]); i++)
+    {
+        for (size_t ofs = 0; ofs < 8; ofs += 3)
+        {
+            size_t n = zipc_check_lengths[i];
+            if (fn(1, buf + ofs, n) != zipc_adler32_scalar(1, buf + ofs, n)) return 1;
+            if (fn(0xFFF0FFF0u, buf + ofs, n) != zipc_adler32_scalar(0xFFF0FFF0u, buf + ofs, n)) return 1;
+        }
+    }
+    return 0;
+}
+
+// Runs fn-based checks over random data and over all-0xFF data, which is the
+// worst case for the accumulators.
+static int zipc_check_backends(const zipc_crc_backend* crcs, size_t crc_count, const zipc_adler_backend* adlers,
+                               size_t adler_count, int* crc_ok, int* adler_ok)
+{
+    uint8_t* buf = malloc(ZIPC_CHECK_SIZE);
+    if (!buf) return -1;
+
+    int failures = 0;
+    for (int pass = 0; pass < 2; pass++)
+    {
+        if (pass == 0) zipc_fill_check_buffer(buf, ZIPC_CHECK_SIZE, 0x9E3779B9u);
+        else memset(buf, 0xFF, ZIPC_CHECK_SIZE);
+
+        for (size_t i = 0; i < crc_count; i++)
+        {
+            if (crc_ok[i] && zipc_check_crc(crcs[i].fn, buf))
+            {
+                crc_ok[i] = 0;
+                failures++;
+            }
+        }
+        for (size_t i = 0; i < adler_count; i++)
+        {
+            if (adler_ok[i] && zipc_check_adler(adlers[i].fn, buf))
+            {
+                adler_ok[i] = 0;
+                failures++;
+            }
+        }
+    }
+    free(buf);
+    return failures;
+}
+
+// Candidates are listed fastest first; the bytewise and scalar entries are the references.
+static size_t zipc_crc_candidates(zipc_crc_backend* out)
+{
+    size_t n = 0;
+#if ZIPC_X86
+    if (zipc_has_pclmul()) out[n++] = (zipc_crc_backend){ "pclmul", zipc_crc32_pclmul };
+#endif
+#if ZIPC_HAVE_ARM_CRC
+    if (zipc_has_arm_crc()) out[n++] = (zipc_crc_backend){ "armv8-crc", zipc_crc32_armv8 };
+#endif
+    out[n++] = (zipc_crc_backend){ "slice8", zipc_crc32_slice8 };
+    out[n++] = (zipc_crc_backend){ "bytewise", zipc_crc32_bytewise };
+    return n;
+}
+
+static size_t zipc_adler_candidates(zipc_adler_backend* out)
+{
+    size_t n = 0;
+#if ZIPC_X86
+    if (zipc_has_ssse3()) out[n++] = (zipc_adler_backend){ "ssse3", zipc_adler32_ssse3 };
+#endif
+#if ZIPC_ARM64
+    out[n++] = (zipc_adler_backend){ "neon", zipc_adler32_neon };
+#endif
+    out[n++] = (zipc_adler_backend){ "scalar", zipc_adler32_scalar };
+    return n;
+}
+
+static int zipc_run_checks(zipc_crc_backend* crcs, size_t* crc_count, int* crc_ok,
+                           zipc_adler_backend* adlers, size_t* adler_count, int* adler_ok)
+{
+    *crc_count = zipc_crc_candidates(crcs);
+    *adler_count = zipc_adler_candidates(adlers);
+    for (size_t i = 0; i < *crc_count; i++) crc_ok[i] = 1;
+    for (size_t i = 0; i < *adler_count; i++) adler_ok[i] = 1;
+
+    // The reference table itself must produce the standard check value.
+    if (~zipc_crc32_bytewise(~0u, (const uint8_t*)"123456789", 9) != 0xCBF43926u) return -1;
+    return zipc_check_backends(crcs, *crc_count, adlers, *adler_count, crc_ok, adler_ok);
+}
+
+static void zipc_init(void)
+{
+    zipc_build_slice_tables();
+
+    zipc_crc_backend crcs[4];
+    zipc_adler_backend adlers[3];
+    int crc_ok[4], adler_ok[3];
+    size_t crc_count, adler_count;
+    zipc_run_checks(crcs, &crc_count, crc_ok, adlers, &adler_count, adler_ok);
+
+    zipc_crc = (zipc_crc_backend){ "bytewise", zipc_crc32_bytewise };
+    for (size_t i = 0; i < crc_count; i++)
+    {
+        if (crc_ok[i])
+        {
+            zipc_crc = crcs[i];
+            break;
+        }
+    }
+    zipc_adler = (zipc_adler_backend){ "scalar", zipc_adler32_scalar };
+    for (size_t i = 0; i < adler_count; i++)
+    {
+        if (adler_ok[i])
+        {
+            zipc_adler = adlers[i];
+            break;
+        }
+    }
+}
+
+const char* zipc_crc32_backend(void)
+{
+    pthread_once(&zipc_once, zipc_init);
+    return zipc_crc.name;
+}
+
+const char* zipc_adler32_backend(void)
+{
+    pthread_once(&zipc_once, zipc_init);
+    return zipc_adler.name;
+}
+
+int zipc_self_check(void)
+{
+    pthread_once(&zipc_once, zipc_init);
+
+    zipc_crc_backend crcs[4];
+    zipc_adler_backend adlers[3];
+    int crc_ok[4], adler_ok[3];
+    size_t crc_count, adler_count;
+    return zipc_run_checks(crcs, &crc_count, crc_ok, adlers, &adler_count, adler_ok);
+}
+
+#pragma mark - miniz entry points
+
+mz_ulong mz_crc32(mz_ulong crc, const mz_uint8* ptr, size_t buf_len)
+{
+    if (!buf_len) return (mz_uint32)crc;
+    pthread_once(&zipc_once, zipc_init);
+    return ~zipc_crc.fn(~(mz_uint32)crc, ptr, buf_len);
+}
+
+mz_ulong mz_adler32(mz_ulong adler, const unsigned char* ptr, size_t buf_len)
+{
+    if (!ptr) return MZ_ADLER32_INIT;
+    pthread_once(&zipc_once, zipc_init);
+    return zipc_adler.fn((mz_uint32)adler, ptr, buf_len);
+}
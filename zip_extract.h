@@ -0,0 +1,41 @@
+// File: zip_extract.h
+// Location: プロジェクト直下
+
+#ifndef ZIP_EXTRACT_H
+#define ZIP_EXTRACT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct zipx_failure
+{
+    const char* name;          // entry name as stored in the archive
+    int error;                 // errno-style code, 0 if zip_error is set
+    int zip_error;             // mz_zip_error, 0 if error is set
+} zipx_failure;
+
+typedef struct zipx_options
+{
+    int num_threads;           // 0 = number of online CPUs
+} zipx_options;
+
+typedef struct zipx_result
+{
+    size_t entries;
+    size_t extracted;
+    uint64_t bytes_out;
+    zipx_failure* failures;    // one record per entry that could not be extracted
+    size_t failure_count;
+    void* storage;             // owns the names referenced by failures
+} zipx_result;
+
+// Reads the central directory once, creates every directory up front and
+// decompresses the files on a pool of workers sharing one descriptor.
+// Returns 0 when the archive could be opened; per-entry problems are listed
+// in result->failures. Release the result with zipx_result_free().
+int zipx_extract_archive(const char* archive_path, const char* dest_dir,
+                         const zipx_options* opts, zipx_result* result);
+
+void zipx_result_free(zipx_result* result);
+
+#endif
@@ -0,0 +1,387 @@
+// File: zip_extract.c
+// Location: プロジェクト直下
+
+#include "zip_extract.h"
+#include "miniz.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define ZIPX_MAX_THREADS 64
+
+typedef struct zipx_item
+{
+    mz_uint32 index;
+    char* name;
+    size_t dir_len;            // length of the parent directory part of name
+    int is_dir;
+    mode_t mode;
+    time_t mtime;
+    uint64_t size;
+    int error;
+    int zip_error;
+} zipx_item;
+
+typedef struct zipx_storage
+{
+    zipx_item* items;
+    size_t count;
+} zipx_storage;
+
+typedef struct zipx_dir
+{
+    const char* name;
+    size_t len;
+    zipx_item* item;           // explicit directory entry, NULL for implied parents
+} zipx_dir;
+
+typedef struct zipx_job
+{
+    zipx_item* item;
+    uint64_t size;
+} zipx_job;
+
+typedef struct zipx_ctx
+{
+    mz_zip_archive* zip;
+    int dest_fd;
+    zipx_job* jobs;
+    size_t job_count;
+    size_t next;
+    size_t extracted;
+    uint64_t bytes_out;
+} zipx_ctx;
+
+typedef struct zipx_sink
+{
+    int fd;
+    int error;
+} zipx_sink;
+
+static size_t zipx_read_cb(void* opaque, mz_uint64 ofs, void* buf, size_t n)
+{
+    int fd = *(const int*)opaque;
+    size_t done = 0;
+    while (done < n)
+    {
+        ssize_t r = pread(fd, (char*)buf + done, n - done, (off_t)(ofs + done));
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) break;
+        done += (size_t)r;
+    }
+    return done;
+}
+
+static size_t zipx_write_cb(void* opaque, mz_uint64 ofs, const void* buf, size_t n)
+{
+    zipx_sink* sink = opaque;
+    size_t done = 0;
+    while (done < n)
+    {
+        ssize_t w = pwrite(sink->fd, (const char*)buf + done, n - done, (off_t)(ofs + done));
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0)
+        {
+            sink->error = w < 0 ? errno : EIO;
+            break;
+        }
+        done += (size_t)w;
+    }
+    return done;
+}
+
+// Rejects absolute names and ".." components so entries cannot escape dest_dir.
+static int zipx_safe_name(const char* name)
+{
+    if (!name[0] || name[0] == '/') return 0;
+    const char* p = name;
+    while (*p)
+    {
+        const char* end = strchr(p, '/');
+        size_t len = end ? (size_t)(end - p) : strlen(p);
+        if (len == 2 && p[0] == '.' && p[1] == '.') return 0;
+        if (!end) break;
+        p = end + 1;
+    }
+    return 1;
+}
+
+static int zipx_dir_cmp(const void* a, const void* b)
+{
+    const zipx_dir* x = a;
+    const zipx_dir* y = b;
+    size_t n = x->len < y->len ? x->len : y->len;
+    int c = memcmp(x->name, y->name, n);
+    if (c) return c;
+    return (x->len > y->len) - (x->len < y->len);
+}
+
+static int zipx_job_cmp(const void* a, const void* b)
+{
+    const zipx_job* x = a;
+    const zipx_job* y = b;
+    return (x->size < y->size) - (x->size > y->size);
+}
+
+static int zipx_mkdirs(int dest_fd, char* rel)
+{
+    if (mkdirat(dest_fd, rel, 0755) == 0 || errno == EEXIST) return 0;
+    if (errno != ENOENT) return errno;
+    char* slash = strrchr(rel, '/');
+    if (!slash) return ENOENT;
+    *slash = '\0';
+    int err = zipx_mkdirs(dest_fd, rel);
+    *slash = '/';
+    if (err) return err;
+    if (mkdirat(dest_fd, rel, 0755) == 0 || errno == EEXIST) return 0;
+    return errno;
+}
+
+// Creates the whole tree in one sorted pass so parents always precede children.
+static void zipx_create_tree(int dest_fd, zipx_item* items, size_t count)
+{
+    zipx_dir* dirs = malloc((count ? count : 1) * sizeof(zipx_dir));
+    if (!dirs) return;
+    size_t n = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        zipx_item* it = &items[i];
+        if (it->error) continue;
+        if (it->is_dir)
+            dirs[n++] = (zipx_dir){ it->name, strlen(it->name), it };
+        else if (it->dir_len)
+            dirs[n++] = (zipx_dir){ it->name, it->dir_len, NULL };
+    }
+    qsort(dirs, n, sizeof(zipx_dir), zipx_dir_cmp);
+
+    char rel[PATH_MAX];
+    for (size_t i = 0; i < n; i++)
+    {
+        int dup = i > 0 && zipx_dir_cmp(&dirs[i - 1], &dirs[i]) == 0;
+        if (dup && !dirs[i].item) continue;
+        int err = ENAMETOOLONG;
+        if (dirs[i].len < sizeof(rel))
+        {
+            memcpy(rel, dirs[i].name, dirs[i].len);
+            rel[dirs[i].len] = '\0';
+            err = dup ? 0 : zipx_mkdirs(dest_fd, rel);
+        }
+        if (dirs[i].item) dirs[i].item->error = err;
+    }
+    free(dirs);
+}
+
+static void zipx_extract_one(zipx_ctx* ctx, mz_zip_archive* zip, zipx_item* it)
+{
+    int fd = openat(ctx->dest_fd, it->name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, it->mode);
+    if (fd < 0)
+    {
+        it->error = errno;
+        return;
+    }
+
+    zipx_sink sink = { fd, 0 };
+    if (it->size && !mz_zip_reader_extract_to_callback(zip, it->index, zipx_write_cb, &sink, 0))
+    {
+        if (sink.error)
+            it->error = sink.error;
+        else
+            it->zip_error = mz_zip_get_last_error(zip);
+    }
+
+    if (!it->error && !it->zip_error)
+    {
+        struct timespec times[2];
+        times[0].tv_sec = times[1].tv_sec = it->mtime;
+        times[0].tv_nsec = times[1].tv_nsec = 0;
+        futimens(fd, times);
+    }
+    if (close(fd) != 0 && !it->error && !it->zip_error) it->error = errno;
+
+    if (it->error || it->zip_error)
+    {
+        unlinkat(ctx->dest_fd, it->name, 0);
+        return;
+    }
+    __atomic_fetch_add(&ctx->extracted, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&ctx->bytes_out, it->size, __ATOMIC_RELAXED);
+}
+
+static void* zipx_worker(void* arg)
+{
+    zipx_ctx* ctx = arg;
+    // A private copy of the reader: same parsed central directory and descriptor,
+    // but its own error slot, so workers never contend on shared state.
+    mz_zip_archive zip = *ctx->zip;
+    for (;;)
+    {
+        size_t i = __atomic_fetch_add(&ctx->next, 1, __ATOMIC_RELAXED);
+        if (i >= ctx->job_count) break;
+        zipx_extract_one(ctx, &zip, ctx->jobs[i].item);
+    }
+    return NULL;
+}
+
+static int zipx_load_items(mz_zip_archive* zip, zipx_storage* storage)
+{
+    mz_uint count = mz_zip_reader_get_num_files(zip);
+    storage->items = calloc(count ? count : 1, sizeof(zipx_item));
+    if (!storage->items) return ENOMEM;
+
+    mz_zip_archive_file_stat st;
+    for (mz_uint i = 0; i < count; i++)
+    {
+        zipx_item* it = &storage->items[storage->count++];
+        it->index = i;
+        if (!mz_zip_reader_file_stat(zip, i, &st))
+        {
+            it->name = strdup("");
+            it->zip_error = mz_zip_get_last_error(zip);
+            if (!it->name) return ENOMEM;
+            continue;
+        }
+
+        size_t len = strlen(st.m_filename);
+        while (len > 0 && st.m_filename[len - 1] == '/') st.m_filename[--len] = '\0';
+        it->name = strdup(st.m_filename);
+        if (!it->name) return ENOMEM;
+
+        it->is_dir = st.m_is_directory;
+        it->size = st.m_uncomp_size;
+        it->mtime = st.m_time;
+        char* slash = strrchr(it->name, '/');
+        it->dir_len = slash ? (size_t)(slash - it->name) : 0;
+
+        mode_t unix_mode = (st.m_version_made_by >> 8) == 3 ? (mode_t)(st.m_external_attr >> 16) : 0;
+        it->mode = (unix_mode & 0777) ? (unix_mode & 0777) : (it->is_dir ? 0755 : 0644);
+
+        if (!zipx_safe_name(it->name))
+            it->error = EACCES;
+        else if (!st.m_is_supported)
+            it->zip_error = MZ_ZIP_UNSUPPORTED_METHOD;
+    }
+    return 0;
+}
+
+static void zipx_collect_failures(zipx_storage* storage, zipx_result* result)
+{
+    size_t failed = 0;
+    for (size_t i = 0; i < storage->count; i++)
+        if (storage->items[i].error || storage->items[i].zip_error) failed++;
+    if (!failed) return;
+
+    result->failures = calloc(failed, sizeof(zipx_failure));
+    if (!result->failures) return;
+    for (size_t i = 0; i < storage->count; i++)
+    {
+        zipx_item* it = &storage->items[i];
+        if (!it->error && !it->zip_error) continue;
+        zipx_failure* f = &result->failures[result->failure_count++];
+        f->name = it->name;
+        f->error = it->error;
+        f->zip_error = it->zip_error;
+    }
+}
+
+int zipx_extract_archive(const char* archive_path, const char* dest_dir,
+                         const zipx_options* opts, zipx_result* result)
+{
+    memset(result, 0, sizeof(*result));
+
+    int fd = open(archive_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return errno;
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        int err = errno;
+        close(fd);
+        return err;
+    }
+
+    mz_zip_archive zip;
+    memset(&zip, 0, sizeof(zip));
+    zip.m_pRead = zipx_read_cb;
+    zip.m_pIO_opaque = &fd;
+    if (!mz_zip_reader_init(&zip, (mz_uint64)st.st_size, 0))
+    {
+        close(fd);
+        return EINVAL;
+    }
+
+    zipx_storage* storage = calloc(1, sizeof(zipx_storage));
+    int err = storage ? zipx_load_items(&zip, storage) : ENOMEM;
+    result->storage = storage;
+
+    int dest_fd = -1;
+    if (!err)
+    {
+        mkdir(dest_dir, 0755);
+        dest_fd = open(dest_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dest_fd < 0) err = errno;
+    }
+
+    if (!err)
+    {
+        result->entries = storage->count;
+        zipx_create_tree(dest_fd, storage->items, storage->count);
+
+        zipx_ctx ctx;
+        memset(&ctx, 0, sizeof(ctx));
+        ctx.zip = &zip;
+        ctx.dest_fd = dest_fd;
+        ctx.jobs = malloc((storage->count ? storage->count : 1) * sizeof(zipx_job));
+        if (!ctx.jobs) err = ENOMEM;
+
+        for (size_t i = 0; !err && i < storage->count; i++)
+        {
+            zipx_item* it = &storage->items[i];
+            if (it->is_dir && !it->error) ctx.extracted++;
+            if (it->is_dir || it->error || it->zip_error) continue;
+            ctx.jobs[ctx.job_count++] = (zipx_job){ it, it->size };
+        }
+        // Largest entries first keeps the tail of the run balanced across workers.
+        if (!err) qsort(ctx.jobs, ctx.job_count, sizeof(zipx_job), zipx_job_cmp);
+
+        long cpus = (opts && opts->num_threads > 0) ? opts->num_threads : sysconf(_SC_NPROCESSORS_ONLN);
+        if (cpus < 1) cpus = 1;
+        if (cpus > ZIPX_MAX_THREADS) cpus = ZIPX_MAX_THREADS;
+        size_t threads = (size_t)cpus < ctx.job_count ? (size_t)cpus : ctx.job_count;
+
+        pthread_t tids[ZIPX_MAX_THREADS];
+        size_t started = 0;
+        for (; !err && started + 1 < threads; started++)
+        {
+            if (pthread_create(&tids[started], NULL, zipx_worker, &ctx) != 0) break;
+        }
+        if (!err) zipx_worker(&ctx);
+        for (size_t t = 0; t < started; t++) pthread_join(tids[t], NULL);
+
+        result->extracted = ctx.extracted;
+        result->bytes_out = ctx.bytes_out;
+        free(ctx.jobs);
+    }
+
+    if (storage) zipx_collect_failures(storage, result);
+    if (dest_fd >= 0) close(dest_fd);
+    mz_zip_reader_end(&zip);
+    close(fd);
+    return err;
+}
+
+void zipx_result_free(zipx_result* result)
+{
+    zipx_storage* storage = result->storage;
+    if (storage)
+    {
+        for (size_t i = 0; i < storage->count; i++) free(storage->items[i].name);
+        free(storage->items);
+        free(storage);
+    }
+    free(result->failures);
+    memset(result, 0, sizeof(*result));
+}
@@ -0,0 +1,34 @@
+// File: zip_policy.h
+// Location: プロジェクト直下
+
+#ifndef ZIP_POLICY_H
+#define ZIP_POLICY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ZIPP_LEVEL_STORE 0
+#define ZIPP_LEVEL_FAST 1
+#define ZIPP_LEVEL_SAMPLE -1      // rule value: ignore the built-in table and sample the file
+
+typedef struct zipp_rule
+{
+    const char* extension;         // without the dot, matched case-insensitively
+    int level;                     // 0 = store, 1..10 = deflate level, ZIPP_LEVEL_SAMPLE
+} zipp_rule;
+
+typedef struct zipp_policy
+{
+    const zipp_rule* rules;        // consulted before the built-in table
+    size_t rule_count;
+    int level;                     // level for data that compresses well
+} zipp_policy;
+
+// Picks the level for one file. Known media/archive extensions are stored
+// without reading; anything else is decided from the byte entropy of its first
+// block and, when that is inconclusive, a trial level-1 deflate of the block.
+// policy may be NULL for the built-in defaults.
+int zipp_choose_level(const zipp_policy* policy, const char* path, uint64_t size);
+int zipp_choose_level_fd(const zipp_policy* policy, const char* name, int fd, uint64_t size);
+
+#endif
@@ -0,0 +1,149 @@
+// File: zip_policy.c
+// Location: プロジェクト直下
+
+#include "zip_policy.h"
+#include "miniz.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#define ZIPP_SAMPLE_SIZE (64u << 10)
+#define ZIPP_MIN_SAMPLE 512u
+#define ZIPP_ENTROPY_STORE 7.9     // bits per byte; random data sits just under 8
+#define ZIPP_ENTROPY_TRIAL 7.0
+#define ZIPP_TRIAL_STORE 0.97      // deflated/raw ratio above which deflate is not worth it
+#define ZIPP_TRIAL_FAST 0.85
+
+// Formats that are already compressed; deflating them costs CPU for ~0% gain.
+static const char* const zipp_stored_extensions[] = {
+    "jpg", "jpeg", "png", "gif", "heic", "heif", "webp",
+    "mp4", "mov", "m4v", "mkv", "avi",
+    "mp3", "m4a", "aac", "flac", "ogg", "opus",
+    "zip", "7z", "rar", "gz", "tgz", "bz2", "xz", "zst", "lz4",
+    "ipa", "apk", "jar", "docx", "xlsx", "pptx",
+};
+
+static const char* zipp_extension(const char* name)
+{
+    const char* slash = strrchr(name, '/');
+    const char* base = slash ? slash + 1 : name;
+    const char* dot = strrchr(base, '.');
+    return (dot && dot != base) ? dot + 1 : NULL;
+}
+
+static int zipp_default_level(const zipp_policy* policy)
+{
+    int level = policy ? policy->level : MZ_DEFAULT_LEVEL;
+    return (level > 0 && level <= MZ_UBER_COMPRESSION) ? level : MZ_DEFAULT_LEVEL;
+}
+
+// Returns the level a rule or the built-in table dictates, or ZIPP_LEVEL_SAMPLE.
+static int zipp_lookup(const zipp_policy* policy, const char* name)
+{
+    const char* ext = zipp_extension(name);
+    if (!ext) return ZIPP_LEVEL_SAMPLE;
+
+    if (policy)
+    {
+        for (size_t i = 0; i < policy->rule_count; i++)
+        {
+            if (strcasecmp(policy->rules[i].extension, ext) != 0) continue;
+            int level = policy->rules[i].level;
+            if (level > MZ_UBER_COMPRESSION) return MZ_UBER_COMPRESSION;
+            return level < ZIPP_LEVEL_SAMPLE ? ZIPP_LEVEL_SAMPLE : level;
+        }
+    }
+    for (size_t i = 0; i < sizeof(zipp_stored_extensions) / sizeof(zipp_stored_extensions[0]); i++)
+    {
+        if (strcasecmp(zipp_stored_extensions[i], ext) == 0) return ZIPP_LEVEL_STORE;
+    }
+    return ZIPP_LEVEL_SAMPLE;
+}
+
+static double zipp_entropy(const uint8_t* buf, size_t n)
+{
+    uint32_t counts[256] = { 0 };
+    for (size_t i = 0; i < n; i++) counts[buf[i]]++;
+
+    double bits = 0.0;
+    for (int i = 0; i < 256; i++)
+    {
+        if (!counts[i]) continue;
+        double p = (double)counts[i] / (double)n;
+        bits -= p * log2(p);
+    }
+    return bits;
+}
+
+// Deflates the sample at level 1 into a buffer sized to the store threshold;
+// a result that does not fit is treated as incompressible.
+static double zipp_trial_ratio(const uint8_t* buf, size_t n)
+{
+    size_t cap = (size_t)(n * ZIPP_TRIAL_STORE);
+    void* out = malloc(cap);
+    if (!out) return 0.0;
+    int flags = (int)tdefl_create_comp_flags_from_zip_params(ZIPP_LEVEL_FAST, -15, MZ_DEFAULT_STRATEGY);
+    size_t len = tdefl_compress_mem_to_mem(out, cap, buf, n, flags);
+    free(out);
+    return len ? (double)len / (double)n : 1.0;
+}
+
+static int zipp_sample(const zipp_policy* policy, int fd, uint64_t size)
+{
+    size_t want = size < ZIPP_SAMPLE_SIZE ? (size_t)size : ZIPP_SAMPLE_SIZE;
+    uint8_t* buf = malloc(want);
+    if (!buf) return zipp_default_level(policy);
+
+    size_t got = 0;
+    while (got < want)
+    {
+        ssize_t r = pread(fd, buf + got, want - got, (off_t)got);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) break;
+        got += (size_t)r;
+    }
+
+    int level = zipp_default_level(policy);
+    if (got >= ZIPP_MIN_SAMPLE)
+    {
+        double entropy = zipp_entropy(buf, got);
+        if (entropy >= ZIPP_ENTROPY_STORE)
+        {
+            level = ZIPP_LEVEL_STORE;
+        }
+        else if (entropy >= ZIPP_ENTROPY_TRIAL)
+        {
+            double ratio = zipp_trial_ratio(buf, got);
+            if (ratio >= ZIPP_TRIAL_STORE) level = ZIPP_LEVEL_STORE;
+            else if (ratio >= ZIPP_TRIAL_FAST) level = ZIPP_LEVEL_FAST;
+        }
+    }
+    free(buf);
+    return level;
+}
+
+int zipp_choose_level_fd(const zipp_policy* policy, const char* name, int fd, uint64_t size)
+{
+    int level = zipp_lookup(policy, name);
+    if (level != ZIPP_LEVEL_SAMPLE) return level;
+    // Small files are cheap to deflate no matter what they contain.
+    if (size < ZIPP_MIN_SAMPLE || fd < 0) return zipp_default_level(policy);
+    return zipp_sample(policy, fd, size);
+}
+
+int zipp_choose_level(const zipp_policy* policy, const char* path, uint64_t size)
+{
+    int level = zipp_lookup(policy, path);
+    if (level != ZIPP_LEVEL_SAMPLE) return level;
+    if (size < ZIPP_MIN_SAMPLE) return zipp_default_level(policy);
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return zipp_default_level(policy);
+    level = zipp_sample(policy, fd, size);
+    close(fd);
+    return level;
+}
@@ -0,0 +1,49 @@
+// File: zip_stream.h
+// Location: プロジェクト直下
+
+#ifndef ZIP_STREAM_H
+#define ZIP_STREAM_H
+
+#include "zip_policy.h"
+#include "zip_writer.h"
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+
+typedef struct zips_item
+{
+    char* src_path;            // NULL for directories
+    char* archive_name;        // directories end with '/'
+    uint64_t size;
+    time_t mtime;
+} zips_item;
+
+typedef struct zips_options
+{
+    int level;                 // 0 = store, 1..10 = deflate level
+    zipw_progress_fn progress; // optional, return non-zero to cancel
+    void* progress_ctx;
+    const zipp_policy* policy; // optional, picks the level per file instead of using level
+} zips_options;
+
+typedef struct zips_result
+{
+    uint64_t bytes_in;
+    uint64_t entries;
+    int zip64;
+    char failed_name[256];     // entry being written when an error occurred
+} zips_result;
+
+// Walks each root recursively (roots become top-level entries named after
+// their last path component) and returns the flattened entry list.
+int zips_collect(const char* const* roots, size_t root_count, zips_item** items, size_t* count);
+void zips_free_items(zips_item* items, size_t count);
+
+// Streams the trees under roots into archive_path through fixed-size reads,
+// so memory use stays constant regardless of input size. Zip64 is enabled
+// automatically when a file or the archive can exceed 4 GB. Returns 0 on
+// success, ECANCELED when the progress callback asked to stop.
+int zips_write_archive(const char* archive_path, const char* const* roots, size_t root_count,
+                       const zips_options* opts, zips_result* result);
+
+#endif
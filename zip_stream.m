@@ -0,0 +1,299 @@
+// File: zip_stream.c
+// Location: プロジェクト直下
+
+#include "zip_stream.h"
+#include "miniz.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define ZIPS_PROGRESS_STEP (1u << 20)
+#define ZIPS_ZIP64_MARGIN (64ull << 20)
+
+typedef int (*zips_visit_fn)(void* ctx, const char* src, const char* name, const struct stat* st);
+
+typedef struct zips_list
+{
+    zips_item* items;
+    size_t count;
+    size_t capacity;
+} zips_list;
+
+typedef struct zips_stream
+{
+    mz_zip_archive zip;
+    const zips_options* opts;
+    zips_result* result;
+    int level;
+    int fd;
+    const char* name;
+    uint64_t done;
+    uint64_t reported;
+    uint64_t total;
+    int io_error;
+    int cancelled;
+} zips_stream;
+
+#pragma mark - Walker
+
+static int zips_walk_path(char* src, size_t src_len, char* name, size_t name_len, zips_visit_fn visit, void* ctx);
+
+static int zips_walk_dir(char* src, size_t src_len, char* name, size_t name_len, zips_visit_fn visit, void* ctx)
+{
+    DIR* dir = opendir(src);
+    if (!dir) return (errno == EACCES || errno == EPERM) ? 0 : errno;
+
+    int err = 0;
+    struct dirent* entry;
+    while (!err && (entry = readdir(dir)) != NULL)
+    {
+        const char* d = entry->d_name;
+        if (d[0] == '.' && (d[1] == '\0' || (d[1] == '.' && d[2] == '\0'))) continue;
+
+        size_t len = strlen(d);
+        if (src_len + len + 2 > PATH_MAX || name_len + len + 2 > PATH_MAX)
+        {
+            err = ENAMETOOLONG;
+            break;
+        }
+        src[src_len] = '/';
+        memcpy(src + src_len + 1, d, len + 1);
+        memcpy(name + name_len, d, len + 1);
+        err = zips_walk_path(src, src_len + 1 + len, name, name_len + len, visit, ctx);
+    }
+    src[src_len] = '\0';
+    name[name_len] = '\0';
+    closedir(dir);
+    return err;
+}
+
+static int zips_walk_path(char* src, size_t src_len, char* name, size_t name_len, zips_visit_fn visit, void* ctx)
+{
+    struct stat st;
+    if (lstat(src, &st) != 0) return errno;
+
+    // Links to files are archived as their contents; links to directories are
+    // never followed so cycles cannot occur.
+    if (S_ISLNK(st.st_mode) && (stat(src, &st) != 0 || !S_ISREG(st.st_mode))) return 0;
+
+    if (S_ISDIR(st.st_mode))
+    {
+        name[name_len] = '/';
+        name[name_len + 1] = '\0';
+        int err = visit(ctx, src, name, &st);
+        if (!err) err = zips_walk_dir(src, src_len, name, name_len + 1, visit, ctx);
+        name[name_len] = '\0';
+        return err;
+    }
+    if (!S_ISREG(st.st_mode)) return 0;
+    return visit(ctx, src, name, &st);
+}
+
+static int zips_walk(const char* const* roots, size_t root_count, zips_visit_fn visit, void* ctx)
+{
+    char src[PATH_MAX + 1];
+    char name[PATH_MAX + 1];
+
+    for (size_t i = 0; i < root_count; i++)
+    {
+        size_t len = strlen(roots[i]);
+        while (len > 1 && roots[i][len - 1] == '/') len--;
+        if (len == 0 || len >= PATH_MAX) return ENAMETOOLONG;
+        memcpy(src, roots[i], len);
+        src[len] = '\0';
+
+        const char* base = strrchr(src, '/');
+        base = base ? base + 1 : src;
+        size_t base_len = strlen(base);
+        if (base_len == 0) return EINVAL;
+        memcpy(name, base, base_len + 1);
+
+        int err = zips_walk_path(src, len, name, base_len, visit, ctx);
+        if (err) return err;
+    }
+    return 0;
+}
+
+static int zips_collect_visit(void* ctx, const char* src, const char* name, const struct stat* st)
+{
+    zips_list* list = ctx;
+    if (list->count == list->capacity)
+    {
+        size_t cap = list->capacity ? list->capacity * 2 : 256;
+        zips_item* items = realloc(list->items, cap * sizeof(zips_item));
+        if (!items) return ENOMEM;
+        list->items = items;
+        list->capacity = cap;
+    }
+    zips_item* it = &list->items[list->count];
+    int is_dir = S_ISDIR(st->st_mode);
+    it->src_path = is_dir ? NULL : strdup(src);
+    it->archive_name = strdup(name);
+    it->size = is_dir ? 0 : (uint64_t)st->st_size;
+    it->mtime = st->st_mtime;
+    if (!it->archive_name || (!is_dir && !it->src_path))
+    {
+        free(it->src_path);
+        free(it->archive_name);
+        return ENOMEM;
+    }
+    list->count++;
+    return 0;
+}
+
+int zips_collect(const char* const* roots, size_t root_count, zips_item** items, size_t* count)
+{
+    zips_list list;
+    memset(&list, 0, sizeof(list));
+    int err = zips_walk(roots, root_count, zips_collect_visit, &list);
+    if (err)
+    {
+        zips_free_items(list.items, list.count);
+        *items = NULL;
+        *count = 0;
+        return err;
+    }
+    *items = list.items;
+    *count = list.count;
+    return 0;
+}
+
+void zips_free_items(zips_item* items, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        free(items[i].src_path);
+        free(items[i].archive_name);
+    }
+    free(items);
+}
+
+#pragma mark - Streaming writer
+
+static int zips_report(zips_stream* s)
+{
+    if (!s->opts || !s->opts->progress) return 0;
+    s->reported = s->done;
+    if (s->opts->progress(s->opts->progress_ctx, s->name, s->done, s->total)) s->cancelled = 1;
+    return s->cancelled;
+}
+
+static size_t zips_read_cb(void* opaque, mz_uint64 ofs, void* buf, size_t n)
+{
+    zips_stream* s = opaque;
+    if (s->cancelled) return (size_t)-1;
+
+    size_t got = 0;
+    while (got < n)
+    {
+        ssize_t r = pread(s->fd, (char*)buf + got, n - got, (off_t)(ofs + got));
+        if (r < 0 && errno == EINTR) continue;
+        if (r < 0)
+        {
+            s->io_error = errno;
+            return (size_t)-1;
+        }
+        if (r == 0) break;
+        got += (size_t)r;
+    }
+
+    s->done += got;
+    if (s->done - s->reported >= ZIPS_PROGRESS_STEP && zips_report(s)) return (size_t)-1;
+    return got;
+}
+
+static int zips_count_visit(void* ctx, const char* src, const char* name, const struct stat* st)
+{
+    (void)src;
+    (void)name;
+    zips_stream* s = ctx;
+    s->result->entries++;
+    if (S_ISREG(st->st_mode)) s->total += (uint64_t)st->st_size;
+    return 0;
+}
+
+static int zips_write_entry(zips_stream* s, const char* src, const char* name, const struct stat* st)
+{
+    MZ_TIME_T mtime = st->st_mtime;
+    mz_bool ok;
+
+    s->name = name;
+    if (zips_report(s)) return ECANCELED;
+
+    if (S_ISDIR(st->st_mode))
+    {
+        ok = mz_zip_writer_add_mem_ex_v2(&s->zip, name, NULL, 0, NULL, 0, (mz_uint)s->level, 0, 0, &mtime, NULL, 0, NULL, 0);
+    }
+    else
+    {
+        s->fd = open(src, O_RDONLY | O_CLOEXEC);
+        if (s->fd < 0) return errno;
+        int level = s->level;
+        if (s->opts && s->opts->policy) level = zipp_choose_level_fd(s->opts->policy, name, s->fd, (uint64_t)st->st_size);
+        ok = mz_zip_writer_add_read_buf_callback(&s->zip, name, zips_read_cb, s, (mz_uint64)st->st_size, &mtime,
+                                                 NULL, 0, (mz_uint)level, NULL, 0, NULL, 0);
+        close(s->fd);
+        s->fd = -1;
+    }
+
+    if (ok) return 0;
+    if (s->cancelled) return ECANCELED;
+    if (s->io_error) return s->io_error;
+    return mz_zip_get_last_error(&s->zip) == MZ_ZIP_ALLOC_FAILED ? ENOMEM : EIO;
+}
+
+static int zips_write_visit(void* ctx, const char* src, const char* name, const struct stat* st)
+{
+    zips_stream* s = ctx;
+    int err = zips_write_entry(s, src, name, st);
+    if (err) strncpy(s->result->failed_name, name, sizeof(s->result->failed_name) - 1);
+    return err;
+}
+
+int zips_write_archive(const char* archive_path, const char* const* roots, size_t root_count,
+                       const zips_options* opts, zips_result* result)
+{
+    zips_result local_result;
+    if (!result) result = &local_result;
+    memset(result, 0, sizeof(*result));
+
+    zips_stream s;
+    memset(&s, 0, sizeof(s));
+    s.opts = opts;
+    s.result = result;
+    s.fd = -1;
+    s.level = opts ? opts->level : MZ_DEFAULT_LEVEL;
+    if (s.level < 0 || s.level > MZ_UBER_COMPRESSION) return EINVAL;
+
+    // A metadata-only pass sizes the job so Zip64 can be chosen before the
+    // first header is written and progress has a stable total.
+    int err = zips_walk(roots, root_count, zips_count_visit, &s);
+    if (err) return err;
+    result->bytes_in = s.total;
+
+    mz_uint flags = 0;
+    if (s.total + ZIPS_ZIP64_MARGIN >= 0xFFFFFFFFull || result->entries >= 0xFFFF)
+    {
+        flags |= MZ_ZIP_FLAG_WRITE_ZIP64;
+        result->zip64 = 1;
+    }
+    if (!mz_zip_writer_init_file_v2(&s.zip, archive_path, 0, flags)) return EIO;
+
+    err = zips_walk(roots, root_count, zips_write_visit, &s);
+    if (!err && !mz_zip_writer_finalize_archive(&s.zip)) err = EIO;
+    mz_zip_writer_end(&s.zip);
+
+    if (err)
+    {
+        unlink(archive_path);
+        return err;
+    }
+    s.name = "";
+    zips_report(&s);
+    return 0;
+}
@@ -0,0 +1,42 @@
+// File: zip_writer.h
+// Location: プロジェクト直下
+
+#ifndef ZIP_WRITER_H
+#define ZIP_WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// Called as data is committed to the archive; return non-zero to cancel.
+typedef int (*zipw_progress_fn)(void* ctx, const char* archive_name, uint64_t done, uint64_t total);
+
+typedef struct zipw_entry
+{
+    const char* src_path;      // NULL for directory entries
+    const char* archive_name;  // directories must end with '/'
+    int level;                 // 0 = store, 1..10 = deflate level
+} zipw_entry;
+
+typedef struct zipw_options
+{
+    int num_threads;           // 0 = number of online CPUs
+    size_t chunk_size;         // files larger than this are deflated in parallel chunks, 0 = default
+    zipw_progress_fn progress; // optional
+    void* progress_ctx;
+} zipw_options;
+
+typedef struct zipw_result
+{
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    size_t failed_index;       // entry that caused the failure, (size_t)-1 if none
+    int error;                 // errno-style code, 0 on success
+} zipw_result;
+
+// Compresses the entries with a pool of deflate workers and a single
+// sequencer that writes them to archive_path in order. Returns 0 on success.
+int zipw_write_archive(const char* archive_path, const zipw_entry* entries, size_t count,
+                       const zipw_options* opts, zipw_result* result);
+
+#endif
@@ -0,0 +1,679 @@
+// File: zip_writer.c
+// Location: プロジェクト直下
+
+#include "zip_writer.h"
+#include "miniz.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define ZIPW_DEFAULT_CHUNK (1u << 20)
+#define ZIPW_MAX_THREADS 64
+#define ZIPW_OUT_BUF (1u << 20)
+#define ZIPW_U32_MAX 0xFFFFFFFFull
+#define ZIPW_U16_MAX 0xFFFFull
+
+typedef struct zipw_job
+{
+    size_t entry;
+    uint64_t offset;
+    size_t length;
+    int first;
+    int last;
+} zipw_job;
+
+typedef struct zipw_slot
+{
+    unsigned char* data;
+    size_t size;
+    size_t capacity;
+    uint32_t crc;
+    int ready;
+    int error;
+} zipw_slot;
+
+typedef struct zipw_info
+{
+    uint64_t size;
+    mode_t mode;
+    int is_dir;
+    int zip64;
+    uint16_t method;
+    uint16_t dos_time;
+    uint16_t dos_date;
+    uint64_t header_offset;
+    uint64_t comp_size;
+    uint32_t crc;
+} zipw_info;
+
+typedef struct zipw_ctx
+{
+    const zipw_entry* entries;
+    zipw_info* info;
+    zipw_job* jobs;
+    size_t job_count;
+    zipw_slot* slots;
+    size_t window;
+    size_t next_job;
+    size_t written;
+    int abort;
+    pthread_mutex_t lock;
+    pthread_cond_t job_cond;
+    pthread_cond_t done_cond;
+} zipw_ctx;
+
+typedef struct zipw_out
+{
+    int fd;
+    unsigned char* buf;
+    size_t len;
+    uint64_t base;
+} zipw_out;
+
+typedef struct zipw_bytes
+{
+    unsigned char* data;
+    size_t size;
+    size_t capacity;
+} zipw_bytes;
+
+#pragma mark - Helpers
+
+static void zipw_put16(unsigned char* p, uint16_t v)
+{
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+}
+
+static void zipw_put32(unsigned char* p, uint32_t v)
+{
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+    p[3] = (unsigned char)(v >> 24);
+}
+
+static void zipw_put64(unsigned char* p, uint64_t v)
+{
+    zipw_put32(p, (uint32_t)v);
+    zipw_put32(p + 4, (uint32_t)(v >> 32));
+}
+
+static int zipw_reserve(unsigned char** data, size_t* capacity, size_t needed)
+{
+    if (needed <= *capacity) return 1;
+    size_t cap = *capacity ? *capacity : 4096;
+    while (cap < needed) cap *= 2;
+    unsigned char* p = realloc(*data, cap);
+    if (!p) return 0;
+    *data = p;
+    *capacity = cap;
+    return 1;
+}
+
+static int zipw_bytes_append(zipw_bytes* b, const void* p, size_t n)
+{
+    if (!zipw_reserve(&b->data, &b->capacity, b->size + n)) return 0;
+    memcpy(b->data + b->size, p, n);
+    b->size += n;
+    return 1;
+}
+
+static void zipw_dos_time(time_t t, uint16_t* dos_time, uint16_t* dos_date)
+{
+    struct tm tm;
+    localtime_r(&t, &tm);
+    if (tm.tm_year < 80)
+    {
+        *dos_time = 0;
+        *dos_date = (1 << 5) | 1;
+        return;
+    }
+    *dos_time = (uint16_t)((tm.tm_hour << 11) | (tm.tm_min << 5) | (tm.tm_sec >> 1));
+    *dos_date = (uint16_t)(((tm.tm_year - 80) << 9) | ((tm.tm_mon + 1) << 5) | tm.tm_mday);
+}
+
+// zlib's crc32_combine: CRC of A||B from crc(A), crc(B) and len(B).
+static uint32_t zipw_gf2_times(const uint32_t* mat, uint32_t vec)
+{
+    uint32_t sum = 0;
+    while (vec)
+    {
+        if (vec & 1) sum ^= *mat;
+        vec >>= 1;
+        mat++;
+    }
+    return sum;
+}
+
+static void zipw_gf2_square(uint32_t* square, const uint32_t* mat)
+{
+    for (int n = 0; n < 32; n++) square[n] = zipw_gf2_times(mat, mat[n]);
+}
+
+static uint32_t zipw_crc32_combine(uint32_t crc1, uint32_t crc2, uint64_t len2)
+{
+    uint32_t even[32], odd[32];
+    if (len2 == 0) return crc1;
+
+    odd[0] = 0xEDB88320u;
+    uint32_t row = 1;
+    for (int n = 1; n < 32; n++)
+    {
+        odd[n] = row;
+        row <<= 1;
+    }
+    zipw_gf2_square(even, odd);
+    zipw_gf2_square(odd, even);
+
+    do
+    {
+        zipw_gf2_square(even, odd);
+        if (len2 & 1) crc1 = zipw_gf2_times(even, crc1);
+        len2 >>= 1;
+        if (len2 == 0) break;
+        zipw_gf2_square(odd, even);
+        if (len2 & 1) crc1 = zipw_gf2_times(odd, crc1);
+        len2 >>= 1;
+    } while (len2);
+
+    return crc1 ^ crc2;
+}
+
+#pragma mark - Output
+
+static int zipw_out_flush(zipw_out* out)
+{
+    size_t done = 0;
+    while (done < out->len)
+    {
+        ssize_t n = write(out->fd, out->buf + done, out->len - done);
+        if (n < 0)
+        {
+            if (errno == EINTR) continue;
+            return errno;
+        }
+        done += (size_t)n;
+    }
+    out->base += out->len;
+    out->len = 0;
+    return 0;
+}
+
+static int zipw_out_write(zipw_out* out, const void* p, size_t n)
+{
+    if (out->len + n > ZIPW_OUT_BUF)
+    {
+        int err = zipw_out_flush(out);
+        if (err) return err;
+    }
+    if (n >= ZIPW_OUT_BUF)
+    {
+        size_t done = 0;
+        while (done < n)
+        {
+            ssize_t w = write(out->fd, (const unsigned char*)p + done, n - done);
+            if (w < 0)
+            {
+                if (errno == EINTR) continue;
+                return errno;
+            }
+            done += (size_t)w;
+        }
+        out->base += n;
+        return 0;
+    }
+    memcpy(out->buf + out->len, p, n);
+    out->len += n;
+    return 0;
+}
+
+static uint64_t zipw_out_pos(const zipw_out* out)
+{
+    return out->base + out->len;
+}
+
+// Rewrites bytes that were already emitted, either still in the buffer or on disk.
+static int zipw_out_patch(zipw_out* out, uint64_t offset, const void* p, size_t n)
+{
+    if (offset >= out->base)
+    {
+        memcpy(out->buf + (offset - out->base), p, n);
+        return 0;
+    }
+    if (pwrite(out->fd, p, n, (off_t)offset) != (ssize_t)n) return errno ? errno : EIO;
+    return 0;
+}
+
+#pragma mark - Workers
+
+static mz_bool zipw_put_buf(const void* buf, int len, void* user)
+{
+    zipw_slot* slot = user;
+    if (!zipw_reserve(&slot->data, &slot->capacity, slot->size + (size_t)len)) return MZ_FALSE;
+    memcpy(slot->data + slot->size, buf, (size_t)len);
+    slot->size += (size_t)len;
+    return MZ_TRUE;
+}
+
+static int zipw_run_job(zipw_ctx* ctx, const zipw_job* job, zipw_slot* slot, tdefl_compressor* comp,
+                        unsigned char** in, size_t* in_cap)
+{
+    const zipw_entry* e = &ctx->entries[job->entry];
+    const zipw_info* fi = &ctx->info[job->entry];
+
+    slot->size = 0;
+    slot->crc = MZ_CRC32_INIT;
+    if (job->length == 0) return 0;
+
+    if (!zipw_reserve(in, in_cap, job->length)) return ENOMEM;
+
+    int fd = open(e->src_path, O_RDONLY);
+    if (fd < 0) return errno;
+    size_t got = 0;
+    int err = 0;
+    while (got < job->length)
+    {
+        ssize_t n = pread(fd, *in + got, job->length - got, (off_t)(job->offset + got));
+        if (n < 0)
+        {
+            if (errno == EINTR) continue;
+            err = errno;
+            break;
+        }
+        if (n == 0)
+        {
+            err = EIO;  // file shrank after it was planned
+            break;
+        }
+        got += (size_t)n;
+    }
+    close(fd);
+    if (err) return err;
+
+    slot->crc = (uint32_t)mz_crc32(MZ_CRC32_INIT, *in, job->length);
+
+    if (fi->method == 0)
+    {
+        if (!zipw_reserve(&slot->data, &slot->capacity, job->length)) return ENOMEM;
+        memcpy(slot->data, *in, job->length);
+        slot->size = job->length;
+        return 0;
+    }
+
+    // Every chunk gets a fresh compressor; non-final chunks end on a byte-aligned
+    // sync flush so the pieces concatenate into one valid deflate stream.
+    mz_uint flags = tdefl_create_comp_flags_from_zip_params(e->level, -15, MZ_DEFAULT_STRATEGY);
+    if (tdefl_init(comp, zipw_put_buf, slot, (int)flags) != TDEFL_STATUS_OKAY) return EINVAL;
+    tdefl_status status = tdefl_compress_buffer(comp, *in, job->length, job->last ? TDEFL_FINISH : TDEFL_SYNC_FLUSH);
+    if (status != (job->last ? TDEFL_STATUS_DONE : TDEFL_STATUS_OKAY)) return ENOMEM;
+    return 0;
+}
+
+static void* zipw_worker(void* arg)
+{
+    zipw_ctx* ctx = arg;
+    tdefl_compressor* comp = malloc(sizeof(tdefl_compressor));
+    unsigned char* in = NULL;
+    size_t in_cap = 0;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&ctx->lock);
+        while (!ctx->abort && ctx->next_job < ctx->job_count && ctx->next_job >= ctx->written + ctx->window)
+            pthread_cond_wait(&ctx->job_cond, &ctx->lock);
+        if (ctx->abort || ctx->next_job >= ctx->job_count)
+        {
+            pthread_mutex_unlock(&ctx->lock);
+            break;
+        }
+        size_t j = ctx->next_job++;
+        pthread_mutex_unlock(&ctx->lock);
+
+        zipw_slot* slot = &ctx->slots[j % ctx->window];
+        int err = comp ? zipw_run_job(ctx, &ctx->jobs[j], slot, comp, &in, &in_cap) : ENOMEM;
+
+        pthread_mutex_lock(&ctx->lock);
+        slot->error = err;
+        slot->ready = 1;
+        pthread_cond_broadcast(&ctx->done_cond);
+        pthread_mutex_unlock(&ctx->lock);
+    }
+
+    free(in);
+    free(comp);
+    return NULL;
+}
+
+#pragma mark - Sequencer
+
+static int zipw_write_local_header(zipw_out* out, const zipw_entry* e, zipw_info* fi)
+{
+    unsigned char h[30 + 20];
+    size_t name_len = strlen(e->archive_name);
+    uint16_t extra_len = fi->zip64 ? 20 : 0;
+
+    fi->header_offset = zipw_out_pos(out);
+    memset(h, 0, sizeof(h));
+    zipw_put32(h, 0x04034b50);
+    zipw_put16(h + 4, fi->zip64 ? 45 : 20);
+    zipw_put16(h + 6, 1 << 11);
+    zipw_put16(h + 8, fi->method);
+    zipw_put16(h + 10, fi->dos_time);
+    zipw_put16(h + 12, fi->dos_date);
+    zipw_put16(h + 26, (uint16_t)name_len);
+    zipw_put16(h + 28, extra_len);
+
+    int err = zipw_out_write(out, h, 30);
+    if (!err) err = zipw_out_write(out, e->archive_name, name_len);
+    if (!err && fi->zip64)
+    {
+        zipw_put16(h + 30, 0x0001);
+        zipw_put16(h + 32, 16);
+        err = zipw_out_write(out, h + 30, 20);
+    }
+    return err;
+}
+
+static int zipw_finish_entry(zipw_out* out, zipw_bytes* cdir, const zipw_entry* e, zipw_info* fi)
+{
+    unsigned char h[46];
+    unsigned char extra[28];
+    size_t name_len = strlen(e->archive_name);
+
+    if (!fi->zip64 && fi->comp_size >= ZIPW_U32_MAX) return EFBIG;
+
+    // Fill in the CRC and sizes that were unknown when the header went out.
+    unsigned char fix[12];
+    zipw_put32(fix, fi->crc);
+    zipw_put32(fix + 4, fi->zip64 ? 0xFFFFFFFFu : (uint32_t)fi->comp_size);
+    zipw_put32(fix + 8, fi->zip64 ? 0xFFFFFFFFu : (uint32_t)fi->size);
+    int err = zipw_out_patch(out, fi->header_offset + 14, fix, sizeof(fix));
+    if (!err && fi->zip64)
+    {
+        unsigned char sizes[16];
+        zipw_put64(sizes, fi->size);
+        zipw_put64(sizes + 8, fi->comp_size);
+        err = zipw_out_patch(out, fi->header_offset + 30 + name_len + 4, sizes, sizeof(sizes));
+    }
+    if (err) return err;
+
+    int big_size = fi->zip64 || fi->size >= ZIPW_U32_MAX;
+    int big_comp = fi->zip64 || fi->comp_size >= ZIPW_U32_MAX;
+    int big_ofs = fi->header_offset >= ZIPW_U32_MAX;
+    size_t extra_len = 0;
+    if (big_size || big_comp || big_ofs)
+    {
+        extra_len = 4;
+        if (big_size) zipw_put64(extra + extra_len, fi->size), extra_len += 8;
+        if (big_comp) zipw_put64(extra + extra_len, fi->comp_size), extra_len += 8;
+        if (big_ofs) zipw_put64(extra + extra_len, fi->header_offset), extra_len += 8;
+        zipw_put16(extra, 0x0001);
+        zipw_put16(extra + 2, (uint16_t)(extra_len - 4));
+    }
+
+    uint32_t ext_attr = ((uint32_t)fi->mode << 16) | (fi->is_dir ? 0x10 : 0);
+    memset(h, 0, sizeof(h));
+    zipw_put32(h, 0x02014b50);
+    zipw_put16(h + 4, (3 << 8) | 45);
+    zipw_put16(h + 6, extra_len ? 45 : 20);
+    zipw_put16(h + 8, 1 << 11);
+    zipw_put16(h + 10, fi->method);
+    zipw_put16(h + 12, fi->dos_time);
+    zipw_put16(h + 14, fi->dos_date);
+    zipw_put32(h + 16, fi->crc);
+    zipw_put32(h + 20, big_comp ? 0xFFFFFFFFu : (uint32_t)fi->comp_size);
+    zipw_put32(h + 24, big_size ? 0xFFFFFFFFu : (uint32_t)fi->size);
+    zipw_put16(h + 28, (uint16_t)name_len);
+    zipw_put16(h + 30, (uint16_t)extra_len);
+    zipw_put32(h + 38, ext_attr);
+    zipw_put32(h + 42, big_ofs ? 0xFFFFFFFFu : (uint32_t)fi->header_offset);
+
+    if (!zipw_bytes_append(cdir, h, sizeof(h)) ||
+        !zipw_bytes_append(cdir, e->archive_name, name_len) ||
+        !zipw_bytes_append(cdir, extra, extra_len))
+        return ENOMEM;
+    return 0;
+}
+
+static int zipw_write_end(zipw_out* out, const zipw_bytes* cdir, size_t count)
+{
+    uint64_t cdir_ofs = zipw_out_pos(out);
+    int err = zipw_out_write(out, cdir->data, cdir->size);
+    if (err) return err;
+
+    int zip64 = count >= ZIPW_U16_MAX || cdir_ofs >= ZIPW_U32_MAX || cdir->size >= ZIPW_U32_MAX;
+    unsigned char rec[56 + 20 + 22];
+    memset(rec, 0, sizeof(rec));
+    size_t len = 0;
+
+    if (zip64)
+    {
+        uint64_t rec_ofs = zipw_out_pos(out);
+        zipw_put32(rec, 0x06064b50);
+        zipw_put64(rec + 4, 44);
+        zipw_put16(rec + 12, (3 << 8) | 45);
+        zipw_put16(rec + 14, 45);
+        zipw_put64(rec + 24, count);
+        zipw_put64(rec + 32, count);
+        zipw_put64(rec + 40, cdir->size);
+        zipw_put64(rec + 48, cdir_ofs);
+        zipw_put32(rec + 56, 0x07064b50);
+        zipw_put64(rec + 64, rec_ofs);
+        zipw_put32(rec + 72, 1);
+        len = 76;
+    }
+
+    unsigned char* eocd = rec + len;
+    zipw_put32(eocd, 0x06054b50);
+    zipw_put16(eocd + 8, zip64 ? 0xFFFF : (uint16_t)count);
+    zipw_put16(eocd + 10, zip64 ? 0xFFFF : (uint16_t)count);
+    zipw_put32(eocd + 12, zip64 ? 0xFFFFFFFFu : (uint32_t)cdir->size);
+    zipw_put32(eocd + 16, zip64 ? 0xFFFFFFFFu : (uint32_t)cdir_ofs);
+    len += 22;
+
+    err = zipw_out_write(out, rec, len);
+    if (!err) err = zipw_out_flush(out);
+    return err;
+}
+
+#pragma mark - Planning
+
+static int zipw_plan(zipw_ctx* ctx, size_t count, size_t chunk, zipw_result* result)
+{
+    size_t job_cap = count + 16;
+    ctx->jobs = malloc(job_cap * sizeof(zipw_job));
+    if (!ctx->jobs) return ENOMEM;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const zipw_entry* e = &ctx->entries[i];
+        zipw_info* fi = &ctx->info[i];
+        struct stat st;
+        size_t name_len = strlen(e->archive_name);
+
+        if (name_len == 0 || name_len > ZIPW_U16_MAX || e->level < 0 || e->level > 10)
+        {
+            result->failed_index = i;
+            return EINVAL;
+        }
+
+        if (e->src_path)
+        {
+            if (stat(e->src_path, &st) != 0)
+            {
+                result->failed_index = i;
+                return errno;
+            }
+        }
+        else
+        {
+            memset(&st, 0, sizeof(st));
+            st.st_mode = S_IFDIR | 0755;
+            st.st_mtime = time(NULL);
+        }
+
+        fi->is_dir = S_ISDIR(st.st_mode);
+        fi->mode = st.st_mode;
+        fi->size = fi->is_dir ? 0 : (uint64_t)st.st_size;
+        fi->method = (fi->size > 0 && e->level > 0) ? MZ_DEFLATED : 0;
+        // Leave headroom for deflate's worst-case expansion on incompressible data.
+        fi->zip64 = fi->size + (fi->size >> 10) + 65536 >= ZIPW_U32_MAX;
+        zipw_dos_time(st.st_mtime, &fi->dos_time, &fi->dos_date);
+        if (fi->is_dir && e->archive_name[name_len - 1] != '/')
+        {
+            result->failed_index = i;
+            return EINVAL;
+        }
+        result->bytes_in += fi->size;
+
+        uint64_t off = 0;
+        do
+        {
+            if (ctx->job_count == job_cap)
+            {
+                job_cap *= 2;
+                zipw_job* jobs = realloc(ctx->jobs, job_cap * sizeof(zipw_job));
+                if (!jobs) return ENOMEM;
+                ctx->jobs = jobs;
+            }
+            zipw_job* job = &ctx->jobs[ctx->job_count++];
+            uint64_t remaining = fi->size - off;
+            job->entry = i;
+            job->offset = off;
+            job->length = remaining > chunk ? chunk : (size_t)remaining;
+            job->first = off == 0;
+            off += job->length;
+            job->last = off >= fi->size;
+        } while (off < fi->size);
+    }
+    return 0;
+}
+
+#pragma mark - Public
+
+int zipw_write_archive(const char* archive_path, const zipw_entry* entries, size_t count,
+                       const zipw_options* opts, zipw_result* result)
+{
+    zipw_result local_result;
+    if (!result) result = &local_result;
+    memset(result, 0, sizeof(*result));
+    result->failed_index = (size_t)-1;
+    if (!archive_path || (count && !entries)) return result->error = EINVAL;
+
+    size_t chunk = (opts && opts->chunk_size) ? opts->chunk_size : ZIPW_DEFAULT_CHUNK;
+    long cpus = (opts && opts->num_threads > 0) ? opts->num_threads : sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1) cpus = 1;
+    if (cpus > ZIPW_MAX_THREADS) cpus = ZIPW_MAX_THREADS;
+
+    zipw_ctx ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.entries = entries;
+    ctx.info = calloc(count ? count : 1, sizeof(zipw_info));
+    if (!ctx.info) return result->error = ENOMEM;
+
+    int err = zipw_plan(&ctx, count, chunk, result);
+    if (err)
+    {
+        free(ctx.jobs);
+        free(ctx.info);
+        return result->error = err;
+    }
+
+    size_t threads = (size_t)cpus < ctx.job_count ? (size_t)cpus : ctx.job_count;
+    ctx.window = threads * 2 < 2 ? 2 : threads * 2;
+    ctx.slots = calloc(ctx.window, sizeof(zipw_slot));
+
+    zipw_out out;
+    memset(&out, 0, sizeof(out));
+    out.buf = malloc(ZIPW_OUT_BUF);
+    out.fd = open(archive_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (!ctx.slots || !out.buf || out.fd < 0)
+    {
+        err = out.fd < 0 ? errno : ENOMEM;
+        if (out.fd >= 0) close(out.fd);
+        free(out.buf);
+        free(ctx.slots);
+        free(ctx.jobs);
+        free(ctx.info);
+        return result->error = err;
+    }
+
+    pthread_mutex_init(&ctx.lock, NULL);
+    pthread_cond_init(&ctx.job_cond, NULL);
+    pthread_cond_init(&ctx.done_cond, NULL);
+
+    pthread_t tids[ZIPW_MAX_THREADS];
+    size_t started = 0;
+    for (; started < threads; started++)
+    {
+        if (pthread_create(&tids[started], NULL, zipw_worker, &ctx) != 0) break;
+    }
+    if (started == 0 && ctx.job_count > 0) err = EAGAIN;
+
+    zipw_bytes cdir;
+    memset(&cdir, 0, sizeof(cdir));
+    uint64_t done = 0;
+
+    for (size_t j = 0; !err && j < ctx.job_count; j++)
+    {
+        zipw_slot* slot = &ctx.slots[j % ctx.window];
+        const zipw_job* job = &ctx.jobs[j];
+        zipw_info* fi = &ctx.info[job->entry];
+
+        pthread_mutex_lock(&ctx.lock);
+        while (!slot->ready) pthread_cond_wait(&ctx.done_cond, &ctx.lock);
+        pthread_mutex_unlock(&ctx.lock);
+
+        err = slot->error;
+        if (!err && job->first) err = zipw_write_local_header(&out, &entries[job->entry], fi);
+        if (!err) err = zipw_out_write(&out, slot->data, slot->size);
+        if (!err)
+        {
+            fi->crc = job->first ? slot->crc : zipw_crc32_combine(fi->crc, slot->crc, job->length);
+            fi->comp_size += slot->size;
+            if (job->last) err = zipw_finish_entry(&out, &cdir, &entries[job->entry], fi);
+        }
+        if (!err && opts && opts->progress)
+        {
+            done += job->length;
+            if (opts->progress(opts->progress_ctx, entries[job->entry].archive_name, done, result->bytes_in)) err = ECANCELED;
+        }
+        if (err) result->failed_index = job->entry;
+
+        pthread_mutex_lock(&ctx.lock);
+        slot->ready = 0;
+        ctx.written++;
+        if (err) ctx.abort = 1;
+        pthread_cond_broadcast(&ctx.job_cond);
+        pthread_mutex_unlock(&ctx.lock);
+    }
+
+    if (!err) err = zipw_write_end(&out, &cdir, count);
+    result->bytes_out = zipw_out_pos(&out);
+
+    pthread_mutex_lock(&ctx.lock);
+    ctx.abort = 1;
+    pthread_cond_broadcast(&ctx.job_cond);
+    pthread_mutex_unlock(&ctx.lock);
+    for (size_t t = 0; t < started; t++) pthread_join(tids[t], NULL);
+
+    if (close(out.fd) != 0 && !err) err = errno;
+    if (err) unlink(archive_path);
+
+    for (size_t s = 0; s < ctx.window; s++) free(ctx.slots[s].data);
+    pthread_cond_destroy(&ctx.done_cond);
+    pthread_cond_destroy(&ctx.job_cond);
+    pthread_mutex_destroy(&ctx.lock);
+    free(cdir.data);
+    free(out.buf);
+    free(ctx.slots);
+    free(ctx.jobs);
+    free(ctx.info);
+    return result->error = err;
+}